@@ -2,17 +2,52 @@
 //Encoder code is loaded onto PRU1 and IRIG code onto PRU0
 //
 // Usage:
-// $ ./loader Encoder1.bin Encoder2.bin IRIG1.bin IRIG2.bin
+// $ ./Beaglebone_Encoder_DAQ [-m spin|poll|irq] [-b single|mmsg|coalesce] [-l latency_us] [-v 1|2] [-s stats_ms] [-t seconds] [-r replay_MB] [-p phase_us] [-P ip:port] [-R priority] [-a cpu] [-d ip:port] [-n packet_edges] [-c pin[/quad_pin][,...]] [-q] Encoder1.bin Encoder2.bin IRIG1.bin IRIG2.bin
+// $ ./Beaglebone_Encoder_DAQ [-m spin|poll|irq] [-b single|mmsg|coalesce] [-l latency_us] [-v 1|2] [-s stats_ms] [-t seconds] [-r replay_MB] [-p phase_us] [-P ip:port] [-R priority] [-a cpu] [-d ip:port] [-n packet_edges] [-c pin[/quad_pin][,...]] [-q] -S /pb2_chwp_pru_shm
+//
+// -m selects how the ARM notices finished packets (default irq, see forwarder.h)
+// -b selects how packets are batched into UDP syscalls (default mmsg, see udp_batch.h)
+// -l is how long a packet may wait for others to share its syscall (default 0, flush on every wakeup)
+// -v selects the encoder packet format, 1 (0x1EAF, default) or the delta encoded 2 (0x2EAF, see packet_v2.h)
+// -s is the time between stats packets (0x57A7) with the PRU and ARM telemetry, in ms (default 1000, 0 for none)
+// -t tells the PRUs to stop after that many seconds (default 0, sample until SIGINT or SIGTERM)
+// -r keeps that many MB of sent packets to answer NACKs from the receiver with (default 0, off, see replay_buffer.h),
+//    16 MB is about 10 minutes of v1 packets at 2 Hz. The receiver has to understand replay packets (0x5E90).
+// -p sends the phase and frequency of the HWP (0x9A5E, see phase_tracker.h) every phase_us, for closed-loop
+//    control of the rotation motor (default 0, off)
+// -P sends them to ip:port instead of the host computer, which skips them
+// -R runs the forwarder in real-time mode (see rt.h): memory locked and faulted in, SCHED_FIFO at that priority
+// -a pins the forwarder to that CPU
+// -d sends the packets to ip:port (default 192.168.2.54:8080)
+// -n is the number of edges in an encoder packet, 1 to 150 (default 150). Smaller packets reach the host sooner
+//    and cost more datagrams, anything but 150 goes out as v2 packets.
+// -c reads an encoder channel on each of the comma separated P8 pins of PRU1, each with its second quadrature pin
+//    after a slash (default P8_28/P8_27). Up to 4 channels, each goes out with its channel in the v2 flags.
+// -q times and decodes every transition of both quadrature pins of each channel (see encoder_kernel.h)
+// -S forwards packets from a simulated shared memory segment (see pru_sim.c) instead of the PRUs, -n, -c and -q
+//    are then those pru_sim was started with
+//
+// The ARM writes -n, -c and -q into the config block in shared memory (pru_layout.h) before it starts the PRUs,
+// so one build of Encoder_Detection.c runs any of them. The forwarder sends them in a layout packet (0x1A70) when
+// it starts and ahead of every stats packet.
+//
+// The PRUs sample continuously until told to stop through the control word in shared memory (PRU_CONTROL_OFFSET),
+// so one load of the PRUs covers a run of any length. On SIGINT or SIGTERM the forwarder writes the control word,
+// waits for the PRUs to finish their packets and sends everything left in the rings before exiting. It then
+// prints its latency histograms, from a packet being ready to the forwarder finding it and to it being sent.
 //
 // Compile with:
-// gcc -o loader loader.c -lprussdrv
+// make host (or make sim for a build without prussdrv)
 
 
 #include <unistd.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#ifndef HOST_SIM
 #include <prussdrv.h> //PRU Subsystem Driver (installed from this package: https://github.com/beagleboard/am335x_pru_package)
 #include <pruss_intc_mapping.h> //PRU Subsystem Interupt Controller Mapping (installed from this package: https://github.com/beagleboard/am335x_pru_package)
+#endif
 #include <string.h>
 //The rest of these libraries are for UDP service
 #include <sys/types.h> 
@@ -20,187 +55,316 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
-//arbitrary port used for UDP
-#define PORT 8080
+#include "forwarder.h"
+#include "pinmux.h"
+#include "pru_layout.h"
+#include "pru_shm.h"
+#include "rt.h"
 
+//arbitrary port used for UDP, the default destination
+#define PORT 8080
+#define HOST_IP "192.168.2.54"
+#define RETRANSMIT_RATE 1000000 //bytes/s retransmissions may add, about 35 times the v1 stream at 2 Hz
+#define REPLAY_LINGER_S 2.0 //time left to the receiver to ask for the last packets of a run
 
+#ifndef HOST_SIM
 //Below variables are defined in pruss_intc_mapping and prussdrv, they are mapping interrupts from PRUs to ARM processor
+//Packet interrupts from both PRUs share PRU_EVTOUT0 so the forwarder can block on a single event,
+//system event 24 (end of run) goes to PRU_EVTOUT1
 #define PRUSS_INTC_CUSTOM {   \
   { PRU0_PRU1_INTERRUPT, PRU1_PRU0_INTERRUPT, PRU0_ARM_INTERRUPT, PRU1_ARM_INTERRUPT, ARM_PRU0_INTERRUPT, ARM_PRU1_INTERRUPT,  24, (char)-1  },  \
-  { {PRU0_PRU1_INTERRUPT,CHANNEL1}, {PRU1_PRU0_INTERRUPT, CHANNEL0}, {PRU0_ARM_INTERRUPT,CHANNEL2}, {PRU1_ARM_INTERRUPT, CHANNEL3}, {ARM_PRU0_INTERRUPT, CHANNEL0}, {ARM_PRU1_INTERRUPT, CHANNEL1}, {24, CHANNEL3}, {-1,-1}},  \
+  { {PRU0_PRU1_INTERRUPT,CHANNEL1}, {PRU1_PRU0_INTERRUPT, CHANNEL0}, {PRU0_ARM_INTERRUPT,CHANNEL2}, {PRU1_ARM_INTERRUPT, CHANNEL2}, {ARM_PRU0_INTERRUPT, CHANNEL0}, {ARM_PRU1_INTERRUPT, CHANNEL1}, {24, CHANNEL3}, {-1,-1}},  \
   {  {CHANNEL0,PRU0}, {CHANNEL1, PRU1}, {CHANNEL2, PRU_EVTOUT0}, {CHANNEL3, PRU_EVTOUT1}, {-1,-1} },  \
   (PRU0_HOSTEN_MASK | PRU1_HOSTEN_MASK | PRU_EVTOUT0_HOSTEN_MASK | PRU_EVTOUT1_HOSTEN_MASK) /*Enable PRU0, PRU1, PRU_EVTOUT0 */ \
 }
 
-//Definining the offsets from the start of shared memory for the structures and variables used by PRUs
-#define ENCODER_COUNTER_SIZE 150
-#define COUNTER_OFFSET 6
-#define ON_OFFSET 2
-#define IRIG_OFFSET 1558
-#define IRIG_IDENTIFIER_OFFSET 1556
-#define ERROR_IDENTIFIER_OFFSET 3072
-#define ERROR_OFFSET 3074
-
-//function to return pointer to shared memory, needs to be typecasted everytime you want to use a datatype that is not only a 32 bit integer
-volatile int32_t* init_prumem()
+#endif
+
+static volatile int stop_requested = 0;
+
+static void on_signal(int sig)
+{
+  (void) sig;
+  stop_requested = 1;
+}
+
+//loads the .bin files into their respective PRUs and starts them
+static int start_prus(char **files)
+{
+#ifdef HOST_SIM
+  (void) files;
+  fprintf(stderr, "built with HOST_SIM, use -S to forward from a simulated segment\n");
+  return -1;
+#else
+  printf("Executing program on PRU1 and waiting for termination\n");
+  if (prussdrv_load_datafile(1, files[1]) < 0) {
+    fprintf(stderr, "Error loading %s\n", files[1]);
+    return -1;
+  }
+  if (prussdrv_exec_program(1, files[0]) < 0) {
+    fprintf(stderr, "Error loading %s\n", files[0]);
+    return -1;
+  }
+
+  printf("Executing program on PRU0 and waiting for termination\n");
+  if (prussdrv_load_datafile(0, files[3]) < 0) {
+    fprintf(stderr, "Error loading %s\n", files[3]);
+    return -1;
+  }
+  if (prussdrv_exec_program(0, files[2]) < 0) {
+    fprintf(stderr, "Error loading %s\n", files[2]);
+    return -1;
+  }
+  return 0;
+#endif
+}
+
+//Parses ip:port, returns -1 if it is not that
+static int parse_address(const char* arg, char* ip, size_t size, int* port)
 {
-	volatile int32_t* p;
-	prussdrv_map_prumem(PRUSS0_SHARED_DATARAM, (void**)&p);
-	return p;
+  const char* colon = strrchr(arg, ':');
+  if (colon == NULL || colon - arg >= (int) size) {
+    return -1;
+  }
+  snprintf(ip, size, "%.*s", (int) (colon - arg), arg);
+  *port = atoi(colon + 1);
+  return 0;
 }
 
-//Structure containing clock information of encoder and absolute count
-struct CounterInfo{
-    unsigned long int clock_cnt[ENCODER_COUNTER_SIZE];
-    unsigned long int counter_ovflow[ENCODER_COUNTER_SIZE];
-    unsigned long int encoder_cnt[ENCODER_COUNTER_SIZE];
-};
-
-//Structure containing values of quadrature pins
-struct QuadEncoder{
-    unsigned long int encoder_value_2;
-    unsigned long int encoder_value_3;
-    unsigned long int encoder_value_4;
-};
-
-//Complete encoder structure comining two above structures and adding a header
-struct CompleteDataPackets{
-    unsigned long int counter_info_header;
-    volatile struct CounterInfo Counter_Packets;
-    volatile struct QuadEncoder Quad;
-};
-
-//Complete structure for IRIG information
-struct IrigInfo{
-    unsigned long int random_header;
-    unsigned long int rising_edge_time;
-    unsigned long int init_overflow;
-    unsigned long int info[10];
-    unsigned long int re_count[10];
-    unsigned long int re_count_overflow[10];
-};
-
-//Structure for error packets, only sent when IRIG isn't synched
-struct ErrorInfo{
-    unsigned int header;
-    unsigned int err_code;
-};
+//Parses the channels of -c, P8_28/P8_27,P8_39 into the pin masks of config, returns -1 for an unknown pin or too
+//many channels
+static int parse_channels(char* arg, struct pru_config* config)
+{
+  char* save = NULL;
+  uint32_t n = 0;
+
+  for (char* channel = strtok_r(arg, ",", &save); channel != NULL; channel = strtok_r(NULL, ",", &save)) {
+    char* quad = strchr(channel, '/');
+    if (n == PRU_MAX_CHANNELS) {
+      return -1;
+    }
+    if (quad != NULL) {
+      *quad++ = '\0';
+    }
+    int pin = pinmux_pru1_bit(channel), quad_pin = quad != NULL ? pinmux_pru1_bit(quad) : -1;
+    if (pin < 0 || (quad != NULL && quad_pin < 0)) {
+      return -1;
+    }
+    config->pin_mask[n] = 1u << pin;
+    config->quad_mask[n] = quad != NULL ? 1u << quad_pin : 0;
+    n += 1;
+  }
+  config->n_channels = n;
+  return n > 0 ? 0 : -1;
+}
 
 int main(int argc, char **argv) {
-  
-  system("./pinconfig"); //runs a bash file to configure the pins needed
-  
+  int mode = FWD_MODE_IRQ;
+  int batch_mode = UDP_BATCH_MMSG;
+  long latency_us = 0;
+  int wire_version = 1;
+  long stats_ms = 1000;
+  double run_s = 0;
+  double replay_mb = 0;
+  long phase_us = 0;
+  char dest_ip[64] = HOST_IP;
+  int dest_port = PORT;
+  char phase_ip[64] = "";
+  int phase_port = 0;
+  struct pru_config config;
+  struct rt_config rt = { .cpu = -1 };
+  const char* sim_name = NULL;
+  int opt;
+
+  pru_config_default(&config);
+  while ((opt = getopt(argc, argv, "m:b:l:v:s:t:r:p:P:R:a:d:n:c:qS:")) != -1) {
+    switch (opt) {
+    case 'm':
+      mode = forwarder_parse_mode(optarg);
+      break;
+    case 'b':
+      batch_mode = udp_batch_parse_mode(optarg);
+      break;
+    case 'l':
+      latency_us = atol(optarg);
+      break;
+    case 'v':
+      wire_version = atoi(optarg);
+      break;
+    case 's':
+      stats_ms = atol(optarg);
+      break;
+    case 't':
+      run_s = atof(optarg);
+      break;
+    case 'r':
+      replay_mb = atof(optarg);
+      break;
+    case 'p':
+      phase_us = atol(optarg);
+      break;
+    case 'P':
+      if (parse_address(optarg, phase_ip, sizeof(phase_ip), &phase_port) < 0) {
+        mode = -1;
+      }
+      break;
+    case 'R':
+      rt.priority = atoi(optarg);
+      rt.lock_memory = 1;
+      if (rt.priority < 1 || rt.priority > 99) {
+        mode = -1;
+      }
+      break;
+    case 'a':
+      rt.cpu = atoi(optarg);
+      if (rt.cpu < 0) {
+        mode = -1;
+      }
+      break;
+    case 'd':
+      if (parse_address(optarg, dest_ip, sizeof(dest_ip), &dest_port) < 0) {
+        mode = -1;
+      }
+      break;
+    case 'n':
+      config.packet_edges = atoi(optarg);
+      break;
+    case 'c':
+      if (parse_channels(optarg, &config) < 0) {
+        mode = -1;
+      }
+      break;
+    case 'q':
+      config.quadrature = 1;
+      break;
+    case 'S':
+      sim_name = optarg;
+      break;
+    default:
+      mode = -1;
+    }
+  }
+  //phase packets go to the host computer unless -P says otherwise
+  if (phase_ip[0] == '\0') {
+    snprintf(phase_ip, sizeof(phase_ip), "%s", dest_ip);
+    phase_port = dest_port;
+  }
+
   //checks that the file is executed with correct arguments passed
-  if (argc !=5) {
-    printf("Usage: %s loader Encoder1.bin Encoder2.bin IRIG1.bin IRIG2.bin\n", argv[0]);
+  if (mode < 0 || batch_mode < 0 || !pru_config_valid(&config) || wire_version < 1 || wire_version > 2 || stats_ms < 0 || run_s < 0 || replay_mb < 0 || phase_us < 0 || (sim_name == NULL && argc - optind != 4)) {
+    printf("Usage: %s [-m spin|poll|irq] [-b single|mmsg|coalesce] [-l latency_us] [-v 1|2] [-s stats_ms] [-t seconds] [-r replay_MB] [-p phase_us] [-P ip:port] [-R priority] [-a cpu] [-d ip:port] [-n packet_edges] [-c pin[/quad_pin][,...]] [-q] Encoder1.bin Encoder2.bin IRIG1.bin IRIG2.bin\n", argv[0]);
+    printf("       %s [-m spin|poll|irq] [-b single|mmsg|coalesce] [-l latency_us] [-v 1|2] [-s stats_ms] [-t seconds] [-r replay_MB] [-p phase_us] [-P ip:port] [-R priority] [-a cpu] [-d ip:port] [-n packet_edges] [-c pin[/quad_pin][,...]] [-q] -S /sim_shm_name\n", argv[0]);
     return 1;
   }
 
-  prussdrv_init(); //initializes the PRU subsystem driver
+  struct pru_shm shm;
+  if (sim_name == NULL) {
+#ifndef HOST_SIM
+    //routes the encoder and IRIG pins to the PRUs, as the pinconfig script does, with the channels of -c
+    uint32_t pins = 0;
+    for (uint32_t c = 0; c < config.n_channels; c++) {
+      pins |= config.pin_mask[c] | config.quad_mask[c];
+    }
+    //each pin that could not be set has been printed, the PRUs would read it floating
+    if (pinmux_configure_prus(pins) != 0) {
+      printf("Pins not routed to the PRUs, not starting\n");
+      return 1;
+    }
 
-  //allows the use of interrupt: PRU_EVTOUT_1; currently only used to notify the ARM that the PRUs have finished executing their code
-  if (prussdrv_open(PRU_EVTOUT_1) == -1) {
-    printf("prussdrv_open() failed\n");
-    return 1;
-  }
+    prussdrv_init(); //initializes the PRU subsystem driver
 
-  //functions to map and initialize the interrupts defined above
-  tpruss_intc_initdata pruss_intc_initdata = PRUSS_INTC_CUSTOM;
-  prussdrv_pruintc_init(&pruss_intc_initdata);
+    //PRU_EVTOUT_0 carries the packet interrupts and PRU_EVTOUT_1 notifies the ARM that the PRUs have finished executing their code
+    if (prussdrv_open(PRU_EVTOUT_0) == -1 || prussdrv_open(PRU_EVTOUT_1) == -1) {
+      printf("prussdrv_open() failed\n");
+      return 1;
+    }
 
-  
-  
-  //Creating pointers to all shared variables and data structures in shared memory
-  volatile unsigned long int* packet_address = (volatile unsigned long int *) init_prumem(); //pointer to variable to identify which encoder packet is ready to be written to UDP
-  volatile unsigned long int* on = (volatile unsigned long int *) (init_prumem()+ON_OFFSET); //pointer to variable to let the ARM know that the PRUs are still executing code
-  volatile unsigned long int* irig_identifier = (volatile unsigned long int *) (init_prumem() + IRIG_IDENTIFIER_OFFSET); //pointer to varialbe to identify which IRIG packet is ready to be written to UDP
-  volatile unsigned long int* error_identifier = (volatile unsigned long int *) (init_prumem() + ERROR_IDENTIFIER_OFFSET);//pointer to variable to identify that an error packet is ready to be writtento UDP
-  volatile struct IrigInfo* irig_packets = (volatile struct IrigInfo *) (init_prumem() + IRIG_OFFSET); //pointer to data structure for IRIG packets
-  volatile struct ErrorInfo* error_state = (volatile struct ErrorInfo *) (init_prumem() + ERROR_OFFSET); //pointer to data structure for error packets
-  volatile struct CompleteDataPackets* Data_Packets = (volatile struct CompleteDataPackets *) (init_prumem()+COUNTER_OFFSET); //pointer to data structure for encoder/counter packets
+    //functions to map and initialize the interrupts defined above
+    tpruss_intc_initdata pruss_intc_initdata = PRUSS_INTC_CUSTOM;
+    prussdrv_pruintc_init(&pruss_intc_initdata);
+#endif
+  }
 
-  //resets identifier variables to 0 meaning nothing is ready to be sent
-  *packet_address = 0;
-  *irig_identifier = 0;
+  if (pru_shm_open(&shm, sim_name, 0) < 0) {
+    fprintf(stderr, "Could not map PRU shared memory\n");
+    return 1;
+  }
+  if (sim_name == NULL) {
+    //sets shared memory to 0 so every ring starts out empty and the control word says run, the PRUs fill in their
+    //own headers. The config block goes in before the forwarder lays out its rings by it and the PRUs start.
+    memset((void *) shm.base, 0, PRU_SHM_SIZE);
+    pru_config_write(shm.base, &config);
+  }
 
   //following bit of code creates socket to write UDP packets with
   int sockfd;
 
-  struct sockaddr_in servaddr;
-	
   if ( (sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-	perror("socket creation failed");
-	exit(EXIT_FAILURE);
+    perror("socket creation failed");
+    exit(EXIT_FAILURE);
   }
 
-  memset(&servaddr, 0, sizeof(servaddr));
-
-  servaddr.sin_family = AF_INET;
-  servaddr.sin_port = htons(PORT);
-  inet_pton(AF_INET, "192.168.2.54", &(servaddr.sin_addr.s_addr));
-
-  //sets memory to be used by data structures to 0
-  
-  memset((struct IrigInfo *) &irig_packets[0], 0, sizeof(*irig_packets));
-  memset((struct IrigInfo *) &irig_packets[1], 0, sizeof(*irig_packets));
-  memset((struct CompleteDataPackets *) &Data_Packets[0], 0, sizeof(*irig_packets));
-  memset((struct CompleteDataPackets *) &Data_Packets[1], 0, sizeof(*irig_packets));
-
-  //following bit of code loads .bin files into their respective PRUs and executes
-  printf("Executing program on PRU1 and waiting for termination\n");
-  if (argc > 2) {
-    if (prussdrv_load_datafile(1, argv[2]) < 0) {
-      fprintf(stderr, "Error loading %s\n", argv[2]);
-      exit(-1);
-    }
+  struct forwarder fwd;
+  forwarder_init(&fwd, &shm, mode, sockfd, dest_ip, dest_port);
+  printf("%u encoder channels, %u edges per packet in %s mode, %u ring slots each\n", fwd.layout.n_channels,
+         fwd.layout.packet_edges, fwd.config.quadrature ? "quadrature" : "edge", fwd.layout.slots);
+  forwarder_set_batching(&fwd, batch_mode, latency_us);
+  fwd.wire_version = wire_version;
+  fwd.stats_period_us = stats_ms * 1000;
+  fwd.run_s = run_s;
+  fwd.stop_requested = &stop_requested;
+  if (replay_mb > 0 && forwarder_enable_replay(&fwd, (size_t) (replay_mb * 1e6), RETRANSMIT_RATE, REPLAY_LINGER_S) < 0) {
+    perror("replay buffer");
+    exit(EXIT_FAILURE);
+  }
+  if (phase_us > 0) {
+    forwarder_enable_phase(&fwd, phase_ip, phase_port, phase_us);
+  }
+  //after every buffer has been allocated, so that all of them are locked and faulted in
+  if (rt_setup(&rt) < 0) {
+    exit(EXIT_FAILURE);
   }
-  if (prussdrv_exec_program(1, argv[1]) < 0) {
-    fprintf(stderr, "Error loading %s\n", argv[1]);
-    exit(-1);
+  if (rt.lock_memory) {
+    rt_prefault(shm.base, PRU_SHM_SIZE, 0);
+    rt_prefault(fwd.replay.data, fwd.replay.size, 1);
   }
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
 
-  printf("Executing program on PRU0 and waiting for termination\n");
-  if (argc == 5) {
-    if (prussdrv_load_datafile(0, argv[4]) < 0) {
-      fprintf(stderr, "Error loading %s\n", argv[4]);
+  if (sim_name == NULL) {
+    if (start_prus(argv + optind) < 0) {
       exit(-1);
     }
   }
-  if (prussdrv_exec_program(0, argv[3]) < 0) {
-    fprintf(stderr, "Error loading %s\n", argv[3]);
-    exit(-1);
-  }
-
-  //continuously loops while PRUs are still executing code and checks if data structures are ready to be written to UDP
-  while(*on != 1) {
-  	if(*packet_address != 0) {
-        	unsigned long int offset = *packet_address - 1;
-		sendto(sockfd, (struct CompleteDataPackets *) &Data_Packets[offset], sizeof(*Data_Packets), MSG_CONFIRM, (const struct sockaddr *) &servaddr, sizeof(servaddr));
-        	*packet_address = 0;
-  	}
-	if(*irig_identifier != 0) {
-		unsigned long int y = *irig_identifier - 1;
-		sendto(sockfd, (struct IrigInfo *) &irig_packets[y], sizeof(*irig_packets), MSG_CONFIRM, (const struct sockaddr *) &servaddr, sizeof(servaddr));
-		*irig_identifier = 0;
-	}
-	//error packets currently not used, should be able to in the future
-	/*if(*error_identifier != 0) {
-		unsigned long int z = *error_identifier - 1;
-		sendto(sockfd, (struct ErrorInfo *) &error_state[z], sizeof(*error_state), MSG_CONFIRM, (const struct sockaddr *) &servaddr, sizeof(servaddr));
-		*error_identifier = 0;
-	}*/
-  }
-    
-  
+
+  forwarder_run(&fwd);
+  printf("Sent %lu encoder and %lu IRIG packets in %lu wakeups\n", fwd.encoder_sent, fwd.irig_sent, fwd.wakeups);
+  printf("Lost %lu encoder and %lu IRIG packets to ring overruns\n", forwarder_encoder_lost(&fwd), fwd.irig_ring.lost);
+  printf("Sent %lu datagrams in %lu syscalls, %lu send errors\n", fwd.batch.datagrams, fwd.batch.syscalls, fwd.batch.send_errors);
+  printf("Sent %lu error and %u stats packets, took up to %u us to notice an encoder packet and %u us to send one\n",
+         fwd.error_sent, fwd.stats_seq, fwd.notice_max_us, fwd.send_max_us);
+  if (fwd.phase_period_us > 0) {
+    printf("Sent %u phase packets, %lu edges tracked, %u gaps\n", fwd.phase_sent, fwd.phase.edges, fwd.phase.gaps);
+  }
+  if (fwd.replay.data != NULL) {
+    printf("Replay: %lu NACKs, %lu packets sent again, %lu asked for after leaving the ring, %lu ranges dropped\n",
+           fwd.nacks, fwd.retransmitted, fwd.expired, fwd.nack_overflows);
+  }
+  forwarder_print_latency(&fwd, stdout);
+  forwarder_free(&fwd);
+
   //disables PRUs when they are done executing code
-  if(*on == 1) {
-  	prussdrv_pru_wait_event(PRU_EVTOUT_1);
-        printf("All done\n");
-        prussdrv_pru_disable(1);
-	prussdrv_pru_disable(0);
-        prussdrv_exit();
-  }
-   
- 
+  if (sim_name == NULL) {
+#ifndef HOST_SIM
+    prussdrv_pru_wait_event(PRU_EVTOUT_1);
+    printf("All done\n");
+    prussdrv_pru_disable(1);
+    prussdrv_pru_disable(0);
+    prussdrv_exit();
+#endif
+  } else {
+    pru_shm_close(&shm, 0);
+  }
+
   return 0;
 }
@@ -0,0 +1,140 @@
+//Benchmark of the forwarding loop against the simulated PRUs
+//For every forwarding mode it reports the CPU used by the forwarding thread and the latency
+//between a packet being published in its ring and the packet being handed to sendto()
+//
+// Usage:
+// $ ./bench_forwarder [-r edges_per_second] [-t seconds_per_mode]
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "forwarder.h"
+#include "pru_sim.h"
+
+#define MAX_SAMPLES 200000
+
+struct bench {
+    struct pru_shm shm;
+    struct forwarder fwd;
+    struct pru_sim_config sim;
+    struct pru_sim_stats sim_stats;
+    volatile uint64_t published_ns[2][256]; //[type][seq % 256] time the packet was published
+    uint64_t* latency_ns;
+    unsigned long int n_latency;
+    double cpu_s;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void on_publish(void* ctx, int type, uint32_t seq)
+{
+    struct bench* b = ctx;
+    b->published_ns[type][seq % 256] = now_ns();
+}
+
+static void on_send(void* ctx, int type, uint32_t seq, const volatile void* packet)
+{
+    struct bench* b = ctx;
+    (void) packet;
+    if (b->n_latency < MAX_SAMPLES) {
+        b->latency_ns[b->n_latency++] = now_ns() - b->published_ns[type][seq % 256];
+    }
+}
+
+static void* producer(void* arg)
+{
+    struct bench* b = arg;
+    pru_sim_run(&b->shm, &b->sim, &b->sim_stats);
+    return NULL;
+}
+
+static void* consumer(void* arg)
+{
+    struct bench* b = arg;
+    struct timespec ts;
+    forwarder_run(&b->fwd);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    b->cpu_s = ts.tv_sec + ts.tv_nsec * 1e-9;
+    return NULL;
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    const char* names[] = { "spin", "poll", "irq" };
+    double rate = 2280 * 10, duration = 5;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:t:")) != -1) {
+        switch (opt) {
+        case 'r': rate = atof(optarg); break;
+        case 't': duration = atof(optarg); break;
+        default:
+            printf("Usage: %s [-r edges_per_second] [-t seconds_per_mode]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    //packets go to a bound but unread loopback socket, the kernel drops them once its buffer is full
+    int sink = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    bind(sink, (struct sockaddr *) &addr, sizeof(addr));
+    getsockname(sink, (struct sockaddr *) &addr, &len);
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    printf("%-6s %10s %10s %10s %10s %10s %10s\n", "mode", "cpu_%", "wakeups", "p50_us", "p99_us", "max_us", "lost");
+    for (int mode = FWD_MODE_SPIN; mode <= FWD_MODE_IRQ; mode++) {
+        struct bench b;
+        pthread_t tp, tc;
+
+        memset(&b, 0, sizeof(b));
+        b.latency_ns = malloc(MAX_SAMPLES * sizeof(uint64_t));
+        if (pru_shm_open(&b.shm, "/pb2_chwp_bench_fwd", 1) < 0) {
+            return 1;
+        }
+        pru_sim_reset(&b.shm);
+        b.sim.edge_rate = rate;
+        b.sim.duration = duration;
+        b.sim.on_publish = on_publish;
+        b.sim.on_publish_ctx = &b;
+        forwarder_init(&b.fwd, &b.shm, mode, sockfd, "127.0.0.1", ntohs(addr.sin_port));
+        b.fwd.on_send = on_send;
+        b.fwd.on_send_ctx = &b;
+
+        pthread_create(&tc, NULL, consumer, &b);
+        pthread_create(&tp, NULL, producer, &b);
+        pthread_join(tp, NULL);
+        pthread_join(tc, NULL);
+
+        qsort(b.latency_ns, b.n_latency, sizeof(uint64_t), cmp_u64);
+        unsigned long int published = b.sim_stats.encoder_published + b.sim_stats.irig_published;
+        printf("%-6s %10.2f %10lu %10.1f %10.1f %10.1f %10lu\n", names[mode],
+               100.0 * b.cpu_s / duration, b.fwd.wakeups,
+               b.n_latency ? b.latency_ns[b.n_latency / 2] / 1e3 : 0.0,
+               b.n_latency ? b.latency_ns[b.n_latency * 99 / 100] / 1e3 : 0.0,
+               b.n_latency ? b.latency_ns[b.n_latency - 1] / 1e3 : 0.0,
+               published - b.fwd.encoder_sent - b.fwd.irig_sent);
+
+        pru_shm_close(&b.shm, 1);
+        free(b.latency_ns);
+    }
+    close(sockfd);
+    close(sink);
+    return 0;
+}
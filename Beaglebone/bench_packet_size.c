@@ -0,0 +1,320 @@
+//Benchmark of the encoder packet size against latency and throughput, through the simulated PRUs and the forwarder
+//For every packet size and number of channels it writes the config block as Beaglebone_Encoder_DAQ does, runs the
+//simulated PRUs against the forwarder in irq mode and receives everything on a loopback socket. Each encoder
+//packet is decoded and checked: its channel, its size, and counts that carry on from the packet before on the same
+//channel. It reports the ring depth the layout gives, packets, datagrams and bytes per second, the CPU used by the
+//forwarding thread, and the latency from the newest and from the oldest edge of a packet to its arrival. The
+//oldest edge waits for the whole packet to fill, which is what a smaller packet buys back.
+//
+//The rings share the same shared RAM whatever the packet size, so small packets get few milliseconds of buffering
+//(buf_ms). The forwarder runs under SCHED_FIFO as Beaglebone_Encoder_DAQ -R would (rt.h), so the listener and
+//the rest of the machine do not hold it up. A ring holding less than MIN_BUFFER_MS can still overrun on a busy or
+//single CPU machine, as can any ring if the forwarder could not be made real-time, so the packets lost there are
+//reported but do not fail the run. Every packet has to be accounted for either way: received, or lost to a ring
+//overrun the forwarder saw.
+//
+// Usage:
+// $ ./bench_packet_size [-r edges_per_second] [-t seconds_per_case] [-c max_channels] [-v 1|2] [-R priority]
+// -R 0 runs the forwarder as a normal thread
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "forwarder.h"
+#include "packet_v2.h"
+#include "pru_sim.h"
+#include "rt.h"
+
+#define MAX_SAMPLES 400000
+#define MIN_BUFFER_MS 10 //rings that hold less may lose packets to scheduling without failing the run
+
+static const uint32_t sizes[] = { 1, 5, 10, 25, 50, 100, 150 };
+
+struct bench {
+    struct pru_shm shm;
+    struct forwarder fwd;
+    struct pru_sim_config sim;
+    struct pru_sim_stats sim_stats;
+    uint32_t packet_edges;
+    uint32_t n_channels;
+    int fd; //where the forwarder's packets arrive
+    struct rt_config rt;
+    int rt_failed;
+    volatile int done;
+    double cpu_s;
+    uint64_t* newest_ns; //arrival - newest edge of every encoder packet
+    uint64_t* oldest_ns; //arrival - oldest edge
+    unsigned long int n_latency;
+    unsigned long int received; //encoder packets
+    unsigned long int datagrams;
+    unsigned long int bytes;
+    unsigned long int layouts; //layout packets that matched the config
+    unsigned long int bad; //packets of the wrong size or channel, or layout packets that do not match the config
+    unsigned long int gaps; //packets missing from the counts of a channel
+    uint32_t next_count[PRU_MAX_CHANNELS]; //count expected at the first edge of the next packet of each channel
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void* producer(void* arg)
+{
+    struct bench* b = arg;
+    pru_sim_run(&b->shm, &b->sim, &b->sim_stats);
+    return NULL;
+}
+
+static void* consumer(void* arg)
+{
+    struct bench* b = arg;
+    struct timespec ts;
+
+    if (b->rt.priority > 0 && rt_setup(&b->rt) < 0) {
+        b->rt_failed = 1;
+    }
+    forwarder_run(&b->fwd);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    b->cpu_s = ts.tv_sec + ts.tv_nsec * 1e-9;
+    b->done = 1;
+    return NULL;
+}
+
+//Checks an encoder packet of a channel and times its edges, the simulated IEP counter is CLOCK_MONOTONIC at 200 MHz
+static void check_encoder(struct bench* b, uint32_t channel, int n, const uint32_t* clock_cnt, const uint32_t* counter_ovflow,
+                          const uint32_t* encoder_cnt, uint64_t arrived)
+{
+    if (channel >= b->n_channels || n != (int) b->packet_edges) {
+        b->bad += 1;
+        return;
+    }
+    for (int x = 1; x < n; x++) {
+        b->bad += encoder_cnt[x] != encoder_cnt[0] + x;
+    }
+    if (encoder_cnt[0] != b->next_count[channel]) {
+        b->gaps += (encoder_cnt[0] - b->next_count[channel]) / b->packet_edges;
+    }
+    b->next_count[channel] = encoder_cnt[n - 1] + 1;
+    b->received += 1;
+    if (b->n_latency < MAX_SAMPLES) {
+        double ns_per_count = 1e9 / PRU_SHM_IEP_HZ;
+        uint64_t newest = (uint64_t) (((uint64_t) counter_ovflow[n - 1] << 32 | clock_cnt[n - 1]) * ns_per_count);
+        uint64_t oldest = (uint64_t) (((uint64_t) counter_ovflow[0] << 32 | clock_cnt[0]) * ns_per_count);
+        b->newest_ns[b->n_latency] = arrived > newest ? arrived - newest : 0;
+        b->oldest_ns[b->n_latency] = arrived > oldest ? arrived - oldest : 0;
+        b->n_latency += 1;
+    }
+}
+
+//Splits a datagram with the framing rules in udp_batch.h and checks every packet in it
+static void on_datagram(struct bench* b, const uint8_t* data, size_t len, uint64_t arrived)
+{
+    static uint32_t clock_cnt[ENCODER_COUNTER_SIZE], counter_ovflow[ENCODER_COUNTER_SIZE], encoder_cnt[ENCODER_COUNTER_SIZE];
+    size_t pos = 0;
+
+    while (pos + 8 <= len) {
+        uint32_t header, size;
+        memcpy(&header, data + pos, 4);
+        if (header == ENCODER_HEADER) {
+            size = sizeof(struct CompleteDataPackets);
+        } else if (header == IRIG_HEADER) {
+            size = sizeof(struct IrigInfo);
+        } else if (header == ERROR_HEADER) {
+            size = sizeof(struct ErrorInfo);
+        } else {
+            memcpy(&size, data + pos + 4, 4);
+        }
+        if (size < 8 || pos + size > len) {
+            b->bad += 1;
+            return;
+        }
+        if (header == ENCODER_HEADER) {
+            struct CompleteDataPackets p;
+            memcpy(&p, data + pos, sizeof(p));
+            check_encoder(b, 0, ENCODER_COUNTER_SIZE, p.Counter_Packets.clock_cnt, p.Counter_Packets.counter_ovflow,
+                          p.Counter_Packets.encoder_cnt, arrived);
+        } else if (header == ENCODER_V2_HEADER) {
+            struct packet_v2_header hdr;
+            int n = packet_v2_decode(data + pos, size, &hdr, clock_cnt, counter_ovflow, encoder_cnt, ENCODER_COUNTER_SIZE);
+            if (n < 1) {
+                b->bad += 1;
+            } else {
+                check_encoder(b, PACKET_V2_CHANNEL(hdr.flags), n, clock_cnt, counter_ovflow, encoder_cnt, arrived);
+            }
+        } else if (header == LAYOUT_HEADER) {
+            struct LayoutPacket layout;
+            memcpy(&layout, data + pos, size < sizeof(layout) ? size : sizeof(layout));
+            if (size >= sizeof(layout) && layout.layout.packet_edges == b->packet_edges &&
+                layout.layout.n_channels == b->n_channels && layout.config.packet_edges == b->packet_edges) {
+                b->layouts += 1;
+            } else {
+                b->bad += 1;
+            }
+        }
+        pos += size;
+    }
+}
+
+//Stands in for the host computer
+static void* listener(void* arg)
+{
+    struct bench* b = arg;
+    static uint8_t buf[65536];
+
+    for (;;) {
+        ssize_t len = recv(b->fd, buf, sizeof(buf), 0);
+        if (len < 0) {
+            if (b->done) {
+                break; //timed out with everything sent
+            }
+            continue;
+        }
+        b->datagrams += 1;
+        b->bytes += len;
+        on_datagram(b, buf, len, now_ns());
+    }
+    return NULL;
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    double rate = 2280 * 10, duration = 2;
+    int max_channels = 2, wire_version = 2, priority = 50;
+    int realtime = 1; //every case got its real-time forwarder
+    int failed = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:t:c:v:R:")) != -1) {
+        switch (opt) {
+        case 'r': rate = atof(optarg); break;
+        case 't': duration = atof(optarg); break;
+        case 'c': max_channels = atoi(optarg); break;
+        case 'v': wire_version = atoi(optarg); break;
+        case 'R': priority = atoi(optarg); break;
+        default:
+            printf("Usage: %s [-r edges_per_second] [-t seconds_per_case] [-c max_channels] [-v 1|2] [-R priority]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (max_channels < 1 || max_channels > PRU_MAX_CHANNELS || wire_version < 1 || wire_version > 2 || priority < 0 ||
+        priority > 99) {
+        printf("Up to %d channels, wire version 1 or 2, priority 0 to 99\n", PRU_MAX_CHANNELS);
+        return 1;
+    }
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    printf("%.0f edges/s per channel, forwarder in irq mode with sendmmsg(), v%d packets, ", rate, wire_version);
+    printf(priority > 0 ? "SCHED_FIFO priority %d\n" : "normal thread\n", priority);
+    printf("%6s %3s %6s %7s %9s %9s %9s %7s %9s %9s %9s %9s %6s %6s %6s\n", "edges", "ch", "slots", "buf_ms", "pkts/s", "dgrams/s",
+           "kB/s", "cpu_%", "new_p50", "new_p99", "old_p50", "old_p99", "lost", "gaps", "bad");
+    for (int channels = 1; channels <= max_channels; channels++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            struct bench* b = calloc(1, sizeof(*b));
+            struct pru_config config;
+            pthread_t tp, tc, tl;
+
+            b->packet_edges = sizes[s];
+            b->rt.cpu = -1;
+            b->rt.priority = priority;
+            b->n_channels = channels;
+            for (int c = 0; c < channels; c++) {
+                b->next_count[c] = 1;
+            }
+            b->newest_ns = malloc(MAX_SAMPLES * sizeof(uint64_t));
+            b->oldest_ns = malloc(MAX_SAMPLES * sizeof(uint64_t));
+            pru_config_default(&config);
+            config.packet_edges = sizes[s];
+            config.n_channels = channels;
+            for (int c = 1; c < channels; c++) {
+                config.pin_mask[c] = 1u << (c - 1); //P8_45, P8_46 and P8_43
+                config.quad_mask[c] = 0;
+            }
+            if (!pru_config_valid(&config)) {
+                printf("%6u %3d does not fit\n", sizes[s], channels);
+                free(b->newest_ns);
+                free(b->oldest_ns);
+                free(b);
+                continue;
+            }
+
+            //the receiving end, with room for a whole case should it fall behind
+            struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+            struct timeval timeout = { .tv_sec = 0, .tv_usec = 100000 };
+            int rcvbuf = 8 << 20;
+            socklen_t len = sizeof(addr);
+            b->fd = socket(AF_INET, SOCK_DGRAM, 0);
+            bind(b->fd, (struct sockaddr *) &addr, sizeof(addr));
+            getsockname(b->fd, (struct sockaddr *) &addr, &len);
+            setsockopt(b->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(b->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+            if (pru_shm_open(&b->shm, "/pb2_chwp_bench_packet_size", 1) < 0) {
+                return 1;
+            }
+            pru_sim_reset(&b->shm);
+            pru_config_write(b->shm.base, &config);
+            b->sim.edge_rate = rate;
+            b->sim.duration = duration;
+            forwarder_init(&b->fwd, &b->shm, FWD_MODE_IRQ, sockfd, "127.0.0.1", ntohs(addr.sin_port));
+            forwarder_set_batching(&b->fwd, UDP_BATCH_MMSG, 0);
+            b->fwd.wire_version = wire_version;
+
+            pthread_create(&tl, NULL, listener, b);
+            pthread_create(&tc, NULL, consumer, b);
+            pthread_create(&tp, NULL, producer, b);
+            pthread_join(tp, NULL);
+            pthread_join(tc, NULL);
+            pthread_join(tl, NULL);
+
+            qsort(b->newest_ns, b->n_latency, sizeof(uint64_t), cmp_u64);
+            qsort(b->oldest_ns, b->n_latency, sizeof(uint64_t), cmp_u64);
+            unsigned long int lost = forwarder_encoder_lost(&b->fwd);
+            double seconds = duration;
+            double buffer_ms = 1e3 * b->fwd.layout.slots * sizes[s] / rate; //of each channel's ring
+            int tight = buffer_ms < MIN_BUFFER_MS || priority == 0 || b->rt_failed;
+            realtime &= !b->rt_failed;
+            printf("%6u %3d %6u %7.1f %9.0f %9.0f %9.1f %7.2f %9.1f %9.1f %9.1f %9.1f %6lu %6lu %6lu", sizes[s], channels,
+                   b->fwd.layout.slots, buffer_ms, b->received / seconds, b->datagrams / seconds, b->bytes / seconds / 1e3,
+                   100.0 * b->cpu_s / seconds,
+                   b->n_latency ? b->newest_ns[b->n_latency / 2] / 1e3 : 0.0,
+                   b->n_latency ? b->newest_ns[b->n_latency * 99 / 100] / 1e3 : 0.0,
+                   b->n_latency ? b->oldest_ns[b->n_latency / 2] / 1e3 : 0.0,
+                   b->n_latency ? b->oldest_ns[b->n_latency * 99 / 100] / 1e3 : 0.0,
+                   lost, b->gaps, b->bad);
+            printf(tight && lost ? " (tight ring)\n" : "\n");
+            //every channel has to arrive whole and as laid out, with the layout announced ahead of it, and only the
+            //rings too small to ride out the scheduler may lose packets, each one seen as an overrun
+            if (b->received == 0 || b->bad || b->layouts == 0 || (lost && !tight) || b->gaps != lost ||
+                b->received + lost != b->sim_stats.encoder_published) {
+                failed = 1;
+            }
+
+            close(b->fd);
+            pru_shm_close(&b->shm, 1);
+            free(b->newest_ns);
+            free(b->oldest_ns);
+            free(b);
+        }
+    }
+    printf("latencies in us from the newest and the oldest edge of a packet to its arrival\n");
+    if (priority > 0 && !realtime) {
+        printf("the forwarder could not be made real-time, ring overruns were reported only\n");
+    }
+    close(sockfd);
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
@@ -0,0 +1,163 @@
+//Round trip check and benchmark of the v2 encoder packet format
+//Synthetic edge streams are packed into v1 packets, encoded to v2, decoded again and compared field
+//by field. Reports the average v2 packet size, the saving against the 1816 byte v1 packet and the
+//encode/decode time per packet. The quadrature streams pack every transition of both channels as
+//encoder_kernel.h does in quadrature mode, turning back now and then, with the odd transition of both channels
+//at once and the odd jump in position. Exits non-zero if any packet fails to round trip.
+//
+// Usage:
+// $ ./bench_packet_v2 [-n packets_per_stream]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "packet_v2.h"
+
+#define IEP_HZ 200000000.0
+
+enum stream { STEADY, SPIN_UP, WRAP, MISSED_OVERFLOW, INDEX_GAPS, RANDOM, QUAD_STEADY, QUAD_REVERSE, N_STREAMS };
+static const char* stream_names[] = { "steady_2Hz", "spin_up", "wrap", "missed_ovflow", "index_gaps", "random",
+                                      "quad_2Hz", "quad_reverse" };
+static const uint32_t quad_forward[4] = { 1, 3, 0, 2 };
+static const uint32_t quad_backward[4] = { 2, 0, 3, 1 };
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dull;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t) (rng_state >> 16);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//Next QUAD_WORD of a quadrature stream, direction carries whether it turns forward between calls
+static uint32_t quad_next(enum stream s, uint32_t word, int* direction)
+{
+    if (s == QUAD_REVERSE && rng() % 500 == 0) {
+        *direction = -*direction;
+    }
+    if (s == QUAD_REVERSE && rng() % 200 == 0) {
+        return word ^ 3; //both channels changed in one sample
+    }
+    if (s == QUAD_REVERSE && rng() % 1000 == 0) {
+        return QUAD_WORD(QUAD_POSITION(word) + (int32_t) (rng() % 64) - 32, rng() & 3); //escaped
+    }
+    return *direction > 0 ? QUAD_WORD(QUAD_POSITION(word) + 1, quad_forward[QUAD_STATE(word)])
+                          : QUAD_WORD(QUAD_POSITION(word) - 1, quad_backward[QUAD_STATE(word)]);
+}
+
+//Fills the next v1 packet of a stream, t, edge and direction carry the stream state between packets
+static void fill(struct CompleteDataPackets* p, enum stream s, unsigned long int n, unsigned long int total, double* t,
+                 uint32_t* edge, int* direction)
+{
+    struct CounterInfo* c = &p->Counter_Packets;
+    int quad = s == QUAD_STEADY || s == QUAD_REVERSE;
+    p->counter_info_header = quad ? ENCODER_QUAD_HEADER : ENCODER_HEADER;
+    p->Quad.encoder_value_2 = rng() & 1;
+    p->Quad.encoder_value_3 = rng() & 1;
+    p->Quad.encoder_value_4 = rng() & 1;
+    for (int x = 0; x < ENCODER_COUNTER_SIZE; x++) {
+        double hz = s == SPIN_UP ? 0.05 + 3.0 * n / total : 2.0; //HWP rotation frequency, spin up ramps to 3 Hz
+        double jitter = ((int) (rng() % 2001) - 1000) * 1e-8; //up to +-10 us
+        *t += 1.0 / (hz * (quad ? 2280 : 1140)) + jitter;
+        uint64_t clk = (uint64_t) (*t * IEP_HZ);
+        if (s == WRAP) {
+            clk += 0xFFFFFFFFull - 2000000; //starts 10 ms before the first 32-bit wrap
+        }
+        if (quad) {
+            *edge = quad_next(s, *edge, direction);
+        } else {
+            *edge += (s == INDEX_GAPS && rng() % 50 == 0) ? rng() % 4 : 1; //dropped and repeated indices
+        }
+        c->clock_cnt[x] = (uint32_t) clk;
+        c->counter_ovflow[x] = (uint32_t) (clk >> 32);
+        c->encoder_cnt[x] = *edge;
+        if (s == MISSED_OVERFLOW && rng() % 100 == 0 && c->counter_ovflow[x] > 0) {
+            c->counter_ovflow[x] -= 1; //the race account_for_missed_ovflow() repairs on the host
+        }
+        if (s == RANDOM) {
+            c->clock_cnt[x] = rng() ^ rng() << 16;
+            c->counter_ovflow[x] = rng();
+            c->encoder_cnt[x] = rng() ^ rng() << 16;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long int n_packets = 20000;
+    int failures = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n': n_packets = strtoul(optarg, NULL, 10); break;
+        default:
+            printf("Usage: %s [-n packets_per_stream]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    struct CompleteDataPackets* packets = malloc(n_packets * sizeof(*packets));
+    uint8_t* encoded = malloc(n_packets * PACKET_V2_MAX_SIZE(ENCODER_COUNTER_SIZE));
+    size_t* sizes = malloc(n_packets * sizeof(size_t));
+    uint32_t clock_cnt[ENCODER_COUNTER_SIZE], counter_ovflow[ENCODER_COUNTER_SIZE], encoder_cnt[ENCODER_COUNTER_SIZE];
+    struct packet_v2_header hdr;
+
+    printf("%-14s %10s %8s %12s %12s %8s\n", "stream", "v2_bytes", "ratio", "encode_ns", "decode_ns", "result");
+    for (int s = 0; s < N_STREAMS; s++) {
+        double t = 0;
+        uint32_t edge = 0;
+        int direction = 1;
+        size_t total = 0;
+        unsigned long int bad = 0;
+
+        for (unsigned long int n = 0; n < n_packets; n++) {
+            fill(&packets[n], s, n, n_packets, &t, &edge, &direction);
+        }
+
+        double t0 = now_s();
+        for (unsigned long int n = 0; n < n_packets; n++) {
+            uint8_t* out = encoded + n * PACKET_V2_MAX_SIZE(ENCODER_COUNTER_SIZE);
+            sizes[n] = packet_v2_encode(&packets[n], (uint32_t) n, out);
+            total += sizes[n];
+        }
+        double t1 = now_s();
+        for (unsigned long int n = 0; n < n_packets; n++) {
+            const uint8_t* in = encoded + n * PACKET_V2_MAX_SIZE(ENCODER_COUNTER_SIZE);
+            int edges = packet_v2_decode(in, sizes[n], &hdr, clock_cnt, counter_ovflow, encoder_cnt, ENCODER_COUNTER_SIZE);
+            const struct CompleteDataPackets* p = &packets[n];
+            uint8_t quad = (uint8_t) (p->Quad.encoder_value_2 | p->Quad.encoder_value_3 << 1 | p->Quad.encoder_value_4 << 2);
+            uint8_t flags = p->counter_info_header == ENCODER_QUAD_HEADER ? PACKET_V2_FLAG_QUAD : 0;
+            if (edges != ENCODER_COUNTER_SIZE || hdr.seq != n || hdr.size != sizes[n] || hdr.quad != quad || hdr.flags != flags ||
+                memcmp(clock_cnt, p->Counter_Packets.clock_cnt, sizeof(clock_cnt)) ||
+                memcmp(counter_ovflow, p->Counter_Packets.counter_ovflow, sizeof(counter_ovflow)) ||
+                memcmp(encoder_cnt, p->Counter_Packets.encoder_cnt, sizeof(encoder_cnt))) {
+                bad += 1;
+            }
+        }
+        double t2 = now_s();
+
+        double avg = (double) total / n_packets;
+        printf("%-14s %10.1f %8.2f %12.0f %12.0f %8s\n", stream_names[s], avg,
+               sizeof(struct CompleteDataPackets) / avg, (t1 - t0) / n_packets * 1e9, (t2 - t1) / n_packets * 1e9,
+               bad ? "FAIL" : "ok");
+        failures += bad != 0;
+    }
+
+    free(packets);
+    free(encoded);
+    free(sizes);
+    return failures ? 1 : 0;
+}
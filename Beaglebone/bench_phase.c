@@ -0,0 +1,222 @@
+//Benchmark of the phase output against the simulated PRUs writing every edge as it happens
+//For phase packets built from finished packets only and with the packet being filled read as well, idle and with
+//a thread spinning on every CPU, it reports the latency from the newest edge of a phase packet to the packet
+//arriving on a loopback socket, and checks every packet against the simulated rotation: the frequency, and the
+//timestamp of the newest edge against its count, which a stale entry read from a slot would break
+//
+// Usage:
+// $ ./bench_phase [-r edges_per_second] [-t seconds_per_case] [-p phase_us]
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "forwarder.h"
+#include "phase_tracker.h"
+#include "pru_sim.h"
+
+#define MAX_SAMPLES 200000
+
+struct bench {
+    struct pru_shm shm;
+    struct forwarder fwd;
+    struct pru_sim_config sim;
+    struct pru_sim_stats sim_stats;
+    int phase_fd; //where the phase packets arrive
+    volatile int done;
+    uint64_t* latency_ns;
+    unsigned long int n_latency;
+    unsigned long int received;
+    unsigned long int valid; //packets sent once the first edge was in
+    unsigned long int partial; //packets whose newest edge came from an unfinished packet
+    unsigned long int bad; //packets that disagree with the simulated rotation
+    double max_freq_err; //relative, over a revolution
+    double max_window_err; //relative, over the window
+    double origin_ns; //time of edge 0 worked out from the first packet
+    double max_origin_err_ns; //the same from every later packet
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void* producer(void* arg)
+{
+    struct bench* b = arg;
+    pru_sim_run(&b->shm, &b->sim, &b->sim_stats);
+    return NULL;
+}
+
+static void* consumer(void* arg)
+{
+    struct bench* b = arg;
+    forwarder_run(&b->fwd);
+    b->done = 1;
+    return NULL;
+}
+
+//Stands in for the motor controller
+static void* listener(void* arg)
+{
+    struct bench* b = arg;
+    double truth = b->sim.edge_rate / PHASE_EDGES_PER_REV;
+    struct PhasePacket p;
+
+    while (!b->done) {
+        if (recv(b->phase_fd, &p, sizeof(p), 0) != sizeof(p)) {
+            continue; //timed out
+        }
+        uint64_t arrived = now_ns();
+        b->received += 1;
+        if (p.header != PHASE_HEADER || p.size != sizeof(p) || !(p.flags & PHASE_VALID)) {
+            continue;
+        }
+        //the simulated IEP counter is CLOCK_MONOTONIC at 200 MHz, 5 ns a count
+        uint64_t edge_ns = ((uint64_t) p.counter_ovflow << 32 | p.clock_cnt) * 5;
+        b->valid += 1;
+        if (b->n_latency < MAX_SAMPLES) {
+            b->latency_ns[b->n_latency++] = arrived - edge_ns;
+        }
+        b->partial += (p.flags & PHASE_PARTIAL) != 0;
+        //edge n is at origin + n / edge_rate, to within a count of the IEP
+        double origin = edge_ns - p.position * 1e9 / b->sim.edge_rate;
+        if (b->valid == 1) {
+            b->origin_ns = origin;
+        }
+        double origin_err = fabs(origin - b->origin_ns);
+        double expected_phase = (p.position % PHASE_EDGES_PER_REV) * 2 * M_PI / PHASE_EDGES_PER_REV;
+        int bad = origin_err > 20 || fabs(p.phase - expected_phase) > 1e-5;
+        if (p.flags & PHASE_FREQUENCY) {
+            double err = fabs(p.frequency - truth) / truth;
+            bad |= err > 1e-5;
+            b->max_freq_err = err > b->max_freq_err ? err : b->max_freq_err;
+        }
+        if (p.flags & PHASE_WINDOW_FREQUENCY) {
+            double err = fabs(p.frequency_window - truth) / truth;
+            bad |= err > 1e-5;
+            b->max_window_err = err > b->max_window_err ? err : b->max_window_err;
+        }
+        b->max_origin_err_ns = origin_err > b->max_origin_err_ns ? origin_err : b->max_origin_err_ns;
+        b->bad += bad;
+    }
+    return NULL;
+}
+
+static void* spinner(void* arg)
+{
+    volatile int* done = arg;
+    while (!*done) {
+    }
+    return NULL;
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    double rate = 2280, duration = 5;
+    long phase_us = 1000;
+    int cpus = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int failed = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:t:p:")) != -1) {
+        switch (opt) {
+        case 'r': rate = atof(optarg); break;
+        case 't': duration = atof(optarg); break;
+        case 'p': phase_us = atol(optarg); break;
+        default:
+            printf("Usage: %s [-r edges_per_second] [-t seconds_per_case] [-p phase_us]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    //encoder and IRIG packets go to a bound but unread loopback socket as in bench_forwarder
+    int sink = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    bind(sink, (struct sockaddr *) &addr, sizeof(addr));
+    getsockname(sink, (struct sockaddr *) &addr, &len);
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    printf("%d CPUs, %.0f edges/s, a phase packet every %ld us, forwarder in irq mode\n", cpus, rate, phase_us);
+    printf("%-16s %8s %9s %9s %9s %9s %9s %10s %10s %6s\n", "case", "packets", "partial_%", "p50_us", "p99_us", "p99.9_us",
+           "max_us", "f_rev_ppm", "f_win_ppm", "bad");
+    for (int loaded = 0; loaded <= 1; loaded++) {
+        for (int partial = 0; partial <= 1; partial++) {
+            struct bench b;
+            pthread_t tp, tc, tl, spinners[64];
+            int n_spinners = loaded ? (cpus < 64 ? cpus : 64) : 0;
+
+            memset(&b, 0, sizeof(b));
+            b.latency_ns = malloc(MAX_SAMPLES * sizeof(uint64_t));
+            if (pru_shm_open(&b.shm, "/pb2_chwp_bench_phase", 1) < 0) {
+                return 1;
+            }
+            pru_sim_reset(&b.shm);
+            b.sim.edge_rate = rate;
+            b.sim.duration = duration;
+            b.sim.live_edges = 1;
+            forwarder_init(&b.fwd, &b.shm, FWD_MODE_IRQ, sockfd, "127.0.0.1", ntohs(addr.sin_port));
+            forwarder_set_batching(&b.fwd, UDP_BATCH_MMSG, 0);
+
+            struct sockaddr_in phase_addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+            struct timeval timeout = { .tv_sec = 0, .tv_usec = 100000 };
+            b.phase_fd = socket(AF_INET, SOCK_DGRAM, 0);
+            bind(b.phase_fd, (struct sockaddr *) &phase_addr, sizeof(phase_addr));
+            len = sizeof(phase_addr);
+            getsockname(b.phase_fd, (struct sockaddr *) &phase_addr, &len);
+            setsockopt(b.phase_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            forwarder_enable_phase(&b.fwd, "127.0.0.1", ntohs(phase_addr.sin_port), phase_us);
+            b.fwd.phase_partial = partial;
+
+            for (int k = 0; k < n_spinners; k++) {
+                pthread_create(&spinners[k], NULL, spinner, (void *) &b.done);
+            }
+            pthread_create(&tl, NULL, listener, &b);
+            pthread_create(&tc, NULL, consumer, &b);
+            pthread_create(&tp, NULL, producer, &b);
+            pthread_join(tp, NULL);
+            pthread_join(tc, NULL);
+            pthread_join(tl, NULL);
+            for (int k = 0; k < n_spinners; k++) {
+                pthread_join(spinners[k], NULL);
+            }
+
+            qsort(b.latency_ns, b.n_latency, sizeof(uint64_t), cmp_u64);
+            char name[32];
+            snprintf(name, sizeof(name), "%s%s", partial ? "partial" : "finished", loaded ? "+load" : "");
+            printf("%-16s %8lu %9.1f %9.1f %9.1f %9.1f %9.1f %10.3f %10.3f %6lu\n", name, b.received,
+                   b.valid ? 100.0 * b.partial / b.valid : 0.0,
+                   b.n_latency ? b.latency_ns[b.n_latency / 2] / 1e3 : 0.0,
+                   b.n_latency ? b.latency_ns[b.n_latency * 99 / 100] / 1e3 : 0.0,
+                   b.n_latency ? b.latency_ns[b.n_latency * 999 / 1000] / 1e3 : 0.0,
+                   b.n_latency ? b.latency_ns[b.n_latency - 1] / 1e3 : 0.0,
+                   b.max_freq_err * 1e6, b.max_window_err * 1e6, b.bad);
+            //finished packets can only ever be read whole, and a stale entry would show in the timestamps
+            if (b.n_latency == 0 || b.bad || b.fwd.phase.gaps || (!partial && b.partial)) {
+                failed = 1;
+            }
+
+            close(b.phase_fd);
+            pru_shm_close(&b.shm, 1);
+            free(b.latency_ns);
+        }
+    }
+    close(sockfd);
+    close(sink);
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
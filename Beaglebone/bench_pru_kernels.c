@@ -0,0 +1,535 @@
+//Cycle budget of the PRU detection kernels, run on the host against the signal simulator in pru_sigsim.h
+//
+//Encoder: the sampling loop in encoder_kernel.h and, for comparison, the loop it replaced as built with
+//--opt_level=off are run on a 2 Hz signal. The run starts close to an IEP wrap. Every packet is drained from
+//the ring as the forwarder would and every edge is checked against the time the simulator generated it at:
+//its count, its 64-bit timestamp, its latency and the quadrature pins. Loop iterations, cycles and
+//instructions per edge are reported. The longest gap between two samples of R31 bounds the edge rate:
+//two edges inside one gap cancel out and are both missed. A sweep of increasing edge rates then finds
+//where edges really start to go missing.
+//
+//Quadrature: the same loop in quadrature mode times every transition of both channels while the HWP reverses
+//half way through. Each entry is checked against the transition the simulator made: its timestamp, the position
+//counted up and then back down, and the state of the two channels. The sweep finds the highest transition rate.
+//
+//Channels: the loop for several encoder channels (encoder_kernel_run_channels()) with P8_28 and P8_27 set up as
+//two channels of their own, each with its own ring and counts. Every edge of either is checked as above, and the
+//sweep is over the edge rate of each channel. The first packet of channel 0 has to match the one the single
+//channel loop made, boundary timing included.
+//
+//IRIG: irig_kernel.h decodes a few frames that straddle an IEP wrap. Each one is checked against the time of
+//day and the rising edges the simulator put in it.
+//
+//The cycle counts come from the PRU_COST() marks in the kernels and the per access figures in pru_sigsim.h,
+//which -c overrides. Exits non-zero if any check fails.
+//
+// Usage:
+// $ ./bench_pru_kernels [-t seconds] [-j edge_jitter_ns] [-f irig_frames] [-c op,load,store,iep]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "encoder_kernel.h"
+#include "irig_kernel.h"
+#include "pru_ring.h"
+#include "pru_sigsim.h"
+
+#define SLITS_PER_REV (570 * 2)
+#define MAX_LATENCY_CYCLES 400 //a timestamp later than this after its edge fails the check
+
+static uint8_t shm[PRU_SHM_SIZE] __attribute__((aligned(8)));
+
+//Encoder loops under test
+enum loop { LOOP_KERNEL, LOOP_LEGACY, LOOP_QUAD, LOOP_CHANNELS, N_LOOPS };
+static const char* loop_names[] = { "kernel", "legacy", "quad", "channels" };
+#define BENCH_CHANNELS 2 //for LOOP_CHANNELS, P8_28 and P8_27
+
+//Structure the old loop sampled through, kept volatile as it was
+struct ECAP {
+    unsigned long int p_sample;
+    unsigned long int ts;
+    unsigned long int p_ts;
+    unsigned long int trigger;
+};
+
+//The sampling loop of Encoder_Detection.c before encoder_kernel.h. With --opt_level=off every local lives on
+//the stack, so each use is a load and each assignment a store on top of the volatile ECAP accesses
+static void legacy_sample(struct encoder_kernel* k, volatile struct ECAP* ecap)
+{
+    uint32_t sample = PRU_R31() & (ENCODER_PIN | QUAD_2_PIN | QUAD_3_PIN | QUAD_4_PIN);
+    PRU_COST(3, 0, 1);
+    uint32_t edge_sample = PRU_R31() & ENCODER_PIN;
+    PRU_COST(3, 0, 1);
+    uint32_t change = edge_sample ^ ecap->p_sample;
+    PRU_COST(2, 2, 1);
+    PRU_COST(4, 2, 0); //change and the loop test on x, both from the stack
+    if (change) {
+        volatile struct CompleteDataPackets* packet = (volatile struct CompleteDataPackets *) (k->slot + 4);
+        k->input_capture_count += 1;
+        PRU_COST(3, 2, 1);
+        if ((edge_sample & ENCODER_PIN) && k->quad_needed) {
+            packet->Quad.encoder_value_2 = (sample & QUAD_2_PIN) >> 8;
+            packet->Quad.encoder_value_3 = (sample & QUAD_3_PIN) >> 9;
+            packet->Quad.encoder_value_4 = (sample & QUAD_4_PIN) >> 11;
+            k->quad_needed = 0;
+            PRU_COST(14, 8, 4);
+        }
+        ecap->p_ts = ecap->ts;
+        PRU_COST(0, 1, 1);
+        ecap->ts = PRU_IEP_COUNT();
+        ecap->trigger = ecap->trigger ^ 1 << 14;
+        ecap->p_sample = edge_sample;
+        PRU_COST(3, 2, 3);
+        packet->Counter_Packets.clock_cnt[k->x] = ecap->ts;
+        PRU_COST(3, 3, 1);
+        packet->Counter_Packets.counter_ovflow[k->x] = *k->counter_overflow + (PRU_IEP_OVERFLOWED() && packet->Counter_Packets.clock_cnt[k->x] < MAX_LOOP_TIME);
+        PRU_COST(8, 5, 1);
+        packet->Counter_Packets.encoder_cnt[k->x] = k->input_capture_count;
+        k->x += 1;
+        PRU_COST(5, 4, 2);
+    }
+}
+
+struct encoder_result {
+    unsigned long int edges; //detected, or transitions of either channel for LOOP_QUAD and LOOP_CHANNELS
+    unsigned long int missed;
+    unsigned long int bad; //edges with a wrong count, timestamp, quadrature reading or position
+    unsigned long int packets;
+    unsigned long int iterations;
+    uint64_t cycles;
+    uint64_t edge_cycles; //spent in iterations that found an edge
+    uint64_t max_idle; //cycles of the longest iteration without an edge
+    uint64_t max_edge; //cycles of the longest iteration with an edge
+    uint64_t max_gap; //longest time between two samples of the encoder pin, packet boundaries included
+    uint32_t telemetry_gap; //longest packet boundary the kernel put in its telemetry
+    int telemetry_ok; //the telemetry counters agree with what was drained
+    double latency_sum; //cycles from edge to timestamp
+    uint64_t max_latency;
+    struct pru_sigsim_counts counts;
+    uint32_t first_cnt[ENCODER_COUNTER_SIZE]; //first packet of channel 0, compared between one and several channels
+    uint64_t first_ts[ENCODER_COUNTER_SIZE];
+    uint32_t first_gap; //longest boundary the kernel had timed when it finished that packet
+};
+
+struct encoder_bench {
+    struct pru_sigsim sim;
+    struct pru_ring_reader reader[BENCH_CHANNELS];
+    int n_channels;
+    struct encoder_result res;
+    uint64_t* log;
+    uint64_t* quad_log; //for LOOP_CHANNELS, cycle of transition n of P8_27 in quad_log[n - 1]
+    size_t quad_log_size;
+    uint32_t quad_scanned; //entries of transitions already looked at for quad_log
+    uint32_t quad_state;
+    int quad;
+    struct pru_sigsim_transition* transitions;
+    uint32_t next_transition; //index in transitions of the next entry expected in quadrature mode
+    struct encoder_kernel* k;
+};
+
+static int check_latency(struct encoder_bench* b, uint64_t ts, uint64_t cycle)
+{
+    int64_t latency = (int64_t) (ts - (b->sim.config.iep_start + cycle));
+    if (latency < 0 || latency > MAX_LATENCY_CYCLES) {
+        return 0;
+    }
+    b->res.latency_sum += latency;
+    b->res.max_latency = (uint64_t) latency > b->res.max_latency ? (uint64_t) latency : b->res.max_latency;
+    return 1;
+}
+
+//Entries of a quadrature packet come in the order the simulator made the transitions, a missed one shifts the
+//rest and fails them all
+static void check_quad(struct encoder_bench* b, volatile struct CompleteDataPackets* p)
+{
+    for (int x = 0; x < ENCODER_COUNTER_SIZE; x++) {
+        uint32_t word = p->Counter_Packets.encoder_cnt[x];
+        uint64_t ts = p->Counter_Packets.clock_cnt[x] + ((uint64_t) p->Counter_Packets.counter_ovflow[x] << 32);
+        uint32_t n = b->next_transition++;
+        if (n >= b->sim.transition_log_size) {
+            b->res.bad += 1;
+            continue;
+        }
+        const struct pru_sigsim_transition* t = &b->transitions[n];
+        if (QUAD_POSITION(word) != t->position || QUAD_STATE(word) != t->state || !check_latency(b, ts, t->cycle)) {
+            b->res.bad += 1;
+        }
+    }
+}
+
+//Edges of channel 1 in LOOP_CHANNELS are the transitions of P8_27, picked out of the transition log
+static void log_quad_edges(struct encoder_bench* b)
+{
+    for (; b->quad_scanned < b->sim.transitions && b->quad_scanned < b->sim.transition_log_size; b->quad_scanned++) {
+        struct pru_sigsim_transition* t = &b->transitions[b->quad_scanned];
+        if ((t->state ^ b->quad_state) & 2) {
+            b->quad_log[b->quad_log_size++] = t->cycle;
+        }
+        b->quad_state = t->state;
+    }
+}
+
+//Drains the rings like the forwarder and checks every edge against the simulated signal
+static void on_encoder_event(void* ctx, uint32_t event)
+{
+    struct encoder_bench* b = ctx;
+    (void) event;
+
+    for (int c = 0; c < b->n_channels; c++) {
+        uint32_t n = pru_ring_available(&b->reader[c]);
+        if (c == 1 && n > 0) {
+            log_quad_edges(b);
+        }
+        for (uint32_t k = 0; k < n; k++) {
+            volatile uint8_t* slot = pru_ring_slot(&b->reader[c], k);
+            volatile struct CompleteDataPackets* p = &((volatile struct CounterSlot *) slot)->packet;
+            if (pru_ring_check_seq(&b->reader[c], slot) == 0 && c == 0) {
+                for (int x = 0; x < ENCODER_COUNTER_SIZE; x++) {
+                    b->res.first_cnt[x] = p->Counter_Packets.encoder_cnt[x];
+                    b->res.first_ts[x] = p->Counter_Packets.clock_cnt[x] + ((uint64_t) p->Counter_Packets.counter_ovflow[x] << 32);
+                }
+                b->res.first_gap = b->k->max_gap;
+            }
+            b->res.packets += 1;
+            if (b->quad) {
+                b->res.bad += p->counter_info_header != ENCODER_QUAD_HEADER;
+                check_quad(b, p);
+                continue;
+            }
+            //forward rotation, the quadrature channel is low at every rising edge of the encoder pin
+            if (c == 0 && (p->Quad.encoder_value_2 != 0 || p->Quad.encoder_value_3 != 1 || p->Quad.encoder_value_4 != 0)) {
+                b->res.bad += 1;
+            }
+            //channel 1 has no quadrature partner and is not channel 0, so it reads none of their pins
+            if (c == 1 && (p->Quad.encoder_value_2 != 0 || p->Quad.encoder_value_3 != 0 || p->Quad.encoder_value_4 != 0)) {
+                b->res.bad += 1;
+            }
+            for (int x = 0; x < ENCODER_COUNTER_SIZE; x++) {
+                uint32_t count = p->Counter_Packets.encoder_cnt[x];
+                uint64_t ts = p->Counter_Packets.clock_cnt[x] + ((uint64_t) p->Counter_Packets.counter_ovflow[x] << 32);
+                size_t logged = c == 0 ? b->sim.edge_log_size : b->quad_log_size;
+                if (count == 0 || count > logged) {
+                    b->res.bad += 1;
+                    continue;
+                }
+                if (!check_latency(b, ts, c == 0 ? b->log[count - 1] : b->quad_log[count - 1])) {
+                    b->res.bad += 1;
+                }
+            }
+        }
+        pru_ring_release(&b->reader[c], n);
+    }
+}
+
+//Runs one loop over duration seconds of encoder signal, the same steps as encoder_kernel_run() with each pass
+//of the sampling loop timed, or for LOOP_CHANNELS those of encoder_kernel_run_channels()
+static struct encoder_result run_encoder(enum loop loop, const struct pru_sigsim_config* config)
+{
+    static struct encoder_bench b;
+    static volatile struct CounterSlot overrun_slot;
+    struct encoder_kernel kernels[BENCH_CHANNELS];
+    struct encoder_kernel* k = kernels;
+    struct pru_config pru_config;
+    struct pru_shm_layout layout;
+    volatile struct ECAP ecap = { 0, 0, 0, 1 << 14 };
+    uint64_t last_sample = 0;
+    uint32_t edges = 0;
+
+    memset(shm, 0, sizeof(shm));
+    memset(&b.res, 0, sizeof(b.res));
+    pru_sigsim_init(&b.sim, shm, config);
+    b.sim.edge_log_size = (size_t) ((config->duration + 1) * config->edge_rate) + 1024;
+    b.sim.edge_log = b.log = realloc(b.log, b.sim.edge_log_size * sizeof(uint64_t));
+    b.sim.transition_log_size = 2 * b.sim.edge_log_size;
+    b.sim.transition_log = b.transitions = realloc(b.transitions, b.sim.transition_log_size * sizeof(b.transitions[0]));
+    b.quad_log = realloc(b.quad_log, b.sim.transition_log_size * sizeof(uint64_t));
+    b.quad = loop == LOOP_QUAD;
+    b.next_transition = 0;
+    b.quad_log_size = b.quad_scanned = b.quad_state = 0;
+    b.sim.on_event = on_encoder_event;
+    b.sim.on_event_ctx = &b;
+    b.k = k;
+
+    pru_config_default(&pru_config);
+    pru_config.quadrature = loop == LOOP_QUAD;
+    if (loop == LOOP_CHANNELS) {
+        pru_config.n_channels = BENCH_CHANNELS;
+        pru_config.pin_mask[1] = QUAD_2_PIN;
+    }
+    pru_layout_compute(&pru_config, &layout);
+    b.n_channels = layout.n_channels;
+    for (int c = 0; c < b.n_channels; c++) {
+        pru_ring_reader_init(&b.reader[c], shm, layout.ring_ctrl_offset[c], layout.ring_offset[c], layout.slot_size, layout.slots);
+    }
+
+    encoder_kernel_init(k, shm, &pru_config, (volatile uint8_t *) &overrun_slot);
+    if (loop == LOOP_CHANNELS) {
+        uint32_t pins = 0, p_sample = 0;
+        for (int c = 0; c < BENCH_CHANNELS; c++) {
+            pins |= k[c].pins;
+            encoder_kernel_begin_packet(&k[c]);
+            encoder_kernel_time_boundary(&k[c]);
+        }
+        for (int running = 1; running; ) {
+            uint64_t start = b.sim.now;
+            uint32_t count = k[0].input_capture_count + k[1].input_capture_count;
+            if (last_sample != 0 && start - last_sample > b.res.max_gap) {
+                b.res.max_gap = start - last_sample;
+            }
+            last_sample = start;
+            running = encoder_kernel_sample_channels(k, BENCH_CHANNELS, pins, 0, &p_sample);
+            uint64_t cycles = b.sim.now - start;
+            b.res.iterations += 1;
+            if (k[0].input_capture_count + k[1].input_capture_count != count) {
+                b.res.edge_cycles += cycles;
+                b.res.max_edge = cycles > b.res.max_edge ? cycles : b.res.max_edge;
+            } else {
+                b.res.max_idle = cycles > b.res.max_idle ? cycles : b.res.max_idle;
+            }
+        }
+    } else {
+        if (loop == LOOP_QUAD) {
+            encoder_kernel_init_quad(k);
+        }
+        while (*k->on == 0) {
+            PRU_COST(2, 1, 0);
+            encoder_kernel_begin_packet(k);
+            if (loop != LOOP_LEGACY) {
+                encoder_kernel_time_boundary(k);
+            }
+            while (k->x < k->packet_edges) {
+                uint64_t start = b.sim.now;
+                uint32_t count = k->input_capture_count;
+                if (last_sample != 0 && start - last_sample > b.res.max_gap) {
+                    b.res.max_gap = start - last_sample;
+                }
+                last_sample = start;
+                if (loop == LOOP_LEGACY) {
+                    legacy_sample(k, &ecap);
+                } else if (loop == LOOP_QUAD) {
+                    encoder_kernel_sample_quad(k);
+                } else {
+                    encoder_kernel_sample(k);
+                }
+                uint64_t cycles = b.sim.now - start;
+                b.res.iterations += 1;
+                if (k->input_capture_count != count) {
+                    b.res.edge_cycles += cycles;
+                    b.res.max_edge = cycles > b.res.max_edge ? cycles : b.res.max_edge;
+                } else {
+                    b.res.max_idle = cycles > b.res.max_idle ? cycles : b.res.max_idle;
+                }
+            }
+            encoder_kernel_end_packet(k);
+        }
+    }
+
+    //every edge generated before the last one detected should have been seen, channel 1 of LOOP_CHANNELS
+    //only finishes packets up to the moment channel 0 stops, so only its published edges are held against it
+    uint64_t last_detect = last_sample;
+    size_t before = 0;
+    if (loop == LOOP_QUAD) {
+        while (before < b.sim.transitions && before < b.sim.transition_log_size && b.transitions[before].cycle <= last_detect) {
+            before++;
+        }
+    } else {
+        while (before < b.sim.edges && before < b.sim.edge_log_size && b.log[before] <= last_detect) {
+            before++;
+        }
+    }
+    for (int c = 0; c < b.n_channels; c++) {
+        edges += k[c].input_capture_count;
+        b.res.bad += b.reader[c].lost + k[c].ring->overruns;
+    }
+    b.res.edges = edges;
+    b.res.missed = before > k->input_capture_count ? before - k->input_capture_count : 0;
+    if (loop == LOOP_CHANNELS) {
+        //channel 1 is checked edge by edge, and its packets have to keep coming at the rate of channel 0's
+        b.res.bad += k[1].seq + 1 < k[0].seq;
+    }
+    //the counters are stored at the first rising edge of a packet, so they trail by at most a packet
+    volatile struct pru_telemetry* t = k->telemetry;
+    b.res.telemetry_gap = t->encoder_max_gap;
+    b.res.telemetry_ok = t->encoder_edges <= k->input_capture_count && t->encoder_edges + 2 * ENCODER_COUNTER_SIZE > k->input_capture_count &&
+                         t->encoder_packets <= k->seq && t->encoder_packets + 2 > k->seq &&
+                         t->encoder_max_gap > 0 && t->encoder_max_gap <= b.res.max_gap;
+    b.res.cycles = b.sim.now;
+    b.res.counts = b.sim.counts;
+    return b.res;
+}
+
+//Highest edge rate, growing in steps of 5%, at which a run of 20000 edges loses none
+//In quadrature mode the rate is of transitions of either channel, twice the edge rate, with a reversal half way
+static double sweep_encoder(enum loop loop, const struct pru_sigsim_config* base)
+{
+    struct pru_sigsim_config config = *base;
+    double ok_rate = 0;
+
+    for (double rate = 100000; rate < PRU_SIGSIM_HZ / 4; rate *= 1.05) {
+        config.edge_rate = loop == LOOP_QUAD ? rate / 2 : rate;
+        config.duration = 20000 / rate;
+        config.reverse_at = loop == LOOP_QUAD ? config.duration / 2 : 0;
+        struct encoder_result res = run_encoder(loop, &config);
+        if (res.missed > 0 || res.bad > 0) {
+            break;
+        }
+        ok_rate = rate;
+    }
+    return ok_rate;
+}
+
+struct irig_bench {
+    struct pru_sigsim sim;
+    struct pru_ring_reader reader;
+    uint64_t log[10000];
+    unsigned long int frames;
+    unsigned long int bad;
+    uint64_t max_latency;
+};
+
+static int check_edge(struct irig_bench* b, uint32_t clock, uint32_t overflow, uint32_t bit)
+{
+    int64_t latency = (int64_t) ((clock + ((uint64_t) overflow << 32)) - (b->sim.config.iep_start + b->log[bit]));
+    if (latency < 0 || latency > MAX_LATENCY_CYCLES) {
+        return 0;
+    }
+    b->max_latency = (uint64_t) latency > b->max_latency ? (uint64_t) latency : b->max_latency;
+    return 1;
+}
+
+//Checks every frame against the one the simulator sent, the first frame is spent synchronizing
+static void on_irig_event(void* ctx, uint32_t event)
+{
+    struct irig_bench* b = ctx;
+    uint32_t n = pru_ring_available(&b->reader);
+    (void) event;
+
+    for (uint32_t k = 0; k < n; k++) {
+        volatile uint8_t* slot = pru_ring_slot(&b->reader, k);
+        volatile struct IrigInfo* p = &((volatile struct IrigSlot *) slot)->packet;
+        uint32_t frame = pru_ring_check_seq(&b->reader, slot) + 1;
+        uint32_t info[10];
+        int ok = 1;
+
+        pru_sigsim_irig_info((b->sim.config.irig_start + frame) % (24 * 3600), info);
+        for (int x = 0; x < 10; x++) {
+            ok &= p->info[x] == info[x];
+            ok &= check_edge(b, p->re_count[x], p->re_count_overflow[x], frame * 100 + x * 10 + 9);
+        }
+        ok &= check_edge(b, p->rising_edge_time, p->init_overflow, frame * 100);
+        b->bad += !ok;
+        b->frames += 1;
+    }
+    pru_ring_release(&b->reader, n);
+}
+
+static void print_counts(const char* name, const struct encoder_result* res)
+{
+    double edges = res->edges ? res->edges : 1;
+    printf("%-8s %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %10.1f\n", name, res->iterations / edges,
+           (double) res->cycles / res->iterations, res->counts.r31_reads / edges, res->counts.iep_reads / edges,
+           res->counts.ops / edges, res->counts.loads / edges, res->counts.stores / edges,
+           res->edge_cycles / edges);
+}
+
+int main(int argc, char **argv)
+{
+    struct pru_sigsim_config config = { .edge_rate = 2 * SLITS_PER_REV, .edge_jitter = 10e-9, .irig_jitter = 100e-9,
+                                        .irig_phase = 0.3, .irig_start = 24 * 3600 - 2, .maintain_overflow = 1 };
+    double seconds = 2;
+    int frames = 4;
+    int failures = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:j:f:c:")) != -1) {
+        switch (opt) {
+        case 't': seconds = atof(optarg); break;
+        case 'j': config.edge_jitter = atof(optarg) * 1e-9; break;
+        case 'f': frames = atoi(optarg); break;
+        case 'c':
+            if (sscanf(optarg, "%d,%d,%d,%d", &config.cycles_op, &config.cycles_load, &config.cycles_store, &config.cycles_iep) == 4) {
+                break;
+            }
+            //fall through
+        default:
+            printf("Usage: %s [-t seconds] [-j edge_jitter_ns] [-f irig_frames] [-c op,load,store,iep]\n", argv[0]);
+            return 1;
+        }
+    }
+    config.duration = seconds;
+    config.iep_start = (uint32_t) (4294967296.0 - seconds / 2 * PRU_SIGSIM_HZ); //wraps halfway through
+
+    static const enum loop order[N_LOOPS] = { LOOP_LEGACY, LOOP_KERNEL, LOOP_QUAD, LOOP_CHANNELS };
+    struct pru_sigsim_config quad_config = config;
+    struct encoder_result res[N_LOOPS];
+    quad_config.reverse_at = seconds / 2;
+    printf("Encoder, %.0f s at %.0f edges/s with %.0f ns jitter, quad reversing after %.0f s\n", seconds, config.edge_rate,
+           config.edge_jitter * 1e9, quad_config.reverse_at);
+    printf("%-8s %8s %8s %8s %8s %8s %8s %8s %10s   (per edge or transition)\n", "loop", "iters", "cyc/iter", "r31", "iep",
+           "ops", "loads", "stores", "edge_cyc");
+    for (int n = 0; n < N_LOOPS; n++) {
+        enum loop loop = order[n];
+        res[loop] = run_encoder(loop, loop == LOOP_QUAD ? &quad_config : &config);
+        print_counts(loop_names[loop], &res[loop]);
+    }
+    printf("%-8s %8s %8s %8s %8s %12s %12s %12s %12s %8s\n", "loop", "idle_cyc", "edge_cyc", "gap_cyc", "lat_ns",
+           "max_lat_ns", "limit_e/s", "swept_e/s", "max_hwp_hz", "result");
+    for (int n = 0; n < N_LOOPS; n++) {
+        enum loop loop = order[n];
+        struct encoder_result* r = &res[loop];
+        double swept = sweep_encoder(loop, &config);
+        int ok = r->edges > 0 && r->missed == 0 && r->bad == 0 && swept > 0;
+        printf("%-8s %8llu %8llu %8llu %8.1f %12.1f %12.0f %12.0f %12.0f %8s\n", loop_names[loop],
+               (unsigned long long) r->max_idle, (unsigned long long) r->max_edge, (unsigned long long) r->max_gap,
+               r->latency_sum / (r->edges ? r->edges : 1) * 5, r->max_latency * 5.0, PRU_SIGSIM_HZ / r->max_gap, swept,
+               swept / (loop == LOOP_QUAD ? 2 * SLITS_PER_REV : SLITS_PER_REV), ok ? "ok" : "FAIL");
+        failures += !ok;
+    }
+    printf("kernel telemetry: longest loop %u cycles (%llu measured), edge and packet counters %s\n",
+           res[LOOP_KERNEL].telemetry_gap, (unsigned long long) res[LOOP_KERNEL].max_gap, res[LOOP_KERNEL].telemetry_ok ? "ok" : "FAIL");
+    failures += !res[LOOP_KERNEL].telemetry_ok || !res[LOOP_QUAD].telemetry_ok || !res[LOOP_CHANNELS].telemetry_ok;
+
+    //channel 0's first packet is the same with a second channel beside it: the same counts, timestamps and overflow
+    //words no further apart than the latencies of the two loops allow, and its packet boundary timed from the start
+    const struct encoder_result* one = &res[LOOP_KERNEL], * two = &res[LOOP_CHANNELS];
+    int first_diff = 0;
+    for (int x = 0; x < ENCODER_COUNTER_SIZE; x++) {
+        int64_t d = (int64_t) (two->first_ts[x] - one->first_ts[x]);
+        first_diff += two->first_cnt[x] != one->first_cnt[x] || d < -MAX_LATENCY_CYCLES || d > MAX_LATENCY_CYCLES;
+    }
+    int first_ok = first_diff == 0 && one->first_gap > 0 && two->first_gap > 0;
+    printf("channels: first packet against one channel, %d of %d entries differ, boundary %u cycles against %u, %s\n",
+           first_diff, ENCODER_COUNTER_SIZE, two->first_gap, one->first_gap, first_ok ? "ok" : "FAIL");
+    failures += !first_ok;
+
+    //IRIG, with the kernel keeping the overflow count
+    static struct irig_bench ib;
+    static volatile struct IrigSlot irig_overrun;
+    struct pru_sigsim_config irig_config = config;
+    struct irig_kernel k;
+    irig_config.edge_rate = 0;
+    irig_config.maintain_overflow = 0;
+    irig_config.duration = frames + 2;
+    irig_config.iep_start = (uint32_t) (4294967296.0 - (irig_config.irig_phase + 1.555) * PRU_SIGSIM_HZ); //in frame 1
+
+    memset(shm, 0, sizeof(shm));
+    pru_sigsim_init(&ib.sim, shm, &irig_config);
+    ib.sim.irig_log = ib.log;
+    ib.sim.irig_log_size = sizeof(ib.log) / sizeof(ib.log[0]);
+    ib.sim.on_event = on_irig_event;
+    ib.sim.on_event_ctx = &ib;
+    pru_ring_reader_init(&ib.reader, shm, IRIG_RING_CTRL_OFFSET, IRIG_RING_OFFSET, sizeof(struct IrigSlot), IRIG_RING_SLOTS);
+    irig_kernel_init(&k, shm, &irig_overrun);
+    irig_kernel_run(&k, frames);
+    int ok = ib.frames == (unsigned long int) frames && ib.bad == 0 && ib.reader.lost == 0 && *k.error_identifier == 0 &&
+             k.telemetry->irig_frames == k.frames && k.telemetry->irig_desyncs == 0 && k.telemetry->irig_bad_pulses == 0 &&
+             k.telemetry->irig_max_gap > 0;
+    printf("IRIG, %d frames with %.0f ns jitter across an IEP wrap\n", frames, irig_config.irig_jitter * 1e9);
+    printf("%-8s %8s %8s %8s %12s %8s %8s\n", "loop", "frames", "bad", "cyc/iter", "max_lat_ns", "gap_cyc", "result");
+    printf("%-8s %8lu %8lu %8.1f %12.1f %8u %8s\n", "kernel", ib.frames, ib.bad, (double) ib.sim.now / ib.sim.counts.r31_reads,
+           ib.max_latency * 5.0, k.telemetry->irig_max_gap, ok ? "ok" : "FAIL");
+    failures += !ok;
+    return failures ? 1 : 0;
+}
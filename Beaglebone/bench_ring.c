@@ -0,0 +1,127 @@
+//Stress benchmark of the shared memory rings
+//One thread plays the PRUs and publishes packets at a high edge rate, a second runs the ARM forwarder.
+//Every forwarded packet is checked against its sequence number, so a torn read (the producer
+//reusing a slot that is still being sent) or a miscounted overrun makes the run fail.
+//
+// Usage:
+// $ ./bench_ring [-r edges_per_second] [-t seconds] [-d stall_us] [-u]
+//
+// -d makes the forwarder stall for stall_us every 64 packets to force overruns
+// -u publishes as fast as possible instead of at the edge rate
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "forwarder.h"
+#include "pru_sim.h"
+
+struct bench {
+    struct pru_shm shm;
+    struct forwarder fwd;
+    struct pru_sim_config sim;
+    struct pru_sim_stats sim_stats;
+    long stall_us;
+    unsigned long int torn;
+};
+
+static void on_send(void* ctx, int type, uint32_t seq, const volatile void* packet)
+{
+    struct bench* b = ctx;
+
+    if (type == FWD_ENCODER) {
+        const volatile struct CompleteDataPackets* p = packet;
+        //the simulated PRU numbers edges continuously, dropped packets included
+        if (p->Counter_Packets.encoder_cnt[0] != seq * ENCODER_COUNTER_SIZE + 1 ||
+            p->Counter_Packets.encoder_cnt[ENCODER_COUNTER_SIZE - 1] != (seq + 1) * ENCODER_COUNTER_SIZE) {
+            b->torn += 1;
+        }
+    }
+    if (b->stall_us && (b->fwd.encoder_sent + b->fwd.irig_sent) % 64 == 63) {
+        struct timespec ts = { .tv_sec = 0, .tv_nsec = b->stall_us * 1000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void* producer(void* arg)
+{
+    struct bench* b = arg;
+    pru_sim_run(&b->shm, &b->sim, &b->sim_stats);
+    return NULL;
+}
+
+static void* consumer(void* arg)
+{
+    struct bench* b = arg;
+    forwarder_run(&b->fwd);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct bench b;
+    struct timespec t0, t1;
+    pthread_t tp, tc;
+    int opt;
+
+    memset(&b, 0, sizeof(b));
+    b.sim.edge_rate = 2280 * 200;
+    b.sim.duration = 5;
+    while ((opt = getopt(argc, argv, "r:t:d:u")) != -1) {
+        switch (opt) {
+        case 'r': b.sim.edge_rate = atof(optarg); break;
+        case 't': b.sim.duration = atof(optarg); break;
+        case 'd': b.stall_us = atol(optarg); break;
+        case 'u': b.sim.unpaced = 1; break;
+        default:
+            printf("Usage: %s [-r edges_per_second] [-t seconds] [-d stall_us] [-u]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    int sink = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    bind(sink, (struct sockaddr *) &addr, sizeof(addr));
+    getsockname(sink, (struct sockaddr *) &addr, &len);
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (pru_shm_open(&b.shm, "/pb2_chwp_bench_ring", 1) < 0) {
+        return 1;
+    }
+    pru_sim_reset(&b.shm);
+    forwarder_init(&b.fwd, &b.shm, FWD_MODE_SPIN, sockfd, "127.0.0.1", ntohs(addr.sin_port));
+    b.fwd.on_send = on_send;
+    b.fwd.on_send_ctx = &b;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_create(&tc, NULL, consumer, &b);
+    pthread_create(&tp, NULL, producer, &b);
+    pthread_join(tp, NULL);
+    pthread_join(tc, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+    unsigned long int published = b.sim_stats.encoder_published + b.sim_stats.irig_published;
+    unsigned long int sent = b.fwd.encoder_sent + b.fwd.irig_sent;
+    unsigned long int lost = forwarder_encoder_lost(&b.fwd) + b.fwd.irig_ring.lost;
+    printf("ring slots:        %u encoder, %u IRIG\n", (unsigned int) COUNTER_RING_SLOTS, (unsigned int) IRIG_RING_SLOTS);
+    printf("packets published: %lu (%.0f/s)\n", published, published / elapsed);
+    printf("packets sent:      %lu in %lu wakeups (%.2f per wakeup)\n", sent, b.fwd.wakeups, (double) sent / b.fwd.wakeups);
+    //packets dropped after the last one the forwarder saw leave no gap, so lost can trail the producer's count
+    printf("overruns:          %lu counted by the producer, %lu sequence gaps seen by the consumer\n",
+           (unsigned long int) (b.fwd.counter_rings[0].ctrl->overruns + b.fwd.irig_ring.ctrl->overruns), lost);
+    printf("torn packets:      %lu\n", b.torn);
+
+    close(sockfd);
+    close(sink);
+
+    int ok = b.torn == 0 && lost <= b.sim_stats.overwritten && sent + b.sim_stats.overwritten == published;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    pru_shm_close(&b.shm, 1);
+    return ok ? 0 : 1;
+}
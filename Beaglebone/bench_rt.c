@@ -0,0 +1,178 @@
+//Benchmark of the forwarder's real-time mode against the simulated PRUs on a loaded machine
+//The forwarder runs in irq mode as a normal thread and then in real-time mode (rt.h), while two threads per CPU
+//spin and one maps, touches and unmaps memory all the time. The simulated PRUs run under SCHED_FIFO above the
+//forwarder in both cases, as the real ones run on their own cores whatever the ARM does. For each case it prints
+//the forwarder's latency histograms and the packets lost to ring overruns. Needs root, or CAP_SYS_NICE and
+//CAP_IPC_LOCK.
+//
+// Usage:
+// $ ./bench_rt [-r edges_per_second] [-t seconds_per_case] [-R priority] [-a cpu]
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "forwarder.h"
+#include "pru_sim.h"
+#include "rt.h"
+
+#define CHURN_BYTES (32 * 1024 * 1024) //mapped, touched and unmapped over and over by the load
+
+struct bench {
+    struct pru_shm shm;
+    struct forwarder fwd;
+    struct pru_sim_config sim;
+    struct pru_sim_stats sim_stats;
+    struct rt_config rt;
+    int producer_priority;
+    int rt_failed;
+    volatile int ready; //the forwarder is set up, as it is before the PRUs are started
+    volatile int done;
+};
+
+static void* producer(void* arg)
+{
+    struct bench* b = arg;
+    struct sched_param param = { .sched_priority = b->producer_priority };
+
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    pru_sim_run(&b->shm, &b->sim, &b->sim_stats);
+    return NULL;
+}
+
+static void* consumer(void* arg)
+{
+    struct bench* b = arg;
+
+    if (rt_setup(&b->rt) < 0) {
+        b->rt_failed = 1;
+    }
+    if (b->rt.lock_memory) {
+        rt_prefault(b->shm.base, PRU_SHM_SIZE, 0);
+    }
+    b->ready = 1;
+    forwarder_run(&b->fwd);
+    b->done = 1;
+    return NULL;
+}
+
+static void* spinner(void* arg)
+{
+    volatile int* done = arg;
+    while (!*done) {
+    }
+    return NULL;
+}
+
+//Keeps the kernel busy faulting pages in and freeing them
+static void* churner(void* arg)
+{
+    volatile int* done = arg;
+    long page = sysconf(_SC_PAGESIZE);
+
+    while (!*done) {
+        volatile uint8_t* p = mmap(NULL, CHURN_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            continue;
+        }
+        for (long k = 0; k < CHURN_BYTES; k += page) {
+            p[k] = 1;
+        }
+        munmap((void *) p, CHURN_BYTES);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    double rate = 2280 * 10, duration = 5;
+    int priority = 80, cpu = -1;
+    int cpus = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int n_spinners = 2 * cpus < 64 ? 2 * cpus : 64;
+    int failed = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:t:R:a:")) != -1) {
+        switch (opt) {
+        case 'r': rate = atof(optarg); break;
+        case 't': duration = atof(optarg); break;
+        case 'R': priority = atoi(optarg); break;
+        case 'a': cpu = atoi(optarg); break;
+        default:
+            printf("Usage: %s [-r edges_per_second] [-t seconds_per_case] [-R priority] [-a cpu]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (priority < 1 || priority > 98) {
+        printf("The priority has to leave room for the simulated PRUs above it, 1 to 98\n");
+        return 1;
+    }
+
+    //packets go to a bound but unread loopback socket as in bench_forwarder
+    int sink = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    bind(sink, (struct sockaddr *) &addr, sizeof(addr));
+    getsockname(sink, (struct sockaddr *) &addr, &len);
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    printf("%d CPUs, %.0f edges/s, %d spinning threads and one faulting pages in, forwarder in irq mode\n",
+           cpus, rate, n_spinners);
+    for (int realtime = 0; realtime <= 1; realtime++) {
+        struct bench* b = calloc(1, sizeof(*b));
+        pthread_t tp, tc, tm, spinners[64];
+
+        if (pru_shm_open(&b->shm, "/pb2_chwp_bench_rt", 1) < 0) {
+            return 1;
+        }
+        pru_sim_reset(&b->shm);
+        b->sim.edge_rate = rate;
+        b->sim.duration = duration;
+        b->producer_priority = priority + 1;
+        b->rt.cpu = realtime ? cpu : -1;
+        b->rt.priority = realtime ? priority : 0;
+        b->rt.lock_memory = realtime;
+        forwarder_init(&b->fwd, &b->shm, FWD_MODE_IRQ, sockfd, "127.0.0.1", ntohs(addr.sin_port));
+        forwarder_set_batching(&b->fwd, UDP_BATCH_MMSG, 0);
+
+        pthread_create(&tc, NULL, consumer, b);
+        while (!b->ready) {
+            usleep(1000);
+        }
+        for (int k = 0; k < n_spinners; k++) {
+            pthread_create(&spinners[k], NULL, spinner, (void *) &b->done);
+        }
+        pthread_create(&tm, NULL, churner, (void *) &b->done);
+        pthread_create(&tp, NULL, producer, b);
+        pthread_join(tp, NULL);
+        pthread_join(tc, NULL);
+        pthread_join(tm, NULL);
+        for (int k = 0; k < n_spinners; k++) {
+            pthread_join(spinners[k], NULL);
+        }
+        if (realtime) {
+            munlockall();
+        }
+
+        printf("\n%s: %lu encoder packets published, %lu lost to overruns, %lu wakeups\n",
+               realtime ? "real-time" : "normal", b->sim_stats.encoder_published, forwarder_encoder_lost(&b->fwd), b->fwd.wakeups);
+        if (b->rt_failed) {
+            printf("real-time mode could not be applied, run as root\n");
+            failed = 1;
+        }
+        forwarder_print_latency(&b->fwd, stdout);
+        if (b->fwd.encoder_sent == 0) {
+            failed = 1;
+        }
+        pru_shm_close(&b->shm, 1);
+        free(b);
+    }
+    close(sockfd);
+    close(sink);
+    return failed;
+}
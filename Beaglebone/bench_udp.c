@@ -0,0 +1,161 @@
+//Loopback benchmark of the UDP batching modes
+//Sends a stream of encoder packets with an IRIG packet every 15 of them, in bursts the size of the
+//encoder ring, and counts what a recvmmsg() receiver on the same host gets back after splitting
+//the datagrams with the framing rules in udp_batch.h.
+//
+// Usage:
+// $ ./bench_udp [-n packets] [-B burst] [-l latency_us]
+
+#define _GNU_SOURCE //recvmmsg
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pru_layout.h"
+#include "udp_batch.h"
+
+#define RECV_BATCH 64
+
+struct receiver {
+    int fd;
+    volatile int stop;
+    unsigned long int packets;
+    unsigned long int datagrams;
+    unsigned long int syscalls;
+    unsigned long int bad;
+};
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//Splits a datagram into packets the way a receiver does
+static void split(struct receiver* r, const uint8_t* data, size_t len)
+{
+    size_t pos = 0;
+    while (pos + 4 <= len) {
+        uint32_t header, size;
+        memcpy(&header, data + pos, 4);
+        if (header == ENCODER_HEADER) {
+            size = sizeof(struct CompleteDataPackets);
+        } else if (header == IRIG_HEADER) {
+            size = sizeof(struct IrigInfo);
+        } else if (header == ERROR_HEADER) {
+            size = sizeof(struct ErrorInfo);
+        } else if (pos + 8 <= len) {
+            memcpy(&size, data + pos + 4, 4);
+        } else {
+            size = 0;
+        }
+        if (size < 4 || pos + size > len) {
+            r->bad += 1;
+            return;
+        }
+        r->packets += 1;
+        pos += size;
+    }
+}
+
+static void* receive(void* arg)
+{
+    struct receiver* r = arg;
+    static uint8_t bufs[RECV_BATCH][65536];
+    struct mmsghdr msgs[RECV_BATCH];
+    struct iovec iov[RECV_BATCH];
+
+    for (int k = 0; k < RECV_BATCH; k++) {
+        iov[k].iov_base = bufs[k];
+        iov[k].iov_len = sizeof(bufs[k]);
+        memset(&msgs[k], 0, sizeof(msgs[k]));
+        msgs[k].msg_hdr.msg_iov = &iov[k];
+        msgs[k].msg_hdr.msg_iovlen = 1;
+    }
+    while (!r->stop) {
+        int n = recvmmsg(r->fd, msgs, RECV_BATCH, MSG_WAITFORONE, NULL);
+        r->syscalls += 1;
+        for (int k = 0; k < n; k++) {
+            r->datagrams += 1;
+            split(r, bufs[k], msgs[k].msg_len);
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    const char* names[] = { "single", "mmsg", "coalesce" };
+    unsigned long int n_packets = 200000;
+    int burst = COUNTER_RING_SLOTS;
+    long latency_us = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:B:l:")) != -1) {
+        switch (opt) {
+        case 'n': n_packets = strtoul(optarg, NULL, 10); break;
+        case 'B': burst = atoi(optarg); break;
+        case 'l': latency_us = atol(optarg); break;
+        default:
+            printf("Usage: %s [-n packets] [-B burst] [-l latency_us]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    static struct CompleteDataPackets encoder;
+    static struct IrigInfo irig;
+    static struct udp_batch batch;
+    encoder.counter_info_header = ENCODER_HEADER;
+    irig.random_header = IRIG_HEADER;
+
+    printf("%-9s %12s %12s %14s %12s %12s\n", "mode", "packets/s", "MB/s", "syscalls/pkt", "datagrams", "received");
+    for (int mode = UDP_BATCH_SINGLE; mode <= UDP_BATCH_COALESCE; mode++) {
+        struct receiver r;
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+        socklen_t len = sizeof(addr);
+        struct timeval tv = { .tv_sec = 0, .tv_usec = 200000 };
+        int rcvbuf = 8 << 20;
+        pthread_t tr;
+
+        memset(&r, 0, sizeof(r));
+        r.fd = socket(AF_INET, SOCK_DGRAM, 0);
+        setsockopt(r.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        setsockopt(r.fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        bind(r.fd, (struct sockaddr *) &addr, sizeof(addr));
+        getsockname(r.fd, (struct sockaddr *) &addr, &len);
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        pthread_create(&tr, NULL, receive, &r);
+
+        udp_batch_init(&batch, fd, &addr, mode, latency_us);
+        double t0 = now_s();
+        for (unsigned long int i = 0; i < n_packets; i++) {
+            if (i % 15 == 14) {
+                udp_batch_add(&batch, &irig, sizeof(irig));
+            } else {
+                udp_batch_add(&batch, &encoder, sizeof(encoder));
+            }
+            //the forwarder checks the latency budget once per wakeup, after draining the rings
+            if (i % burst == (unsigned long int) burst - 1 && udp_batch_due_in_us(&batch) == 0) {
+                udp_batch_flush(&batch);
+            }
+        }
+        udp_batch_flush(&batch);
+        double elapsed = now_s() - t0;
+
+        usleep(300000);
+        r.stop = 1;
+        pthread_join(tr, NULL);
+        printf("%-9s %12.0f %12.1f %14.3f %12lu %12lu\n", names[mode], n_packets / elapsed,
+               (n_packets / 15 * sizeof(irig) + (n_packets - n_packets / 15) * sizeof(encoder)) / elapsed / 1e6,
+               (double) batch.syscalls / n_packets, batch.datagrams, r.packets);
+        close(fd);
+        close(r.fd);
+    }
+    return 0;
+}
@@ -0,0 +1,392 @@
+//Encoder edge detection, the sampling loop of Encoder_Detection.c on PRU1
+//Header only so that the PRU program and the host benchmark (bench_pru_kernels.c) compile the same code
+//against pru_hw.h
+//
+//Each call to encoder_kernel_sample() is one pass of the sampling loop. R31 is read once. When the encoder bit
+//differs from the last sample, the IEP count is taken straight away, so none of the bookkeeping adds to the
+//latency of the timestamp. The state lives in a struct local to main(), so an optimizing build keeps it in
+//registers instead of the volatile ECAP struct the loop used to go through.
+//
+//In quadrature mode (encoder_kernel_run_quad()) the loop watches P8_27 as well and every transition of either
+//channel becomes an entry of the packet: its timestamp and QUAD_WORD(position, state) in encoder_cnt. The
+//position is stepped through encoder_quad_step[], indexed by the old and new state of the two channels, so a
+//reversal shows up as the position counting down. Four transitions per slit are twice the resolution of timing
+//both edges of P8_28 alone and four times that of counting slits.
+//
+//The packet size, the pins and the mode come from the config block the ARM writes (struct pru_config), so none of
+//them needs a new build. Each encoder channel has a struct encoder_kernel of its own, with its own ring and counts.
+//One channel runs the loops above, which only look at the config at packet boundaries. Several run
+//encoder_kernel_run_channels(), which reads R31 once per pass for all of them and times each edge on the channels
+//whose pin changed, finishing and starting packets as each one fills up.
+//
+//Telemetry (struct pru_telemetry) stays out of the passes that look for edges: the longest loop is timed once per
+//packet at the packet boundary, and the counters are stored in the pass of the first rising edge of a packet,
+//which already reads the quadrature pins and is still shorter than the boundary.
+
+#ifndef ENCODER_KERNEL_H
+#define ENCODER_KERNEL_H
+
+#include <stdint.h>
+
+#include "pru_hw.h"
+#include "pru_layout.h"
+
+#define ENCODER_PIN (1 << 10) //P8_28, the encoder signal of the default config
+#define QUAD_2_PIN (1 << 8) //P8_27, its quadrature partner
+#define QUAD_3_PIN (1 << 9) //P8_29
+#define QUAD_4_PIN (1 << 11) //P8_30
+#define MAX_LOOP_TIME 0x5FFFFFFF //~75% of max counter value
+#define PRU1_ARM_EVENT (32 | (20 - 16)) //strobe bit + system event 20 (PRU1_ARM_INTERRUPT), wakes the ARM forwarder
+
+struct encoder_kernel {
+    volatile uint32_t* on; //0 while the PRUs are sampling, set by the IRIG PRU when it is done
+    volatile uint32_t* counter_overflow; //updated by the IRIG PRU every time the counter overflows
+    volatile struct pru_ring_ctrl* ring; //ring of packets the ARM sends to the host, see pru_layout.h
+    volatile uint8_t* ring_slots;
+    volatile uint8_t* overrun_slot; //filled and dropped while the ring is full, shared by all channels
+    volatile uint8_t* slot; //slot holding the packet being filled
+    volatile uint32_t* entry; //clock_cnt of the next entry of that packet, counter_ovflow and encoder_cnt follow at stride
+    volatile uint32_t* quad_pins; //quadrature pins of that packet
+    volatile struct pru_telemetry* telemetry; //NULL on every channel but the first, the counters are channel 0's
+    uint32_t pins; //R31 bits this channel watches, the encoder pin and in quadrature mode its partner
+    uint32_t pin; //R31 bit of the encoder pin
+    uint32_t pin_shift; //bit numbers of the encoder pin and of its quadrature partner
+    uint32_t quad_shift;
+    uint32_t quad_pin; //R31 bit of the quadrature partner, 0 if the channel has none
+    uint32_t quad_3_pin; //QUAD_3_PIN and QUAD_4_PIN for channel 0, whose packets have always carried them, else 0
+    uint32_t quad_4_pin;
+    uint32_t packet_edges; //entries per packet, from the config
+    uint32_t stride; //words from one array of the packet to the next, packet_edges
+    uint32_t slot_size; //bytes per ring slot
+    uint32_t ring_size; //bytes of the whole ring
+    uint32_t slots;
+    uint32_t p_sample; //last sample of R31
+    uint32_t input_capture_count; //edges seen
+    uint32_t head; //copy of ring->head, which only this PRU writes, so the boundary does not have to load it
+    uint32_t offset; //byte offset of the ring slot at head, kept here so the PRU never has to multiply
+    uint32_t seq; //sequence number of the packet being filled, counts dropped packets too
+    uint32_t x; //edges in the packet being filled
+    uint32_t quad_needed; //the quadrature pins are still to be read for this packet
+    uint32_t last_ts; //IEP count of the last edge
+    uint32_t max_gap; //longest packet boundary so far in IEP counts
+    int32_t position; //quadrature mode, transitions forward minus transitions backward
+    uint32_t state; //quadrature mode, bit 0 the encoder pin and bit 1 its partner at the last sample
+};
+
+//Position step from the old to the new state of the two channels, indexed by old << 2 | new. Turning forward the
+//state goes 0, 1, 3, 2: the encoder pin rises while its partner is low. A change of both channels at once cannot
+//be placed and counts 0, the host sees it as a change of state without a step.
+static const int8_t encoder_quad_step[16] = {
+    0, 1, -1, 0,
+    -1, 0, 0, 1,
+    1, 0, 0, -1,
+    0, -1, 1, 0
+};
+
+//Bit number of a single bit mask, run once per channel at startup
+static inline uint32_t encoder_kernel_bit(uint32_t mask)
+{
+    uint32_t n = 0;
+
+    while (mask > 1) {
+        mask >>= 1;
+        n += 1;
+    }
+    return n;
+}
+
+//Sets up one channel's ring and counts as the layout has them
+static inline void encoder_kernel_init_channel(struct encoder_kernel* k, volatile uint8_t* shm, const struct pru_config* config,
+                                               const struct pru_shm_layout* layout, uint32_t channel, volatile uint8_t* overrun_slot)
+{
+    uint32_t header = config->quadrature ? ENCODER_QUAD_HEADER : ENCODER_HEADER;
+    uint32_t x;
+
+    k->on = PRU_SHM_PTR(shm, uint32_t, ON_OFFSET);
+    k->counter_overflow = PRU_SHM_PTR(shm, uint32_t, OVERFLOW_OFFSET);
+    k->ring = PRU_SHM_PTR(shm, struct pru_ring_ctrl, layout->ring_ctrl_offset[channel]);
+    k->ring_slots = shm + layout->ring_offset[channel];
+    k->overrun_slot = overrun_slot;
+    k->slot = overrun_slot;
+    k->telemetry = channel == 0 ? PRU_SHM_PTR(shm, struct pru_telemetry, TELEMETRY_OFFSET) : 0;
+    k->pin = config->pin_mask[channel];
+    k->pins = k->pin | (config->quadrature ? config->quad_mask[channel] : 0);
+    k->pin_shift = encoder_kernel_bit(k->pin);
+    k->quad_shift = encoder_kernel_bit(config->quad_mask[channel]);
+    k->quad_pin = config->quad_mask[channel];
+    k->quad_3_pin = channel == 0 ? QUAD_3_PIN : 0;
+    k->quad_4_pin = channel == 0 ? QUAD_4_PIN : 0;
+    k->packet_edges = layout->packet_edges;
+    k->stride = layout->packet_edges;
+    k->slot_size = layout->slot_size;
+    k->slots = layout->slots;
+    k->ring_size = layout->slots * layout->slot_size;
+    k->p_sample = 0; //so the first edge is recognized as a rising edge
+    k->input_capture_count = 0;
+    k->head = 0;
+    k->offset = 0;
+    k->seq = 0;
+    k->x = 0;
+    k->quad_needed = 1;
+    k->max_gap = 0;
+    k->position = 0;
+    k->state = 0;
+    k->ring->head = 0;
+    k->ring->overruns = 0;
+    k->ring->slots = layout->slots;
+    for (x = 0; x < layout->slots; x++) {
+        *PRU_SHM_PTR(k->ring_slots, uint32_t, x * layout->slot_size + 4) = header;
+    }
+    *PRU_SHM_PTR(overrun_slot, uint32_t, 4) = header;
+}
+
+//Starts the IEP counter and the rings of every channel in the config, k holds config->n_channels kernels
+//The ARM has zeroed the ring tails before starting the PRUs
+static inline void encoder_kernel_init(struct encoder_kernel* k, volatile uint8_t* shm, const struct pru_config* config,
+                                       volatile uint8_t* overrun_slot)
+{
+    struct pru_shm_layout layout;
+    uint32_t c;
+
+    PRU_IEP_START();
+    pru_layout_compute(config, &layout);
+    for (c = 0; c < layout.n_channels; c++) {
+        encoder_kernel_init_channel(&k[c], shm, config, &layout, c, overrun_slot);
+    }
+    k->telemetry->encoder_edges = 0;
+    k->telemetry->encoder_packets = 0;
+    k->telemetry->encoder_max_gap = 0;
+    *k->on = 0;
+    *k->counter_overflow = 0;
+    for (c = 0; c < layout.n_channels; c++) {
+        k[c].last_ts = PRU_IEP_COUNT(); //the first boundary is timed from here
+    }
+}
+
+//Switches to quadrature mode: starts counting from the state the two channels are in now, so the first transition
+//is a step of one
+static inline void encoder_kernel_init_quad(struct encoder_kernel* k)
+{
+    k->p_sample = PRU_R31();
+    k->state = (k->p_sample >> k->pin_shift & 1) | (k->p_sample >> k->quad_shift & 1) << 1;
+}
+
+//Picks the slot at head unless the ARM has not yet emptied it, in which case this packet will be dropped
+static inline void encoder_kernel_begin_packet(struct encoder_kernel* k)
+{
+    k->slot = (k->head - k->ring->tail < k->slots) ? k->ring_slots + k->offset : k->overrun_slot;
+    volatile uint32_t* packet = PRU_SHM_PTR(k->slot, uint32_t, 4); //behind the sequence number
+    k->entry = packet + ENCODER_PACKET_CLOCK_CNT(k->stride);
+    k->quad_pins = packet + ENCODER_PACKET_QUAD(k->stride);
+    k->x = 0;
+    k->quad_needed = 1;
+    PRU_COST(10, 1, 0);
+}
+
+//Times the packet boundary, from the last edge of a packet to sampling again once the next one is set up
+static inline void encoder_kernel_time_boundary(struct encoder_kernel* k)
+{
+    uint32_t gap = PRU_IEP_COUNT() - k->last_ts;
+    if (gap > k->max_gap) {
+        k->max_gap = gap;
+    }
+    PRU_COST(3, 0, 0);
+}
+
+//Stores the counters in the pass of the first rising edge of a packet, only the first channel has them
+static inline void encoder_kernel_store_telemetry(struct encoder_kernel* k)
+{
+    if (k->telemetry) {
+        k->telemetry->encoder_edges = k->input_capture_count;
+        k->telemetry->encoder_packets = k->seq;
+        k->telemetry->encoder_max_gap = k->max_gap;
+        PRU_COST(1, 0, 3);
+    }
+}
+
+//Writes an entry, the count last: the ARM may read the packet while it is being filled (forwarder.c, peek_phase())
+static inline void encoder_kernel_store(struct encoder_kernel* k, uint32_t ts, uint32_t count)
+{
+    volatile uint32_t* entry = k->entry;
+    entry[0] = ts;
+    //the overflow count lags the counter by up to an IRIG loop, a pending overflow flag on a small count
+    //means the count has already wrapped
+    entry[k->stride] = *k->counter_overflow + (ts < MAX_LOOP_TIME && PRU_IEP_OVERFLOWED());
+    entry[2 * k->stride] = count;
+    k->entry = entry + 1;
+    k->x += 1;
+    k->last_ts = ts;
+}
+
+//Records an edge of the encoder pin seen in sample at ts
+static inline void encoder_kernel_edge(struct encoder_kernel* k, uint32_t sample, uint32_t ts)
+{
+    k->input_capture_count += 1;
+    if ((sample & k->pin) && k->quad_needed) { //first rising edge of the packet
+        k->quad_pins[0] = (sample & k->quad_pin) >> k->quad_shift;
+        k->quad_pins[1] = (sample & k->quad_3_pin) >> 9;
+        k->quad_pins[2] = (sample & k->quad_4_pin) >> 11;
+        k->quad_needed = 0;
+        encoder_kernel_store_telemetry(k);
+        PRU_COST(7, 0, 3);
+    }
+    encoder_kernel_store(k, ts, k->input_capture_count);
+    PRU_COST(12, 1, 3);
+}
+
+//Records a transition of either quadrature channel seen in sample at ts
+static inline void encoder_kernel_transition(struct encoder_kernel* k, uint32_t sample, uint32_t ts)
+{
+    uint32_t state = (sample >> k->pin_shift & 1) | (sample >> k->quad_shift & 1) << 1;
+    k->position += encoder_quad_step[k->state << 2 | state];
+    k->state = state;
+    k->input_capture_count += 1;
+    if (k->quad_needed) { //first transition of the packet
+        k->quad_pins[0] = (sample & k->quad_pin) >> k->quad_shift;
+        k->quad_pins[1] = (sample & k->quad_3_pin) >> 9;
+        k->quad_pins[2] = (sample & k->quad_4_pin) >> 11;
+        k->quad_needed = 0;
+        encoder_kernel_store_telemetry(k);
+        PRU_COST(7, 0, 3);
+    }
+    encoder_kernel_store(k, ts, QUAD_WORD(k->position, state));
+    PRU_COST(23, 2, 3); //on top of the edge path: the state, the table lookup and the packed word
+}
+
+//One pass of the sampling loop
+static inline void encoder_kernel_sample(struct encoder_kernel* k)
+{
+    uint32_t sample = PRU_R31();
+    PRU_COST(4, 0, 0); //xor, bit test, loop test, jump
+    if ((sample ^ k->p_sample) & k->pin) {
+        uint32_t ts = PRU_IEP_COUNT();
+        k->p_sample = sample;
+        encoder_kernel_edge(k, sample, ts);
+    }
+}
+
+//One pass of the sampling loop in quadrature mode, the same as encoder_kernel_sample() with both channels watched
+static inline void encoder_kernel_sample_quad(struct encoder_kernel* k)
+{
+    uint32_t sample = PRU_R31();
+    PRU_COST(4, 0, 0); //xor, bit test, loop test, jump
+    if ((sample ^ k->p_sample) & k->pins) {
+        uint32_t ts = PRU_IEP_COUNT();
+        k->p_sample = sample;
+        encoder_kernel_transition(k, sample, ts);
+    }
+}
+
+//Stamps the sequence number and publishes the packet to the ARM
+static inline void encoder_kernel_end_packet(struct encoder_kernel* k)
+{
+    *(volatile uint32_t *) k->slot = k->seq;
+    k->seq += 1;
+    if (k->slot != k->overrun_slot) {
+        k->head += 1;
+        k->ring->head = k->head;
+        k->offset = (k->offset + k->slot_size == k->ring_size) ? 0 : k->offset + k->slot_size;
+        PRU_COST(7, 0, 2);
+        PRU_R31_EVENT(PRU1_ARM_EVENT); //interrupt so the ARM does not have to spin on the ring
+    }
+    else {
+        k->ring->overruns += 1; //ARM fell behind by a full ring, the gap in seq tells the host which packet is missing
+        PRU_COST(4, 1, 2);
+    }
+}
+
+//Samples until the IRIG PRU sets the on word, finishing the packet being filled
+static inline void encoder_kernel_run(struct encoder_kernel* k)
+{
+    while (*k->on == 0) {
+        PRU_COST(2, 1, 0);
+        encoder_kernel_begin_packet(k);
+        encoder_kernel_time_boundary(k);
+        while (k->x < k->packet_edges) {
+            encoder_kernel_sample(k);
+        }
+        encoder_kernel_end_packet(k);
+    }
+}
+
+//encoder_kernel_run() in quadrature mode
+static inline void encoder_kernel_run_quad(struct encoder_kernel* k)
+{
+    encoder_kernel_init_quad(k);
+    while (*k->on == 0) {
+        PRU_COST(2, 1, 0);
+        encoder_kernel_begin_packet(k);
+        encoder_kernel_time_boundary(k);
+        while (k->x < k->packet_edges) {
+            encoder_kernel_sample_quad(k);
+        }
+        encoder_kernel_end_packet(k);
+    }
+}
+
+//One pass of the sampling loop over n channels, returns 0 once a packet has been finished after the IRIG PRU set
+//the on word. pins is every pin of every channel and p_sample the last sample of R31.
+static inline int encoder_kernel_sample_channels(struct encoder_kernel* k, uint32_t n, uint32_t pins, uint32_t quadrature,
+                                                 uint32_t* p_sample)
+{
+    uint32_t sample = PRU_R31();
+    uint32_t changed = (sample ^ *p_sample) & pins;
+    uint32_t c;
+    PRU_COST(4, 0, 0); //xor, bit test, loop test, jump
+    if (changed) {
+        uint32_t ts = PRU_IEP_COUNT();
+        *p_sample = sample;
+        for (c = 0; c < n; c++) {
+            PRU_COST(3, 0, 0);
+            if (changed & k[c].pins) {
+                if (quadrature) {
+                    encoder_kernel_transition(&k[c], sample, ts);
+                } else {
+                    encoder_kernel_edge(&k[c], sample, ts);
+                }
+                //the boundary is only as long as one channel's, the other channels are sampled again straight after
+                if (k[c].x == k[c].packet_edges) {
+                    encoder_kernel_end_packet(&k[c]);
+                    PRU_COST(2, 1, 0);
+                    if (*k->on != 0) {
+                        return 0;
+                    }
+                    encoder_kernel_begin_packet(&k[c]);
+                    encoder_kernel_time_boundary(&k[c]);
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+//Samples n channels at once until the IRIG PRU sets the on word, stopping after the next packet any channel
+//finishes. The packets the other channels were filling then are never published.
+static inline void encoder_kernel_run_channels(struct encoder_kernel* k, uint32_t n, uint32_t quadrature)
+{
+    //as with one channel, in edge mode a pin that is high to begin with is a rising edge
+    uint32_t pins = 0, p_sample = quadrature ? PRU_R31() : 0, c;
+
+    for (c = 0; c < n; c++) {
+        pins |= k[c].pins;
+        k[c].state = (p_sample >> k[c].pin_shift & 1) | (p_sample >> k[c].quad_shift & 1) << 1;
+        encoder_kernel_begin_packet(&k[c]);
+        encoder_kernel_time_boundary(&k[c]);
+    }
+    while (encoder_kernel_sample_channels(k, n, pins, quadrature, &p_sample)) {
+    }
+}
+
+//Runs the loop the config asks for, k holds config->n_channels kernels set up by encoder_kernel_init()
+static inline void encoder_kernel_run_config(struct encoder_kernel* k, const struct pru_config* config)
+{
+    if (config->n_channels > 1) {
+        encoder_kernel_run_channels(k, config->n_channels, config->quadrature);
+    } else if (config->quadrature) {
+        encoder_kernel_run_quad(k);
+    } else {
+        encoder_kernel_run(k);
+    }
+}
+
+#endif
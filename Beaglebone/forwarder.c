@@ -0,0 +1,597 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "forwarder.h"
+#include "packet_v2.h"
+#include "pru_layout.h"
+
+#define LINGER_REPEAT_US 200000 //while lingering the last packet goes out again this often, so a receiver that lost
+                                //the packets before it still finds out
+#define RETRANSMIT_BURST 65536 //most bytes sent again at once, well within the default 208 kB socket buffer of
+                               //the receiver, so catching up on an outage does not overflow it
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//Counts a latency into its power of two bin and keeps the largest
+static void hist_add(uint32_t* hist, uint32_t* max_us, uint64_t us)
+{
+    int bin = 0;
+
+    while (bin < TELEMETRY_HIST_BINS - 1 && us >= (2ull << bin)) {
+        bin += 1;
+    }
+    hist[bin] += 1;
+    if (us > *max_us) {
+        *max_us = us > UINT32_MAX ? UINT32_MAX : (uint32_t) us;
+    }
+}
+
+//udp_batch hook, every packet of a send waited at most as long as the oldest one
+static void on_sent(void* ctx, uint64_t oldest_ns, uint64_t sent_ns, int packets)
+{
+    struct forwarder* fwd = ctx;
+    uint64_t us = (sent_ns - oldest_ns) / 1000;
+
+    for (int k = 0; k < packets; k++) {
+        hist_add(fwd->send_hist, &fwd->send_max_us, us);
+    }
+    //the batch sends packets in the order they were added, so the encoder packets that just went out are the oldest
+    fwd->batch_sent += packets;
+    while (fwd->ready_tail != fwd->ready_head && fwd->ready[fwd->ready_tail % FWD_READY_SLOTS].packet < fwd->batch_sent) {
+        uint64_t ready_ns = fwd->ready[fwd->ready_tail % FWD_READY_SLOTS].ready_ns;
+        hist_add(fwd->ready_hist, &fwd->ready_max_us, sent_ns > ready_ns ? (sent_ns - ready_ns) / 1000 : 0);
+        fwd->ready_tail += 1;
+    }
+}
+
+//Every packet goes through here so that the count matches what the batch reports as sent
+static void batch_add(struct forwarder* fwd, const volatile void* packet, size_t len)
+{
+    fwd->batch_added += 1;
+    udp_batch_add(&fwd->batch, packet, len);
+}
+
+void forwarder_init(struct forwarder* fwd, struct pru_shm* shm, enum fwd_mode mode, int sockfd, const char* ip, int port)
+{
+    memset(fwd, 0, sizeof(*fwd));
+    fwd->shm = shm;
+    fwd->mode = mode;
+    fwd->poll_min_us = 50;
+    fwd->poll_max_us = 2000; //well below the time the PRU needs to fill the encoder ring
+    fwd->wire_version = 1;
+
+    struct sockaddr_in servaddr;
+    memset(&servaddr, 0, sizeof(servaddr));
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_port = htons(port);
+    inet_pton(AF_INET, ip, &(servaddr.sin_addr.s_addr));
+    udp_batch_init(&fwd->batch, sockfd, &servaddr, UDP_BATCH_SINGLE, 0);
+    fwd->batch.on_sent = on_sent;
+    fwd->batch.on_sent_ctx = fwd;
+    fwd->stats_period_us = 1000000;
+    fwd->start_ns = now_ns();
+    fwd->next_stats_ns = fwd->start_ns + fwd->stats_period_us * 1000ull;
+    phase_tracker_init(&fwd->phase, PHASE_EDGES_PER_REV, PHASE_WINDOW, 0);
+    fwd->phase_partial = 1;
+
+    pru_config_read(shm->base, &fwd->config);
+    pru_layout_compute(&fwd->config, &fwd->layout);
+    for (uint32_t c = 0; c < fwd->layout.n_channels; c++) {
+        pru_ring_reader_init(&fwd->counter_rings[c], shm->base, fwd->layout.ring_ctrl_offset[c], fwd->layout.ring_offset[c],
+                             fwd->layout.slot_size, fwd->layout.slots);
+    }
+    pru_ring_reader_init(&fwd->irig_ring, shm->base, IRIG_RING_CTRL_OFFSET, IRIG_RING_OFFSET, sizeof(struct IrigSlot), IRIG_RING_SLOTS);
+}
+
+int forwarder_enable_replay(struct forwarder* fwd, size_t bytes, long rate, double linger_s)
+{
+    if (replay_buffer_init(&fwd->replay, bytes) < 0) {
+        return -1;
+    }
+    fwd->retransmit_rate = rate;
+    fwd->linger_s = linger_s;
+    fwd->budget_ns = now_ns();
+    return 0;
+}
+
+void forwarder_enable_phase(struct forwarder* fwd, const char* ip, int port, long period_us)
+{
+    memset(&fwd->phase_dest, 0, sizeof(fwd->phase_dest));
+    fwd->phase_dest.sin_family = AF_INET;
+    fwd->phase_dest.sin_port = htons(port);
+    inet_pton(AF_INET, ip, &(fwd->phase_dest.sin_addr.s_addr));
+    fwd->phase_period_us = period_us;
+    fwd->next_phase_ns = now_ns();
+}
+
+void forwarder_free(struct forwarder* fwd)
+{
+    replay_buffer_free(&fwd->replay);
+}
+
+//Hands a packet to the batch, numbered and kept for retransmission when replay is on
+static void send_packet(struct forwarder* fwd, const volatile void* packet, size_t len)
+{
+    size_t wrapped_len;
+    const uint8_t* wrapped = fwd->replay.data != NULL ? replay_buffer_add(&fwd->replay, packet, len, &wrapped_len) : NULL;
+
+    if (wrapped != NULL) {
+        batch_add(fwd, wrapped, wrapped_len);
+    } else {
+        batch_add(fwd, packet, len);
+    }
+}
+
+void forwarder_set_batching(struct forwarder* fwd, enum udp_batch_mode mode, long latency_us)
+{
+    udp_batch_flush(&fwd->batch);
+    fwd->batch.mode = mode;
+    fwd->batch.latency_us = latency_us;
+}
+
+//Feeds the phase tracker the edges of an encoder packet of n entries from entry from on
+static void track_packet(struct forwarder* fwd, const volatile uint32_t* packet, uint32_t n, uint32_t from)
+{
+    int quad = packet[0] == ENCODER_QUAD_HEADER;
+
+    if (quad != fwd->phase.quad) {
+        phase_tracker_init(&fwd->phase, fwd->phase.edges_per_rev, fwd->phase.window, quad);
+    }
+    for (uint32_t x = from; x < n; x++) {
+        phase_tracker_add(&fwd->phase, packet[ENCODER_PACKET_ENCODER_CNT(n) + x],
+                          (uint64_t) packet[ENCODER_PACKET_COUNTER_OVFLOW(n) + x] << 32 | packet[ENCODER_PACKET_CLOCK_CNT(n) + x]);
+    }
+}
+
+//Hands every packet waiting in a ring to the UDP batch, then gives all of their slots back at once
+//channel is that of an encoder ring, the phase output follows channel 0
+static int drain(struct forwarder* fwd, struct pru_ring_reader* ring, int type, uint32_t channel, size_t packet_size)
+{
+    uint32_t n = pru_ring_available(ring);
+    uint32_t edges = fwd->layout.packet_edges;
+    uint32_t iep = 0;
+    //one IEP read per wakeup, packets found together were all noticed at the same time
+    int timed = n && type == FWD_ENCODER && pru_shm_iep_count(fwd->shm, &iep) == 0;
+    uint64_t found_ns = timed ? now_ns() : 0;
+
+    for (uint32_t k = 0; k < n; k++) {
+        volatile uint8_t* slot = pru_ring_slot(ring, k);
+        uint32_t seq = pru_ring_check_seq(ring, slot);
+        volatile uint8_t* packet = slot + sizeof(uint32_t); //packet follows the sequence number
+        const volatile uint32_t* words = (const volatile uint32_t *) packet;
+        if (timed) {
+            //the counter wraps every 21 s, a packet stamped ahead of the read is one the ring was still filling
+            int32_t ticks = (int32_t) (iep - words[ENCODER_PACKET_CLOCK_CNT(edges) + edges - 1]);
+            if (ticks >= 0) {
+                hist_add(fwd->notice_hist, &fwd->notice_max_us, (uint64_t) (ticks / (PRU_SHM_IEP_HZ / 1e6)));
+                //the packet added next is this one, timed until on_sent() sees it go
+                if (fwd->ready_head - fwd->ready_tail < FWD_READY_SLOTS) {
+                    struct fwd_ready* r = &fwd->ready[fwd->ready_head++ % FWD_READY_SLOTS];
+                    r->packet = fwd->batch_added;
+                    r->ready_ns = found_ns - (uint64_t) (ticks * (1e9 / PRU_SHM_IEP_HZ));
+                }
+            }
+        }
+        //quadrature packets, other sizes and other channels have no v1 form on the wire
+        if (type == FWD_ENCODER && (fwd->wire_version == 2 || words[0] == ENCODER_QUAD_HEADER ||
+                                    edges != ENCODER_COUNTER_SIZE || channel != 0)) {
+            uint8_t v2[PACKET_V2_MAX_SIZE(ENCODER_COUNTER_SIZE)];
+            send_packet(fwd, v2, packet_v2_encode_slot(words, edges, channel, seq, v2));
+        } else {
+            send_packet(fwd, packet, packet_size);
+        }
+        if (fwd->on_send) {
+            fwd->on_send(fwd->on_send_ctx, type, seq, packet);
+        }
+        //the first packet may be the one the edges were read from while it was being filled
+        if (type == FWD_ENCODER && channel == 0 && fwd->phase_period_us > 0) {
+            track_packet(fwd, words, edges, k == 0 ? fwd->phase_peeked : 0);
+        }
+    }
+    if (n) {
+        pru_ring_release(ring, n);
+        if (type == FWD_ENCODER && channel == 0) {
+            fwd->phase_peeked = 0;
+        }
+    }
+    return n;
+}
+
+//Copies the ARM counters into the shared memory block so that anything mapping it sees them between stats packets
+static void publish_telemetry(struct forwarder* fwd)
+{
+    volatile struct pru_telemetry* t = PRU_SHM_PTR(fwd->shm->base, struct pru_telemetry, TELEMETRY_OFFSET);
+
+    t->arm_encoder_sent = fwd->encoder_sent;
+    t->arm_irig_sent = fwd->irig_sent;
+    t->arm_error_sent = fwd->error_sent;
+    t->arm_encoder_lost = forwarder_encoder_lost(fwd);
+    t->arm_irig_lost = fwd->irig_ring.lost;
+    t->arm_datagrams = fwd->batch.datagrams;
+    t->arm_send_errors = fwd->batch.send_errors;
+    t->arm_wakeups = fwd->wakeups;
+    t->arm_notice_max_us = fwd->notice_max_us;
+    t->arm_send_max_us = fwd->send_max_us;
+    t->arm_nacks = fwd->nacks;
+    t->arm_retransmitted = fwd->retransmitted;
+    t->arm_replay_expired = fwd->expired;
+    for (int k = 0; k < TELEMETRY_HIST_BINS; k++) {
+        t->arm_notice_hist[k] = fwd->notice_hist[k];
+        t->arm_send_hist[k] = fwd->send_hist[k];
+    }
+}
+
+unsigned long int forwarder_encoder_lost(const struct forwarder* fwd)
+{
+    unsigned long int lost = 0;
+
+    for (uint32_t c = 0; c < fwd->layout.n_channels; c++) {
+        lost += fwd->counter_rings[c].lost;
+    }
+    return lost;
+}
+
+void forwarder_send_layout(struct forwarder* fwd)
+{
+    struct LayoutPacket layout;
+
+    memset(&layout, 0, sizeof(layout));
+    layout.header = LAYOUT_HEADER;
+    layout.size = sizeof(layout);
+    layout.wire_version = fwd->wire_version;
+    layout.config = fwd->config;
+    layout.layout = fwd->layout;
+    send_packet(fwd, &layout, sizeof(layout));
+    fwd->layout_sent += 1;
+}
+
+void forwarder_send_stats(struct forwarder* fwd)
+{
+    struct StatsPacket stats;
+    uint64_t now = now_ns();
+
+    //a receiver that started late learns the layout at the latest with the first stats packet it sees
+    forwarder_send_layout(fwd);
+    publish_telemetry(fwd);
+    stats.header = STATS_HEADER;
+    stats.size = sizeof(stats);
+    stats.seq = fwd->stats_seq++;
+    stats.uptime_ms = (now - fwd->start_ns) / 1000000;
+    stats.encoder_overruns = 0;
+    for (uint32_t c = 0; c < fwd->layout.n_channels; c++) {
+        stats.encoder_overruns += fwd->counter_rings[c].ctrl->overruns;
+    }
+    stats.irig_overruns = fwd->irig_ring.ctrl->overruns;
+    memcpy(&stats.telemetry, (const void *) PRU_SHM_PTR(fwd->shm->base, struct pru_telemetry, TELEMETRY_OFFSET), sizeof(stats.telemetry));
+    send_packet(fwd, &stats, sizeof(stats));
+    fwd->next_stats_ns = now + fwd->stats_period_us * 1000ull;
+}
+
+//Feeds the phase tracker the entries the PRU has written so far into the packet it is filling
+static void peek_phase(struct forwarder* fwd)
+{
+    struct pru_ring_reader* ring = &fwd->counter_rings[0];
+    uint32_t n = fwd->layout.packet_edges;
+
+    //only with the ring empty is the oldest unread slot the one being filled, and it has to follow the newest edge
+    if (fwd->phase.quad || fwd->phase.edges == 0 || pru_ring_available(ring) != 0) {
+        return;
+    }
+    const volatile uint32_t* packet = (const volatile uint32_t *) (pru_ring_slot(ring, 0) + sizeof(uint32_t));
+    uint32_t x = fwd->phase_peeked;
+    while (x < n && packet[ENCODER_PACKET_ENCODER_CNT(n) + x] == phase_tracker_next_count(&fwd->phase)) {
+        __sync_synchronize(); //the PRU writes the count of an entry last, its timestamp is read only after it
+        phase_tracker_add(&fwd->phase, packet[ENCODER_PACKET_ENCODER_CNT(n) + x],
+                          (uint64_t) packet[ENCODER_PACKET_COUNTER_OVFLOW(n) + x] << 32 | packet[ENCODER_PACKET_CLOCK_CNT(n) + x]);
+        fwd->phase.partial = 1;
+        x += 1;
+    }
+    fwd->phase_peeked = x;
+}
+
+//Sends the phase and frequency of the newest edge straight away, ahead of anything batched
+static void send_phase(struct forwarder* fwd, uint64_t now)
+{
+    struct PhasePacket p;
+    uint32_t iep = 0;
+    int timed;
+
+    if (fwd->phase_partial) {
+        peek_phase(fwd);
+    }
+    timed = pru_shm_iep_count(fwd->shm, &iep) == 0;
+    phase_tracker_fill(&fwd->phase, &p, iep);
+    if (!timed) {
+        p.age_us = 0;
+    }
+    p.seq = fwd->phase_sent++;
+    if (sendto(fwd->batch.sockfd, &p, sizeof(p), MSG_DONTWAIT, (const struct sockaddr *) &fwd->phase_dest, sizeof(fwd->phase_dest)) < 0) {
+        fwd->batch.send_errors += 1;
+    }
+    //keeps to the period, but a late wakeup is not made up for with a burst
+    fwd->next_phase_ns += fwd->phase_period_us * 1000ull;
+    if (fwd->next_phase_ns <= now) {
+        fwd->next_phase_ns = now + fwd->phase_period_us * 1000ull;
+    }
+}
+
+//Queues the ranges of every NACK waiting on the socket
+static void receive_nacks(struct forwarder* fwd)
+{
+    struct nack_packet nack;
+    ssize_t len;
+
+    while ((len = recv(fwd->batch.sockfd, &nack, sizeof(nack), MSG_DONTWAIT)) >= 0 || errno == EINTR) {
+        //anything else arriving on the socket is not ours to answer
+        if (len < 12 || nack.header != NACK_HEADER || nack.n_ranges > NACK_MAX_RANGES ||
+            (size_t) len < 12 + nack.n_ranges * sizeof(struct nack_range)) {
+            continue;
+        }
+        fwd->nacks += 1;
+        for (uint32_t k = 0; k < nack.n_ranges; k++) {
+            if (fwd->n_nacked == FWD_NACKED_RANGES) {
+                fwd->nack_overflows += nack.n_ranges - k;
+                break;
+            }
+            if (nack.ranges[k].count > 0) {
+                fwd->nacked[fwd->n_nacked++] = nack.ranges[k];
+            }
+        }
+    }
+}
+
+//Sends the oldest requested packets again, as many as the budget allows after the live packets
+static void retransmit(struct forwarder* fwd)
+{
+    uint64_t now = now_ns();
+
+    fwd->retransmit_budget += (now - fwd->budget_ns) * 1e-9 * fwd->retransmit_rate;
+    if (fwd->retransmit_budget > RETRANSMIT_BURST) {
+        fwd->retransmit_budget = RETRANSMIT_BURST;
+    }
+    fwd->budget_ns = now;
+
+    while (fwd->n_nacked > 0) {
+        struct nack_range* range = &fwd->nacked[0];
+        size_t len;
+        const uint8_t* wrapped = replay_buffer_get(&fwd->replay, range->first, &len);
+        uint32_t skip = 1;
+        if (wrapped == NULL) {
+            //gone from the ring, or never sent: a whole stretch of them is skipped at once
+            int32_t behind = (int32_t) (fwd->replay.first - range->first);
+            skip = behind > 0 && (uint32_t) behind < range->count ? (uint32_t) behind : range->count;
+            fwd->expired += skip;
+        } else {
+            if (fwd->retransmit_budget < len) {
+                break;
+            }
+            batch_add(fwd, wrapped, len);
+            fwd->retransmit_budget -= len;
+            fwd->retransmitted += 1;
+        }
+        range->first += skip;
+        range->count -= skip;
+        if (range->count == 0) {
+            fwd->n_nacked -= 1;
+            memmove(fwd->nacked, fwd->nacked + 1, fwd->n_nacked * sizeof(fwd->nacked[0]));
+        }
+    }
+}
+
+int forwarder_service(struct forwarder* fwd)
+{
+    volatile uint32_t* error_identifier = PRU_SHM_PTR(fwd->shm->base, uint32_t, ERROR_IDENTIFIER_OFFSET);
+    int sent_encoder = 0, sent_irig;
+
+    fwd->wakeups += 1;
+    for (uint32_t c = 0; c < fwd->layout.n_channels; c++) {
+        sent_encoder += drain(fwd, &fwd->counter_rings[c], FWD_ENCODER, c, sizeof(struct CompleteDataPackets));
+    }
+    sent_irig = drain(fwd, &fwd->irig_ring, FWD_IRIG, 0, sizeof(struct IrigInfo));
+    fwd->encoder_sent += sent_encoder;
+    fwd->irig_sent += sent_irig;
+    if (fwd->phase_period_us > 0) {
+        uint64_t now = now_ns();
+        if (now >= fwd->next_phase_ns) {
+            send_phase(fwd, now);
+        }
+    }
+    //the PRUs do not raise errors yet, but the packet goes out as soon as one does
+    if (*error_identifier != 0) {
+        volatile struct ErrorInfo* error_state = PRU_SHM_PTR(fwd->shm->base, struct ErrorInfo, ERROR_OFFSET);
+        send_packet(fwd, error_state, sizeof(*error_state));
+        *error_identifier = 0;
+        fwd->error_sent += 1;
+        if (fwd->on_send) {
+            fwd->on_send(fwd->on_send_ctx, FWD_ERROR, fwd->error_sent - 1, error_state);
+        }
+    }
+    if (fwd->stats_period_us > 0 && now_ns() >= fwd->next_stats_ns) {
+        forwarder_send_stats(fwd);
+    }
+    //retransmissions only ever go out behind the live packets of the same wakeup
+    if (fwd->replay.data != NULL) {
+        receive_nacks(fwd);
+        retransmit(fwd);
+    }
+    if (udp_batch_due_in_us(&fwd->batch) == 0) {
+        udp_batch_flush(&fwd->batch);
+    }
+    return sent_encoder + sent_irig;
+}
+
+static void sleep_us(long us)
+{
+    struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+//Microseconds until the batch or the next phase packet is due, -1 if neither is
+static long due_in_us(struct forwarder* fwd)
+{
+    long due_us = udp_batch_due_in_us(&fwd->batch);
+
+    if (fwd->phase_period_us > 0) {
+        uint64_t now = now_ns();
+        long phase_us = fwd->next_phase_ns > now ? (long) ((fwd->next_phase_ns - now + 999) / 1000) : 0;
+        if (due_us < 0 || phase_us < due_us) {
+            due_us = phase_us;
+        }
+    }
+    return due_us;
+}
+
+void forwarder_stop(struct forwarder* fwd)
+{
+    *PRU_SHM_PTR(fwd->shm->base, uint32_t, PRU_CONTROL_OFFSET) = PRU_CONTROL_STOP;
+    fwd->stopping = 1;
+}
+
+void forwarder_run(struct forwarder* fwd)
+{
+    volatile uint32_t* on = PRU_SHM_PTR(fwd->shm->base, uint32_t, ON_OFFSET);
+    long backoff_us = fwd->poll_min_us;
+    long due_us;
+    uint64_t start_ns = now_ns();
+    uint64_t stop_ns = fwd->run_s > 0 ? start_ns + (uint64_t) (fwd->run_s * 1e9) : UINT64_MAX;
+
+    fwd->next_stats_ns = start_ns + fwd->stats_period_us * 1000ull;
+    fwd->next_phase_ns = start_ns;
+    forwarder_send_layout(fwd); //ahead of any encoder packet, so the receiver knows their size and channels
+
+    //continuously loops while PRUs are still executing code and checks if data structures are ready to be written to UDP
+    //A stop is noticed within a poll timeout in the sleeping modes, and the PRUs finish what they were publishing
+    while(*on != 1) {
+        if (!fwd->stopping && ((fwd->stop_requested != NULL && *fwd->stop_requested) ||
+                               (stop_ns != UINT64_MAX && now_ns() >= stop_ns))) {
+            forwarder_stop(fwd);
+        }
+        int sent = forwarder_service(fwd);
+        switch (fwd->mode) {
+        case FWD_MODE_SPIN:
+            break;
+        case FWD_MODE_POLL:
+            //sleeps a little longer every time nothing was ready, and starts over once packets flow again
+            if (sent) {
+                backoff_us = fwd->poll_min_us;
+            } else {
+                //never sleeps past the moment a batched or phase packet is due to go out
+                due_us = due_in_us(fwd);
+                sleep_us(due_us >= 0 && due_us < backoff_us ? due_us : backoff_us);
+                backoff_us = backoff_us * 2 > fwd->poll_max_us ? fwd->poll_max_us : backoff_us * 2;
+            }
+            break;
+        case FWD_MODE_IRQ:
+            //the rings are checked again on timeout, so an interrupt raised between servicing and waiting is never fatal
+            if (!sent) {
+                due_us = due_in_us(fwd);
+                pru_shm_wait_event(fwd->shm, due_us >= 0 && due_us < fwd->poll_max_us ? due_us : fwd->poll_max_us);
+            }
+            break;
+        }
+    }
+    forwarder_service(fwd); //packets published right before the PRUs stopped
+    if (fwd->stats_period_us > 0) {
+        forwarder_send_stats(fwd); //final counts, so the receiver can tell whether anything went missing
+    }
+    udp_batch_flush(&fwd->batch);
+
+    //the receiver may still be missing the last packets of the run
+    if (fwd->replay.data != NULL && fwd->linger_s > 0) {
+        uint64_t end_ns = now_ns() + (uint64_t) (fwd->linger_s * 1e9);
+        uint64_t repeat_ns = 0;
+        for (uint64_t now = now_ns(); now < end_ns; now = now_ns()) {
+            size_t len;
+            const uint8_t* last = replay_buffer_get(&fwd->replay, fwd->replay.next - 1, &len);
+            if (now >= repeat_ns && last != NULL) {
+                batch_add(fwd, last, len);
+                repeat_ns = now + LINGER_REPEAT_US * 1000ull;
+            }
+            receive_nacks(fwd);
+            retransmit(fwd);
+            udp_batch_flush(&fwd->batch);
+            sleep_us(fwd->poll_min_us);
+        }
+    }
+}
+
+//Bin that at least fraction of the counts fall in or below, -1 for an empty histogram
+static int hist_percentile(const uint32_t* hist, double fraction)
+{
+    uint64_t total = 0, seen = 0;
+
+    for (int k = 0; k < TELEMETRY_HIST_BINS; k++) {
+        total += hist[k];
+    }
+    for (int k = 0; k < TELEMETRY_HIST_BINS && total; k++) {
+        seen += hist[k];
+        if (seen >= fraction * total) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+void forwarder_print_latency(const struct forwarder* fwd, FILE* f)
+{
+    const uint32_t* hists[3] = { fwd->notice_hist, fwd->send_hist, fwd->ready_hist };
+    const uint32_t max_us[3] = { fwd->notice_max_us, fwd->send_max_us, fwd->ready_max_us };
+    const double fractions[3] = { 0.5, 0.99, 0.999 };
+    const char* names[3] = { "p50", "p99", "p99.9" };
+    int first = TELEMETRY_HIST_BINS, last = -1;
+
+    for (int k = 0; k < TELEMETRY_HIST_BINS; k++) {
+        if (hists[0][k] || hists[1][k] || hists[2][k]) {
+            first = k < first ? k : first;
+            last = k;
+        }
+    }
+    fprintf(f, "%-16s %12s %12s %12s\n", "latency_us", "ready-found", "found-sent", "ready-sent");
+    for (int k = first; k <= last; k++) {
+        char range[32];
+        if (k == TELEMETRY_HIST_BINS - 1) {
+            snprintf(range, sizeof(range), "[%lu, inf)", k ? 1ul << k : 0);
+        } else {
+            snprintf(range, sizeof(range), "[%lu, %lu)", k ? 1ul << k : 0, 2ul << k);
+        }
+        fprintf(f, "%-16s %12u %12u %12u\n", range, hists[0][k], hists[1][k], hists[2][k]);
+    }
+    for (int p = 0; p < 3; p++) {
+        fprintf(f, "%-16s", names[p]);
+        for (int h = 0; h < 3; h++) {
+            int bin = hist_percentile(hists[h], fractions[p]);
+            char bound[32] = "-";
+            if (bin == TELEMETRY_HIST_BINS - 1) {
+                snprintf(bound, sizeof(bound), ">= %lu", 1ul << bin);
+            } else if (bin >= 0) {
+                snprintf(bound, sizeof(bound), "< %lu", 2ul << bin);
+            }
+            fprintf(f, " %12s", bound);
+        }
+        fprintf(f, "\n");
+    }
+    fprintf(f, "%-16s %12u %12u %12u\n", "max", max_us[0], max_us[1], max_us[2]);
+}
+
+int forwarder_parse_mode(const char* name)
+{
+    if (strcmp(name, "spin") == 0) {
+        return FWD_MODE_SPIN;
+    }
+    if (strcmp(name, "poll") == 0) {
+        return FWD_MODE_POLL;
+    }
+    if (strcmp(name, "irq") == 0) {
+        return FWD_MODE_IRQ;
+    }
+    return -1;
+}
@@ -0,0 +1,144 @@
+//Loop that forwards packets published by the PRUs in shared memory to the host computer over UDP
+
+#ifndef FORWARDER_H
+#define FORWARDER_H
+
+#include <netinet/in.h>
+#include <stdio.h>
+
+#include "phase_tracker.h"
+#include "pru_layout.h"
+#include "pru_ring.h"
+#include "pru_shm.h"
+#include "replay_buffer.h"
+#include "udp_batch.h"
+
+//How the ARM finds out that a PRU has finished a packet
+enum fwd_mode {
+    FWD_MODE_SPIN, //busy-polls the ring heads, lowest latency but keeps one core at 100%
+    FWD_MODE_POLL, //polls with an adaptive sleep that backs off while the PRUs are idle
+    FWD_MODE_IRQ   //blocks on the PRU->ARM interrupt, with a poll timeout in case an event is missed
+};
+
+//Packet types passed to the send hook
+#define FWD_ENCODER 0
+#define FWD_IRIG 1
+#define FWD_ERROR 2
+
+#define FWD_NACKED_RANGES 256 //missing ranges waiting to be sent again, later ones are dropped until there is room
+#define FWD_READY_SLOTS 2048 //encoder packets in the batch whose ready time is kept, more than a full batch holds
+
+//Encoder packet waiting in the batch: its number among the packets added to the batch and when it was ready
+struct fwd_ready {
+    uint64_t packet;
+    uint64_t ready_ns; //CLOCK_MONOTONIC time of its last edge
+};
+
+struct forwarder {
+    struct pru_shm* shm;
+    enum fwd_mode mode;
+    struct udp_batch batch; //packets waiting to go out, one sendto() per packet unless batching is enabled
+    int wire_version; //1 sends encoder packets as they are in shared memory, 2 delta encodes them (packet_v2.h),
+                      //quadrature packets, other packet sizes and channels after the first are delta encoded either way
+    struct pru_config config; //what the encoder PRU samples, read from shared memory by forwarder_init()
+    struct pru_shm_layout layout; //where its rings are for that config
+    struct pru_ring_reader counter_rings[PRU_MAX_CHANNELS]; //encoder packets from PRU1, a ring per channel
+    struct pru_ring_reader irig_ring; //IRIG packets from PRU0
+    long poll_min_us; //first sleep once the PRUs go idle in FWD_MODE_POLL
+    long poll_max_us; //longest sleep in FWD_MODE_POLL and interrupt timeout in FWD_MODE_IRQ, shortened when a batch is due
+    unsigned long int encoder_sent; //number of encoder packets handed to the batch
+    unsigned long int irig_sent; //number of IRIG packets handed to the batch
+    unsigned long int error_sent; //number of error packets handed to the batch
+    unsigned long int layout_sent; //number of layout packets handed to the batch
+    //packets lost to ring overruns are counted in counter_rings[].lost, forwarder_encoder_lost(), and irig_ring.lost
+    unsigned long int wakeups; //number of times the loop woke up to check the rings
+    //telemetry, mirrored into the shared memory block next to the PRU counters and sent in a stats packet
+    long stats_period_us; //time between stats packets, 0 sends none
+    uint64_t start_ns; //CLOCK_MONOTONIC time of forwarder_init
+    uint64_t next_stats_ns;
+    uint32_t stats_seq; //stats packets sent
+    uint32_t notice_max_us; //longest from the last edge of an encoder packet to drain() finding it, in IEP time
+    uint32_t notice_hist[TELEMETRY_HIST_BINS];
+    uint32_t send_max_us; //longest from a packet being added to the batch to its datagram being sent
+    uint32_t send_hist[TELEMETRY_HIST_BINS];
+    uint32_t ready_max_us; //longest from the last edge of an encoder packet to its datagram being sent, the two above
+    uint32_t ready_hist[TELEMETRY_HIST_BINS]; //together. Printed by forwarder_print_latency(), never sent.
+    struct fwd_ready ready[FWD_READY_SLOTS]; //encoder packets added to the batch and not sent yet, oldest first
+    uint32_t ready_head, ready_tail;
+    uint64_t batch_added; //packets handed to the batch
+    uint64_t batch_sent; //of which the batch has sent
+    //the PRUs sample until the ARM tells them to stop, through PRU_CONTROL_OFFSET
+    double run_s; //stops them this long after forwarder_run() starts, 0 for no limit
+    volatile int* stop_requested; //optional, stops them once it is non-zero, set from a signal handler
+    int stopping; //PRU_CONTROL_STOP has been written
+    //replay (replay_buffer.h), on once forwarder_enable_replay() has allocated the ring
+    struct replay_buffer replay;
+    long retransmit_rate; //bytes per second retransmissions may add to the live stream
+    double linger_s; //how long forwarder_run() goes on answering NACKs once the PRUs have stopped
+    struct nack_range nacked[FWD_NACKED_RANGES]; //packets asked for and not sent again yet, oldest request first
+    int n_nacked;
+    double retransmit_budget; //bytes that may be sent again now, refilled at retransmit_rate
+    uint64_t budget_ns; //time the budget was last refilled
+    unsigned long int nacks; //NACK packets received
+    unsigned long int retransmitted; //packets sent again
+    unsigned long int expired; //packets asked for that had already left the ring
+    unsigned long int nack_overflows; //ranges dropped because FWD_NACKED_RANGES were waiting
+    //phase output (phase_tracker.h), on once forwarder_enable_phase() has set a period
+    struct phase_tracker phase;
+    long phase_period_us; //time between phase packets, 0 sends none
+    int phase_partial; //also reads edges from the packet the PRU is still filling, in edge mode
+    struct sockaddr_in phase_dest;
+    uint64_t next_phase_ns;
+    uint32_t phase_peeked; //entries of the oldest unread slot already fed to the tracker while it was being filled
+    uint32_t phase_sent; //phase packets sent
+    //optional hook called after each packet is handed to the batch, used by the benchmarks to time forwarding,
+    //encoder packets of every channel included
+    void (*on_send)(void* ctx, int type, uint32_t seq, const volatile void* packet);
+    void* on_send_ctx;
+};
+
+//Fills in defaults and the destination address, sockfd must already be open
+//The packet size and channels come from the config block in shared memory (pru_layout.h), which has to be written
+//before, or the default one is assumed
+//Packets are sent with one sendto() each until forwarder_set_batching() is called
+void forwarder_init(struct forwarder* fwd, struct pru_shm* shm, enum fwd_mode mode, int sockfd, const char* ip, int port);
+
+//Selects how packets are batched and how long the oldest one may wait (0 flushes after every wakeup)
+void forwarder_set_batching(struct forwarder* fwd, enum udp_batch_mode mode, long latency_us);
+
+//Keeps everything sent from now on in a replay ring of bytes and answers NACKs from the receiver with it
+//rate limits retransmissions to that many bytes per second, linger_s keeps answering after the PRUs stop
+//Returns 0 on success, -1 with errno set if the ring could not be allocated
+int forwarder_enable_replay(struct forwarder* fwd, size_t bytes, long rate, double linger_s);
+
+//Sends a PhasePacket to ip:port every period_us from now on, with edges read from unfinished packets
+void forwarder_enable_phase(struct forwarder* fwd, const char* ip, int port, long period_us);
+
+//Sends every packet that is currently ready and returns how many were sent
+int forwarder_service(struct forwarder* fwd);
+
+//Sends a stats packet with the PRU and ARM telemetry now, whatever the period, behind a layout packet
+void forwarder_send_stats(struct forwarder* fwd);
+
+//Sends a LayoutPacket with the config and the wire format, which forwarder_run() does first thing
+void forwarder_send_layout(struct forwarder* fwd);
+
+//Encoder packets lost to ring overruns over all channels
+unsigned long int forwarder_encoder_lost(const struct forwarder* fwd);
+
+//Tells the PRUs to stop, forwarder_run() returns once they have and the rings are drained
+void forwarder_stop(struct forwarder* fwd);
+
+//Forwards packets until the IRIG PRU sets the on variable, which it does once it has been told to stop
+void forwarder_run(struct forwarder* fwd);
+
+//Frees the replay ring
+void forwarder_free(struct forwarder* fwd);
+
+//Prints the notice, send and ready to sent latency histograms, to compare configurations at the end of a run
+void forwarder_print_latency(const struct forwarder* fwd, FILE* f);
+
+//Parses "spin", "poll" or "irq", returns -1 if the name is unknown
+int forwarder_parse_mode(const char* name);
+
+#endif
@@ -0,0 +1,249 @@
+//IRIG-B decoding, the sampling loop of IRIG_Detection.c on PRU0
+//Header only so that the PRU program and the host benchmark (bench_pru_kernels.c) compile the same code
+//against pru_hw.h
+//
+//Each call to irig_kernel_sample() is one pass of the sampling loop: the IEP overflow flag is folded into the
+//overflow count shared with the encoder PRU, and R31 is checked for an edge on the IRIG pin. Pulse widths
+//between a rising and a falling edge give the bit type, two position identifiers in a row mark the start of a
+//frame, and every finished frame is published to the ring with its rising edge and the rising edges of its ten
+//position identifiers.
+//
+//Telemetry (struct pru_telemetry) is updated only after a falling edge has been handled, the IRIG bits are
+//milliseconds long so the extra IEP read there costs nothing that matters.
+
+#ifndef IRIG_KERNEL_H
+#define IRIG_KERNEL_H
+
+#include <stdint.h>
+
+#include "pru_hw.h"
+#include "pru_layout.h"
+
+#define IRIG_PIN (1 << 14) //P8_16
+#define PRU0_ARM_EVENT (32 | (19 - 16)) //strobe bit + system event 19 (PRU0_ARM_INTERRUPT), wakes the ARM forwarder
+
+#define IRIG_0 0 //2 ms
+#define IRIG_1 1 //5 ms
+#define IRIG_PI 2  //8 ms
+#define IRIG_ERR 3 //Error
+
+#define ERR_NONE 0
+#define ERR_DESYNC 1
+
+struct irig_kernel {
+    volatile uint32_t* on; //0 if PRUs are still sampling, 1 if they are done
+    volatile uint32_t* control; //PRU_CONTROL_STOP once the ARM wants the PRUs to stop
+    volatile uint32_t* error_identifier; //identifies if error struct is ready to be sent over UDP
+    volatile uint32_t* counter_overflow; //counts the IEP counter overflows for both PRUs
+    volatile struct ErrorInfo* error_state;
+    volatile struct pru_ring_ctrl* ring; //ring of IRIG packets the ARM sends to the host, see pru_layout.h
+    volatile struct IrigSlot* ring_slots;
+    volatile struct IrigSlot* overrun_slot; //filled and dropped while the ring is full
+    volatile struct IrigSlot* slot; //slot the current frame is written to
+    volatile struct pru_telemetry* telemetry;
+    uint32_t p_sample; //last sample of R31
+    uint64_t rising_edge_t; //last rising edge accounting for overflows
+    uint32_t short_rising_edge_t; //same without the overflows, as stored in the packet
+    uint32_t rising_edge_overflow; //overflows at the last rising edge
+    unsigned char prev_bit_type; //by default, assume bit type is an error
+    unsigned char synched; //by default, assume IRIG parser is not synched
+    unsigned char bit_position; //bit position '0' marks the beginning of an IRIG frame
+    uint32_t index; //index of the ring slot at head, kept here so the PRU never has to divide
+    uint32_t seq; //sequence number of the frame being filled, counts dropped frames too
+    uint32_t frames; //frames finished
+    uint32_t max_gap; //longest pass so far in IEP counts, from a falling edge to sampling again
+    uint32_t control_word; //last value read from control, after every IRIG bit and every IEP overflow
+};
+
+//Returns the slot the next IRIG frame is written to, overrun_slot if the ARM has not emptied the one at head
+static inline volatile struct IrigSlot* irig_kernel_next_slot(struct irig_kernel* k)
+{
+    PRU_COST(5, 2, 0);
+    return (k->ring->head - k->ring->tail < IRIG_RING_SLOTS) ? &k->ring_slots[k->index] : k->overrun_slot;
+}
+
+//Starts the IEP counter and the ring, the ARM has zeroed the ring tail before starting the PRUs
+static inline void irig_kernel_init(struct irig_kernel* k, volatile uint8_t* shm, volatile struct IrigSlot* overrun_slot)
+{
+    uint32_t x;
+
+    PRU_IEP_START();
+    k->on = PRU_SHM_PTR(shm, uint32_t, ON_OFFSET);
+    k->control = PRU_SHM_PTR(shm, uint32_t, PRU_CONTROL_OFFSET);
+    k->error_identifier = PRU_SHM_PTR(shm, uint32_t, ERROR_IDENTIFIER_OFFSET);
+    k->counter_overflow = PRU_SHM_PTR(shm, uint32_t, OVERFLOW_OFFSET);
+    k->error_state = PRU_SHM_PTR(shm, struct ErrorInfo, ERROR_OFFSET);
+    k->ring = PRU_SHM_PTR(shm, struct pru_ring_ctrl, IRIG_RING_CTRL_OFFSET);
+    k->ring_slots = PRU_SHM_PTR(shm, struct IrigSlot, IRIG_RING_OFFSET);
+    k->overrun_slot = overrun_slot;
+    k->telemetry = PRU_SHM_PTR(shm, struct pru_telemetry, TELEMETRY_OFFSET);
+    k->p_sample = 0;
+    k->rising_edge_t = 0;
+    k->short_rising_edge_t = 0;
+    k->rising_edge_overflow = 0;
+    k->prev_bit_type = IRIG_ERR;
+    k->synched = 0;
+    k->bit_position = 0;
+    k->index = 0;
+    k->seq = 0;
+    k->frames = 0;
+    k->max_gap = 0;
+    k->control_word = PRU_CONTROL_RUN;
+    k->telemetry->irig_frames = 0;
+    k->telemetry->irig_desyncs = 0;
+    k->telemetry->irig_bad_pulses = 0;
+    k->telemetry->irig_max_gap = 0;
+
+    *k->error_identifier = 0; //initial state is that no error struct is ready to be sent
+    *k->counter_overflow = 0;
+    *k->on = 0; //*on = 0 means PRUs are taking data
+    k->error_state->header = ERROR_HEADER;
+    k->error_state->err_code = ERR_NONE;
+    k->ring->head = 0;
+    k->ring->overruns = 0;
+    k->ring->slots = IRIG_RING_SLOTS;
+    for (x = 0; x < IRIG_RING_SLOTS; x++) {
+        k->ring_slots[x].packet.random_header = IRIG_HEADER;
+    }
+    overrun_slot->packet.random_header = IRIG_HEADER;
+    k->slot = irig_kernel_next_slot(k);
+}
+
+//Publishes the finished frame to the ARM
+static inline void irig_kernel_publish(struct irig_kernel* k)
+{
+    k->slot->seq = k->seq;
+    k->seq += 1;
+    if (k->slot != k->overrun_slot) {
+        k->ring->head += 1;
+        k->index = (k->index + 1 == IRIG_RING_SLOTS) ? 0 : k->index + 1;
+        PRU_COST(6, 1, 2);
+        PRU_R31_EVENT(PRU0_ARM_EVENT); //interrupt so the ARM does not have to spin on the ring
+    }
+    else {
+        k->ring->overruns += 1;
+        PRU_COST(4, 1, 2);
+    }
+    k->frames += 1;
+    k->telemetry->irig_frames = k->frames;
+    PRU_COST(0, 0, 1);
+}
+
+//Handles the bit that ended with a falling edge
+static inline void irig_kernel_bit(struct irig_kernel* k, unsigned char irig_bit_type)
+{
+    volatile struct IrigInfo* irig_packet = &k->slot->packet;
+
+    if (k->synched) {
+        if (k->bit_position == 100) { //this falling edge ends the reference bit of the next frame
+            irig_kernel_publish(k);
+            k->slot = irig_kernel_next_slot(k); //switches which packet is being written to
+            k->slot->packet.rising_edge_time = k->short_rising_edge_t;
+            k->slot->packet.init_overflow = k->rising_edge_overflow;
+            k->bit_position = 1;
+            PRU_COST(3, 0, 2);
+        }
+        else if (k->bit_position % 10 == 9) { //every 9th bit should be synch pulse
+            unsigned char ind = k->bit_position / 10;
+            if (irig_bit_type != IRIG_PI) {
+                k->synched = 0; //the partial frame is never published
+                k->error_state->err_code = ERR_DESYNC;
+                *k->error_identifier = 1;
+                k->telemetry->irig_desyncs += 1;
+                PRU_COST(3, 1, 3);
+            }
+            irig_packet->re_count[ind] = k->short_rising_edge_t;
+            irig_packet->re_count_overflow[ind] = k->rising_edge_overflow;
+            k->bit_position += 1;
+            PRU_COST(8, 0, 2);
+        }
+        else {
+            unsigned char offset = k->bit_position % 10;
+            //sets the bit of 'info' to either a 1 or 0 depending on bit type
+            irig_packet->info[k->bit_position / 10] = (irig_packet->info[k->bit_position / 10] & ~(1 << offset)) | (irig_bit_type << offset);
+            k->bit_position += 1;
+            PRU_COST(10, 1, 1);
+        }
+    }
+    else if (irig_bit_type == IRIG_PI && k->prev_bit_type == IRIG_PI) { //2 synch pulses in a row means a new frame is starting
+        k->bit_position = 1;
+        k->synched = 1;
+        k->slot = irig_kernel_next_slot(k); //the ring may have drained while we were out of sync
+        k->slot->packet.rising_edge_time = k->short_rising_edge_t;
+        k->slot->packet.init_overflow = k->rising_edge_overflow;
+        PRU_COST(4, 0, 2);
+    }
+    k->prev_bit_type = irig_bit_type;
+}
+
+//One pass of the sampling loop
+static inline void irig_kernel_sample(struct irig_kernel* k)
+{
+    //folds a counter overflow into the overflow count and resets the bit by writing a 1
+    if (PRU_IEP_OVERFLOWED()) {
+        *k->counter_overflow += 1;
+        PRU_IEP_CLEAR_OVERFLOW();
+        k->control_word = *k->control; //so a stop is seen within 21 s even without an IRIG signal
+        PRU_COST(2, 2, 1);
+    }
+
+    uint32_t sample = PRU_R31();
+    PRU_COST(5, 0, 0); //overflow test, xor, bit test, loop test, jump
+    if ((sample ^ k->p_sample) & IRIG_PIN) {
+        uint32_t ts = PRU_IEP_COUNT(); //grabs clock value first
+        k->p_sample = sample;
+        //checks again for an overflow that has occurred since the last check
+        uint32_t overflow = *k->counter_overflow + PRU_IEP_OVERFLOWED();
+        PRU_COST(4, 1, 0);
+        if ((sample & IRIG_PIN) == 0) {
+            uint64_t delta = ts + ((uint64_t) overflow << 32) - k->rising_edge_t;
+            unsigned char irig_bit_type;
+            if (delta < 700000) {
+                irig_bit_type = IRIG_0;
+            }
+            else if (delta > 2457600) {
+                irig_bit_type = IRIG_ERR;
+                k->telemetry->irig_bad_pulses += 1;
+                PRU_COST(1, 1, 1);
+            }
+            else if (delta > 1300000) {
+                irig_bit_type = IRIG_PI;
+            }
+            else {
+                irig_bit_type = IRIG_1;
+            }
+            PRU_COST(12, 0, 0);
+            irig_kernel_bit(k, irig_bit_type);
+            k->control_word = *k->control;
+            uint32_t gap = PRU_IEP_COUNT() - ts;
+            if (gap > k->max_gap) {
+                k->max_gap = gap;
+                k->telemetry->irig_max_gap = gap;
+                PRU_COST(1, 0, 1);
+            }
+            PRU_COST(3, 1, 0);
+        }
+        else {
+            k->rising_edge_t = ts + ((uint64_t) overflow << 32);
+            k->short_rising_edge_t = ts; //only clock count not accounting for overflow is stored in irig struct
+            k->rising_edge_overflow = overflow;
+            PRU_COST(4, 0, 0);
+        }
+    }
+}
+
+//Samples until the ARM writes PRU_CONTROL_STOP or, if frames is not 0, the given number of frames have been
+//published, then tells the ARM and the encoder PRU to stop. The PRU program runs with frames 0, so acquisition
+//is unbounded. The control word is read after every IRIG bit, where there is time to spare, so the PRU stops
+//within 10 ms of the ARM asking, and after every IEP overflow in case there is no IRIG signal. The frame being
+//read when it stops is never published.
+static inline void irig_kernel_run(struct irig_kernel* k, uint32_t frames)
+{
+    while (k->control_word == PRU_CONTROL_RUN && (frames == 0 || k->frames < frames)) {
+        irig_kernel_sample(k);
+    }
+    *k->on = 1;
+    PRU_R31_EVENT(PRU0_ARM_EVENT); //wakes the forwarder so it sees *on without waiting for its poll timeout
+}
+
+#endif
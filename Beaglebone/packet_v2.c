@@ -0,0 +1,180 @@
+#include <string.h>
+
+#include "packet_v2.h"
+
+static inline uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v)
+{
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+static inline uint8_t* put_varint(uint8_t* out, uint64_t v)
+{
+    while (v >= 0x80) {
+        *out++ = (uint8_t) (v | 0x80);
+        v >>= 7;
+    }
+    *out++ = (uint8_t) v;
+    return out;
+}
+
+//Returns NULL if the varint runs past end or is longer than 10 bytes
+static inline const uint8_t* get_varint(const uint8_t* in, const uint8_t* end, uint64_t* v)
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 70 && in < end; shift += 7) {
+        uint8_t b = *in++;
+        result |= (uint64_t) (b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return in;
+        }
+    }
+    return NULL;
+}
+
+static uint8_t* encode_edges(const volatile uint32_t* clock_cnt, const volatile uint32_t* counter_ovflow,
+                             const volatile uint32_t* encoder_cnt, uint32_t n_edges, uint64_t prev_clk, uint8_t* p)
+{
+    uint32_t prev_edge = encoder_cnt[0];
+
+    for (uint32_t x = 1; x < n_edges; x++) {
+        uint64_t clk = (uint64_t) counter_ovflow[x] << 32 | clock_cnt[x];
+        uint32_t edge = encoder_cnt[x];
+        int64_t dclk = (int64_t) (clk - prev_clk);
+        if (edge - prev_edge != 1 || dclk == 0) {
+            *p++ = 0;
+            p = put_varint(p, zigzag((int32_t) (edge - prev_edge)));
+        }
+        p = put_varint(p, zigzag(dclk));
+        prev_clk = clk;
+        prev_edge = edge;
+    }
+    return p;
+}
+
+//Next state of the two quadrature channels turning forward and backward, see encoder_quad_step[]
+static const uint8_t quad_forward[4] = { 1, 3, 0, 2 };
+static const uint8_t quad_backward[4] = { 2, 0, 3, 1 };
+
+static uint8_t* encode_quad(const volatile uint32_t* clock_cnt, const volatile uint32_t* counter_ovflow,
+                            const volatile uint32_t* encoder_cnt, uint32_t n_edges, uint64_t prev_clk, uint8_t* p)
+{
+    uint32_t prev = encoder_cnt[0];
+
+    for (uint32_t x = 1; x < n_edges; x++) {
+        uint64_t clk = (uint64_t) counter_ovflow[x] << 32 | clock_cnt[x];
+        uint32_t word = encoder_cnt[x];
+        uint32_t step = PACKET_V2_QUAD_ESCAPE;
+        if (word == QUAD_WORD(QUAD_POSITION(prev) + 1, quad_forward[QUAD_STATE(prev)])) {
+            step = PACKET_V2_QUAD_FORWARD;
+        } else if (word == QUAD_WORD(QUAD_POSITION(prev) - 1, quad_backward[QUAD_STATE(prev)])) {
+            step = PACKET_V2_QUAD_BACKWARD;
+        } else if (word == (prev ^ 3)) {
+            step = PACKET_V2_QUAD_BOTH;
+        }
+        p = put_varint(p, zigzag((int64_t) (clk - prev_clk)) << 2 | step);
+        if (step == PACKET_V2_QUAD_ESCAPE) {
+            p = put_varint(p, word);
+        }
+        prev_clk = clk;
+        prev = word;
+    }
+    return p;
+}
+
+size_t packet_v2_encode(const volatile struct CompleteDataPackets* packet, uint32_t seq, uint8_t* out)
+{
+    return packet_v2_encode_slot((const volatile uint32_t *) packet, ENCODER_COUNTER_SIZE, 0, seq, out);
+}
+
+size_t packet_v2_encode_slot(const volatile uint32_t* packet, uint32_t n_edges, uint32_t channel, uint32_t seq, uint8_t* out)
+{
+    const volatile uint32_t* clock_cnt = packet + ENCODER_PACKET_CLOCK_CNT(n_edges);
+    const volatile uint32_t* counter_ovflow = packet + ENCODER_PACKET_COUNTER_OVFLOW(n_edges);
+    const volatile uint32_t* encoder_cnt = packet + ENCODER_PACKET_ENCODER_CNT(n_edges);
+    const volatile uint32_t* quad = packet + ENCODER_PACKET_QUAD(n_edges);
+    struct packet_v2_header hdr;
+    uint8_t* p = out + sizeof(hdr);
+
+    hdr.header = ENCODER_V2_HEADER;
+    hdr.seq = seq;
+    hdr.first_edge = encoder_cnt[0];
+    hdr.base_clock = clock_cnt[0];
+    hdr.base_overflow = counter_ovflow[0];
+    hdr.n_edges = n_edges;
+    hdr.quad = (uint8_t) ((quad[0] & 1) | (quad[1] & 1) << 1 | (quad[2] & 1) << 2);
+    hdr.flags = (uint8_t) ((packet[0] == ENCODER_QUAD_HEADER ? PACKET_V2_FLAG_QUAD : 0) | channel << PACKET_V2_CHANNEL_SHIFT);
+
+    uint64_t base_clk = (uint64_t) hdr.base_overflow << 32 | hdr.base_clock;
+    p = (hdr.flags & PACKET_V2_FLAG_QUAD) ? encode_quad(clock_cnt, counter_ovflow, encoder_cnt, n_edges, base_clk, p)
+                                          : encode_edges(clock_cnt, counter_ovflow, encoder_cnt, n_edges, base_clk, p);
+    while ((p - out) & 3) {
+        *p++ = 0;
+    }
+    hdr.size = (uint32_t) (p - out);
+    memcpy(out, &hdr, sizeof(hdr));
+    return hdr.size;
+}
+
+int packet_v2_decode(const uint8_t* in, size_t len, struct packet_v2_header* hdr,
+                     uint32_t* clock_cnt, uint32_t* counter_ovflow, uint32_t* encoder_cnt, size_t max_edges)
+{
+    if (len < sizeof(*hdr)) {
+        return -1;
+    }
+    memcpy(hdr, in, sizeof(*hdr));
+    if (hdr->header != ENCODER_V2_HEADER || hdr->size > len || hdr->size < sizeof(*hdr) ||
+        hdr->n_edges == 0 || hdr->n_edges > max_edges) {
+        return -1;
+    }
+
+    const uint8_t* p = in + sizeof(*hdr);
+    const uint8_t* end = in + hdr->size;
+    uint64_t clk = (uint64_t) hdr->base_overflow << 32 | hdr->base_clock;
+    uint32_t edge = hdr->first_edge;
+    uint64_t v;
+
+    clock_cnt[0] = hdr->base_clock;
+    counter_ovflow[0] = hdr->base_overflow;
+    encoder_cnt[0] = edge;
+    for (int x = 1; x < hdr->n_edges; x++) {
+        if ((p = get_varint(p, end, &v)) == NULL) {
+            return -1;
+        }
+        if (hdr->flags & PACKET_V2_FLAG_QUAD) {
+            uint64_t word;
+            if ((v & 3) == PACKET_V2_QUAD_FORWARD) {
+                edge = QUAD_WORD(QUAD_POSITION(edge) + 1, quad_forward[QUAD_STATE(edge)]);
+            } else if ((v & 3) == PACKET_V2_QUAD_BACKWARD) {
+                edge = QUAD_WORD(QUAD_POSITION(edge) - 1, quad_backward[QUAD_STATE(edge)]);
+            } else if ((v & 3) == PACKET_V2_QUAD_BOTH) {
+                edge ^= 3;
+            } else if ((p = get_varint(p, end, &word)) != NULL) {
+                edge = (uint32_t) word;
+            } else {
+                return -1;
+            }
+            v >>= 2;
+        } else if (v == 0) {
+            if ((p = get_varint(p, end, &v)) == NULL) {
+                return -1;
+            }
+            edge += (uint32_t) unzigzag(v);
+            if ((p = get_varint(p, end, &v)) == NULL) {
+                return -1;
+            }
+        } else {
+            edge += 1;
+        }
+        clk += (uint64_t) unzigzag(v);
+        clock_cnt[x] = (uint32_t) clk;
+        counter_ovflow[x] = (uint32_t) (clk >> 32);
+        encoder_cnt[x] = edge;
+    }
+    return hdr->n_edges;
+}
@@ -0,0 +1,73 @@
+//Compact delta encoded encoder packet (wire protocol v2)
+//
+//A v1 packet (0x1EAF, struct CompleteDataPackets) sends clock_cnt, counter_ovflow and encoder_cnt as
+//full 32-bit words for every edge. A v2 packet sends the first edge in full and every later edge as
+//the difference from the one before it:
+//
+//  struct packet_v2_header  (28 bytes, size is the total packet size as required by udp_batch.h)
+//  n_edges - 1 edge records, each either
+//      varint(zigzag(dclk))                          when the edge index went up by exactly 1
+//      0, varint(zigzag(dedge)), varint(zigzag(dclk)) otherwise (escape code for gaps and repeats)
+//  zero padding up to a multiple of 4 bytes
+//
+//dclk is the difference of the 64-bit clocks (counter_ovflow << 32 | clock_cnt) and dedge that of
+//encoder_cnt. Varints are little endian base 128, zigzag maps signed to unsigned so that the
+//occasional backwards step from the MAX_LOOP_TIME overflow race still round trips exactly.
+//At 2 Hz a delta takes 3 bytes instead of 12.
+//
+//Quadrature packets (slot header ENCODER_QUAD_HEADER, see encoder_kernel.h) set PACKET_V2_FLAG_QUAD, carry the
+//QUAD_WORD of the first transition in first_edge and encode every later transition as
+//      varint(zigzag(dclk) << 2 | step)
+//where step is PACKET_V2_QUAD_FORWARD or _BACKWARD for a position step of one with the state following it,
+//_BOTH when both channels changed and the position did not, and _ESCAPE for anything else, which is followed
+//by varint(QUAD_WORD) in full. A reversal costs nothing extra, so a transition still takes 3 bytes at 2 Hz.
+
+#ifndef PACKET_V2_H
+#define PACKET_V2_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pru_layout.h"
+
+#define ENCODER_V2_HEADER 0x2eaf
+
+//Quadrature pins are packed into quad as bit 0 = encoder_value_2, bit 1 = encoder_value_3, bit 2 = encoder_value_4
+struct packet_v2_header {
+    uint32_t header; //ENCODER_V2_HEADER
+    uint32_t size; //bytes in the whole packet, padding included
+    uint32_t seq; //sequence number of the ring slot the edges came from
+    uint32_t first_edge; //encoder_cnt of the first edge
+    uint32_t base_clock; //clock_cnt of the first edge
+    uint32_t base_overflow; //counter_ovflow of the first edge
+    uint16_t n_edges;
+    uint8_t quad;
+    uint8_t flags; //PACKET_V2_FLAG_ bits and the channel, 0 for a packet of encoder edges from channel 0
+};
+
+#define PACKET_V2_FLAG_QUAD 0x01 //entries are quadrature transitions and encoder_cnt holds QUAD_WORDs
+#define PACKET_V2_CHANNEL_SHIFT 4 //the upper 4 bits of flags hold the encoder channel (struct pru_config)
+#define PACKET_V2_CHANNEL(flags) ((flags) >> PACKET_V2_CHANNEL_SHIFT)
+
+#define PACKET_V2_QUAD_FORWARD 0
+#define PACKET_V2_QUAD_BACKWARD 1
+#define PACKET_V2_QUAD_BOTH 2
+#define PACKET_V2_QUAD_ESCAPE 3
+
+//Worst case: every edge escaped with two 10 byte varints
+#define PACKET_V2_MAX_SIZE(n_edges) (sizeof(struct packet_v2_header) + (n_edges) * 21 + 3)
+
+//Encodes a v1 packet, or a quadrature packet if its header is ENCODER_QUAD_HEADER, out must hold PACKET_V2_MAX_SIZE(ENCODER_COUNTER_SIZE) bytes
+//Returns the size of the v2 packet
+size_t packet_v2_encode(const volatile struct CompleteDataPackets* packet, uint32_t seq, uint8_t* out);
+
+//The same for a packet of n_edges entries from an encoder channel, laid out as in a ring slot (ENCODER_PACKET_ in
+//pru_layout.h), out must hold PACKET_V2_MAX_SIZE(n_edges) bytes
+size_t packet_v2_encode_slot(const volatile uint32_t* packet, uint32_t n_edges, uint32_t channel, uint32_t seq, uint8_t* out);
+
+//Decodes a v2 packet back into the v1 fields, the arrays must hold max_edges entries
+//Returns the number of edges, or -1 if the packet is malformed or holds more than max_edges
+int packet_v2_decode(const uint8_t* in, size_t len, struct packet_v2_header* hdr,
+                     uint32_t* clock_cnt, uint32_t* counter_ovflow, uint32_t* encoder_cnt, size_t max_edges);
+
+#endif
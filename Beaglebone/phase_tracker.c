@@ -0,0 +1,76 @@
+#include <math.h>
+#include <string.h>
+
+#include "phase_tracker.h"
+#include "pru_layout.h"
+#include "pru_shm.h"
+
+void phase_tracker_init(struct phase_tracker* t, uint32_t edges_per_rev, uint32_t window, int quad)
+{
+    memset(t, 0, sizeof(*t));
+    t->edges_per_rev = edges_per_rev;
+    t->window = window;
+    t->quad = quad;
+}
+
+void phase_tracker_add(struct phase_tracker* t, uint32_t encoder_cnt, uint64_t clock)
+{
+    t->partial = 0; //the forwarder sets it again for edges of an unfinished packet
+    int32_t position = t->quad ? QUAD_POSITION(encoder_cnt) : (int32_t) encoder_cnt;
+    int32_t step = (int32_t) ((uint32_t) position - (uint32_t) t->position); //wraps with encoder_cnt
+
+    int reverse = t->quad && (step == 1 || step == -1); //a quadrature position may count either way
+
+    t->edges += 1;
+    if (t->n == 1 && (step == 1 || reverse)) {
+        t->step = step; //the second edge sets the direction
+    } else if (t->n > 0 && step != t->step) {
+        //a lost packet, or the HWP turning back, which is no gap: what came before no longer measures the rotation
+        t->gaps += !reverse;
+        t->n = 0;
+    }
+    if (t->n == 0) {
+        t->step = 1;
+    }
+    t->times[t->n % PHASE_HISTORY] = clock;
+    t->n += 1;
+    t->position = position;
+}
+
+//Hz over the last span counts, 0 until the history holds them
+static float frequency(const struct phase_tracker* t, uint32_t span)
+{
+    if (t->n <= span) {
+        return 0;
+    }
+    uint64_t dt = t->times[(t->n - 1) % PHASE_HISTORY] - t->times[(t->n - 1 - span) % PHASE_HISTORY];
+    uint32_t per_rev = t->quad ? 2 * t->edges_per_rev : t->edges_per_rev;
+    return dt ? (float) (t->step * PRU_SHM_IEP_HZ * span / per_rev / dt) : 0;
+}
+
+void phase_tracker_fill(const struct phase_tracker* t, struct PhasePacket* p, uint32_t iep)
+{
+    uint32_t per_rev = t->quad ? 2 * t->edges_per_rev : t->edges_per_rev;
+    uint32_t span = t->quad ? 2 * t->window : t->window;
+    uint64_t clock = t->n ? t->times[(t->n - 1) % PHASE_HISTORY] : 0;
+    int32_t slit = t->position % (int32_t) per_rev;
+
+    memset(p, 0, sizeof(*p));
+    p->header = PHASE_HEADER;
+    p->size = sizeof(*p);
+    p->gaps = t->gaps;
+    if (t->edges == 0) {
+        return;
+    }
+    p->flags = PHASE_VALID | (t->quad ? PHASE_QUAD : 0) | (t->partial ? PHASE_PARTIAL : 0) |
+               (t->n > per_rev ? PHASE_FREQUENCY : 0) | (t->n > span ? PHASE_WINDOW_FREQUENCY : 0);
+    p->position = t->position;
+    p->clock_cnt = (uint32_t) clock;
+    p->counter_ovflow = (uint32_t) (clock >> 32);
+    //the counter wraps every 21 s, an edge stamped ahead of iep was read after it
+    int32_t ticks = (int32_t) (iep - p->clock_cnt);
+    p->age_us = ticks > 0 ? (uint32_t) (ticks / (PRU_SHM_IEP_HZ / 1e6)) : 0;
+    p->phase = (float) ((slit < 0 ? slit + (int32_t) per_rev : slit) * (2 * M_PI / per_rev));
+    p->frequency = frequency(t, per_rev);
+    p->frequency_window = frequency(t, span);
+}
@@ -0,0 +1,81 @@
+//Phase and frequency of the HWP from the newest encoder edges, sent to the rotation motor controller at a fixed rate
+//
+//The forwarder feeds the tracker every edge of every encoder packet it takes from the ring. The ring only holds
+//finished packets, and at 2 Hz a packet of 150 edges is 33 ms of rotation, so in edge mode the forwarder also
+//reads the packet the PRU is still filling: the PRU writes encoder_cnt last for every edge, and an entry holds
+//the count that follows the newest edge fed only once the PRU has written all of it. A slot still holding a packet
+//from a lap of the ring ago has counts that are whole rings behind. This needs nothing from the PRU, and with it
+//the newest edge of a phase packet is a few loop passes old instead of up to a packet. In quadrature mode a
+//stale QUAD_WORD can match the next position when the HWP is standing still, so quadrature packets are only
+//read once they are finished.
+//
+//Frequency is measured over exactly one revolution, from the newest edge to the same edge a turn before, so the
+//spacing errors of the slits cancel. A second frequency over the last window edges follows changes in speed
+//within a revolution but carries the slit errors. The phase is the angle of the newest edge, its count modulo a
+//revolution, which has the same zero as the angles worked out on the host. age_us tells the controller how far
+//to extrapolate at the measured frequency.
+
+#ifndef PHASE_TRACKER_H
+#define PHASE_TRACKER_H
+
+#include <stdint.h>
+
+#define PHASE_HEADER 0x9a5e
+#define PHASE_EDGES_PER_REV 1140 //570 slits, both edges of each, twice that in quadrature
+#define PHASE_WINDOW 285 //edges in the short frequency measurement, a quarter of a revolution
+#define PHASE_HISTORY 4096 //edge times kept, a power of two above a revolution of quadrature transitions
+
+//PhasePacket.flags
+#define PHASE_VALID 1 //at least one edge has been seen, phase and position are set
+#define PHASE_FREQUENCY 2 //a whole revolution without a gap, frequency is set
+#define PHASE_WINDOW_FREQUENCY 4 //window edges without a gap, frequency_window is set
+#define PHASE_QUAD 8 //position counts quadrature transitions
+#define PHASE_PARTIAL 16 //the newest edge was read from a packet the PRU was still filling
+
+//Fixed size status packet, like the packet types after 0xE12A it carries its size after the header
+//It goes straight out with its own sendto() and is never batched or kept for replay, the next one supersedes it
+struct PhasePacket{
+    uint32_t header; //PHASE_HEADER
+    uint32_t size; //sizeof(struct PhasePacket)
+    uint32_t seq; //phase packets sent before this one
+    uint32_t flags; //PHASE_*
+    int32_t position; //encoder_cnt of the newest edge, its QUAD_POSITION() in quadrature
+    uint32_t clock_cnt; //IEP count of the newest edge
+    uint32_t counter_ovflow; //IEP overflows at the newest edge, as in struct CounterInfo
+    uint32_t age_us; //from the newest edge to the packet being sent
+    float phase; //rad in [0, 2 pi), position modulo a revolution times 2 pi over the counts in one
+    float frequency; //Hz over the last revolution, negative when the position counts down
+    float frequency_window; //Hz over the last window edges
+    uint32_t gaps; //times the edges were not consecutive and the history started over
+};
+
+struct phase_tracker {
+    uint32_t edges_per_rev; //counts in a revolution in edge mode
+    uint32_t window; //edges in the short frequency measurement
+    int quad; //positions are quadrature transitions, two per edge
+    uint64_t times[PHASE_HISTORY]; //IEP time of the newest edges, the n-th since the history started at n % PHASE_HISTORY
+    uint32_t n; //consecutive edges in the history
+    int32_t position; //position of the newest edge
+    int32_t step; //+1, or -1 for a quadrature position counting down
+    int partial; //the newest edge was read from an unfinished packet
+    uint32_t gaps;
+    unsigned long int edges; //edges fed
+};
+
+//Empties the history, edges_per_rev must be below PHASE_HISTORY / 2 and window at most edges_per_rev
+void phase_tracker_init(struct phase_tracker* t, uint32_t edges_per_rev, uint32_t window, int quad);
+
+//Adds the edge that came after the newest one: an encoder_cnt word and the 64-bit IEP time of its entry
+//Anything but the next position in the same direction starts the history over
+void phase_tracker_add(struct phase_tracker* t, uint32_t encoder_cnt, uint64_t clock);
+
+//Position the next edge has in edge mode, to tell a freshly written entry from a stale one
+static inline uint32_t phase_tracker_next_count(const struct phase_tracker* t)
+{
+    return (uint32_t) t->position + 1;
+}
+
+//Fills in everything but seq, iep is the IEP count now, used for age_us
+void phase_tracker_fill(const struct phase_tracker* t, struct PhasePacket* p, uint32_t iep);
+
+#endif
@@ -0,0 +1,92 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pinmux.h"
+
+int pinmux_set(const char* pin, const char* mode)
+{
+    char path[128], state[32];
+    size_t len = strlen(mode);
+    ssize_t n;
+    int fd;
+
+    snprintf(path, sizeof(path), PINMUX_STATE_PATH, pin);
+    if ((fd = open(path, O_RDWR)) < 0) {
+        return -1;
+    }
+    //the state reads back as the mode name and a newline
+    n = read(fd, state, sizeof(state) - 1);
+    if (n >= (ssize_t) len && strncmp(state, mode, len) == 0 && (n == (ssize_t) len || state[len] == '\n')) {
+        close(fd);
+        return 0;
+    }
+    if (lseek(fd, 0, SEEK_SET) < 0 || write(fd, mode, len) != (ssize_t) len) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return close(fd);
+}
+
+struct pru1_input {
+    const char* pin;
+    int bit;
+};
+
+static const struct pru1_input pru1_inputs[] = PINMUX_PRU1_INPUTS;
+
+int pinmux_pru1_bit(const char* pin)
+{
+    for (size_t k = 0; k < sizeof(pru1_inputs) / sizeof(pru1_inputs[0]); k++) {
+        if (strcmp(pin, pru1_inputs[k].pin) == 0) {
+            return pru1_inputs[k].bit;
+        }
+    }
+    return -1;
+}
+
+const char* pinmux_pru1_pin(int bit)
+{
+    for (size_t k = 0; k < sizeof(pru1_inputs) / sizeof(pru1_inputs[0]); k++) {
+        if (bit == pru1_inputs[k].bit) {
+            return pru1_inputs[k].pin;
+        }
+    }
+    return NULL;
+}
+
+static int configure_pin(const char* pin)
+{
+    if (pinmux_set(pin, PINMUX_PRU_INPUT) < 0) {
+        fprintf(stderr, "Could not set %s to %s: %s\n", pin, PINMUX_PRU_INPUT, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+int pinmux_configure_prus(uint32_t pru1_mask)
+{
+    static const char* pins[] = PINMUX_PRU_PINS;
+    int failed = 0;
+
+    for (size_t k = 0; k < sizeof(pins) / sizeof(pins[0]); k++) {
+        int bit = pinmux_pru1_bit(pins[k]);
+        failed += configure_pin(pins[k]);
+        if (bit >= 0) {
+            pru1_mask &= ~(1u << bit); //not twice
+        }
+    }
+    for (int bit = 0; bit < 32; bit++) {
+        if ((pru1_mask >> bit & 1) && pinmux_pru1_pin(bit) != NULL) {
+            failed += configure_pin(pinmux_pru1_pin(bit));
+        }
+    }
+    if (failed == 0) {
+        printf("Pins configured\n");
+    }
+    return failed;
+}
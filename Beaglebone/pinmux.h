@@ -0,0 +1,37 @@
+//Pin multiplexing of the encoder and IRIG inputs, what the pinconfig script did with config-pin
+//
+//The cape-universal overlay of the Beaglebone exposes every header pin as a pinmux helper under sysfs, whose
+//state file takes the name of a mode. Writing "pruin" there routes the pin to R31 of the PRUs.
+
+#ifndef PINMUX_H
+#define PINMUX_H
+
+#include <stdint.h>
+
+#define PINMUX_STATE_PATH "/sys/devices/platform/ocp/ocp:%s_pinmux/state"
+#define PINMUX_PRU_INPUT "pruin"
+
+//Header pins the PRU programs read: the IRIG signal (P8_16, PRU0) and the encoder channels (PRU1, see
+//encoder_kernel.h). Channels of the config block on other pins are configured as well.
+#define PINMUX_PRU_PINS { "P8_16", "P8_27", "P8_28", "P8_29", "P8_30" }
+
+//Header pins wired to R31 of PRU1 and their bits, the pins an encoder channel can be on
+#define PINMUX_PRU1_INPUTS { { "P8_45", 0 }, { "P8_46", 1 }, { "P8_43", 2 }, { "P8_44", 3 }, { "P8_41", 4 }, \
+                             { "P8_42", 5 }, { "P8_39", 6 }, { "P8_40", 7 }, { "P8_27", 8 }, { "P8_29", 9 }, \
+                             { "P8_28", 10 }, { "P8_30", 11 } }
+
+//Puts a pin in the given mode, unless it is in it already
+//Returns 0, or -1 with errno set if the state file could not be read or written
+int pinmux_set(const char* pin, const char* mode);
+
+//R31 bit of PRU1 a header pin ("P8_28") is read on, -1 if it is not one of PINMUX_PRU1_INPUTS
+int pinmux_pru1_bit(const char* pin);
+
+//Header pin of an R31 bit of PRU1, NULL if no pin is wired to it
+const char* pinmux_pru1_pin(int bit);
+
+//Puts every pin the PRU programs read in PINMUX_PRU_INPUT, those of PINMUX_PRU_PINS and the PRU1 pins of the
+//R31 bits in pru1_mask. Returns the number of pins that failed, each with a message printed.
+int pinmux_configure_prus(uint32_t pru1_mask);
+
+#endif
@@ -0,0 +1,51 @@
+//PRU hardware access for the detection kernels (encoder_kernel.h, irig_kernel.h)
+//On the PRU these are the __R31 register and the IEP timer registers. Built with -DHOST_SIM they come from the
+//signal simulator in pru_sigsim.h instead, so the same kernels run on x86 against replayed encoder, quadrature
+//and IRIG-B signals.
+//
+//PRU_COST(ops, loads, stores) marks the instructions a block compiles to on the PRU: single cycle register
+//instructions, loads and stores to data or shared RAM. It is empty on the PRU. On the host it advances the
+//simulated clock, so the time a loop takes on the PRU (and with it the edges it can miss and the latency of its
+//timestamps) comes out of the simulation. The R31 and IEP accessors charge their own cost.
+
+#ifndef PRU_HW_H
+#define PRU_HW_H
+
+#include <stdint.h>
+
+#ifdef HOST_SIM
+
+#include "pru_sigsim.h"
+
+#define PRU_R31() pru_sigsim_r31()
+#define PRU_R31_EVENT(event) pru_sigsim_event(event)
+#define PRU_IEP_START() pru_sigsim_iep_start()
+#define PRU_IEP_COUNT() pru_sigsim_iep_count()
+#define PRU_IEP_OVERFLOWED() pru_sigsim_iep_overflowed()
+#define PRU_IEP_CLEAR_OVERFLOW() pru_sigsim_iep_clear_overflow()
+#define PRU_COST(ops, loads, stores) pru_sigsim_cost(ops, loads, stores)
+
+#else
+
+// IEP(Industrial Ethernet Peripheral Registers
+#define IEP 0x0002e000 //IEP base address
+#define IEP_TMR_GLB_CFG ((volatile unsigned long int *)(IEP + 0x00)) //Register IEP Timer configuration
+#define IEP_TMR_CNT ((volatile unsigned long int *)(IEP + 0x0c)) //Register for the IEP counter(32-bit, 200MHz)
+#define IEP_TMR_COMPEN ((volatile unsigned long int *)(IEP + 0x08)) //Register to configure compensation counter
+#define IEP_TMR_GLB_STS ((volatile unsigned long int *)(IEP + 0x04)) //Register to check for counter overflows
+
+//Registers to use for PRU input/output, __R31 is input, __R30 is output
+volatile register unsigned int __R31, __R30;
+
+#define PRU_R31() (__R31)
+#define PRU_R31_EVENT(event) (__R31 = (event)) //strobe bit + system event, raises an interrupt on the ARM
+//Clears overflow flags, enables the IEP counter to increment by 1 every cycle and disables compensation
+#define PRU_IEP_START() (*IEP_TMR_GLB_STS = 1, *IEP_TMR_GLB_CFG = 0x11, *IEP_TMR_COMPEN = 0)
+#define PRU_IEP_COUNT() ((uint32_t) *IEP_TMR_CNT)
+#define PRU_IEP_OVERFLOWED() (*IEP_TMR_GLB_STS & 1)
+#define PRU_IEP_CLEAR_OVERFLOW() (*IEP_TMR_GLB_STS = 1) //writing a 1 resets the overflow bit
+#define PRU_COST(ops, loads, stores)
+
+#endif
+
+#endif
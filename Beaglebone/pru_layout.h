@@ -0,0 +1,323 @@
+//Layout of the PRU shared data RAM, included by both PRU programs and the ARM forwarder
+//Offsets are in bytes from the start of shared memory (0x00010000 on the PRU side)
+//Fixed width types are used so the same structures line up on the ARM, the PRUs and an x86 host running the simulator
+//
+//  0x0000  control words (on, overflow, ARM control, error packet, ring control blocks, telemetry, config block)
+//  0x0200  IRIG ring, IRIG_RING_SLOTS slots
+//  ......  one encoder ring per channel, splitting what is left of the 12kB evenly
+//
+//Everything past the IRIG ring depends on the config block (struct pru_config), which the ARM writes before it
+//starts the PRUs: the packet size and the pins of each encoder channel. The PRUs, the simulated PRUs and the
+//forwarder all derive the rings from it with pru_layout_compute(), and the forwarder sends the result to the
+//receivers in a layout packet (struct LayoutPacket). Without a config block the PRUs run as they always have,
+//one channel on P8_28 in packets of ENCODER_COUNTER_SIZE edges.
+
+#ifndef PRU_LAYOUT_H
+#define PRU_LAYOUT_H
+
+#include <stdint.h>
+
+#define PRU_SHM_BASE 0x00010000 //address of shared RAM as seen by the PRUs
+#define PRU_SHM_SIZE 0x3000 //12kB of shared RAM
+
+#define ENCODER_COUNTER_SIZE 150 //Size of edges to sample before sending packet, the default and the most a packet holds
+#define PRU_MAX_CHANNELS 4 //encoder channels the encoder PRU can time at once, each with a ring of its own
+
+//Definining the offsets from the start of shared memory for the variables shared by the PRUs and the ARM
+#define ON_OFFSET 0x0000 //0 while the PRUs are sampling, set to 1 by the IRIG PRU when it is done
+#define OVERFLOW_OFFSET 0x0004 //number of IEP counter overflows, maintained by the IRIG PRU
+#define ERROR_IDENTIFIER_OFFSET 0x0008 //1 when the error packet is ready to be sent
+#define PRU_CONTROL_OFFSET 0x000c //PRU_CONTROL_*, written only by the ARM
+#define ERROR_OFFSET 0x0010 //struct ErrorInfo
+#define COUNTER_RING_CTRL_OFFSET 0x0020 //struct pru_ring_ctrl for the encoder ring
+#define IRIG_RING_CTRL_OFFSET 0x0030 //struct pru_ring_ctrl for the IRIG ring
+#define TELEMETRY_OFFSET 0x0040 //struct pru_telemetry
+#define PRU_CONFIG_OFFSET 0x0180 //struct pru_config, written by the ARM before it starts the PRUs
+#define CHANNEL_RING_CTRL_OFFSET 0x01c0 //struct pru_ring_ctrl of encoder channels 1 and up, channel 0 has COUNTER_RING_CTRL_OFFSET
+#define PRU_CTRL_SIZE 0x0200 //space reserved for control words ahead of the rings
+
+//Values of the control word. The ARM zeroes shared memory before starting the PRUs, so they sample from the
+//moment they are loaded and keep going, across any number of output files on the host, until the ARM writes
+//PRU_CONTROL_STOP. The IRIG PRU then sets the on word, which stops the encoder PRU after its current packet.
+#define PRU_CONTROL_RUN 0
+#define PRU_CONTROL_STOP 1
+
+//Headers identifying each packet type on the wire
+#define ENCODER_HEADER 0x1eaf
+#define IRIG_HEADER 0xcafe
+#define ERROR_HEADER 0xe12a
+#define STATS_HEADER 0x57a7
+#define LAYOUT_HEADER 0x1a70
+//Header of an encoder ring slot filled in quadrature mode, never sent as is: the forwarder always delta encodes
+//these packets (packet_v2.h, PACKET_V2_FLAG_QUAD) since they have no size word
+#define ENCODER_QUAD_HEADER 0x3eaf
+
+//In quadrature mode every transition of either channel is an entry of the packet and encoder_cnt holds the signed
+//position in transitions, forward positive, above the state of the two channels (bit 0 = P8_28, bit 1 = P8_27).
+//The position is kept to 30 bits and wraps after 2^29 transitions, about 33 hours at 2 Hz.
+#define QUAD_WORD(position, state) ((uint32_t) (position) << 2 | (state))
+#define QUAD_POSITION(word) ((int32_t) (word) >> 2)
+#define QUAD_STATE(word) ((word) & 3)
+
+//Structure containing clock information of encoder and absolute count
+struct CounterInfo{
+    uint32_t clock_cnt[ENCODER_COUNTER_SIZE];
+    uint32_t counter_ovflow[ENCODER_COUNTER_SIZE];
+    uint32_t encoder_cnt[ENCODER_COUNTER_SIZE];
+};
+
+//Structure containing values of quadrature pins
+struct QuadEncoder{
+    uint32_t encoder_value_2;
+    uint32_t encoder_value_3;
+    uint32_t encoder_value_4;
+};
+
+//Complete encoder structure comining two above structures and adding a header
+struct CompleteDataPackets{
+    uint32_t counter_info_header;
+    struct CounterInfo Counter_Packets;
+    struct QuadEncoder Quad;
+};
+
+//An encoder packet of n entries as it sits in a ring slot: the header, clock_cnt, counter_ovflow and encoder_cnt of
+//n words each, then the three quadrature pins. With n = ENCODER_COUNTER_SIZE it is struct CompleteDataPackets,
+//the v1 packet on the wire. The offsets are in words from the header.
+//The quadrature pins are read at the first edge of the packet: the channel's own quadrature partner (quad_mask of
+//struct pru_config, 0 if it has none), then P8_29 and P8_30 for channel 0 only. The other channels have 0 there.
+#define ENCODER_PACKET_WORDS(n) (4 + 3 * (n))
+#define ENCODER_PACKET_CLOCK_CNT(n) 1
+#define ENCODER_PACKET_COUNTER_OVFLOW(n) (1 + (n))
+#define ENCODER_PACKET_ENCODER_CNT(n) (1 + 2 * (n))
+#define ENCODER_PACKET_QUAD(n) (1 + 3 * (n))
+
+//Complete structure for IRIG information
+struct IrigInfo{
+    uint32_t random_header;
+    uint32_t rising_edge_time;
+    uint32_t init_overflow; //number of overflows that have occurred when first rising edge seen
+    uint32_t info[10];
+    uint32_t re_count[10];
+    uint32_t re_count_overflow[10]; //number of overflows that have occurred at each synch pulse in IRIG
+};
+
+//Structure for error packets, only sent when IRIG isn't synched
+struct ErrorInfo{
+    uint32_t header;
+    uint32_t err_code; //0 if all is good, 1 if an error exists
+};
+
+//Latency histograms have TELEMETRY_HIST_BINS bins of microseconds: bin 0 counts [0, 2), bin k [2^k, 2^(k+1))
+//and the last bin everything from 2^(TELEMETRY_HIST_BINS - 1) up
+#define TELEMETRY_HIST_BINS 16
+
+//Counters that tell where data went missing, every word is written by one side only
+//The PRUs update theirs once per packet or frame and never in a pass that can catch an edge, the ARM keeps its
+//own in local memory and copies them in whenever it sends a stats packet. Ring overruns are in pru_ring_ctrl.
+struct pru_telemetry{
+    //encoder PRU
+    uint32_t encoder_edges; //edges seen, written at the first rising edge of every packet
+    uint32_t encoder_packets; //packets finished, dropped ones included
+    uint32_t encoder_max_gap; //most IEP counts from the last edge of a packet to sampling again, the longest loop
+    //IRIG PRU
+    uint32_t irig_frames; //frames finished, dropped ones included
+    uint32_t irig_desyncs; //times a position identifier was missing and the partial frame was thrown away
+    uint32_t irig_bad_pulses; //pulses too long to be an IRIG bit
+    uint32_t irig_max_gap; //most IEP counts from a falling edge to sampling again, the longest loop
+    uint32_t pru_reserved;
+    //ARM forwarder
+    uint32_t arm_encoder_sent; //packets taken from each ring and handed to the UDP batch
+    uint32_t arm_irig_sent;
+    uint32_t arm_error_sent;
+    uint32_t arm_encoder_lost; //gaps in the ring sequence numbers
+    uint32_t arm_irig_lost;
+    uint32_t arm_datagrams; //datagrams handed to the kernel
+    uint32_t arm_send_errors; //datagrams the kernel refused
+    uint32_t arm_wakeups;
+    uint32_t arm_notice_max_us; //longest from the last edge of an encoder packet to the ARM finding it
+    uint32_t arm_send_max_us; //longest from a packet leaving its ring to its datagram being sent
+    uint32_t arm_notice_hist[TELEMETRY_HIST_BINS];
+    uint32_t arm_send_hist[TELEMETRY_HIST_BINS];
+    uint32_t arm_nacks; //NACK packets from the receiver, 0 unless replay is on (replay_buffer.h)
+    uint32_t arm_retransmitted; //packets sent again
+    uint32_t arm_replay_expired; //packets asked for after they had left the replay ring
+};
+
+//Periodic stats packet, like the packet types after 0xE12A it carries its size after the header
+struct StatsPacket{
+    uint32_t header; //STATS_HEADER
+    uint32_t size; //sizeof(struct StatsPacket)
+    uint32_t seq; //stats packets sent before this one
+    uint32_t uptime_ms; //since the forwarder started
+    uint32_t encoder_overruns; //pru_ring_ctrl.overruns of the two rings
+    uint32_t irig_overruns;
+    struct pru_telemetry telemetry;
+};
+
+//Control block of a single-producer/single-consumer ring of packet slots
+//head and tail are free running counts, so the ring holds head - tail packets and is full at head - tail == slots
+//The PRU fills the slot at head % slots and increments head once the packet is complete. If the ring is full
+//when a packet starts it fills a private scratch packet instead and counts an overrun, so it never waits on the ARM.
+//The ARM reads every slot between tail and head and then advances tail once for the whole batch.
+struct pru_ring_ctrl{
+    uint32_t head; //packets published, written only by the PRU
+    uint32_t tail; //packets consumed, written only by the ARM
+    uint32_t overruns; //packets dropped because the ring was full, written only by the PRU
+    uint32_t slots; //number of slots in the ring, written by the PRU at startup
+};
+
+//Ring slots carry the sequence number of the packet ahead of the packet itself
+//Sequence numbers count every packet the PRU finished, dropped ones included, so a gap is a lost packet
+struct CounterSlot{
+    uint32_t seq;
+    struct CompleteDataPackets packet;
+};
+
+struct IrigSlot{
+    uint32_t seq;
+    struct IrigInfo packet;
+};
+
+#define IRIG_RING_SLOTS 4
+#define IRIG_RING_OFFSET PRU_CTRL_SIZE
+#define COUNTER_RING_OFFSET (IRIG_RING_OFFSET + IRIG_RING_SLOTS * sizeof(struct IrigSlot))
+#define COUNTER_RING_SLOTS ((PRU_SHM_SIZE - COUNTER_RING_OFFSET) / sizeof(struct CounterSlot)) //with the default config
+
+//Bytes of a ring slot holding an encoder packet of n entries and its sequence number
+#define COUNTER_SLOT_SIZE(n) (4 * (1 + ENCODER_PACKET_WORDS(n)))
+
+#define PRU_CONFIG_MAGIC 0xc0f16001 //first word of a config block the ARM has written
+#define PRU_CONFIG_VERSION 1
+
+//Config block, everything the encoder PRU program used to have compiled in
+//Pin masks are bits of R31 on PRU1: P8_28 is bit 10 (1 << 10), P8_27 bit 8, P8_29 bit 9, P8_30 bit 11, P8_39 to
+//P8_46 bits 6, 7, 4, 5, 2, 3, 0 and 1. The masks of all channels must differ.
+struct pru_config{
+    uint32_t magic; //PRU_CONFIG_MAGIC
+    uint32_t version; //PRU_CONFIG_VERSION
+    uint32_t packet_edges; //entries per encoder packet, 1 to ENCODER_COUNTER_SIZE
+    uint32_t n_channels; //encoder channels, 1 to PRU_MAX_CHANNELS
+    uint32_t quadrature; //1 times every transition of both pins of each channel, see encoder_kernel.h
+    uint32_t pin_mask[PRU_MAX_CHANNELS]; //R31 bit of each channel's encoder signal
+    uint32_t quad_mask[PRU_MAX_CHANNELS]; //R31 bit of its second quadrature signal, used in quadrature mode
+};
+
+//Where everything past the control words is for a config, see pru_layout_compute()
+struct pru_shm_layout{
+    uint32_t packet_edges; //as in the config
+    uint32_t n_channels;
+    uint32_t slot_size; //bytes of an encoder ring slot, COUNTER_SLOT_SIZE(packet_edges)
+    uint32_t slots; //slots in each channel's ring
+    uint32_t irig_ring_offset; //IRIG_RING_OFFSET
+    uint32_t irig_slots; //IRIG_RING_SLOTS
+    uint32_t ring_ctrl_offset[PRU_MAX_CHANNELS]; //struct pru_ring_ctrl of each channel
+    uint32_t ring_offset[PRU_MAX_CHANNELS]; //first slot of each channel's ring
+};
+
+//Sent by the forwarder when it starts and ahead of every stats packet, so a receiver knows the packet size and the
+//channels before it has to make sense of any of them. Encoder packets of channel 0 with ENCODER_COUNTER_SIZE edges
+//go out as they always have, everything else goes out as v2 packets (packet_v2.h) with the channel in their flags.
+struct LayoutPacket{
+    uint32_t header; //LAYOUT_HEADER
+    uint32_t size; //sizeof(struct LayoutPacket)
+    uint32_t wire_version; //format of the encoder packets that may go out either way, 1 or 2
+    uint32_t reserved;
+    struct pru_config config;
+    struct pru_shm_layout layout;
+};
+
+//One channel on the encoder pin (P8_28) and its quadrature partner (P8_27), in packets of ENCODER_COUNTER_SIZE
+static inline void pru_config_default(struct pru_config* config)
+{
+    uint32_t c;
+
+    config->magic = PRU_CONFIG_MAGIC;
+    config->version = PRU_CONFIG_VERSION;
+    config->packet_edges = ENCODER_COUNTER_SIZE;
+    config->n_channels = 1;
+    config->quadrature = 0;
+    for (c = 0; c < PRU_MAX_CHANNELS; c++) {
+        config->pin_mask[c] = 0;
+        config->quad_mask[c] = 0;
+    }
+    config->pin_mask[0] = 1 << 10;
+    config->quad_mask[0] = 1 << 8;
+}
+
+//1 if a config can be laid out and sampled: sizes in range and one R31 bit per pin, none of them shared
+static inline int pru_config_valid(const struct pru_config* config)
+{
+    uint32_t c, used = 0;
+
+    if (config->magic != PRU_CONFIG_MAGIC || config->version != PRU_CONFIG_VERSION || config->packet_edges < 1 ||
+        config->packet_edges > ENCODER_COUNTER_SIZE || config->n_channels < 1 || config->n_channels > PRU_MAX_CHANNELS) {
+        return 0;
+    }
+    //a slot to fill while the ARM reads another, for every channel
+    if ((PRU_SHM_SIZE - COUNTER_RING_OFFSET) / config->n_channels / COUNTER_SLOT_SIZE(config->packet_edges) < 2) {
+        return 0;
+    }
+    for (c = 0; c < config->n_channels; c++) {
+        uint32_t pin = config->pin_mask[c], quad = config->quadrature ? config->quad_mask[c] : 0;
+        if (pin == 0 || (pin & (pin - 1)) || (quad & (quad - 1)) || (config->quadrature && quad == 0) ||
+            (used & (pin | quad)) || pin == quad) {
+            return 0;
+        }
+        used |= pin | quad;
+    }
+    return 1;
+}
+
+//Reads the config block out of shared memory, or the default if the ARM has not written a valid one
+//Returns 1 for a config from shared memory and 0 for the default
+static inline int pru_config_read(const volatile uint8_t* shm, struct pru_config* config)
+{
+    const volatile uint32_t* from = (const volatile uint32_t *) (shm + PRU_CONFIG_OFFSET);
+    uint32_t* to = (uint32_t *) config;
+    uint32_t k;
+
+    for (k = 0; k < sizeof(*config) / 4; k++) {
+        to[k] = from[k];
+    }
+    if (!pru_config_valid(config)) {
+        pru_config_default(config);
+        return 0;
+    }
+    return 1;
+}
+
+//Writes the config block, which nothing reads until the PRUs are started
+static inline void pru_config_write(volatile uint8_t* shm, const struct pru_config* config)
+{
+    volatile uint32_t* to = (volatile uint32_t *) (shm + PRU_CONFIG_OFFSET);
+    const uint32_t* from = (const uint32_t *) config;
+    uint32_t k;
+
+    for (k = 0; k < sizeof(*config) / 4; k++) {
+        to[k] = from[k];
+    }
+}
+
+//The one definition of the rings: the IRIG ring first, then a ring per channel, each with as many slots of the
+//configured size as fit in an even share of the rest. Small packets get deep rings, 1 edge packets about 330 slots.
+static inline void pru_layout_compute(const struct pru_config* config, struct pru_shm_layout* layout)
+{
+    uint32_t c, share;
+
+    layout->packet_edges = config->packet_edges;
+    layout->n_channels = config->n_channels;
+    layout->slot_size = COUNTER_SLOT_SIZE(config->packet_edges);
+    share = (PRU_SHM_SIZE - COUNTER_RING_OFFSET) / config->n_channels;
+    layout->slots = share / layout->slot_size;
+    layout->irig_ring_offset = IRIG_RING_OFFSET;
+    layout->irig_slots = IRIG_RING_SLOTS;
+    for (c = 0; c < PRU_MAX_CHANNELS; c++) {
+        layout->ring_ctrl_offset[c] = c == 0 ? COUNTER_RING_CTRL_OFFSET : CHANNEL_RING_CTRL_OFFSET + (c - 1) * sizeof(struct pru_ring_ctrl);
+        layout->ring_offset[c] = c < config->n_channels ? COUNTER_RING_OFFSET + c * layout->slots * layout->slot_size : 0;
+    }
+}
+
+//Returns a pointer of the given type to a byte offset in shared memory
+#define PRU_SHM_PTR(base, type, offset) ((volatile type *) ((volatile uint8_t *) (base) + (offset)))
+
+#endif
@@ -0,0 +1,116 @@
+//ARM side of the packet rings described in pru_layout.h
+//The reader is used by the forwarder, the writer mirrors what Encoder_Detection.c and IRIG_Detection.c
+//do on the PRUs and is used by the simulated PRUs
+
+#ifndef PRU_RING_H
+#define PRU_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pru_layout.h"
+
+struct pru_ring_reader {
+    volatile struct pru_ring_ctrl* ctrl;
+    volatile uint8_t* slots;
+    uint32_t slot_size;
+    uint32_t nslots;
+    uint32_t index; //slot holding the oldest unread packet
+    uint32_t next_seq; //sequence number expected in the next packet
+    unsigned long int lost; //packets missing from the sequence
+};
+
+struct pru_ring_writer {
+    volatile struct pru_ring_ctrl* ctrl;
+    volatile uint8_t* slots;
+    uint32_t slot_size;
+    uint32_t nslots;
+    uint32_t index; //slot the next packet is written to
+    uint32_t seq; //sequence number of the next packet
+    volatile uint8_t* scratch; //where packets go while the ring is full
+};
+
+static inline void pru_ring_reader_init(struct pru_ring_reader* r, volatile uint8_t* base, uint32_t ctrl_offset,
+                                        uint32_t slots_offset, uint32_t slot_size, uint32_t nslots)
+{
+    r->ctrl = PRU_SHM_PTR(base, struct pru_ring_ctrl, ctrl_offset);
+    r->slots = base + slots_offset;
+    r->slot_size = slot_size;
+    r->nslots = nslots;
+    r->index = 0;
+    r->next_seq = 0;
+    r->lost = 0;
+}
+
+//Number of packets ready to be read
+static inline uint32_t pru_ring_available(struct pru_ring_reader* r)
+{
+    uint32_t n = r->ctrl->head - r->ctrl->tail;
+    __sync_synchronize(); //slot contents are read only after head
+    return n > r->nslots ? r->nslots : n;
+}
+
+//k-th unread slot, starting at the oldest
+static inline volatile uint8_t* pru_ring_slot(struct pru_ring_reader* r, uint32_t k)
+{
+    uint32_t i = r->index + k;
+    return r->slots + (size_t) (i >= r->nslots ? i - r->nslots : i) * r->slot_size;
+}
+
+//Checks the sequence number of a slot against the last one and counts the packets in between as lost
+static inline uint32_t pru_ring_check_seq(struct pru_ring_reader* r, volatile uint8_t* slot)
+{
+    uint32_t seq = *(volatile uint32_t *) slot;
+    r->lost += seq - r->next_seq;
+    r->next_seq = seq + 1;
+    return seq;
+}
+
+//Hands n slots back to the PRU
+static inline void pru_ring_release(struct pru_ring_reader* r, uint32_t n)
+{
+    __sync_synchronize(); //slot contents are fully read before the PRU may reuse them
+    r->ctrl->tail += n;
+    r->index = (r->index + n) % r->nslots;
+}
+
+static inline void pru_ring_writer_init(struct pru_ring_writer* w, volatile uint8_t* base, uint32_t ctrl_offset,
+                                        uint32_t slots_offset, uint32_t slot_size, uint32_t nslots, volatile uint8_t* scratch)
+{
+    w->ctrl = PRU_SHM_PTR(base, struct pru_ring_ctrl, ctrl_offset);
+    w->slots = base + slots_offset;
+    w->slot_size = slot_size;
+    w->nslots = nslots;
+    w->index = 0;
+    w->seq = 0;
+    w->scratch = scratch;
+    w->ctrl->head = 0;
+    w->ctrl->overruns = 0;
+    w->ctrl->slots = nslots;
+}
+
+//Slot to fill with the next packet, the scratch packet if the ring is full
+static inline volatile uint8_t* pru_ring_claim(struct pru_ring_writer* w)
+{
+    if (w->ctrl->head - w->ctrl->tail >= w->nslots) {
+        return w->scratch;
+    }
+    __sync_synchronize(); //the ARM has finished reading the slot before it is overwritten
+    return w->slots + (size_t) w->index * w->slot_size;
+}
+
+//Stamps the sequence number and publishes the slot, returns 0 if it was dropped as an overrun
+static inline int pru_ring_publish(struct pru_ring_writer* w, volatile uint8_t* slot)
+{
+    *(volatile uint32_t *) slot = w->seq++;
+    if (slot == w->scratch) {
+        w->ctrl->overruns += 1;
+        return 0;
+    }
+    __sync_synchronize(); //slot contents are visible before head moves
+    w->ctrl->head += 1;
+    w->index = w->index + 1 == w->nslots ? 0 : w->index + 1;
+    return 1;
+}
+
+#endif
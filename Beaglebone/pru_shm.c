@@ -0,0 +1,167 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef HOST_SIM
+#include <prussdrv.h>
+#include <pruss_intc_mapping.h>
+#endif
+
+#include "pru_layout.h"
+#include "pru_shm.h"
+
+static int sim_open(struct pru_shm* shm, const char* name, int create)
+{
+    int flags = O_RDWR | (create ? O_CREAT : 0);
+    char sem_name[80];
+    int fd;
+    void* p;
+
+    snprintf(shm->sim_name, sizeof(shm->sim_name), "%s", name);
+    snprintf(sem_name, sizeof(sem_name), "%s_evt", name);
+    if (create) {
+        shm_unlink(name);
+        sem_unlink(sem_name);
+    }
+
+    if ((fd = shm_open(name, flags, 0600)) < 0) {
+        perror("shm_open");
+        return -1;
+    }
+    if (create && ftruncate(fd, PRU_SHM_SIZE) < 0) {
+        perror("ftruncate");
+        close(fd);
+        return -1;
+    }
+    p = mmap(NULL, PRU_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    shm->sim_event = sem_open(sem_name, flags, 0600, 0);
+    if (shm->sim_event == SEM_FAILED) {
+        perror("sem_open");
+        munmap(p, PRU_SHM_SIZE);
+        return -1;
+    }
+    shm->base = (volatile uint8_t *) p;
+    shm->simulated = 1;
+    shm->event_fd = -1;
+    return 0;
+}
+
+int pru_shm_open(struct pru_shm* shm, const char* sim_name, int create)
+{
+    memset(shm, 0, sizeof(*shm));
+    shm->event_fd = -1;
+    if (sim_name != NULL) {
+        return sim_open(shm, sim_name, create);
+    }
+
+#ifdef HOST_SIM
+    fprintf(stderr, "built with HOST_SIM, only the simulated PRU backend is available\n");
+    return -1;
+#else
+    void* p;
+    prussdrv_map_prumem(PRUSS0_SHARED_DATARAM, &p);
+    shm->base = (volatile uint8_t *) p;
+    //the IEP counter is only used for telemetry, the forwarder runs without it
+    int fd = open("/dev/mem", O_RDONLY | O_SYNC);
+    if (fd >= 0) {
+        p = mmap(NULL, 0x1000, PROT_READ, MAP_SHARED, fd, PRU_SHM_IEP_PHYS);
+        shm->iep_regs = p != MAP_FAILED ? (volatile uint32_t *) p : NULL;
+        close(fd);
+    }
+    //packet interrupts from both PRUs are routed to PRU_EVTOUT_0, see PRUSS_INTC_CUSTOM
+    shm->event_fd = prussdrv_pru_event_fd(PRU_EVTOUT_0);
+    return shm->base != NULL ? 0 : -1;
+#endif
+}
+
+int pru_shm_wait_event(struct pru_shm* shm, long timeout_us)
+{
+    if (shm->simulated) {
+        int rc;
+        if (timeout_us < 0) {
+            while ((rc = sem_wait((sem_t *) shm->sim_event)) < 0 && errno == EINTR);
+        } else {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += timeout_us / 1000000;
+            deadline.tv_nsec += (timeout_us % 1000000) * 1000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000;
+            }
+            while ((rc = sem_timedwait((sem_t *) shm->sim_event, &deadline)) < 0 && errno == EINTR);
+        }
+        if (rc == 0) {
+            //several packets may have been announced while we were busy, one wakeup drains them all
+            while (sem_trywait((sem_t *) shm->sim_event) == 0);
+            return 1;
+        }
+        return errno == ETIMEDOUT || errno == EAGAIN ? 0 : -1;
+    }
+
+#ifdef HOST_SIM
+    return -1;
+#else
+    struct pollfd pfd = { .fd = shm->event_fd, .events = POLLIN };
+    int rc = poll(&pfd, 1, timeout_us < 0 ? -1 : (int) ((timeout_us + 999) / 1000));
+    if (rc <= 0) {
+        return rc;
+    }
+    prussdrv_pru_wait_event(PRU_EVTOUT_0); //consumes the pending event without blocking
+    prussdrv_pru_clear_event(PRU_EVTOUT_0, PRU0_ARM_INTERRUPT);
+    prussdrv_pru_clear_event(PRU_EVTOUT_0, PRU1_ARM_INTERRUPT);
+    return 1;
+#endif
+}
+
+int pru_shm_iep_count(struct pru_shm* shm, uint32_t* count)
+{
+    if (shm->simulated) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        *count = (uint32_t) (((uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec) / 5); //5 ns per count
+        return 0;
+    }
+    if (shm->iep_regs == NULL) {
+        return -1;
+    }
+    *count = shm->iep_regs[0x0c / 4]; //IEP_TMR_CNT
+    return 0;
+}
+
+void pru_shm_signal_event(struct pru_shm* shm)
+{
+    if (shm->simulated) {
+        sem_post((sem_t *) shm->sim_event);
+    }
+}
+
+void pru_shm_close(struct pru_shm* shm, int unlink)
+{
+    if (!shm->simulated) {
+        if (shm->iep_regs != NULL) {
+            munmap((void *) shm->iep_regs, 0x1000);
+        }
+        return; //prussdrv_exit() releases the shared memory mapping
+    }
+    munmap((void *) shm->base, PRU_SHM_SIZE);
+    sem_close((sem_t *) shm->sim_event);
+    if (unlink) {
+        char sem_name[80];
+        snprintf(sem_name, sizeof(sem_name), "%s_evt", shm->sim_name);
+        shm_unlink(shm->sim_name);
+        sem_unlink(sem_name);
+    }
+}
@@ -0,0 +1,48 @@
+//Access to the PRU shared data RAM and to the PRU->ARM packet interrupt
+//
+//On the Beaglebone this wraps prussdrv. The simulated backend maps a POSIX shared memory
+//segment of the same size and uses a named semaphore in place of the interrupt, so the
+//forwarding loop can be run and benchmarked on an ordinary Linux box.
+//
+//The ARM can also read the IEP counter the PRUs stamp their edges with, to time how long a packet took to
+//reach it. On the Beaglebone the IEP registers are mapped from /dev/mem. In simulation the counter is
+//CLOCK_MONOTONIC at 200 MHz, which is what the simulated PRUs stamp their edges with.
+//Building with -DHOST_SIM leaves out the prussdrv backend entirely.
+
+#ifndef PRU_SHM_H
+#define PRU_SHM_H
+
+#include <stdint.h>
+
+#define PRU_SHM_SIM_NAME "/pb2_chwp_pru_shm" //default name of the simulated segment in /dev/shm
+#define PRU_SHM_IEP_HZ 200000000.0 //IEP counter frequency
+#define PRU_SHM_IEP_PHYS 0x4a32e000 //IEP registers in the ARM address space, PRU-ICSS base + 0x2e000
+
+struct pru_shm {
+    volatile uint8_t* base; //start of shared memory
+    int simulated; //1 if backed by the simulated segment
+    int event_fd; //uio file descriptor of PRU_EVTOUT_0, -1 in simulation
+    void* sim_event; //semaphore standing in for PRU_EVTOUT_0 in simulation
+    char sim_name[64]; //name of the simulated segment and semaphore
+    volatile uint32_t* iep_regs; //IEP registers, NULL if /dev/mem could not be mapped or in simulation
+};
+
+//Opens shared memory; sim_name selects the simulated backend (NULL for the real PRUs)
+//create is only used in simulation and makes a fresh zeroed segment
+//Returns 0 on success, -1 on failure
+int pru_shm_open(struct pru_shm* shm, const char* sim_name, int create);
+
+//Blocks until a PRU raises a packet interrupt or timeout_us expires (negative blocks forever)
+//Returns 1 if an event arrived, 0 on timeout and -1 on error
+int pru_shm_wait_event(struct pru_shm* shm, long timeout_us);
+
+//Reads the IEP counter into *count, returns -1 if it cannot be read from the ARM
+int pru_shm_iep_count(struct pru_shm* shm, uint32_t* count);
+
+//Raises the packet interrupt, only meaningful for the simulated PRUs
+void pru_shm_signal_event(struct pru_shm* shm);
+
+//Unmaps shared memory, unlink also removes a simulated segment
+void pru_shm_close(struct pru_shm* shm, int unlink);
+
+#endif
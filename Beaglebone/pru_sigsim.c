@@ -0,0 +1,263 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pru_layout.h"
+#include "pru_sigsim.h"
+
+#define ENCODER_BIT (1 << 10)
+#define QUAD_2_BIT (1 << 8)
+#define QUAD_3_BIT (1 << 9)
+#define IRIG_BIT (1 << 14)
+#define IRIG_BIT_CYCLES (PRU_SIGSIM_HZ / 100) //10 ms per IRIG bit
+#define NEVER UINT64_MAX
+
+static __thread struct pru_sigsim* current;
+
+//xorshift64 and Box-Muller
+static double uniform(struct pru_sigsim* s)
+{
+    s->rng ^= s->rng << 13;
+    s->rng ^= s->rng >> 7;
+    s->rng ^= s->rng << 17;
+    return ((s->rng >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double gaussian(struct pru_sigsim* s)
+{
+    return sqrt(-2 * log(uniform(s))) * cos(2 * M_PI * uniform(s));
+}
+
+//Nominal time plus jitter in cycles, never at or before the previous edge of the same signal
+static uint64_t jittered(struct pru_sigsim* s, double nominal, double jitter_s, uint64_t previous)
+{
+    double t = nominal + (jitter_s > 0 ? jitter_s * PRU_SIGSIM_HZ * gaussian(s) : 0);
+    uint64_t c = t > 0 ? (uint64_t) llround(t) : 0;
+    return c > previous ? c : previous + 1;
+}
+
+//BCD encoding of an IRIG field in the layout of IRIG-B, as Host/irig_frame.c decodes it
+static uint32_t irig_bcd(unsigned int value, int shift)
+{
+    return (((value % 10) & 0xf) | ((value / 10) << 5)) << shift;
+}
+
+void pru_sigsim_irig_info(uint32_t time_of_day, uint32_t* info)
+{
+    memset(info, 0, 10 * sizeof(uint32_t));
+    info[0] = irig_bcd(time_of_day % 60, 1);
+    info[1] = irig_bcd(time_of_day / 60 % 60, 0);
+    info[2] = irig_bcd(time_of_day / 3600 % 24, 0);
+}
+
+//Nominal rising edge of IRIG bit n, counted over all frames
+static double irig_rise(const struct pru_sigsim* s, uint32_t n)
+{
+    return s->config.irig_phase * PRU_SIGSIM_HZ + (double) n * IRIG_BIT_CYCLES;
+}
+
+//Pulse width of IRIG bit n: 8 ms for the position identifiers at 0, 9, 19, ..., 99, 5 ms for a 1, 2 ms for a 0
+static double irig_width(const struct pru_sigsim* s, uint32_t n)
+{
+    uint32_t b = n % 100;
+    uint32_t info[10];
+
+    if (b == 0 || b % 10 == 9) {
+        return 0.008 * PRU_SIGSIM_HZ;
+    }
+    pru_sigsim_irig_info((s->config.irig_start + n / 100) % (24 * 3600), info);
+    return ((info[b / 10] >> (b % 10)) & 1) ? 0.005 * PRU_SIGSIM_HZ : 0.002 * PRU_SIGSIM_HZ;
+}
+
+//Nominal cycle at which the HWP reaches a phase, on the current side of the reversal
+static double phase_time(const struct pru_sigsim* s, double phase)
+{
+    return s->turn_cycle + s->direction * (phase - s->turn_phase) * s->edge_period;
+}
+
+static void schedule_edge(struct pru_sigsim* s)
+{
+    uint64_t previous = s->edges ? s->next_edge : 0;
+    s->next_edge = s->config.edge_rate > 0 ? jittered(s, phase_time(s, s->edge_phase), s->config.edge_jitter, previous) : NEVER;
+}
+
+static void schedule_quad(struct pru_sigsim* s)
+{
+    s->next_quad = s->config.edge_rate > 0 ? (uint64_t) llround(phase_time(s, s->quad_phase)) : NEVER;
+}
+
+static void log_transition(struct pru_sigsim* s, uint64_t cycle)
+{
+    s->position += s->direction;
+    if (s->transitions < s->transition_log_size) {
+        struct pru_sigsim_transition* t = &s->transition_log[s->transitions];
+        t->cycle = cycle;
+        t->position = s->position;
+        t->state = (s->r31 & ENCODER_BIT) >> 10 | (s->r31 & QUAD_2_BIT) >> 7;
+    }
+    s->transitions += 1;
+}
+
+//Turns the HWP around: the edges of both channels that were passed last are the next ones to come back
+static void reverse(struct pru_sigsim* s)
+{
+    s->turn_phase += s->direction * (s->reverse_cycle - s->turn_cycle) / s->edge_period;
+    s->turn_cycle = s->reverse_cycle;
+    s->edge_phase -= s->direction;
+    s->quad_phase -= s->direction;
+    s->direction = -s->direction;
+    s->next_edge = s->reverse_cycle; //the edge that was due is cancelled, the next one only has to come after the turn
+    s->reverse_cycle = NEVER;
+    schedule_edge(s);
+    schedule_quad(s);
+}
+
+//Brings the pins, the IEP overflow and the on word up to s->now
+static void advance(struct pru_sigsim* s)
+{
+    //both channels in time order, so the transition log is too
+    for (;;) {
+        if (s->reverse_cycle <= s->now && s->reverse_cycle < s->next_edge && s->reverse_cycle < s->next_quad) {
+            reverse(s);
+        } else if (s->next_edge <= s->now && s->next_edge <= s->next_quad) {
+            s->r31 ^= ENCODER_BIT;
+            if (s->edges < s->edge_log_size) {
+                s->edge_log[s->edges] = s->next_edge;
+            }
+            s->edges += 1;
+            log_transition(s, s->next_edge);
+            s->edge_phase += s->direction;
+            schedule_edge(s);
+        } else if (s->next_quad <= s->now) {
+            s->r31 ^= QUAD_2_BIT;
+            s->quads += 1;
+            log_transition(s, s->next_quad);
+            s->quad_phase += s->direction;
+            schedule_quad(s);
+        } else {
+            break;
+        }
+    }
+    while (s->next_irig <= s->now) {
+        if (!s->irig_high) {
+            s->r31 |= IRIG_BIT;
+            if (s->irig_bit < s->irig_log_size) {
+                s->irig_log[s->irig_bit] = s->next_irig;
+            }
+            s->irig_high = 1;
+            s->next_irig = jittered(s, irig_rise(s, s->irig_bit) + irig_width(s, s->irig_bit), s->config.irig_jitter, s->next_irig);
+        } else {
+            s->r31 &= ~IRIG_BIT;
+            s->irig_high = 0;
+            s->irig_bit += 1;
+            s->next_irig = jittered(s, irig_rise(s, s->irig_bit), s->config.irig_jitter, s->next_irig);
+        }
+    }
+
+    uint64_t wraps = ((uint64_t) s->config.iep_start + s->now) >> 32;
+    if (wraps != s->wraps) {
+        if (s->config.maintain_overflow) {
+            *PRU_SHM_PTR(s->shm, uint32_t, OVERFLOW_OFFSET) += (uint32_t) (wraps - s->wraps);
+            s->wraps_cleared = wraps;
+        }
+        s->wraps = wraps;
+    }
+    if (s->now >= s->end) {
+        *PRU_SHM_PTR(s->shm, uint32_t, ON_OFFSET) = 1;
+    }
+}
+
+void pru_sigsim_init(struct pru_sigsim* s, volatile uint8_t* shm, const struct pru_sigsim_config* config)
+{
+    memset(s, 0, sizeof(*s));
+    s->config = *config;
+    s->config.cycles_op = config->cycles_op > 0 ? config->cycles_op : PRU_SIGSIM_CYCLES_OP;
+    s->config.cycles_load = config->cycles_load > 0 ? config->cycles_load : PRU_SIGSIM_CYCLES_LOAD;
+    s->config.cycles_store = config->cycles_store > 0 ? config->cycles_store : PRU_SIGSIM_CYCLES_STORE;
+    s->config.cycles_iep = config->cycles_iep > 0 ? config->cycles_iep : PRU_SIGSIM_CYCLES_IEP;
+    s->shm = shm;
+    s->end = (uint64_t) (config->duration * PRU_SIGSIM_HZ);
+    s->rng = config->seed ? config->seed : 88172645463325252ull;
+    s->r31 = QUAD_3_BIT;
+    s->edge_period = config->edge_rate > 0 ? PRU_SIGSIM_HZ / config->edge_rate : 0;
+    s->edge_phase = 1;
+    s->quad_phase = 1.5;
+    s->direction = 1;
+    s->reverse_cycle = config->reverse_at > 0 && config->edge_rate > 0 ? (uint64_t) (config->reverse_at * PRU_SIGSIM_HZ) : NEVER;
+    schedule_edge(s);
+    schedule_quad(s);
+    s->next_irig = jittered(s, irig_rise(s, 0), config->irig_jitter, 0);
+    s->wraps = s->wraps_cleared = (uint64_t) config->iep_start >> 32;
+    current = s;
+}
+
+void pru_sigsim_select(struct pru_sigsim* s)
+{
+    current = s;
+}
+
+uint32_t pru_sigsim_r31(void)
+{
+    struct pru_sigsim* s = current;
+    s->now += s->config.cycles_op;
+    s->counts.r31_reads += 1;
+    advance(s);
+    return s->r31;
+}
+
+void pru_sigsim_event(uint32_t event)
+{
+    struct pru_sigsim* s = current;
+    s->now += s->config.cycles_op;
+    s->counts.events += 1;
+    advance(s);
+    if (s->on_event != NULL) {
+        s->on_event(s->on_event_ctx, event);
+    }
+}
+
+void pru_sigsim_iep_start(void)
+{
+    struct pru_sigsim* s = current;
+    s->now += 3 * s->config.cycles_store;
+    s->counts.stores += 3;
+    advance(s);
+    s->wraps_cleared = s->wraps;
+}
+
+uint32_t pru_sigsim_iep_count(void)
+{
+    struct pru_sigsim* s = current;
+    s->now += s->config.cycles_iep;
+    s->counts.iep_reads += 1;
+    advance(s);
+    return (uint32_t) (s->config.iep_start + s->now);
+}
+
+uint32_t pru_sigsim_iep_overflowed(void)
+{
+    struct pru_sigsim* s = current;
+    s->now += s->config.cycles_iep;
+    s->counts.iep_reads += 1;
+    advance(s);
+    return s->wraps != s->wraps_cleared;
+}
+
+void pru_sigsim_iep_clear_overflow(void)
+{
+    struct pru_sigsim* s = current;
+    s->now += s->config.cycles_store;
+    s->counts.stores += 1;
+    advance(s);
+    s->wraps_cleared = s->wraps;
+}
+
+void pru_sigsim_cost(int ops, int loads, int stores)
+{
+    struct pru_sigsim* s = current;
+    s->now += ops * s->config.cycles_op + loads * s->config.cycles_load + stores * s->config.cycles_store;
+    s->counts.ops += ops;
+    s->counts.loads += loads;
+    s->counts.stores += stores;
+    advance(s);
+}
@@ -0,0 +1,126 @@
+//Deterministic stand-in for the PRU input pins and the IEP timer, for running the detection kernels on a host
+//
+//Time is counted in PRU cycles (5 ns, the IEP counts one per cycle). Nothing happens between accesses: every
+//R31 or IEP access and every PRU_COST() in a kernel moves the clock forward by what it costs on the PRU, and
+//the signals are then brought up to the new time. The signals on R31 are
+//  - bit 10 (P8_28): the encoder square wave at edge_rate, every edge moved by gaussian jitter
+//  - bit 8 (P8_27): the quadrature channel, the same wave a quarter period later, low at every rising edge
+//    while the HWP turns forward. With reverse_at set the HWP turns back at that time and both channels
+//    retrace their edges, so the quadrature channel is then high at every rising edge.
+//  - bit 9 (P8_29) high and bit 11 (P8_30) low: the remaining quadrature pins
+//  - bit 14 (P8_16): IRIG-B, one 100 bit frame per second carrying the time of day, 2/5/8 ms pulses for
+//    0/1/position bits, every edge moved by gaussian jitter
+//The random numbers come from a fixed seed, so a run replays exactly.
+
+#ifndef PRU_SIGSIM_H
+#define PRU_SIGSIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PRU_SIGSIM_HZ 200000000.0 //PRU clock and IEP counter frequency
+
+//PRU cycles of each kind of access, rough figures for the AM335x PRU-ICSS
+#define PRU_SIGSIM_CYCLES_OP 1 //register instruction, including a read of R31
+#define PRU_SIGSIM_CYCLES_LOAD 3 //LBBO/LBCO of a word from data or shared RAM
+#define PRU_SIGSIM_CYCLES_STORE 2 //SBBO/SBCO of a word
+#define PRU_SIGSIM_CYCLES_IEP 4 //read of an IEP timer register over the local interconnect
+
+struct pru_sigsim_config {
+    double edge_rate; //encoder edges per second, 0 leaves the encoder pin low
+    double edge_jitter; //seconds rms on every encoder edge
+    double reverse_at; //seconds from the start at which the HWP reverses, 0 never
+    double irig_jitter; //seconds rms on every IRIG edge
+    double irig_phase; //seconds from the start to the first IRIG frame
+    uint32_t irig_start; //time of day of the first IRIG frame, seconds since midnight
+    uint32_t iep_start; //IEP count at the start, close to 2^32 to get a wrap early on
+    double duration; //seconds of signal before the on word in shared memory is set to 1
+    int maintain_overflow; //counts IEP wraps into the overflow word, what the IRIG PRU does, when it is not running
+    uint64_t seed;
+    //PRU cycles per access, 0 picks the PRU_SIGSIM_CYCLES_ defaults
+    int cycles_op;
+    int cycles_load;
+    int cycles_store;
+    int cycles_iep;
+};
+
+struct pru_sigsim_counts {
+    unsigned long int r31_reads;
+    unsigned long int iep_reads; //count and status
+    unsigned long int ops; //from PRU_COST(), R31 reads not included
+    unsigned long int loads;
+    unsigned long int stores; //IEP writes included
+    unsigned long int events; //interrupts raised to the ARM
+};
+
+//A transition of either quadrature channel (the encoder pin or P8_27)
+struct pru_sigsim_transition {
+    uint64_t cycle;
+    int32_t position; //after the transition, +1 per transition forward and -1 backward
+    uint32_t state; //bit 0 the encoder pin, bit 1 P8_27, after the transition
+};
+
+struct pru_sigsim {
+    struct pru_sigsim_config config;
+    volatile uint8_t* shm; //simulated shared RAM, PRU_SHM_SIZE bytes
+    uint64_t now; //PRU cycles since the start
+    uint64_t end; //cycle at which on is set
+    uint32_t r31; //pin levels
+
+    //encoder and quadrature, the encoder pin changes where the phase of the HWP is a whole number of edge
+    //periods and P8_27 half way between
+    double edge_period; //cycles
+    double edge_phase; //phase of the next encoder transition, in edge periods
+    double quad_phase; //phase of the next P8_27 transition
+    int direction; //+1 turning forward, -1 backward
+    double turn_cycle; //cycle and phase of the last reversal, the phase is a linear function of time from there
+    double turn_phase;
+    uint64_t reverse_cycle;
+    uint64_t next_edge;
+    uint64_t next_quad;
+    uint32_t edges; //encoder transitions so far, the first one is rising
+    uint32_t quads;
+    int32_t position; //transitions of both channels, counted back down after a reversal
+    uint64_t* edge_log; //cycle of encoder transition n in edge_log[n - 1], optional
+    size_t edge_log_size;
+    struct pru_sigsim_transition* transition_log; //transition n of either channel in transition_log[n - 1], optional
+    size_t transition_log_size;
+    uint32_t transitions;
+
+    //IRIG
+    uint64_t next_irig;
+    uint32_t irig_bit; //bits started so far over all frames
+    int irig_high;
+    uint64_t* irig_log; //cycle of the rising edge of bit n (over all frames) in irig_log[n], optional
+    size_t irig_log_size;
+
+    //IEP overflow flag, set on every wrap and cleared by the kernel
+    uint64_t wraps;
+    uint64_t wraps_cleared;
+
+    uint64_t rng;
+    struct pru_sigsim_counts counts;
+    //called for every PRU_R31_EVENT(), for instance to drain the rings like the forwarder would
+    void (*on_event)(void* ctx, uint32_t event);
+    void* on_event_ctx;
+};
+
+//Sets up a simulation on shm and makes it the one the accessors use
+void pru_sigsim_init(struct pru_sigsim* s, volatile uint8_t* shm, const struct pru_sigsim_config* config);
+
+//The simulation the accessors use, one per thread
+void pru_sigsim_select(struct pru_sigsim* s);
+
+//Expected IRIG info[] words of a time of day, as the PRU decodes them
+void pru_sigsim_irig_info(uint32_t time_of_day, uint32_t* info);
+
+//Accessors behind pru_hw.h
+uint32_t pru_sigsim_r31(void);
+void pru_sigsim_event(uint32_t event);
+void pru_sigsim_iep_start(void);
+uint32_t pru_sigsim_iep_count(void);
+uint32_t pru_sigsim_iep_overflowed(void);
+void pru_sigsim_iep_clear_overflow(void);
+void pru_sigsim_cost(int ops, int loads, int stores);
+
+#endif
@@ -0,0 +1,225 @@
+//Simulated PRUs for running the ARM forwarder without a Beaglebone
+//
+// Usage:
+// $ ./pru_sim [-r edges_per_second] [-t seconds] [-n packet_edges] [-c channels] [-q] [-e] [-S /sim_shm_name]
+// -t 0 publishes until the forwarder tells the PRUs to stop, as they do on the Beaglebone
+// -n and -c write the config block as Beaglebone_Encoder_DAQ does, start the forwarder after this
+// -q publishes quadrature packets as Encoder_Detection.c does with the quadrature config
+// -e writes every edge into its slot as it happens, for the forwarder's phase output (-p) to read early
+// then in another shell
+// $ ./Beaglebone_Encoder_DAQ_sim -S /sim_shm_name
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "forwarder.h"
+#include "pru_layout.h"
+#include "pru_ring.h"
+#include "pru_sim.h"
+
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_until(double t)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t) t;
+    ts.tv_nsec = (long) ((t - ts.tv_sec) * 1e9);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+//BCD encoding of an IRIG field in the layout of IRIG-B, as Host/irig_frame.c decodes it
+static uint32_t irig_bcd(unsigned int value, int shift)
+{
+    return (((value % 10) & 0xf) | ((value / 10) << 5)) << shift;
+}
+
+void pru_sim_reset(struct pru_shm* shm)
+{
+    memset((void *) shm->base, 0, PRU_SHM_SIZE);
+}
+
+void pru_sim_run(struct pru_shm* shm, const struct pru_sim_config* config, struct pru_sim_stats* stats)
+{
+    volatile uint32_t* on = PRU_SHM_PTR(shm->base, uint32_t, ON_OFFSET);
+    volatile uint32_t* control = PRU_SHM_PTR(shm->base, uint32_t, PRU_CONTROL_OFFSET);
+    volatile struct pru_telemetry* telemetry = PRU_SHM_PTR(shm->base, struct pru_telemetry, TELEMETRY_OFFSET);
+    static const uint32_t quad_state[4] = { 0, 1, 3, 2 }; //state of the two channels at each position, turning forward
+    //private to the producer, like the PRUs' local data RAM, and shared by the channels as on the PRU
+    static uint8_t counter_scratch[COUNTER_SLOT_SIZE(ENCODER_COUNTER_SIZE)] __attribute__((aligned(4)));
+    static struct IrigSlot irig_scratch;
+    struct pru_ring_writer counter_rings[PRU_MAX_CHANNELS], irig_ring;
+    struct pru_config pru_config;
+    struct pru_shm_layout layout;
+
+    //the layout comes from the config block the ARM wrote, as the encoder PRU reads it at startup
+    pru_config_read(shm->base, &pru_config);
+    pru_layout_compute(&pru_config, &layout);
+    uint32_t n = layout.packet_edges;
+    int quadrature = config->quadrature || pru_config.quadrature;
+    uint32_t header = quadrature ? ENCODER_QUAD_HEADER : ENCODER_HEADER;
+    for (uint32_t c = 0; c < layout.n_channels; c++) {
+        pru_ring_writer_init(&counter_rings[c], shm->base, layout.ring_ctrl_offset[c], layout.ring_offset[c],
+                             layout.slot_size, layout.slots, counter_scratch);
+        for (uint32_t k = 0; k < layout.slots; k++) {
+            *PRU_SHM_PTR(counter_rings[c].slots, uint32_t, k * layout.slot_size + 4) = header;
+        }
+    }
+    pru_ring_writer_init(&irig_ring, shm->base, IRIG_RING_CTRL_OFFSET, IRIG_RING_OFFSET,
+                         sizeof(struct IrigSlot), IRIG_RING_SLOTS, (volatile uint8_t *) &irig_scratch);
+    for (uint32_t k = 0; k < IRIG_RING_SLOTS; k++) {
+        PRU_SHM_PTR(irig_ring.slots, struct IrigSlot, k * sizeof(struct IrigSlot))->packet.random_header = IRIG_HEADER;
+    }
+    *PRU_SHM_PTR(counter_scratch, uint32_t, 4) = header;
+    irig_scratch.packet.random_header = IRIG_HEADER;
+
+    //next_packet and next_irig are in simulated seconds since the start, which follow the wall clock unless config->unpaced
+    //An IRIG frame takes a second to read, so its packet goes out a second after its rising edge as on the PRU
+    //The IEP count at simulated time t is CLOCK_MONOTONIC at start + t, as pru_shm_iep_count() reads it
+    //Every channel sees the same rotation, so their packets fill up and go out together
+    double entry_rate = quadrature ? 2 * config->edge_rate : config->edge_rate;
+    double packet_period = n / entry_rate;
+    double start = now_s();
+    double iep_origin = start * PRU_SHM_IEP_HZ;
+    double next_packet = packet_period;
+    double next_irig = 1.0;
+    uint32_t edge = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    *on = 0;
+    //runs until the forwarder writes PRU_CONTROL_STOP, or config->duration if it is set and comes first
+    while (*control == PRU_CONTROL_RUN &&
+           (config->duration <= 0 || next_packet < config->duration || next_irig + 1.0 < config->duration)) {
+        //with live edges a packet is due when its first edge is, and an IRIG packet waits for it to finish
+        if ((config->live_edges ? next_packet - packet_period : next_packet) <= next_irig + 1.0) {
+            volatile uint32_t* packets[PRU_MAX_CHANNELS];
+            if (!config->unpaced && !config->live_edges) {
+                sleep_until(start + next_packet);
+            }
+            for (uint32_t c = 0; c < layout.n_channels; c++) {
+                packets[c] = PRU_SHM_PTR(pru_ring_claim(&counter_rings[c]), uint32_t, 4);
+            }
+            //edges (or transitions) are spread evenly over the packet period, timestamps come from the 200 MHz IEP counter
+            for (uint32_t x = 0; x < n; x++) {
+                double t = next_packet - packet_period + (x + 1) / entry_rate;
+                uint64_t clk = (uint64_t) (iep_origin + t * PRU_SHM_IEP_HZ);
+                if (config->live_edges && !config->unpaced) {
+                    sleep_until(start + t);
+                }
+                edge += 1;
+                //the count goes in last, as on the PRU
+                for (uint32_t c = 0; c < layout.n_channels; c++) {
+                    packets[c][ENCODER_PACKET_CLOCK_CNT(n) + x] = (uint32_t) clk;
+                    packets[c][ENCODER_PACKET_COUNTER_OVFLOW(n) + x] = (uint32_t) (clk >> 32);
+                    packets[c][ENCODER_PACKET_ENCODER_CNT(n) + x] = quadrature ? QUAD_WORD(edge, quad_state[edge & 3]) : edge;
+                }
+            }
+            for (uint32_t c = 0; c < layout.n_channels; c++) {
+                packets[c][ENCODER_PACKET_QUAD(n)] = c == 0; //the other channels have no pins of channel 0 to read, pru_layout.h
+                if (config->on_publish && c == 0) {
+                    config->on_publish(config->on_publish_ctx, FWD_ENCODER, counter_rings[c].seq);
+                }
+                if (pru_ring_publish(&counter_rings[c], (volatile uint8_t *) packets[c] - 4)) {
+                    pru_shm_signal_event(shm);
+                } else {
+                    stats->overwritten += 1;
+                }
+                stats->encoder_published += 1;
+            }
+            telemetry->encoder_edges = edge;
+            telemetry->encoder_packets = counter_rings[0].seq;
+            next_packet += packet_period;
+        } else {
+            if (!config->unpaced) {
+                sleep_until(start + next_irig + 1.0);
+            }
+            volatile struct IrigSlot* slot = (volatile struct IrigSlot *) pru_ring_claim(&irig_ring);
+            uint64_t clk = (uint64_t) (iep_origin + next_irig * PRU_SHM_IEP_HZ);
+            unsigned int secs = (unsigned int) next_irig;
+            slot->packet.rising_edge_time = (uint32_t) clk;
+            slot->packet.init_overflow = (uint32_t) (clk >> 32);
+            slot->packet.info[0] = irig_bcd(secs % 60, 1);
+            slot->packet.info[1] = irig_bcd((secs / 60) % 60, 0);
+            slot->packet.info[2] = irig_bcd((secs / 3600) % 24, 0);
+            for (int k = 0; k < 10; k++) {
+                uint64_t re = clk + (uint64_t) ((k * 10 + 9) * 0.01 * PRU_SHM_IEP_HZ);
+                slot->packet.re_count[k] = (uint32_t) re;
+                slot->packet.re_count_overflow[k] = (uint32_t) (re >> 32);
+            }
+            if (config->on_publish) {
+                config->on_publish(config->on_publish_ctx, FWD_IRIG, irig_ring.seq);
+            }
+            if (pru_ring_publish(&irig_ring, (volatile uint8_t *) slot)) {
+                pru_shm_signal_event(shm);
+            } else {
+                stats->overwritten += 1;
+            }
+            stats->irig_published += 1;
+            telemetry->irig_frames = irig_ring.seq;
+            next_irig += 1.0;
+        }
+    }
+    *on = 1;
+    pru_shm_signal_event(shm);
+}
+
+#ifdef PRU_SIM_MAIN
+int main(int argc, char **argv)
+{
+    struct pru_sim_config config = { .edge_rate = 2280, .duration = 10 };
+    const char* name = PRU_SHM_SIM_NAME;
+    struct pru_sim_stats stats;
+    struct pru_shm shm;
+    struct pru_config pru_config;
+    int opt;
+
+    pru_config_default(&pru_config);
+    while ((opt = getopt(argc, argv, "r:t:n:c:qeS:")) != -1) {
+        switch (opt) {
+        case 'r': config.edge_rate = atof(optarg); break;
+        case 't': config.duration = atof(optarg); break;
+        case 'n': pru_config.packet_edges = atoi(optarg); break;
+        case 'c': pru_config.n_channels = atoi(optarg); break;
+        case 'q': pru_config.quadrature = 1; break;
+        case 'e': config.live_edges = 1; break;
+        case 'S': name = optarg; break;
+        default:
+            printf("Usage: %s [-r edges_per_second] [-t seconds] [-n packet_edges] [-c channels] [-q] [-e] [-S /sim_shm_name]\n", argv[0]);
+            return 1;
+        }
+    }
+    //the channels after the first stand on the other P8 pins of PRU1 in turn
+    static const uint32_t bits[] = { 10, 8, 9, 11, 6, 7, 4, 5 };
+    for (uint32_t c = 1; c < pru_config.n_channels && c < PRU_MAX_CHANNELS; c++) {
+        pru_config.pin_mask[c] = 1u << bits[2 * c];
+        pru_config.quad_mask[c] = 1u << bits[2 * c + 1];
+    }
+    if (!pru_config_valid(&pru_config)) {
+        printf("%u edges per packet in %u channels does not fit, at most %u edges in up to %u channels\n",
+               pru_config.packet_edges, pru_config.n_channels, ENCODER_COUNTER_SIZE, PRU_MAX_CHANNELS);
+        return 1;
+    }
+
+    if (pru_shm_open(&shm, name, 1) < 0) {
+        return 1;
+    }
+    pru_sim_reset(&shm);
+    pru_config_write(shm.base, &pru_config);
+    printf("Simulated PRUs on %s, start the forwarder with -S %s\n", name, name);
+    sleep(1);
+    pru_sim_run(&shm, &config, &stats);
+    printf("Published %lu encoder and %lu IRIG packets, %lu dropped on full rings\n",
+           stats.encoder_published, stats.irig_published, stats.overwritten);
+    sleep(1); //gives the forwarder time to see *on before the segment goes away
+    pru_shm_close(&shm, 1);
+    return 0;
+}
+#endif
@@ -0,0 +1,37 @@
+//Stand-in for the Encoder and IRIG PRU programs writing into a simulated shared memory segment
+//Packets are published into the rings with the same protocol as Encoder_Detection.c and IRIG_Detection.c, in the
+//packet size and channels of the config block found in shared memory (pru_layout.h), every channel turning alike
+
+#ifndef PRU_SIM_H
+#define PRU_SIM_H
+
+#include <stdint.h>
+
+#include "pru_shm.h"
+
+struct pru_sim_config {
+    double edge_rate; //encoder edges per second (570*2 slits at 2 Hz is 2280)
+    double duration; //seconds of signal to simulate before setting the on variable, 0 until PRU_CONTROL_STOP
+    int unpaced; //publish as fast as possible instead of in real time, for stress tests
+    int quadrature; //publish quadrature packets (ENCODER_QUAD_HEADER) of a forward turning HWP, two transitions per edge,
+                    //as a config block asking for quadrature does too
+    int live_edges; //write every entry into its slot at the time of its edge, as the PRU does, instead of the whole
+                    //packet at its end. An IRIG packet due meanwhile goes out once the packet is finished.
+    //optional hook called right before a packet is published, used by the benchmarks, for channel 0 only
+    void (*on_publish)(void* ctx, int type, uint32_t seq);
+    void* on_publish_ctx;
+};
+
+struct pru_sim_stats {
+    unsigned long int encoder_published;
+    unsigned long int irig_published;
+    unsigned long int overwritten; //packets dropped because a ring was full
+};
+
+//Clears shared memory and the rings like the ARM and PRU programs do at startup
+void pru_sim_reset(struct pru_shm* shm);
+
+//Publishes packets, following the config block written after pru_sim_reset(), until config->duration of signal has been simulated or the control word says stop, then sets on = 1
+void pru_sim_run(struct pru_shm* shm, const struct pru_sim_config* config, struct pru_sim_stats* stats);
+
+#endif
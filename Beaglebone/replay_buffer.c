@@ -0,0 +1,97 @@
+#define _GNU_SOURCE //MAP_POPULATE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "replay_buffer.h"
+
+int replay_buffer_init(struct replay_buffer* rb, size_t bytes)
+{
+    memset(rb, 0, sizeof(*rb));
+    if (bytes < sizeof(struct replay_header) || bytes > UINT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    rb->data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (rb->data == MAP_FAILED) {
+        rb->data = NULL;
+        return -1;
+    }
+    rb->n_entries = bytes / REPLAY_ENTRY_BYTES + 1;
+    if ((rb->entries = calloc(rb->n_entries, sizeof(struct replay_entry))) == NULL) {
+        munmap(rb->data, bytes);
+        rb->data = NULL;
+        return -1;
+    }
+    rb->size = bytes;
+    return 0;
+}
+
+void replay_buffer_free(struct replay_buffer* rb)
+{
+    if (rb->data != NULL) {
+        munmap(rb->data, rb->size);
+    }
+    free(rb->entries);
+    memset(rb, 0, sizeof(*rb));
+}
+
+//Finds room for len bytes at head, dropping the oldest packets until there is
+static void make_room(struct replay_buffer* rb, size_t len)
+{
+    while (1) {
+        if (rb->first == rb->next) {
+            rb->head = 0;
+            return;
+        }
+        if (rb->next - rb->first < rb->n_entries) {
+            //packets sit in [tail, head) when head is past tail and in [tail, end) and [0, head) when it is not
+            size_t tail = rb->entries[rb->first % rb->n_entries].offset;
+            if (rb->head > tail) {
+                if (rb->head + len <= rb->size) {
+                    return;
+                }
+                if (len <= tail) {
+                    rb->head = 0;
+                    return;
+                }
+            } else if (rb->head + len <= tail) {
+                return;
+            }
+        }
+        rb->first += 1;
+        rb->evicted += 1;
+    }
+}
+
+const uint8_t* replay_buffer_add(struct replay_buffer* rb, const volatile void* packet, size_t len, size_t* wrapped_len)
+{
+    size_t size = sizeof(struct replay_header) + len;
+
+    if (size > rb->size) {
+        return NULL;
+    }
+    make_room(rb, size);
+
+    uint8_t* p = rb->data + rb->head;
+    struct replay_header h = { .header = REPLAY_HEADER, .size = (uint32_t) size, .seq = rb->next };
+    memcpy(p, &h, sizeof(h));
+    memcpy(p + sizeof(h), (const void *) packet, len);
+    rb->entries[rb->next % rb->n_entries] = (struct replay_entry) { .offset = (uint32_t) rb->head, .size = (uint32_t) size };
+    rb->head += size;
+    rb->next += 1;
+    *wrapped_len = size;
+    return p;
+}
+
+const uint8_t* replay_buffer_get(const struct replay_buffer* rb, uint32_t seq, size_t* len)
+{
+    //unsigned differences, so the check holds across the wrap of the sequence numbers
+    if (seq - rb->first >= rb->next - rb->first) {
+        return NULL;
+    }
+    const struct replay_entry* e = &rb->entries[seq % rb->n_entries];
+    *len = e->size;
+    return rb->data + e->offset;
+}
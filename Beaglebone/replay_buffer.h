@@ -0,0 +1,85 @@
+//Replay buffer of everything the forwarder sent, so packets the network lost can be sent again
+//
+//With replay on, every packet the forwarder sends (encoder, IRIG, error and stats) goes out behind a struct
+//replay_header that numbers it. The numbers count the packets the forwarder sent and nothing else, so unlike
+//the ring sequence numbers, which also count packets the PRUs had to drop, a gap in them is always a packet lost
+//between the Beaglebone and the host. The wrapped packet is kept in a ring in ARM memory until the ring needs
+//its space, a few minutes at the normal rate for a ring of 16 MB.
+//
+//A receiver that sees a gap answers with a struct nack_packet listing the missing ranges, sent back to the
+//address the data came from. The forwarder sends those packets again from the ring, as they were sent the first
+//time, after the live packets of every wakeup and at a limited rate, so the live stream never waits behind a
+//retransmission. A receiver takes a packet it already has as a duplicate and drops it.
+//
+//The ring lives in ordinary DDR memory of the ARM. The PRU extended memory mapped by prussdrv_map_extmem() is
+//only as big as the uio_pruss extram_pool_sz parameter, 256 kB unless the module is reloaded, a few seconds of
+//data, and the PRUs never need to see the ring.
+//
+//Wire framing follows udp_batch.h: both packet types carry their size in the word after the header.
+
+#ifndef REPLAY_BUFFER_H
+#define REPLAY_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define REPLAY_HEADER 0x5e90
+#define NACK_HEADER 0x4ac0
+
+#define REPLAY_ENTRY_BYTES 128 //ring bytes per index entry, less than any packet but an error packet takes
+#define NACK_MAX_RANGES 128 //ranges in one NACK packet
+
+//Ahead of every packet sent with replay on, size covers this header and the packet behind it
+struct replay_header {
+    uint32_t header; //REPLAY_HEADER
+    uint32_t size;
+    uint32_t seq; //packets the forwarder sent before this one
+};
+
+//Packets first to first + count - 1
+struct nack_range {
+    uint32_t first;
+    uint32_t count;
+};
+
+//Sent by the receiver, size is 12 bytes plus 8 per range
+struct nack_packet {
+    uint32_t header; //NACK_HEADER
+    uint32_t size;
+    uint32_t n_ranges;
+    struct nack_range ranges[NACK_MAX_RANGES];
+};
+
+//Where a packet sits in the ring
+struct replay_entry {
+    uint32_t offset;
+    uint32_t size;
+};
+
+//The ring is filled from head on, a packet that does not fit before the end starts over at 0, so every packet is
+//in one piece. The oldest packets are dropped as the head comes round to them.
+struct replay_buffer {
+    uint8_t* data;
+    size_t size;
+    struct replay_entry* entries; //packet seq at seq % n_entries
+    uint32_t n_entries;
+    uint32_t first; //oldest packet still held
+    uint32_t next; //sequence number of the next packet
+    size_t head; //where the next packet goes
+    unsigned long int evicted; //packets dropped to make room
+};
+
+//Allocates a ring of bytes and faults it in, so adding a packet never waits for the kernel to find a page
+//Returns 0 on success, -1 with errno set otherwise
+int replay_buffer_init(struct replay_buffer* rb, size_t bytes);
+
+void replay_buffer_free(struct replay_buffer* rb);
+
+//Numbers a packet and stores it behind its replay header, returns the wrapped packet to send and its size in *wrapped_len
+//NULL if the packet is larger than the ring
+const uint8_t* replay_buffer_add(struct replay_buffer* rb, const volatile void* packet, size_t len, size_t* wrapped_len);
+
+//The wrapped packet seq as it was sent, NULL if it has been dropped from the ring or has not been sent yet
+const uint8_t* replay_buffer_get(const struct replay_buffer* rb, uint32_t seq, size_t* len);
+
+#endif
@@ -0,0 +1,63 @@
+#define _GNU_SOURCE //CPU_SET and pthread_setaffinity_np
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "rt.h"
+
+void rt_prefault(const volatile void* p, size_t len, int write)
+{
+    volatile uint8_t* bytes = (volatile uint8_t *) p;
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+
+    for (size_t k = 0; k < len; k += page) {
+        if (write) {
+            bytes[k] = bytes[k];
+        } else {
+            (void) bytes[k];
+        }
+    }
+}
+
+//Grows the stack to its full depth once, so the pages are there before the loop needs them
+static void prefault_stack(void)
+{
+    volatile uint8_t stack[RT_STACK_PREFAULT];
+
+    rt_prefault(stack, sizeof(stack), 1);
+}
+
+int rt_setup(const struct rt_config* config)
+{
+    int rc;
+
+    if (config->lock_memory) {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+            perror("mlockall");
+            return -1;
+        }
+        prefault_stack();
+    }
+    if (config->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(config->cpu, &set);
+        if ((rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0) {
+            fprintf(stderr, "Could not pin the forwarder to CPU %d: %s\n", config->cpu, strerror(rc));
+            return -1;
+        }
+    }
+    if (config->priority > 0) {
+        struct sched_param param = { .sched_priority = config->priority };
+        if ((rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) != 0) {
+            fprintf(stderr, "Could not run the forwarder under SCHED_FIFO %d: %s\n", config->priority, strerror(rc));
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+//Real-time setup of the forwarding thread: memory locked and faulted in ahead of time, pinned to a CPU and run
+//under SCHED_FIFO
+//
+//Run as a normal process, the forwarder can be held up by a page fault on its own buffers, or by any daemon the
+//scheduler prefers at that moment, and the PRU goes on filling the encoder ring meanwhile. With the memory
+//locked, nothing the loop touches is ever paged out or faulted in for the first time mid-run. A SCHED_FIFO
+//priority wakes it ahead of every normal process as soon as the PRU interrupt arrives. A CPU of its own keeps it
+//out of the way of the rest of the system. Nothing here touches the PRUs, so the same setup runs against the
+//simulated shared memory on any Linux host, given CAP_SYS_NICE and CAP_IPC_LOCK (or root).
+
+#ifndef RT_H
+#define RT_H
+
+#include <stddef.h>
+
+#define RT_STACK_PREFAULT (256 * 1024) //bytes of stack faulted in by rt_setup(), far more than the loop uses
+
+struct rt_config {
+    int cpu; //CPU the calling thread is pinned to, -1 leaves the affinity alone
+    int priority; //SCHED_FIFO priority of the calling thread from 1 to 99, 0 leaves the policy alone
+    int lock_memory; //locks everything mapped now and later into RAM and faults in the stack
+};
+
+//Applies config to the calling thread, and to the whole process for the memory
+//Returns 0, or -1 with a message printed for the first part that could not be applied
+int rt_setup(const struct rt_config* config);
+
+//Touches every page of a buffer so none of it faults on first use, write dirties them as well, which shared
+//memory of the PRUs must not be
+void rt_prefault(const volatile void* p, size_t len, int write);
+
+#endif
@@ -0,0 +1,135 @@
+#define _GNU_SOURCE //sendmmsg
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "udp_batch.h"
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void udp_batch_init(struct udp_batch* b, int sockfd, const struct sockaddr_in* dest, enum udp_batch_mode mode, long latency_us)
+{
+    b->sockfd = sockfd;
+    b->dest = *dest;
+    b->mode = mode;
+    b->max_datagram_size = UDP_BATCH_MAX_DATAGRAM_SIZE;
+    b->latency_us = latency_us;
+    b->n_datagrams = 0;
+    b->oldest_ns = 0;
+    b->pending = 0;
+    b->packets = 0;
+    b->datagrams = 0;
+    b->syscalls = 0;
+    b->send_errors = 0;
+    b->on_sent = NULL;
+    b->on_sent_ctx = NULL;
+}
+
+int udp_batch_flush(struct udp_batch* b)
+{
+    struct mmsghdr msgs[UDP_BATCH_MAX_DATAGRAMS];
+    struct iovec iov[UDP_BATCH_MAX_DATAGRAMS];
+    int sent = 0, rc = 0;
+
+    if (b->n_datagrams == 0) {
+        return 0;
+    }
+    memset(msgs, 0, sizeof(msgs[0]) * b->n_datagrams);
+    for (int k = 0; k < b->n_datagrams; k++) {
+        iov[k].iov_base = b->buf[k];
+        iov[k].iov_len = b->len[k];
+        msgs[k].msg_hdr.msg_name = &b->dest;
+        msgs[k].msg_hdr.msg_namelen = sizeof(b->dest);
+        msgs[k].msg_hdr.msg_iov = &iov[k];
+        msgs[k].msg_hdr.msg_iovlen = 1;
+    }
+    //sendmmsg stops at the first datagram it cannot send, that one is dropped and the rest retried
+    while (sent < b->n_datagrams) {
+        int n = sendmmsg(b->sockfd, msgs + sent, b->n_datagrams - sent, 0);
+        b->syscalls += 1;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            b->send_errors += 1;
+            sent += 1;
+            rc = -1;
+        } else {
+            sent += n;
+        }
+    }
+    b->datagrams += b->n_datagrams;
+    b->n_datagrams = 0;
+    if (b->on_sent) {
+        b->on_sent(b->on_sent_ctx, b->oldest_ns, now_ns(), b->pending);
+    }
+    b->pending = 0;
+    return rc;
+}
+
+int udp_batch_add(struct udp_batch* b, const volatile void* packet, size_t len)
+{
+    int rc = 0;
+
+    b->packets += 1;
+    if (b->mode == UDP_BATCH_SINGLE) {
+        uint64_t added_ns = b->on_sent ? now_ns() : 0;
+        b->syscalls += 1;
+        b->datagrams += 1;
+        if (sendto(b->sockfd, (const void *) packet, len, MSG_CONFIRM, (const struct sockaddr *) &b->dest, sizeof(b->dest)) < 0) {
+            b->send_errors += 1;
+            rc = -1;
+        }
+        if (b->on_sent) {
+            b->on_sent(b->on_sent_ctx, added_ns, now_ns(), 1);
+        }
+        return rc;
+    }
+
+    //starts a new datagram unless the packet fits behind the last one
+    int k = b->n_datagrams - 1;
+    if (k < 0 || b->mode != UDP_BATCH_COALESCE || b->len[k] + len > b->max_datagram_size) {
+        if (b->n_datagrams == UDP_BATCH_MAX_DATAGRAMS) {
+            rc = udp_batch_flush(b);
+        }
+        if (b->n_datagrams == 0) {
+            b->oldest_ns = now_ns();
+        }
+        k = b->n_datagrams++;
+        b->len[k] = 0;
+    }
+    memcpy(b->buf[k] + b->len[k], (const void *) packet, len);
+    b->len[k] += len;
+    b->pending += 1;
+    return rc;
+}
+
+long udp_batch_due_in_us(struct udp_batch* b)
+{
+    if (b->n_datagrams == 0) {
+        return -1;
+    }
+    long waited_us = (long) ((now_ns() - b->oldest_ns) / 1000);
+    return waited_us >= b->latency_us ? 0 : b->latency_us - waited_us;
+}
+
+int udp_batch_parse_mode(const char* name)
+{
+    if (strcmp(name, "single") == 0) {
+        return UDP_BATCH_SINGLE;
+    }
+    if (strcmp(name, "mmsg") == 0) {
+        return UDP_BATCH_MMSG;
+    }
+    if (strcmp(name, "coalesce") == 0) {
+        return UDP_BATCH_COALESCE;
+    }
+    return -1;
+}
@@ -0,0 +1,64 @@
+//Batches packets before they go out over UDP so the forwarder does not pay one syscall per packet
+//
+//Packets are copied out of shared memory into a set of datagram buffers. With coalescing on, several
+//packets share a datagram; every batched mode hands all full datagrams to the kernel with one sendmmsg().
+//A batch is flushed when the buffers are full or when its oldest packet has waited latency_us.
+//
+//Wire framing: a datagram is a concatenation of packets, each starting with its 32-bit little endian
+//header word. 0x1EAF, 0xCAFE and 0xE12A packets have fixed sizes (see pru_layout.h); any packet type
+//added later carries its total size in bytes in the 32-bit word after its header, so receivers can
+//split a datagram without knowing every type.
+
+#ifndef UDP_BATCH_H
+#define UDP_BATCH_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define UDP_BATCH_MAX_DATAGRAMS 32 //datagrams handed to one sendmmsg()
+#define UDP_BATCH_MAX_DATAGRAM_SIZE 8192 //largest coalesced datagram, receivers read in 8 kB chunks
+
+enum udp_batch_mode {
+    UDP_BATCH_SINGLE,  //one sendto() per packet as soon as it is added, the original behaviour
+    UDP_BATCH_MMSG,    //one datagram per packet, sent together with sendmmsg()
+    UDP_BATCH_COALESCE //several packets per datagram, sent together with sendmmsg()
+};
+
+struct udp_batch {
+    int sockfd;
+    struct sockaddr_in dest;
+    enum udp_batch_mode mode;
+    size_t max_datagram_size; //coalesced datagrams never grow past this
+    long latency_us; //longest a packet may wait in the batch
+    int n_datagrams; //datagrams in use, the last one may still have room
+    size_t len[UDP_BATCH_MAX_DATAGRAMS];
+    uint8_t buf[UDP_BATCH_MAX_DATAGRAMS][UDP_BATCH_MAX_DATAGRAM_SIZE];
+    uint64_t oldest_ns; //time the oldest packet in the batch was added
+    int pending; //packets in the batch
+    unsigned long int packets; //packets sent
+    unsigned long int datagrams; //datagrams sent
+    unsigned long int syscalls; //sendto()/sendmmsg() calls made
+    unsigned long int send_errors; //datagrams the kernel refused
+    //optional hook called after every send with the CLOCK_MONOTONIC times the oldest packet was added and the
+    //send returned, and the number of packets that went out, used for the forwarder's telemetry
+    void (*on_sent)(void* ctx, uint64_t oldest_ns, uint64_t sent_ns, int packets);
+    void* on_sent_ctx;
+};
+
+//Sets up an empty batch, sockfd must already be open
+void udp_batch_init(struct udp_batch* b, int sockfd, const struct sockaddr_in* dest, enum udp_batch_mode mode, long latency_us);
+
+//Copies a packet into the batch, flushing first if it does not fit, returns -1 on send errors
+int udp_batch_add(struct udp_batch* b, const volatile void* packet, size_t len);
+
+//Sends everything in the batch, returns -1 on send errors
+int udp_batch_flush(struct udp_batch* b);
+
+//Microseconds until the oldest packet in the batch is due, -1 if the batch is empty
+long udp_batch_due_in_us(struct udp_batch* b);
+
+//Parses "single", "mmsg" or "coalesce", returns -1 if the name is unknown
+int udp_batch_parse_mode(const char* name);
+
+#endif
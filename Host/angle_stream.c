@@ -0,0 +1,328 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "angle_stream.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ANGLE_HAVE_AVX2 1
+#endif
+
+#define SECONDS_PER_DAY (24 * 3600)
+#define STEP (1ll << 32)
+
+//The overflow count is read separately from the 32-bit IEP clock (MAX_LOOP_TIME race), so a clock that has
+//just wrapped is now and then paired with the old count and comes out 2^32 counts too early for one edge.
+//A bare 32-bit clock steps back the same way at every wrap. Both show up as the raw value falling by more
+//than 2^31 and are undone by adding 2^32 from there on; the raw value jumping forward by more than 2^31
+//while that correction is in place is the overflow count catching up, and the correction is dropped again.
+//This is one comparison per edge instead of the out_arr[ind:] += ... per wrap in account_for_wrapping().
+static uint64_t unwrap(struct angle_stream* s, struct angle_unwrap* u, uint64_t raw)
+{
+    if (u->started) {
+        int64_t d = (int64_t) (raw - u->last_raw);
+        if (d < -(STEP / 2)) {
+            u->offset += STEP;
+            s->clock_wraps += 1;
+        } else if (d > STEP / 2 && u->offset > 0) {
+            u->offset -= STEP;
+            s->clock_wraps -= 1;
+            s->overflow_repairs += 1;
+        }
+    }
+    u->started = 1;
+    u->last_raw = raw;
+    return raw + u->offset;
+}
+
+static int reserve(void** a, void** b, size_t* cap, size_t need, size_t size_a, size_t size_b)
+{
+    if (need <= *cap) {
+        return 0;
+    }
+    size_t cap2 = *cap ? *cap : 4096;
+    while (cap2 < need) {
+        cap2 *= 2;
+    }
+    void* a2 = realloc(*a, cap2 * size_a);
+    if (a2 == NULL) {
+        return -1;
+    }
+    *a = a2;
+    void* b2 = realloc(*b, cap2 * size_b);
+    if (b2 == NULL) {
+        return -1;
+    }
+    *b = b2;
+    *cap = cap2;
+    return 0;
+}
+
+//time = t0 + (clock - c0) * slope, angle = count * rad_per_edge
+static void interpolate_scalar(const uint64_t* clock, const int64_t* count, size_t n, uint64_t c0, double t0,
+                               double slope, double rad_per_edge, double* time, double* angle)
+{
+    for (size_t i = 0; i < n; i++) {
+        time[i] = t0 + (double) (int64_t) (clock[i] - c0) * slope;
+        angle[i] = (double) count[i] * rad_per_edge;
+    }
+}
+
+#ifdef ANGLE_HAVE_AVX2
+//AVX2 has no 64-bit integer to double conversion. Adding the bit pattern of 1.5 * 2^52 puts an integer of
+//less than 2^51 in magnitude into the mantissa of a double, and subtracting 1.5 * 2^52 as a double leaves
+//exactly its value. Clock differences within an IRIG second and edge numbers are far below that.
+__attribute__((target("avx2,fma")))
+static void interpolate_avx2(const uint64_t* clock, const int64_t* count, size_t n, uint64_t c0, double t0,
+                             double slope, double rad_per_edge, double* time, double* angle)
+{
+    const __m256i magic_i = _mm256_set1_epi64x(0x4338000000000000ll);
+    const __m256d magic_d = _mm256_set1_pd(6755399441055744.0);
+    const __m256i vc0 = _mm256_set1_epi64x((long long) c0);
+    const __m256d vt0 = _mm256_set1_pd(t0);
+    const __m256d vslope = _mm256_set1_pd(slope);
+    const __m256d vrad = _mm256_set1_pd(rad_per_edge);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256i d = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *) (clock + i)), vc0);
+        __m256d dd = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(d, magic_i)), magic_d);
+        _mm256_storeu_pd(time + i, _mm256_fmadd_pd(dd, vslope, vt0));
+        __m256i c = _mm256_loadu_si256((const __m256i *) (count + i));
+        __m256d cd = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(c, magic_i)), magic_d);
+        _mm256_storeu_pd(angle + i, _mm256_mul_pd(cd, vrad));
+    }
+    interpolate_scalar(clock + i, count + i, n - i, c0, t0, slope, rad_per_edge, time + i, angle + i);
+}
+#endif
+
+int angle_stream_init(struct angle_stream* s, double slits_per_rev, double epoch)
+{
+    memset(s, 0, sizeof(*s));
+    s->slits_per_rev = slits_per_rev > 0 ? slits_per_rev : ANGLE_SLITS_PER_REV;
+    s->epoch = epoch;
+#ifdef ANGLE_HAVE_AVX2
+    s->simd = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    if (reserve((void **) &s->pend_clock, (void **) &s->pend_count, &s->cap_pend, 16384, sizeof(uint64_t), sizeof(int64_t)) < 0 ||
+        reserve((void **) &s->out_time, (void **) &s->out_angle, &s->cap_out, 16384, sizeof(double), sizeof(double)) < 0) {
+        angle_stream_free(s);
+        return -1;
+    }
+    return 0;
+}
+
+void angle_stream_free(struct angle_stream* s)
+{
+    free(s->pend_clock);
+    free(s->pend_count);
+    free(s->out_time);
+    free(s->out_angle);
+    s->pend_clock = NULL;
+    s->pend_count = NULL;
+    s->out_time = NULL;
+    s->out_angle = NULL;
+    s->n_pend = s->cap_pend = s->n_out = s->cap_out = 0;
+}
+
+void angle_stream_set_simd(struct angle_stream* s, int simd)
+{
+#ifdef ANGLE_HAVE_AVX2
+    s->simd = simd && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    (void) simd;
+    s->simd = 0;
+#endif
+}
+
+//Forgets the oldest n pending edges
+static void drop_pending(struct angle_stream* s, size_t n)
+{
+    memmove(s->pend_clock, s->pend_clock + n, (s->n_pend - n) * sizeof(uint64_t));
+    memmove(s->pend_count, s->pend_count + n, (s->n_pend - n) * sizeof(int64_t));
+    s->n_pend -= n;
+}
+
+//Turns pending edges k to m - 1 into samples, time = t0 + (clock - c0) * slope
+static int place(struct angle_stream* s, size_t k, size_t m, uint64_t c0, double t0, double slope)
+{
+    if (reserve((void **) &s->out_time, (void **) &s->out_angle, &s->cap_out, s->n_out + (m - k), sizeof(double), sizeof(double)) < 0) {
+        return -1;
+    }
+    double rad_per_edge = 2 * M_PI / s->slits_per_rev;
+#ifdef ANGLE_HAVE_AVX2
+    if (s->simd) {
+        interpolate_avx2(s->pend_clock + k, s->pend_count + k, m - k, c0, t0, slope, rad_per_edge,
+                         s->out_time + s->n_out, s->out_angle + s->n_out);
+    } else
+#endif
+    {
+        interpolate_scalar(s->pend_clock + k, s->pend_count + k, m - k, c0, t0, slope, rad_per_edge,
+                           s->out_time + s->n_out, s->out_angle + s->n_out);
+    }
+    s->n_out += m - k;
+    s->samples += m - k;
+    return 0;
+}
+
+//Pending edges with a clock at or before limit
+static size_t pending_until(const struct angle_stream* s, uint64_t limit)
+{
+    size_t m = 0;
+    while (m < s->n_pend && s->pend_clock[m] <= limit) {
+        m++;
+    }
+    return m;
+}
+
+void angle_stream_set_clock_model(struct angle_stream* s, const struct clock_model* model)
+{
+    s->model = model;
+}
+
+//IRIG is late or has dropped out: edges held longer than ANGLE_MODEL_HOLD_S are timed by the clock model
+static int extrapolate(struct angle_stream* s)
+{
+    if (s->model == NULL || !clock_model_locked(s->model) || s->n_pend == 0) {
+        return 0;
+    }
+    uint64_t newest = s->pend_clock[s->n_pend - 1];
+    uint64_t hold = (uint64_t) (ANGLE_MODEL_HOLD_S * s->model->hz);
+    if (newest < hold || (double) (int64_t) (newest - s->model->c_ref) > ANGLE_MODEL_MAX_GAP_S * s->model->hz) {
+        return 0;
+    }
+    size_t m = pending_until(s, newest - hold);
+    if (m == 0) {
+        return 0;
+    }
+    uint64_t c0;
+    double t0, slope;
+    clock_model_affine(s->model, &c0, &t0, &slope);
+    if (place(s, 0, m, c0, s->epoch + t0, slope) < 0) {
+        return -1;
+    }
+    s->extrapolated += m;
+    drop_pending(s, m);
+    return 0;
+}
+
+int angle_stream_push_encoder(struct angle_stream* s, const uint64_t* clock, const uint32_t* count, size_t n)
+{
+    //without IRIG nothing can be finished, so the oldest edges go first
+    if (s->n_pend + n > ANGLE_MAX_PENDING) {
+        size_t excess = s->n_pend + n - ANGLE_MAX_PENDING;
+        if (excess > s->n_pend) {
+            s->dropped += excess - s->n_pend;
+            clock += excess - s->n_pend;
+            count += excess - s->n_pend;
+            n -= excess - s->n_pend;
+            excess = s->n_pend;
+        }
+        s->dropped += excess;
+        drop_pending(s, excess);
+    }
+    if (reserve((void **) &s->pend_clock, (void **) &s->pend_count, &s->cap_pend, s->n_pend + n, sizeof(uint64_t), sizeof(int64_t)) < 0) {
+        return -1;
+    }
+    for (size_t x = 0; x < n; x++) {
+        s->count = s->have_count ? s->count + (int32_t) (count[x] - s->last_count) : count[x];
+        s->have_count = 1;
+        s->last_count = count[x];
+        s->pend_clock[s->n_pend] = unwrap(s, &s->edge_clock, clock[x]);
+        s->pend_count[s->n_pend] = s->count;
+        s->n_pend += 1;
+    }
+    return extrapolate(s);
+}
+
+int angle_stream_push_irig(struct angle_stream* s, uint32_t irig_time, uint64_t rising_edge_clock)
+{
+    uint64_t clock = unwrap(s, &s->irig_clock, rising_edge_clock);
+    size_t k = 0, m = 0;
+
+    //account_for_next_day()
+    if (s->have_knot && irig_time < s->last_irig_time) {
+        s->day_offset += SECONDS_PER_DAY;
+    }
+    s->last_irig_time = irig_time;
+    double time = s->epoch + (double) (s->day_offset + irig_time);
+
+    if (s->model != NULL && clock_model_locked(s->model) && (!s->have_knot || clock > s->knot_clock)) {
+        //every edge up to the last pulse in the model can be timed, late ones included
+        uint64_t c0;
+        double t0, slope;
+        clock_model_affine(s->model, &c0, &t0, &slope);
+        m = pending_until(s, c0 > clock ? c0 : clock);
+        if (place(s, 0, m, c0, s->epoch + t0, slope) < 0) {
+            return -1;
+        }
+    } else if (s->have_knot && clock > s->knot_clock) {
+        //edges that came in after a later rising edge had already been used cannot be placed
+        while (k < s->n_pend && s->pend_clock[k] < s->knot_clock) {
+            k++;
+        }
+        m = k;
+        while (m < s->n_pend && s->pend_clock[m] <= clock) {
+            m++;
+        }
+        if (place(s, k, m, s->knot_clock, s->knot_time, (time - s->knot_time) / (double) (clock - s->knot_clock)) < 0) {
+            return -1;
+        }
+    } else {
+        //first IRIG packet, or a rising edge that did not move forward: start over from here
+        while (m < s->n_pend && s->pend_clock[m] < clock) {
+            m++;
+        }
+        k = m;
+    }
+    s->dropped += k;
+    drop_pending(s, m);
+    s->have_knot = 1;
+    s->knot_clock = clock;
+    s->knot_time = time;
+    return 0;
+}
+
+size_t angle_stream_read(struct angle_stream* s, double* time, double* angle, size_t max)
+{
+    size_t n = s->n_out < max ? s->n_out : max;
+    memcpy(time, s->out_time, n * sizeof(double));
+    memcpy(angle, s->out_angle, n * sizeof(double));
+    memmove(s->out_time, s->out_time + n, (s->n_out - n) * sizeof(double));
+    memmove(s->out_angle, s->out_angle + n, (s->n_out - n) * sizeof(double));
+    s->n_out -= n;
+    return n;
+}
+
+size_t angle_stream_available(const struct angle_stream* s)
+{
+    return s->n_out;
+}
+
+struct angle_stream* angle_stream_new(double slits_per_rev, double epoch)
+{
+    struct angle_stream* s = malloc(sizeof(*s));
+    if (s != NULL && angle_stream_init(s, slits_per_rev, epoch) < 0) {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void angle_stream_delete(struct angle_stream* s)
+{
+    if (s != NULL) {
+        angle_stream_free(s);
+        free(s);
+    }
+}
+
+void angle_stream_stats(const struct angle_stream* s, unsigned long int* stats)
+{
+    stats[0] = s->clock_wraps;
+    stats[1] = s->overflow_repairs;
+    stats[2] = s->dropped;
+    stats[3] = s->samples;
+    stats[4] = s->extrapolated;
+}
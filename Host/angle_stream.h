@@ -0,0 +1,115 @@
+//Streaming reconstruction of the HWP angle from encoder edges and IRIG packets
+//
+//Replaces account_for_wrapping(), account_for_missed_ovflow() and convert_to_angle() in encoderDAQ_BB.py with
+//a single pass that can be fed one packet at a time:
+//  - encoder and IRIG clocks are unwrapped to 64 bits, whether or not the overflow count is included,
+//    and the one-sample 2^32 step from the MAX_LOOP_TIME missed overflow race is repaired
+//  - IRIG seconds are unwrapped across midnight
+//  - every edge between two IRIG rising edges gets its UTC time by linear interpolation between them and
+//    its angle from its absolute edge number
+//Edges wait in the stream until the IRIG packet after them arrives, the finished samples are collected
+//with angle_stream_read(). Edges before the first IRIG rising edge are dropped, as convert_to_angle() does.
+//
+//With a clock model set (angle_stream_set_clock_model()) the time of an edge comes from the model fit to all
+//the IRIG pulses instead, once it has locked: the same affine transform, with the pulse noise averaged down
+//and bad frames left out. Edges are then finished up to the last pulse in the model, and edges held for more
+//than ANGLE_MODEL_HOLD_S while no IRIG packet comes are timed by extrapolating the model, for up to
+//ANGLE_MODEL_MAX_GAP_S past its last pulse.
+//
+//The interpolation runs 4 edges at a time with AVX2 when the CPU has it.
+
+#ifndef ANGLE_STREAM_H
+#define ANGLE_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "clock_model.h"
+
+#define ANGLE_SLITS_PER_REV (570 * 2) //edges per revolution, slit_scalar in convert_to_angle()
+#define ANGLE_MAX_PENDING (1 << 20) //edges held while waiting for IRIG, about 230 s at 2 Hz
+#define ANGLE_MODEL_HOLD_S 3.0 //seconds of clock an edge waits for IRIG before the clock model is extrapolated
+#define ANGLE_MODEL_MAX_GAP_S 60.0 //how far past its last pulse the clock model is extrapolated
+
+//Unwraps a counter that may be missing its upper bits, see angle_stream.c
+struct angle_unwrap {
+    int started;
+    uint64_t last_raw;
+    int64_t offset;
+};
+
+struct angle_stream {
+    double slits_per_rev;
+    //added to every time, 0 gives seconds since the midnight before the run. A Unix time here costs resolution,
+    //a double only resolves about 0.2 us at 1.7e9 s
+    double epoch;
+    int simd; //1 if the AVX2 path is used
+    const struct clock_model* model; //NULL times the edges by the IRIG knots alone
+
+    struct angle_unwrap edge_clock;
+    struct angle_unwrap irig_clock;
+    int have_count;
+    uint32_t last_count;
+    int64_t count;
+
+    //last IRIG rising edge seen
+    int have_knot;
+    uint64_t knot_clock;
+    double knot_time;
+    int64_t day_offset; //whole days added to the IRIG seconds since midnight
+    uint32_t last_irig_time;
+
+    //edges after the last IRIG rising edge
+    uint64_t* pend_clock;
+    int64_t* pend_count;
+    size_t n_pend;
+    size_t cap_pend;
+
+    //samples ready to be read
+    double* out_time;
+    double* out_angle;
+    size_t n_out;
+    size_t cap_out;
+
+    unsigned long int clock_wraps; //32-bit wraps of the clock when no overflow count was given
+    unsigned long int overflow_repairs; //missed overflows repaired
+    unsigned long int dropped; //edges before the first IRIG packet or past ANGLE_MAX_PENDING
+    unsigned long int samples; //samples produced
+    unsigned long int extrapolated; //samples timed by the clock model past its last pulse
+};
+
+//slits_per_rev <= 0 picks ANGLE_SLITS_PER_REV, returns -1 if out of memory
+int angle_stream_init(struct angle_stream* s, double slits_per_rev, double epoch);
+
+void angle_stream_free(struct angle_stream* s);
+
+//Adds encoder edges, clock is clock_cnt or counter_ovflow << 32 | clock_cnt and count is encoder_cnt
+int angle_stream_push_encoder(struct angle_stream* s, const uint64_t* clock, const uint32_t* count, size_t n);
+
+//Adds an IRIG packet, irig_time is in seconds since midnight as in the IRIG_Data CSV files
+//Every edge up to its rising edge becomes a sample
+int angle_stream_push_irig(struct angle_stream* s, uint32_t irig_time, uint64_t rising_edge_clock);
+
+//Copies out up to max finished samples in time order, returns how many
+size_t angle_stream_read(struct angle_stream* s, double* time, double* angle, size_t max);
+
+//Samples waiting to be read
+size_t angle_stream_available(const struct angle_stream* s);
+
+//Times the edges with a clock model, fed by the caller with every IRIG frame before it is passed to
+//angle_stream_push_irig(), on the same seconds (irig_time plus whole days since the midnight before the run)
+//and with clocks that include the overflow count. NULL goes back to the IRIG knots.
+void angle_stream_set_clock_model(struct angle_stream* s, const struct clock_model* model);
+
+//Forces the portable path, for benchmarking
+void angle_stream_set_simd(struct angle_stream* s, int simd);
+
+//Heap allocated stream for the Python bindings (angle_stream.py), NULL if out of memory
+struct angle_stream* angle_stream_new(double slits_per_rev, double epoch);
+
+void angle_stream_delete(struct angle_stream* s);
+
+//Copies clock_wraps, overflow_repairs, dropped, samples and extrapolated into stats[0..4], for the Python bindings
+void angle_stream_stats(const struct angle_stream* s, unsigned long int* stats);
+
+#endif
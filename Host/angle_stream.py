@@ -0,0 +1,170 @@
+# Python bindings for the streaming angle reconstruction in angle_stream.c
+# Build the library with make libangle_stream.so in Host/
+#
+# Example, one packet at a time:
+#     s = AngleStream()
+#     s.push_encoder(clock, count)        # numpy arrays of one encoder packet
+#     s.push_irig(irig_time, rising_edge_clock)
+#     time, angle = s.read()
+#
+# or a whole run at once, e.g. from a run archive:
+#     time, angle = reconstruct(run.edge_clock, run.edge_index, run.irig['irig_time'], run.irig['rising_edge_clock'])
+#
+# With the sync pulses of the IRIG packets the times come from the IRIG clock model in clock_model.c instead:
+#     time, angle = reconstruct(run.edge_clock, run.edge_index, run.irig['irig_time'], run.irig['rising_edge_clock'],
+#                               sync_clock=run.irig['sync_clock'])
+import ctypes
+import os
+import numpy
+
+SLITS_PER_REV = 570 * 2
+
+_lib = ctypes.CDLL(os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libangle_stream.so'))
+_lib.angle_stream_new.restype = ctypes.c_void_p
+_lib.angle_stream_new.argtypes = [ctypes.c_double, ctypes.c_double]
+_lib.angle_stream_delete.restype = None
+_lib.angle_stream_delete.argtypes = [ctypes.c_void_p]
+_lib.angle_stream_push_encoder.restype = ctypes.c_int
+_lib.angle_stream_push_encoder.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+_lib.angle_stream_push_irig.restype = ctypes.c_int
+_lib.angle_stream_push_irig.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_uint64]
+_lib.angle_stream_read.restype = ctypes.c_size_t
+_lib.angle_stream_read.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+_lib.angle_stream_available.restype = ctypes.c_size_t
+_lib.angle_stream_available.argtypes = [ctypes.c_void_p]
+_lib.angle_stream_set_simd.restype = None
+_lib.angle_stream_set_simd.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_lib.angle_stream_stats.restype = None
+_lib.angle_stream_stats.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+_lib.angle_stream_set_clock_model.restype = None
+_lib.angle_stream_set_clock_model.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+_lib.clock_model_new.restype = ctypes.c_void_p
+_lib.clock_model_new.argtypes = [ctypes.c_double, ctypes.c_double, ctypes.c_double]
+_lib.clock_model_delete.restype = None
+_lib.clock_model_delete.argtypes = [ctypes.c_void_p]
+_lib.clock_model_push_frame.restype = ctypes.c_int
+_lib.clock_model_push_frame.argtypes = [ctypes.c_void_p, ctypes.c_int64, ctypes.c_uint64, ctypes.c_void_p]
+_lib.clock_model_locked.restype = ctypes.c_int
+_lib.clock_model_locked.argtypes = [ctypes.c_void_p]
+_lib.clock_model_time.restype = ctypes.c_double
+_lib.clock_model_time.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.POINTER(ctypes.c_double)]
+_lib.clock_model_sigma.restype = ctypes.c_double
+_lib.clock_model_sigma.argtypes = [ctypes.c_void_p]
+
+
+# Model of UTC against the IEP clock fit to the IRIG pulses, see clock_model.h
+class ClockModel(object):
+    # hz, window_s, outlier_sigma: 0 picks the defaults in clock_model.h
+    def __init__(self, hz=0.0, window_s=0.0, outlier_sigma=0.0):
+        self._m = _lib.clock_model_new(hz, window_s, outlier_sigma)
+        if not self._m:
+            raise MemoryError('clock_model_new')
+
+    def __del__(self):
+        if getattr(self, '_m', None):
+            _lib.clock_model_delete(self._m)
+            self._m = None
+
+    # second: seconds of the frame on a scale that does not wrap, e.g. irig_time plus whole days since the
+    # midnight before the run; sync_clock: the 10 synchronization pulse clock counts of the packet
+    # Returns the number of the 11 pulses that were used
+    def push_frame(self, second, rising_edge_clock, sync_clock):
+        sync_clock = numpy.ascontiguousarray(sync_clock, dtype=numpy.uint64)
+        if len(sync_clock) != 10:
+            raise ValueError('an IRIG frame has 10 sync pulses')
+        return _lib.clock_model_push_frame(self._m, int(second), int(rising_edge_clock), sync_clock.ctypes.data)
+
+    def locked(self):
+        return bool(_lib.clock_model_locked(self._m))
+
+    # Returns (time, 1 sigma error) at a clock count
+    def time(self, clock):
+        err = ctypes.c_double()
+        t = _lib.clock_model_time(self._m, int(clock), ctypes.byref(err))
+        return t, err.value
+
+    # Noise of the IRIG pulses in seconds
+    def sigma(self):
+        return _lib.clock_model_sigma(self._m)
+
+
+class AngleStream(object):
+    # slits_per_rev: edges per revolution, slit_scalar in convert_to_angle()
+    # epoch: added to every time, 0 gives seconds since the midnight before the run
+    def __init__(self, slits_per_rev=SLITS_PER_REV, epoch=0.0):
+        self._s = _lib.angle_stream_new(slits_per_rev, epoch)
+        if not self._s:
+            raise MemoryError('angle_stream_new')
+
+    def __del__(self):
+        if getattr(self, '_s', None):
+            _lib.angle_stream_delete(self._s)
+            self._s = None
+
+    def set_simd(self, simd):
+        _lib.angle_stream_set_simd(self._s, int(simd))
+
+    # Times the edges with a ClockModel, fed with every IRIG frame before it is pushed here, None for the IRIG knots
+    def set_clock_model(self, model):
+        self._model = model
+        _lib.angle_stream_set_clock_model(self._s, model._m if model is not None else None)
+
+    # clock: clock_cnt, or clock_cnt + (counter_ovflow << 32) as in the Encoder_Data CSV files
+    # count: absolute edge numbers
+    def push_encoder(self, clock, count):
+        clock = numpy.ascontiguousarray(clock, dtype=numpy.uint64)
+        count = numpy.ascontiguousarray(count, dtype=numpy.uint32)
+        if len(clock) != len(count):
+            raise ValueError('clock and count differ in length')
+        if _lib.angle_stream_push_encoder(self._s, clock.ctypes.data, count.ctypes.data, len(clock)) < 0:
+            raise MemoryError('angle_stream_push_encoder')
+
+    # irig_time: UTC seconds since midnight, rising_edge_clock: clock count of the IRIG rising edge
+    def push_irig(self, irig_time, rising_edge_clock):
+        if _lib.angle_stream_push_irig(self._s, int(irig_time), int(rising_edge_clock)) < 0:
+            raise MemoryError('angle_stream_push_irig')
+
+    # Returns (time, angle) arrays of every sample finished so far
+    def read(self):
+        n = _lib.angle_stream_available(self._s)
+        time = numpy.empty(n, dtype=numpy.float64)
+        angle = numpy.empty(n, dtype=numpy.float64)
+        _lib.angle_stream_read(self._s, time.ctypes.data, angle.ctypes.data, n)
+        return time, angle
+
+    # Clock wraps, missed overflows repaired, edges dropped, samples produced and samples extrapolated by the
+    # clock model so far
+    def stats(self):
+        stats = numpy.zeros(5, dtype=numpy.uint64)
+        _lib.angle_stream_stats(self._s, stats.ctypes.data)
+        return dict(zip(('clock_wraps', 'overflow_repairs', 'dropped', 'samples', 'extrapolated'), [int(x) for x in stats]))
+
+
+# Reconstructs a whole run, feeding the IRIG packets in between the edges in clock order as they would arrive
+# With sync_clock (one row of 10 per IRIG packet) the edges are timed by a ClockModel fit to all the IRIG pulses
+def reconstruct(encoder_clock, encoder_count, irig_time, irig_clock, slits_per_rev=SLITS_PER_REV, epoch=0.0,
+                sync_clock=None):
+    s = AngleStream(slits_per_rev, epoch)
+    encoder_clock = numpy.asarray(encoder_clock)
+    encoder_count = numpy.asarray(encoder_count)
+    model = None
+    if sync_clock is not None:
+        model = ClockModel()
+        s.set_clock_model(model)
+        # the model runs on seconds that do not wrap at midnight, as account_for_next_day() makes them
+        irig_time = numpy.asarray(irig_time, dtype=numpy.int64)
+        seconds = irig_time + 24 * 3600 * numpy.concatenate(([0], numpy.cumsum(numpy.diff(irig_time) < 0)))
+    times, angles = [], []
+    start = 0
+    for k, (t, c) in enumerate(zip(irig_time, irig_clock)):
+        # every edge up to the rising edge after this one must be in before it can be placed
+        stop = start + numpy.searchsorted(encoder_clock[start:], c, side='right')
+        s.push_encoder(encoder_clock[start:stop], encoder_count[start:stop])
+        start = stop
+        if model is not None:
+            model.push_frame(seconds[k], c, sync_clock[k])
+        s.push_irig(t, c)
+        time, angle = s.read()
+        times.append(time)
+        angles.append(angle)
+    return numpy.concatenate(times), numpy.concatenate(angles)
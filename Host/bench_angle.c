@@ -0,0 +1,151 @@
+//Benchmark and check of angle_stream on a synthetic run
+//Feeds an hour at 4 Hz (16.4M edges) through the stream in 150 edge packets, with each IRIG packet arriving a
+//second after its rising edge as it does from the Beaglebone. The run crosses midnight and every third wrap of
+//the IEP clock has its first edge paired with the old overflow count, the MAX_LOOP_TIME race. Each sample is
+//checked against the time the edge was generated at. Runs the scalar and the AVX2 interpolation, with the
+//overflow count included and with bare 32-bit clocks. Exits non-zero if any sample is off by more than the
+//half IEP tick (2.5 ns) the generated clocks are rounded to.
+//bench_angle.py compares the same data against the functions in encoderDAQ_BB.py.
+//
+// Usage:
+// $ ./bench_angle [-s seconds]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "angle_stream.h"
+
+#define IEP_HZ 200000000.0
+#define EDGES_PER_SECOND 4560.0 //4 Hz
+#define START_TIME (24 * 3600 - 1800) //IRIG seconds since midnight of the first rising edge
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//Seconds after the first IRIG rising edge at which edge e passes, a 2 Hz rotation with a slow wobble
+static double edge_time(long e)
+{
+    return 0.25 + e / EDGES_PER_SECOND + 0.02 * sin(2 * M_PI * e / (EDGES_PER_SECOND * 60));
+}
+
+//Clock of a moment, with the IEP counter started a second before the first rising edge
+static uint64_t clock_at(double t)
+{
+    return (uint64_t) llround((t + 1.0) * IEP_HZ);
+}
+
+struct result {
+    double seconds;
+    double max_err;
+    unsigned long int samples;
+    unsigned long int repairs;
+    unsigned long int glitches;
+};
+
+static struct result run(long n_edges, int seconds, int simd, int bare)
+{
+    struct angle_stream s;
+    struct result res = { 0 };
+    static double time[1 << 16], angle[1 << 16];
+    uint64_t clock[150];
+    uint32_t count[150];
+    double rad_per_edge = 2 * M_PI / ANGLE_SLITS_PER_REV;
+    int next_irig = 0;
+    int in_glitch = 0;
+    double elapsed = 0;
+
+    angle_stream_init(&s, 0, 0);
+    angle_stream_set_simd(&s, simd);
+    for (long e0 = 0; e0 < n_edges; e0 += 150) {
+        int n = n_edges - e0 < 150 ? (int) (n_edges - e0) : 150;
+        for (int x = 0; x < n; x++) {
+            uint64_t c = clock_at(edge_time(e0 + x));
+            uint32_t clk = (uint32_t) c, ovflow = (uint32_t) (c >> 32);
+            //the first edges after every third wrap miss their overflow, a run of them is one repair
+            if (clk < 2 * IEP_HZ / EDGES_PER_SECOND && ovflow % 3 == 0 && ovflow > 0) {
+                ovflow -= 1;
+                res.glitches += !in_glitch;
+                in_glitch = 1;
+            } else {
+                in_glitch = 0;
+            }
+            clock[x] = bare ? clk : (uint64_t) ovflow << 32 | clk;
+            count[x] = (uint32_t) (e0 + x);
+        }
+        double t0 = now_s();
+        angle_stream_push_encoder(&s, clock, count, n);
+        //IRIG packets are complete a second after their rising edge
+        double t_last = edge_time(e0 + n - 1);
+        while (next_irig < seconds && next_irig + 1.0 <= t_last) {
+            uint64_t c = clock_at(next_irig);
+            angle_stream_push_irig(&s, (START_TIME + next_irig) % (24 * 3600), bare ? (uint32_t) c : c);
+            next_irig += 1;
+        }
+        size_t got = angle_stream_read(&s, time, angle, sizeof(time) / sizeof(time[0]));
+        elapsed += now_s() - t0;
+
+        for (size_t k = 0; k < got; k++) {
+            long e = lround(angle[k] / rad_per_edge);
+            double err = fabs(time[k] - (START_TIME + edge_time(e)));
+            res.max_err = err > res.max_err ? err : res.max_err;
+        }
+        res.samples += got;
+    }
+    res.seconds = elapsed;
+    res.repairs = s.overflow_repairs;
+    if (bare) {
+        res.glitches = 0; //a bare 32-bit clock has no overflow count to get wrong
+    }
+    angle_stream_free(&s);
+    return res;
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = 3600;
+    int failures = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:")) != -1) {
+        switch (opt) {
+        case 's': seconds = atoi(optarg); break;
+        default:
+            printf("Usage: %s [-s seconds]\n", argv[0]);
+            return 1;
+        }
+    }
+    long n_edges = (long) ((seconds + 0.5) * EDGES_PER_SECOND);
+
+    printf("%ld edges over %d s\n", n_edges, seconds);
+    printf("%-8s %-10s %12s %10s %12s %10s %10s %8s\n", "interp", "clock", "Medges/s", "ms", "samples", "max_err_ns",
+           "repairs", "result");
+    for (int bare = 0; bare <= 1; bare++) {
+        for (int simd = 0; simd <= 1; simd++) {
+            struct angle_stream probe;
+            angle_stream_init(&probe, 0, 0);
+            angle_stream_set_simd(&probe, simd);
+            int have_simd = probe.simd;
+            angle_stream_free(&probe);
+            if (simd && !have_simd) {
+                printf("%-8s %-10s %12s\n", "avx2", bare ? "32-bit" : "64-bit", "unsupported");
+                continue;
+            }
+
+            struct result res = run(n_edges, seconds, simd, bare);
+            //edges from the first rising edge to the last one become samples
+            int ok = res.max_err < 0.5 / IEP_HZ + 1e-10 && res.repairs == res.glitches && res.samples > 0;
+            printf("%-8s %-10s %12.1f %10.1f %12lu %10.3f %10lu %8s\n", simd ? "avx2" : "scalar", bare ? "32-bit" : "64-bit",
+                   res.samples / res.seconds / 1e6, res.seconds * 1e3, res.samples, res.max_err * 1e9, res.repairs,
+                   ok ? "ok" : "FAIL");
+            failures += !ok;
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,72 @@
+# Benchmarks angle_stream against account_for_wrapping(), account_for_missed_ovflow() and convert_to_angle()
+# from encoderDAQ_BB.py on the same synthetic run as bench_angle.c: 4 Hz with a slow wobble, crossing
+# midnight, with the first edge after every third IEP clock wrap missing its overflow count
+#
+# Usage:
+# $ python bench_angle.py [seconds]
+from __future__ import print_function
+import os
+import sys
+import time
+
+import numpy
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+import encoderDAQ_BB as legacy
+import angle_stream
+
+IEP_HZ = 200000000.0
+EDGES_PER_SECOND = 4560.0
+START_TIME = 24 * 3600 - 1800
+
+
+def edge_time(e):
+    return 0.25 + e / EDGES_PER_SECOND + 0.02 * numpy.sin(2 * numpy.pi * e / (EDGES_PER_SECOND * 60))
+
+
+def make_run(seconds):
+    e = numpy.arange(int((seconds + 0.5) * EDGES_PER_SECOND))
+    clock = numpy.round((edge_time(e) + 1.0) * IEP_HZ).astype(numpy.int64)
+    clk = clock & 0xFFFFFFFF
+    ovflow = clock >> 32
+    glitch = (clk < 2 * IEP_HZ / EDGES_PER_SECOND) & (ovflow % 3 == 0) & (ovflow > 0)
+    ovflow[glitch] -= 1
+    seconds_range = numpy.arange(seconds)
+    irig_clock = numpy.round((seconds_range + 1.0) * IEP_HZ).astype(numpy.int64)
+    irig_time = (START_TIME + seconds_range) % (24 * 3600)
+    return e, clk + (ovflow << 32), irig_time, irig_clock, edge_time(e)
+
+
+def main():
+    seconds = int(sys.argv[1]) if len(sys.argv) > 1 else 3600
+    count, clock, irig_time, irig_clock, truth = make_run(seconds)
+    print('%d edges over %d s, %d edges missing their overflow' % (len(count), seconds,
+          numpy.count_nonzero(numpy.diff(clock) < 0)))
+
+    t0 = time.time()
+    t, angle = angle_stream.reconstruct(clock, count, irig_time, irig_clock)
+    new_s = time.time() - t0
+    e = numpy.round(angle / (2 * numpy.pi / angle_stream.SLITS_PER_REV)).astype(numpy.int64)
+    new_err = numpy.max(numpy.abs(t - (START_TIME + truth[e])))
+    print('angle_stream:  %8.2f s  %10d samples  max time error %.3g s' % (new_s, len(t), new_err))
+
+    t0 = time.time()
+    legacy_clock = legacy.account_for_wrapping(legacy.account_for_missed_ovflow(clock.copy()), 32)
+    legacy_irig_time = legacy.account_for_next_day(irig_time.copy())
+    unwrap_s = time.time() - t0
+    data = legacy.convert_to_angle((legacy_irig_time - legacy_irig_time[0]).astype(float), irig_clock - irig_clock[0],
+                                   legacy_clock - irig_clock[0], count)
+    legacy_s = time.time() - t0
+    angle_legacy, t_legacy = zip(*data) if len(data) else ((), ())
+    t_legacy = numpy.array(t_legacy) + START_TIME
+    # convert_to_angle() returns samples in edge order, so they line up with the edges after the first rising edge
+    first = numpy.searchsorted(clock, irig_clock[0])
+    n = len(t_legacy)
+    legacy_err = numpy.max(numpy.abs(t_legacy - (START_TIME + truth[first:first + n]))) if n else float('nan')
+    print('encoderDAQ_BB: %8.2f s  %10d samples  max time error %.3g s  (%.2f s unwrapping)' % (legacy_s, n, legacy_err,
+          unwrap_s))
+    print('speedup: %.0fx' % (legacy_s / new_s))
+
+
+if __name__ == '__main__':
+    main()
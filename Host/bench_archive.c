@@ -0,0 +1,222 @@
+//Read benchmark of the binary run archive against the CSV files
+//Writes a synthetic run at 2 Hz as CSV, converts it with csv_convert_run() and then times a full pass over
+//every edge and a set of one second queries on both. The CSV side uses the C parser from csv2archive.c, which
+//is already far quicker than loading the files in Python. Exits non-zero if the two disagree.
+//
+// Usage:
+// $ ./bench_archive [-s seconds] [-q queries] [-o dir]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "csv2archive.h"
+#include "run_archive.h"
+
+#define IEP_HZ 200000000ull
+#define EDGES_PER_PACKET 150
+#define EDGES_PER_SECOND 4560 //2 Hz, 1140 slits, both edges
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long file_size(const char* path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (long) st.st_size : 0;
+}
+
+//Same rows as encoder_receiver and encoderDAQ_BB.py write
+static void write_csv_run(const char* encoder_csv, const char* irig_csv, int seconds, uint32_t start_time)
+{
+    FILE* enc = fopen(encoder_csv, "w");
+    FILE* irig = fopen(irig_csv, "w");
+    unsigned long int n_edges = (unsigned long int) seconds * EDGES_PER_SECOND;
+
+    fputs("1: Quad readout,2-152: capt_cnt/clk_cnt\r\n\r\n", enc);
+    fputs("1: IRIG_time/clk_cnt,3-13: synch_pulse/clk_cnt\r\n\r\n", irig);
+    for (unsigned long int e = 0; e < n_edges; e++) {
+        if (e % EDGES_PER_PACKET == 0) {
+            if (e) {
+                fputs("\r\n", enc);
+            }
+            fprintf(enc, "%lu,0,1\r\n\r\n", (e / EDGES_PER_PACKET) & 1);
+        }
+        uint64_t clock = IEP_HZ + e * IEP_HZ / EDGES_PER_SECOND + (e * 7919) % 2000;
+        fprintf(enc, "%lu,%llu\r\n", e, (unsigned long long) clock);
+    }
+    fputs("\r\n", enc);
+    for (int s = 0; s < seconds; s++) {
+        uint64_t clock = IEP_HZ + s * IEP_HZ + 1000;
+        fprintf(irig, "%u,%llu\r\n\r\n", (start_time + s) % (24 * 3600), (unsigned long long) clock);
+        for (int x = 0; x < 10; x++) {
+            fprintf(irig, "%d,%llu\r\n", x, (unsigned long long) (clock + (x + 1) * IEP_HZ / 10 - IEP_HZ / 100));
+        }
+        fputs("\r\n", irig);
+    }
+    fclose(enc);
+    fclose(irig);
+}
+
+//Sums the edges in [clock_begin, clock_end) the only way a CSV run allows: from the top of the file
+static uint64_t csv_window(const char* encoder_csv, uint64_t clock_begin, uint64_t clock_end, unsigned long int* n_edges)
+{
+    struct csv_reader r;
+    uint64_t clock[1024], sum = 0;
+    uint32_t edge[1024];
+    size_t n;
+    uint8_t quad;
+
+    *n_edges = 0;
+    csv_reader_open(&r, encoder_csv);
+    while (csv_next_encoder(&r, clock, edge, 1024, &n, &quad) == 1 && (n == 0 || clock[0] < clock_end)) {
+        for (size_t x = 0; x < n; x++) {
+            if (clock[x] >= clock_begin && clock[x] < clock_end) {
+                sum += clock[x] + edge[x];
+                *n_edges += 1;
+            }
+        }
+    }
+    csv_reader_close(&r);
+    return sum;
+}
+
+//Clock of the rising edge of an IRIG second, scanning the IRIG CSV file
+static uint64_t csv_second(const char* irig_csv, uint32_t irig_time)
+{
+    struct csv_reader r;
+    uint64_t clock, sync_clock[ARCHIVE_SYNC_PULSES], found = UINT64_MAX;
+    uint32_t t;
+
+    csv_reader_open(&r, irig_csv);
+    while (csv_next_irig(&r, &t, &clock, sync_clock) == 1) {
+        if (t == irig_time) {
+            found = clock;
+            break;
+        }
+    }
+    csv_reader_close(&r);
+    return found;
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = 600;
+    int queries = 20;
+    const char* dir = "/tmp";
+    char encoder_csv[4096], irig_csv[4096], archive_dir[4096], path[4096 + 64];
+    struct run_archive_writer w;
+    struct run_archive a;
+    int failures = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:q:o:")) != -1) {
+        switch (opt) {
+        case 's': seconds = atoi(optarg); break;
+        case 'q': queries = atoi(optarg); break;
+        case 'o': dir = optarg; break;
+        default:
+            printf("Usage: %s [-s seconds] [-q queries] [-o dir]\n", argv[0]);
+            return 1;
+        }
+    }
+    snprintf(encoder_csv, sizeof(encoder_csv), "%s/bench_archive_Encoder.csv", dir);
+    snprintf(irig_csv, sizeof(irig_csv), "%s/bench_archive_IRIG.csv", dir);
+    snprintf(archive_dir, sizeof(archive_dir), "%s/bench_archive", dir);
+
+    //the run crosses midnight, so the index has to cope with the IRIG clock wrapping
+    uint32_t start_time = 24 * 3600 - seconds / 2;
+    write_csv_run(encoder_csv, irig_csv, seconds, start_time);
+
+    double t0 = now_s();
+    if (csv_convert_run(encoder_csv, irig_csv, archive_dir, 0, &w) < 0) {
+        return 1;
+    }
+    run_archive_close_writer(&w);
+    double convert_s = now_s() - t0;
+
+    long csv_bytes = file_size(encoder_csv) + file_size(irig_csv), archive_bytes = 0;
+    const char* names[] = { "edge_index.col", "edge_clock.col", "edge_quad.col", "irig.tab", "irig_index.tab" };
+    for (int k = 0; k < 5; k++) {
+        snprintf(path, sizeof(path), "%s/%s", archive_dir, names[k]);
+        archive_bytes += file_size(path);
+    }
+    printf("%d s run, %lu edges: CSV %.1f MB, archive %.1f MB (%.1fx smaller), converted in %.2f s\n", seconds,
+           (unsigned long int) seconds * EDGES_PER_SECOND, csv_bytes / 1e6, archive_bytes / 1e6,
+           (double) csv_bytes / archive_bytes, convert_s);
+
+    //Full pass over every edge
+    struct csv_reader r;
+    uint64_t clock[1024], csv_sum = 0, bin_sum = 0;
+    uint32_t edge[1024];
+    size_t n;
+    uint8_t quad;
+    t0 = now_s();
+    csv_reader_open(&r, encoder_csv);
+    while (csv_next_encoder(&r, clock, edge, 1024, &n, &quad) == 1) {
+        for (size_t x = 0; x < n; x++) {
+            csv_sum += clock[x] + edge[x];
+        }
+    }
+    csv_reader_close(&r);
+    double csv_full = now_s() - t0;
+
+    t0 = now_s();
+    if (run_archive_open(&a, archive_dir) < 0) {
+        perror(archive_dir);
+        return 1;
+    }
+    for (size_t x = 0; x < a.n_edges; x++) {
+        bin_sum += a.edge_clock[x] + a.edge_index[x];
+    }
+    double bin_full = now_s() - t0;
+    failures += csv_sum != bin_sum;
+    printf("%-22s %12s %12s %10s %8s\n", "", "csv_ms", "archive_ms", "speedup", "result");
+    printf("%-22s %12.2f %12.3f %10.0f %8s\n", "full pass", csv_full * 1e3, bin_full * 1e3, csv_full / bin_full,
+           csv_sum == bin_sum ? "ok" : "FAIL");
+
+    //One second windows spread over the run
+    double csv_query = 0, bin_query = 0;
+    int bad = 0;
+    for (int q = 0; q < queries; q++) {
+        uint32_t second = (start_time + 1 + (uint32_t) ((long) (seconds - 3) * q / (queries > 1 ? queries - 1 : 1))) % (24 * 3600);
+        unsigned long int csv_n;
+        size_t begin, end;
+
+        t0 = now_s();
+        uint64_t clock_begin = csv_second(irig_csv, second);
+        uint64_t clock_end = csv_second(irig_csv, (second + 1) % (24 * 3600));
+        uint64_t csv_window_sum = csv_window(encoder_csv, clock_begin, clock_end, &csv_n);
+        csv_query += now_s() - t0;
+
+        t0 = now_s();
+        uint64_t bin_window_sum = 0;
+        if (run_archive_seconds(&a, second, second, &begin, &end) == 0) {
+            for (size_t x = begin; x < end; x++) {
+                bin_window_sum += a.edge_clock[x] + a.edge_index[x];
+            }
+        }
+        bin_query += now_s() - t0;
+        bad += csv_window_sum != bin_window_sum || csv_n != end - begin;
+    }
+    failures += bad != 0;
+    printf("%-22s %12.2f %12.3f %10.0f %8s\n", "1 s query (avg)", csv_query / queries * 1e3, bin_query / queries * 1e3,
+           csv_query / bin_query, bad ? "FAIL" : "ok");
+
+    run_archive_close(&a);
+    unlink(encoder_csv);
+    unlink(irig_csv);
+    for (int k = 0; k < 5; k++) {
+        snprintf(path, sizeof(path), "%s/%s", archive_dir, names[k]);
+        unlink(path);
+    }
+    rmdir(archive_dir);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,366 @@
+//Benchmark and check of the IRIG frame decoder and the IRIG clock model
+//  - decode: every second from the evening of 2027-12-30 to the morning of 2028-01-02, across the new year and
+//    through the leap day count, is encoded and decoded and must come back the same, with the time of day
+//    matching the bit-by-bit de_irig() the receivers used before. Frames with a bad BCD digit or binary
+//    seconds that disagree must be flagged.
+//  - model: an hour of IRIG frames from a crystal 20 ppm fast with +-50 ppb of slow wander, the pulses with
+//    40 ns rms of noise. Now and then a pulse is glitched by 20 us or misses its overflow count, a frame has its
+//    seconds off by one, a frame does not decode, and 20 frames in a row go missing. The model is checked at 10
+//    points within each second against the true time: rms error, how well the reported error bars match it,
+//    every glitch rejected, and no relock. A second, short run steps the IRIG time by a second and checks the
+//    model follows it.
+//  - angle: the same hour timestamps a 2 Hz HWP through angle_stream once with the IRIG knots and once with the
+//    clock model. The clock model must be more accurate and must time the edges of the dropout without waiting.
+//Exits non-zero if any check fails.
+//
+// Usage:
+// $ ./bench_clock [-s seconds]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "angle_stream.h"
+#include "clock_model.h"
+#include "irig_frame.h"
+
+#define IEP_HZ 200000000.0
+#define START_TIME (24 * 3600 - 1800) //IRIG seconds since midnight of the first frame, the run crosses midnight
+#define RATE 20e-6 //crystal offset
+#define WANDER 50e-9 //amplitude of the slow change of the crystal rate
+#define WANDER_PERIOD 1800.0
+#define PULSE_NOISE 40e-9 //rms of the IRIG pulse timing
+#define EDGES_PER_SECOND 2280.0 //2 Hz
+#define DROPOUT_START 1800 //first frame of the dropout
+#define DROPOUT_FRAMES 20
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//xorshift64 and Box-Muller, as in pru_sigsim.c
+static uint64_t rng = 88172645463325252ull;
+
+static double uniform(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return ((rng >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double gaussian(void)
+{
+    return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+//IEP clock at t seconds after the first frame, the counter started a second before it
+static double clock_exact(double t)
+{
+    return IEP_HZ * ((1 + RATE) * (t + 1) + WANDER * WANDER_PERIOD / (2 * M_PI) * sin(2 * M_PI * t / WANDER_PERIOD));
+}
+
+static uint64_t clock_at(double t)
+{
+    return (uint64_t) llround(clock_exact(t));
+}
+
+//Time at a clock, the inverse of clock_exact() by Newton's method
+static double time_at(uint64_t clock)
+{
+    double t = clock / (IEP_HZ * (1 + RATE)) - 1;
+    for (int k = 0; k < 3; k++) {
+        double rate = IEP_HZ * (1 + RATE + WANDER * cos(2 * M_PI * t / WANDER_PERIOD));
+        t -= (clock_exact(t) - (double) clock) / rate;
+    }
+    return t;
+}
+
+//The bit-by-bit decoding of receiver.c and encoderDAQ_BB.py before irig_frame.c
+static int de_irig(uint32_t val, int base_shift)
+{
+    return ((val >> (0 + base_shift)) & 1) +
+           ((val >> (1 + base_shift)) & 1) * 2 +
+           ((val >> (2 + base_shift)) & 1) * 4 +
+           ((val >> (3 + base_shift)) & 1) * 8 +
+           ((val >> (5 + base_shift)) & 1) * 10 +
+           ((val >> (6 + base_shift)) & 1) * 20 +
+           ((val >> (7 + base_shift)) & 1) * 40;
+}
+
+static int check_decode(void)
+{
+    const int64_t new_year = 1830297600; //2028-01-01 00:00:00 UTC
+    const int64_t first = new_year - 27 * 3600; //2027-12-30 21:00:00
+    const int64_t last = new_year + 30 * 3600; //2028-01-02 06:00:00
+    struct irig_frame f, g;
+    uint32_t info[IRIG_FRAME_WORDS];
+    unsigned long int bad = 0, frames = 0;
+    int new_year_day = 0;
+
+    double t0 = now_s();
+    for (int64_t t = first; t <= last; t++) {
+        irig_frame_from_unix_time(t, &f);
+        f.control = (uint32_t) (t & 0x3ffff);
+        irig_frame_encode(&f, info);
+        int flags = irig_frame_decode(info, &g);
+        long legacy = de_irig(info[0], 1) + 60 * de_irig(info[1], 0) + 3600 * de_irig(info[2], 0);
+        if (flags || memcmp(&f, &g, sizeof(f)) != 0 || irig_frame_unix_time(&g) != t || legacy != irig_frame_time_of_day(&g)) {
+            bad += 1;
+        }
+        if (t == new_year) {
+            new_year_day = g.day_of_year == 1 && g.year == 28;
+        }
+        frames += 1;
+    }
+    double elapsed = now_s() - t0;
+
+    //a minutes units digit of 12, and binary seconds one off the BCD time of day
+    irig_frame_from_unix_time(first, &f);
+    irig_frame_encode(&f, info);
+    info[1] |= 0xc;
+    int bad_digit = irig_frame_decode(info, &g) & IRIG_FRAME_BAD_DIGIT;
+    f.sbs += 1;
+    irig_frame_encode(&f, info);
+    int bad_sbs = irig_frame_decode(info, &g) & IRIG_FRAME_BAD_SBS;
+
+    int ok = bad == 0 && new_year_day && bad_digit && bad_sbs;
+    printf("decode: %lu frames, %.0f ns per encode and decode, %lu mismatches, new year %s, bad digit %s, bad sbs %s  %s\n",
+           frames, elapsed / frames * 1e9, bad, new_year_day ? "ok" : "wrong", bad_digit ? "flagged" : "missed",
+           bad_sbs ? "flagged" : "missed", ok ? "ok" : "FAIL");
+    return ok;
+}
+
+//One IRIG packet of the synthetic run
+struct frame {
+    int64_t second; //as sent, seconds since the midnight before the run
+    uint64_t rising_edge_clock;
+    uint64_t sync_clock[10];
+    int decodes; //0 for a frame irig_frame_decode() rejects
+    int glitches; //pulses a good model must reject
+};
+
+static void make_frame(int n, struct frame* f)
+{
+    int glitched = -1;
+
+    rng = 88172645463325252ull ^ (uint64_t) (n + 1) * 0x9e3779b97f4a7c15ull; //the same noise on every run
+
+    f->second = START_TIME + n;
+    f->decodes = n % 1500 != 1000;
+    f->glitches = 0;
+    f->rising_edge_clock = (uint64_t) llround(clock_exact(n) + PULSE_NOISE * IEP_HZ * gaussian());
+    for (int k = 0; k < 10; k++) {
+        f->sync_clock[k] = (uint64_t) llround(clock_exact(n + (10 * k + 9) * 0.01) + PULSE_NOISE * IEP_HZ * gaussian());
+    }
+    if (n % 97 == 50) {
+        glitched = n % 10;
+        f->sync_clock[glitched] += (uint64_t) (20e-6 * IEP_HZ);
+    }
+    if (n % 613 == 300) {
+        glitched = (n + 3) % 10;
+        f->sync_clock[glitched] -= 1ull << 32;
+    }
+    if (glitched >= 0) {
+        f->glitches = 1;
+    }
+    if (n % 1000 == 700) {
+        f->second += 1;
+        f->glitches = 11;
+    }
+}
+
+static int dropped(int n)
+{
+    return n >= DROPOUT_START && n < DROPOUT_START + DROPOUT_FRAMES;
+}
+
+static int check_model(int seconds)
+{
+    struct clock_model m;
+    struct frame f;
+    unsigned long int glitches = 0, points = 0, within = 0;
+    double sum_sq = 0, sum_z = 0, max_err = 0, pushing = 0, dropout_err = 0;
+
+    clock_model_init(&m, IEP_HZ, 0, 0);
+    for (int n = 0; n < seconds; n++) {
+        make_frame(n, &f);
+        if (dropped(n) || !f.decodes) {
+            continue;
+        }
+        glitches += f.glitches;
+        double t0 = now_s();
+        clock_model_push_frame(&m, f.second, f.rising_edge_clock, f.sync_clock);
+        pushing += now_s() - t0;
+        if (!clock_model_locked(&m) || n < 30) {
+            continue;
+        }
+        //within the second just fit, as the edges of it are timed
+        for (int k = 0; k < 10; k++) {
+            double t = n + (k + uniform()) * 0.1;
+            uint64_t c = clock_at(t);
+            double err;
+            double e = clock_model_time(&m, c, &err) - (START_TIME + time_at(c));
+            if (n == DROPOUT_START + DROPOUT_FRAMES) {
+                continue; //the first second after the dropout is measured below
+            }
+            sum_sq += e * e;
+            sum_z += e * e / (err * err);
+            within += fabs(e) < 3 * err;
+            max_err = fabs(e) > max_err ? fabs(e) : max_err;
+            points += 1;
+        }
+        //just before the dropout, how far the model is off at its end
+        if (n == DROPOUT_START - 1) {
+            uint64_t c = clock_at(DROPOUT_START + DROPOUT_FRAMES);
+            dropout_err = clock_model_time(&m, c, NULL) - (START_TIME + time_at(c));
+        }
+    }
+    double rms = sqrt(sum_sq / points);
+    double rms_z = sqrt(sum_z / points);
+    double frac = (double) within / points;
+    int ok = points > 0 && rms < PULSE_NOISE / 2 && rms_z > 0.5 && rms_z < 2 && frac > 0.95 && m.rejected == glitches &&
+             m.relocks == 0 && fabs(dropout_err) < 1e-6;
+    printf("model: %lu frames, %.0f ns per pulse, rate %+.3f ppm, rms %.1f ns (pulses %.0f ns), max %.1f ns, "
+           "error bars: rms z %.2f, %.1f%% within 3 sigma, %lu/%lu glitches rejected, %lu relocks, "
+           "%.0f ns off after the %d s dropout  %s\n",
+           m.frames, pushing / m.frames / CLOCK_MODEL_PULSES * 1e9, (m.rate - 1) * 1e6, rms * 1e9, clock_model_sigma(&m) * 1e9,
+           max_err * 1e9, rms_z, frac * 100, m.rejected, glitches, m.relocks, dropout_err * 1e9, DROPOUT_FRAMES, ok ? "ok" : "FAIL");
+
+    //the IRIG source steps a second ahead after 30 s
+    struct clock_model s;
+    clock_model_init(&s, IEP_HZ, 0, 0);
+    for (int n = 0; n < 60; n++) {
+        make_frame(n, &f);
+        clock_model_push_frame(&s, f.second + (n >= 30), f.rising_edge_clock, f.sync_clock);
+    }
+    uint64_t c = clock_at(59.5);
+    double step_err = clock_model_time(&s, c, NULL) - (START_TIME + 1 + time_at(c));
+    int step_ok = s.relocks == 1 && fabs(step_err) < 1e-6;
+    printf("step: %lu relocks, %.0f ns off the new time  %s\n", s.relocks, step_err * 1e9, step_ok ? "ok" : "FAIL");
+    return ok && step_ok;
+}
+
+struct angle_result {
+    double rms;
+    double rms_clean; //leaving out the samples off by more than a microsecond, around a wrong IRIG frame
+    double max_err;
+    double seconds;
+    unsigned long int samples;
+    unsigned long int extrapolated;
+    unsigned long int dropped;
+};
+
+static double edge_time(long e)
+{
+    return 0.25 + e / EDGES_PER_SECOND;
+}
+
+static struct angle_result run_angle(int seconds, int use_model)
+{
+    struct angle_stream s;
+    struct clock_model m;
+    struct angle_result res = { 0 };
+    struct frame f;
+    static double time[1 << 16], angle[1 << 16];
+    uint64_t clock[150];
+    uint32_t count[150];
+    double rad_per_edge = 2 * M_PI / ANGLE_SLITS_PER_REV;
+    long n_edges = (long) ((seconds - 1) * EDGES_PER_SECOND);
+    double sum_sq = 0, sum_sq_clean = 0;
+    unsigned long int clean = 0;
+    int next_irig = 0;
+
+    angle_stream_init(&s, 0, 0);
+    clock_model_init(&m, IEP_HZ, 0, 0);
+    if (use_model) {
+        angle_stream_set_clock_model(&s, &m);
+    }
+    for (long e0 = 0; e0 < n_edges; e0 += 150) {
+        int n = n_edges - e0 < 150 ? (int) (n_edges - e0) : 150;
+        for (int x = 0; x < n; x++) {
+            clock[x] = clock_at(edge_time(e0 + x));
+            count[x] = (uint32_t) (e0 + x);
+        }
+        double t0 = now_s();
+        angle_stream_push_encoder(&s, clock, count, n);
+        //IRIG packets are complete a second after their rising edge
+        while (next_irig < seconds && next_irig + 1.0 <= edge_time(e0 + n - 1)) {
+            make_frame(next_irig, &f);
+            if (!dropped(next_irig) && f.decodes) {
+                if (use_model) {
+                    clock_model_push_frame(&m, f.second, f.rising_edge_clock, f.sync_clock);
+                }
+                angle_stream_push_irig(&s, (uint32_t) (f.second % (24 * 3600)), f.rising_edge_clock);
+            }
+            next_irig += 1;
+        }
+        size_t got = angle_stream_read(&s, time, angle, sizeof(time) / sizeof(time[0]));
+        res.seconds += now_s() - t0;
+
+        for (size_t k = 0; k < got; k++) {
+            long e = lround(angle[k] / rad_per_edge);
+            double err = fabs(time[k] - (START_TIME + time_at(clock_at(edge_time(e)))));
+            sum_sq += err * err;
+            if (err < 1e-6) {
+                sum_sq_clean += err * err;
+                clean += 1;
+            }
+            res.max_err = err > res.max_err ? err : res.max_err;
+        }
+        res.samples += got;
+    }
+    res.rms = sqrt(sum_sq / res.samples);
+    res.rms_clean = sqrt(sum_sq_clean / clean);
+    res.extrapolated = s.extrapolated;
+    res.dropped = s.dropped;
+    angle_stream_free(&s);
+    return res;
+}
+
+static int check_angle(int seconds)
+{
+    struct angle_result knots = run_angle(seconds, 0);
+    struct angle_result model = run_angle(seconds, 1);
+    const char* names[2] = { "knots", "model" };
+    struct angle_result* res[2] = { &knots, &model };
+
+    for (int k = 0; k < 2; k++) {
+        printf("angle %s: %lu samples, %.1f Medges/s, rms %.3g ns (%.3g ns within 1 us), max %.3g ns, %lu extrapolated, "
+               "%lu dropped\n", names[k], res[k]->samples, res[k]->samples / res[k]->seconds / 1e6, res[k]->rms * 1e9,
+               res[k]->rms_clean * 1e9, res[k]->max_err * 1e9, res[k]->extrapolated, res[k]->dropped);
+    }
+    int ok = model.rms < knots.rms_clean && model.max_err < 1e-6 && model.extrapolated > 0 && model.samples >= knots.samples;
+    printf("angle: clock model %.1fx more accurate than the knots where they are right  %s\n", knots.rms_clean / model.rms,
+           ok ? "ok" : "FAIL");
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = 3600;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:")) != -1) {
+        switch (opt) {
+        case 's': seconds = atoi(optarg); break;
+        default:
+            printf("Usage: %s [-s seconds]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (seconds < DROPOUT_START + DROPOUT_FRAMES + 60) {
+        printf("The run must last past the dropout at %d s\n", DROPOUT_START);
+        return 1;
+    }
+    int ok = check_decode();
+    ok &= check_model(seconds);
+    ok &= check_angle(seconds);
+    return ok ? 0 : 1;
+}
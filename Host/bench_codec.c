@@ -0,0 +1,426 @@
+//Benchmark of the packed edge codec (edge_codec.h) against the CSV files and the plain archive columns
+//Generates edge streams the way the encoder PRU stamps them, 200 MHz clock and 1140 edges per revolution:
+//  steady    2 Hz, slits with their own width and position error, 20 ns rms jitter, a slow speed wobble
+//  spinup    0.05 Hz up to 2 Hz over the run
+//  quad      2 Hz in quadrature mode, QUAD_WORD transitions of both channels
+//  dropouts  steady with 1% of the packets lost on the way
+//  replay    the steady run written out as CSV and read back the way csv2archive reads a recorded run, or the
+//            run given with -f
+//For each one it reports the size as CSV, as the plain columns and packed, and the encode and decode rates in
+//GB/s of plain columns (13 bytes an edge), decode with the SSE2 unpacking and without, next to parsing the CSV.
+//Every stream is decoded both ways and checked edge by edge. The steady run is also written as a plain and a
+//packed archive, read back whole with run_archive_read_edges() and in one second windows at random rows.
+//Exits non-zero on any mismatch.
+//
+// Usage:
+// $ ./bench_codec [-s seconds] [-q queries] [-f Encoder_Data.csv] [-o dir]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "csv2archive.h"
+#include "edge_codec.h"
+#include "pru_layout.h"
+#include "run_archive.h"
+
+#define IEP_HZ 200000000.0
+#define SLITS 570
+#define EDGES_PER_REV (2 * SLITS)
+#define PLAIN_BYTES_PER_EDGE (sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint8_t))
+
+struct stream {
+    const char* name;
+    size_t n;
+    uint64_t* clock;
+    uint32_t* edge_index;
+    uint8_t* quad;
+};
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long file_size(const char* path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (long) st.st_size : 0;
+}
+
+//xorshift64, as in pru_sigsim.c
+static uint64_t rng = 0x9e3779b97f4a7c15ull;
+
+static double uniform(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return ((rng >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double gaussian(void)
+{
+    return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+static void alloc_stream(struct stream* s, const char* name, size_t n)
+{
+    s->name = name;
+    s->n = 0;
+    s->clock = malloc(n * sizeof(uint64_t));
+    s->edge_index = malloc(n * sizeof(uint32_t));
+    s->quad = malloc(n);
+    if (s->clock == NULL || s->edge_index == NULL || s->quad == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+}
+
+static void free_stream(struct stream* s)
+{
+    free(s->clock);
+    free(s->edge_index);
+    free(s->quad);
+}
+
+//Edge k of the wheel is at slit k / 2, the falling edge a slit width after the rising one. hz(t) is the rotation
+//frequency, the phase is integrated in small steps. Packets are dropped whole with probability loss.
+static void generate(struct stream* s, const char* name, double seconds, double hz_start, double hz_end, double wobble,
+                     int quadrature, double loss)
+{
+    double position_error[SLITS], width[SLITS];
+    double jitter = 20e-9;
+    size_t max = (size_t) (seconds * (hz_start > hz_end ? hz_start : hz_end) * EDGES_PER_REV * (quadrature ? 2 : 1)) + 1;
+
+    for (int k = 0; k < SLITS; k++) {
+        position_error[k] = 1e-4 * gaussian();
+        width[k] = 0.5 + 0.02 * gaussian();
+    }
+    alloc_stream(s, name, max);
+    double t = 0, phase = 0, dt = 1e-4;
+    uint32_t edge = 1;
+    int32_t position = 0;
+    int drop = 0;
+    while (t < seconds && s->n < max) {
+        double hz = hz_start + (hz_end - hz_start) * t / seconds;
+        hz *= 1 + wobble * sin(2 * M_PI * t / 60);
+        double step = hz * dt * EDGES_PER_REV * (quadrature ? 2 : 1);
+        //edges that fall in this step, in units of edges (or transitions) from the start
+        double next = floor(phase) + 1;
+        while (next <= phase + step && s->n < max) {
+            long k = (long) next;
+            double slot = quadrature ? k / 4.0 : k / 2.0;
+            int slit = (long) floor(slot) % SLITS;
+            double offset = quadrature ? (k % 4) * 0.25 : (k % 2 ? width[slit] : 0);
+            double where = (floor(slot) + position_error[slit] + offset) * (quadrature ? 4 : 2);
+            double when = t + (where - phase) / step * dt + jitter * gaussian();
+            if (edge % ENCODER_COUNTER_SIZE == 1) {
+                drop = uniform() < loss;
+            }
+            if (!drop) {
+                s->clock[s->n] = 0xfff00000ull + (uint64_t) llround(when * IEP_HZ);
+                if (quadrature) {
+                    position += 1;
+                    static const uint32_t gray[4] = { 1, 3, 2, 0 };
+                    s->edge_index[s->n] = QUAD_WORD(position, gray[position & 3]);
+                    s->quad[s->n] = ARCHIVE_QUAD_ENTRY | 2;
+                } else {
+                    s->edge_index[s->n] = edge;
+                    s->quad[s->n] = ((edge - 1) / ENCODER_COUNTER_SIZE) & 1 ? 2 : 0;
+                }
+                s->n += 1;
+            }
+            edge += 1;
+            next += 1;
+        }
+        phase += step;
+        t += dt;
+    }
+}
+
+//Same rows as encoder_receiver writes
+static void write_csv(const struct stream* s, const char* path)
+{
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fputs("1: Quad readout,2-152: capt_cnt/clk_cnt\r\n\r\n", f);
+    for (size_t k = 0; k < s->n; k += ENCODER_COUNTER_SIZE) {
+        fprintf(f, "%d,%d,%d\r\n\r\n", s->quad[k] & 1, (s->quad[k] >> 1) & 1, (s->quad[k] >> 2) & 1);
+        for (size_t x = k; x < s->n && x < k + ENCODER_COUNTER_SIZE; x++) {
+            if (s->quad[x] & ARCHIVE_QUAD_ENTRY) {
+                fprintf(f, "%d,%llu\r\n", QUAD_POSITION(s->edge_index[x]), (unsigned long long) s->clock[x]);
+            } else {
+                fprintf(f, "%u,%llu\r\n", s->edge_index[x], (unsigned long long) s->clock[x]);
+            }
+        }
+        fputs("\r\n", f);
+    }
+    fclose(f);
+}
+
+//Reads a run back as csv2archive does, returns the seconds it took
+static double read_csv(struct stream* s, const char* name, const char* path)
+{
+    struct csv_reader r;
+    uint64_t clock[1024];
+    uint32_t edge[1024];
+    size_t n, cap = 1 << 20;
+    uint8_t quad;
+
+    alloc_stream(s, name, cap);
+    if (csv_reader_open(&r, path) < 0) {
+        perror(path);
+        exit(1);
+    }
+    double t0 = now_s();
+    while (csv_next_encoder(&r, clock, edge, 1024, &n, &quad) == 1) {
+        if (s->n + n > cap) {
+            cap *= 2;
+            s->clock = realloc(s->clock, cap * sizeof(uint64_t));
+            s->edge_index = realloc(s->edge_index, cap * sizeof(uint32_t));
+            s->quad = realloc(s->quad, cap);
+            if (s->clock == NULL || s->edge_index == NULL || s->quad == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                exit(1);
+            }
+        }
+        memcpy(s->clock + s->n, clock, n * sizeof(uint64_t));
+        memcpy(s->edge_index + s->n, edge, n * sizeof(uint32_t));
+        memset(s->quad + s->n, quad, n);
+        s->n += n;
+    }
+    double dt = now_s() - t0;
+    csv_reader_close(&r);
+    return dt;
+}
+
+//Decodes every block, returns the seconds it took or -1 if an edge came out wrong
+static double decode_all(const struct stream* s, const uint8_t* packed, const size_t* offsets, size_t n_blocks,
+                         uint64_t* clock, uint32_t* edge_index, uint8_t* quad)
+{
+    double t0 = now_s();
+    for (size_t b = 0; b < n_blocks; b++) {
+        size_t first = b * EDGE_CODEC_BLOCK;
+        if (edge_codec_decode(packed + offsets[b], offsets[b + 1] - offsets[b], clock + first, edge_index + first,
+                              quad + first) < 0) {
+            return -1;
+        }
+    }
+    double dt = now_s() - t0;
+    if (memcmp(clock, s->clock, s->n * sizeof(uint64_t)) != 0 ||
+        memcmp(edge_index, s->edge_index, s->n * sizeof(uint32_t)) != 0 || memcmp(quad, s->quad, s->n) != 0) {
+        return -1;
+    }
+    return dt;
+}
+
+static int run(const struct stream* s, const char* dir, double csv_parse_s)
+{
+    char csv_path[4096];
+    size_t n_blocks = (s->n + EDGE_CODEC_BLOCK - 1) / EDGE_CODEC_BLOCK;
+    uint8_t* packed = malloc(n_blocks * EDGE_CODEC_MAX_BYTES);
+    size_t* offsets = malloc((n_blocks + 1) * sizeof(size_t));
+    uint64_t* clock = malloc(n_blocks * EDGE_CODEC_BLOCK * sizeof(uint64_t));
+    uint32_t* edge_index = malloc(n_blocks * EDGE_CODEC_BLOCK * sizeof(uint32_t));
+    uint8_t* quad = malloc(n_blocks * EDGE_CODEC_BLOCK);
+    if (packed == NULL || offsets == NULL || clock == NULL || edge_index == NULL || quad == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    double t0 = now_s();
+    offsets[0] = 0;
+    for (size_t b = 0; b < n_blocks; b++) {
+        size_t first = b * EDGE_CODEC_BLOCK, n = s->n - first < EDGE_CODEC_BLOCK ? s->n - first : EDGE_CODEC_BLOCK;
+        offsets[b + 1] = offsets[b] + edge_codec_encode(s->clock + first, s->edge_index + first, s->quad + first, n,
+                                                        packed + offsets[b]);
+    }
+    double encode_s = now_s() - t0;
+
+    edge_codec_set_simd(0);
+    double scalar_s = decode_all(s, packed, offsets, n_blocks, clock, edge_index, quad);
+    int simd = edge_codec_set_simd(1);
+    double simd_s = simd ? decode_all(s, packed, offsets, n_blocks, clock, edge_index, quad) : scalar_s;
+
+    snprintf(csv_path, sizeof(csv_path), "%s/bench_codec_%d.csv", dir, (int) getpid());
+    write_csv(s, csv_path);
+    if (csv_parse_s <= 0) {
+        struct stream back;
+        csv_parse_s = read_csv(&back, s->name, csv_path);
+        free_stream(&back);
+    }
+    double csv_mb = file_size(csv_path) / 1e6;
+    unlink(csv_path);
+
+    double plain = (double) s->n * PLAIN_BYTES_PER_EDGE;
+    int ok = scalar_s >= 0 && simd_s >= 0;
+    printf("%-10s %10zu %8.1f %8.1f %8.2f %6.2f %6.1f %7.0f %8.2f %8.2f %8.2f %8.3f %6s\n", s->name, s->n, csv_mb,
+           plain / 1e6, offsets[n_blocks] / 1e6, (double) offsets[n_blocks] / s->n, plain / offsets[n_blocks],
+           csv_mb * 1e6 / offsets[n_blocks], plain / encode_s / 1e9, ok ? plain / simd_s / 1e9 : 0,
+           ok ? plain / scalar_s / 1e9 : 0, plain / csv_parse_s / 1e9, ok ? "ok" : "FAIL");
+
+    free(packed);
+    free(offsets);
+    free(clock);
+    free(edge_index);
+    free(quad);
+    return ok;
+}
+
+static void write_archive(const struct stream* s, const char* dir, int packed)
+{
+    struct run_archive_writer w;
+    if (run_archive_create(&w, dir, packed) < 0) {
+        perror(dir);
+        exit(1);
+    }
+    for (size_t k = 0; k < s->n; k += ENCODER_COUNTER_SIZE) {
+        size_t n = s->n - k < ENCODER_COUNTER_SIZE ? s->n - k : ENCODER_COUNTER_SIZE;
+        run_archive_append_edges(&w, s->clock + k, s->edge_index + k, n, s->quad[k]);
+    }
+    run_archive_close_writer(&w);
+}
+
+static void remove_archive(const char* dir)
+{
+    const char* names[] = { "edge_index.col", "edge_clock.col", "edge_quad.col", "irig.tab", "irig_index.tab",
+                            "edges.pack", "edge_blocks.tab" };
+    char path[4096 + 64];
+    for (int k = 0; k < 7; k++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[k]);
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+//Writes the stream as a plain and a packed archive and reads both back, whole and in windows of window edges
+static int archive_check(const struct stream* s, const char* dir, int queries, size_t window)
+{
+    char plain_dir[4096], packed_dir[4096];
+    struct run_archive a[2];
+    uint64_t* clock = malloc(s->n * sizeof(uint64_t));
+    uint32_t* edge_index = malloc(s->n * sizeof(uint32_t));
+    uint8_t* quad = malloc(s->n);
+    double query_s[2] = { 0, 0 };
+    long bytes[2];
+    int ok = 1;
+
+    snprintf(plain_dir, sizeof(plain_dir), "%s/bench_codec_plain", dir);
+    snprintf(packed_dir, sizeof(packed_dir), "%s/bench_codec_packed", dir);
+    write_archive(s, plain_dir, 0);
+    write_archive(s, packed_dir, 1);
+    char path[4096 + 64];
+    snprintf(path, sizeof(path), "%s/edge_index.col", plain_dir);
+    bytes[0] = file_size(path);
+    snprintf(path, sizeof(path), "%s/edge_clock.col", plain_dir);
+    bytes[0] += file_size(path);
+    snprintf(path, sizeof(path), "%s/edge_quad.col", plain_dir);
+    bytes[0] += file_size(path);
+    snprintf(path, sizeof(path), "%s/edges.pack", packed_dir);
+    bytes[1] = file_size(path);
+    snprintf(path, sizeof(path), "%s/edge_blocks.tab", packed_dir);
+    bytes[1] += file_size(path);
+
+    for (int k = 0; k < 2; k++) {
+        if (run_archive_open(&a[k], k ? packed_dir : plain_dir) < 0) {
+            perror(k ? packed_dir : plain_dir);
+            exit(1);
+        }
+        ok &= a[k].n_edges == s->n && run_archive_read_edges(&a[k], 0, s->n, edge_index, clock, quad) == 0 &&
+              memcmp(clock, s->clock, s->n * sizeof(uint64_t)) == 0 &&
+              memcmp(edge_index, s->edge_index, s->n * sizeof(uint32_t)) == 0 && memcmp(quad, s->quad, s->n) == 0;
+    }
+    for (int q = 0; q < queries && s->n > window; q++) {
+        size_t begin = (size_t) (uniform() * (s->n - window));
+        for (int k = 0; k < 2; k++) {
+            double t0 = now_s();
+            if (run_archive_read_edges(&a[k], begin, begin + window, edge_index, clock, quad) < 0) {
+                ok = 0;
+            }
+            query_s[k] += now_s() - t0;
+            ok &= memcmp(clock, s->clock + begin, window * sizeof(uint64_t)) == 0 &&
+                  memcmp(edge_index, s->edge_index + begin, window * sizeof(uint32_t)) == 0;
+        }
+    }
+    printf("archive: plain %.1f MB, packed %.2f MB; %zu edge windows at random rows, plain %.1f us, packed %.1f us; %s\n",
+           bytes[0] / 1e6, bytes[1] / 1e6, window, query_s[0] / queries * 1e6, query_s[1] / queries * 1e6,
+           ok ? "ok" : "FAIL");
+    run_archive_close(&a[0]);
+    run_archive_close(&a[1]);
+    remove_archive(plain_dir);
+    remove_archive(packed_dir);
+    free(clock);
+    free(edge_index);
+    free(quad);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 600;
+    int queries = 200;
+    const char* recorded = NULL;
+    const char* dir = "/tmp";
+    struct stream s;
+    int ok = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:q:f:o:")) != -1) {
+        switch (opt) {
+        case 's': seconds = atof(optarg); break;
+        case 'q': queries = atoi(optarg); break;
+        case 'f': recorded = optarg; break;
+        case 'o': dir = optarg; break;
+        default:
+            printf("Usage: %s [-s seconds] [-q queries] [-f Encoder_Data.csv] [-o dir]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("%.0f s runs at up to 2 Hz; rates in GB/s of plain columns, %zu bytes an edge\n", seconds,
+           PLAIN_BYTES_PER_EDGE);
+    printf("%-10s %10s %8s %8s %8s %6s %6s %7s %8s %8s %8s %8s %6s\n", "stream", "edges", "csv_MB", "bin_MB",
+           "pack_MB", "B/edge", "x_bin", "x_csv", "enc_GB/s", "dec_GB/s", "scalar", "csv_GB/s", "result");
+
+    generate(&s, "steady", seconds, 2, 2, 1e-3, 0, 0);
+    ok &= run(&s, dir, 0);
+    ok &= archive_check(&s, dir, queries, 2 * EDGES_PER_REV);
+    free_stream(&s);
+    generate(&s, "spinup", seconds, 0.05, 2, 0, 0, 0);
+    ok &= run(&s, dir, 0);
+    free_stream(&s);
+    generate(&s, "quad", seconds, 2, 2, 1e-3, 1, 0);
+    ok &= run(&s, dir, 0);
+    free_stream(&s);
+    generate(&s, "dropouts", seconds, 2, 2, 1e-3, 0, 0.01);
+    ok &= run(&s, dir, 0);
+    free_stream(&s);
+
+    //a recorded run, or the steady one through CSV, read back as csv2archive would
+    char csv_path[4096];
+    if (recorded == NULL) {
+        snprintf(csv_path, sizeof(csv_path), "%s/bench_codec_replay_%d.csv", dir, (int) getpid());
+        generate(&s, "steady", seconds, 2, 2, 1e-3, 0, 0);
+        write_csv(&s, csv_path);
+        free_stream(&s);
+    }
+    double parse_s = read_csv(&s, "replay", recorded != NULL ? recorded : csv_path);
+    if (recorded == NULL) {
+        unlink(csv_path);
+    }
+    ok &= run(&s, dir, parse_s);
+    free_stream(&s);
+
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
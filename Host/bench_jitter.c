@@ -0,0 +1,156 @@
+//Benchmark and check of jitter_monitor on a synthetic run
+//A 2 Hz rotation with 5 us of sinusoidal timing jitter at 37 Hz and 50 ns of white noise on every edge, fed in
+//one second chunks as angle_stream hands them out, with one missing edge partway through. For every window
+//size the update cost per window is timed and the results are checked: the rotation frequency, the phase
+//extrapolated a second past the last window, the PSD peak landing on 37 Hz, the PSD integrating to the
+//variance of the jitter (Parseval), and the missing edge restarting exactly one window.
+//Exits non-zero if any check fails.
+//
+// Usage:
+// $ ./bench_jitter [-s seconds] [-o overlap fraction]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "angle_stream.h"
+#include "jitter_monitor.h"
+
+#define EDGES_PER_SECOND 2280 //570 * 2 slits at 2 Hz
+#define ROTATION_HZ ((double) EDGES_PER_SECOND / ANGLE_SLITS_PER_REV)
+#define JITTER_AMPLITUDE 5e-6
+#define JITTER_HZ 37.0
+#define NOISE 50e-9
+#define START_TIME 43200.0
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//xorshift64 and Box-Muller, repeatable across runs
+static uint64_t rng = 88172645463325252ull;
+
+static double uniform(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return ((rng >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double gaussian(void)
+{
+    return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+static double ideal_time(long e)
+{
+    return START_TIME + e / (double) EDGES_PER_SECOND;
+}
+
+struct result {
+    double us_per_window;
+    unsigned long int windows;
+    unsigned long int gaps;
+    double rotation_hz;
+    double phase_err;
+    double peak_hz;
+    double freq_step;
+    double parseval; //integral of the PSD over the variance of the jitter
+};
+
+static struct result run(size_t window, size_t overlap, int seconds)
+{
+    struct jitter_monitor m;
+    struct result res = { 0 };
+    static double time[EDGES_PER_SECOND], angle[EDGES_PER_SECOND];
+    double rad_per_edge = 2 * M_PI / ANGLE_SLITS_PER_REV;
+    long gap_edge = (long) seconds / 3 * EDGES_PER_SECOND + 17;
+    double elapsed = 0, var = 0;
+    long n_var = 0;
+
+    rng = 88172645463325252ull;
+    if (jitter_monitor_init(&m, window, overlap, 0, 0, 0, NULL, NULL) < 0) {
+        return res;
+    }
+    for (long e0 = 0; e0 < (long) seconds * EDGES_PER_SECOND; e0 += EDGES_PER_SECOND) {
+        size_t n = 0;
+        for (long e = e0; e < e0 + EDGES_PER_SECOND; e++) {
+            if (e == gap_edge) {
+                continue;
+            }
+            double t = ideal_time(e);
+            double j = JITTER_AMPLITUDE * sin(2 * M_PI * JITTER_HZ * (t - START_TIME)) + NOISE * gaussian();
+            time[n] = t + j;
+            angle[n] = e * rad_per_edge;
+            var += j * j;
+            n_var += 1;
+            n++;
+        }
+        double t0 = now_s();
+        res.windows += jitter_monitor_push(&m, time, angle, n);
+        elapsed += now_s() - t0;
+    }
+
+    struct jitter_report report;
+    jitter_monitor_report(&m, &report);
+    size_t peak = 1;
+    double total = 0;
+    for (size_t k = 1; k < report.n_bins; k++) {
+        peak = report.psd[k] > report.psd[peak] ? k : peak;
+        total += report.psd[k] * report.freq_step;
+    }
+    //the true angle a second on, ignoring the jitter on the edges
+    double t = report.time + 1.0;
+    double truth = fmod(2 * M_PI * ROTATION_HZ * (t - START_TIME), 2 * M_PI);
+    double err = fabs(jitter_monitor_phase_at(&m, t) - truth);
+
+    res.us_per_window = res.windows ? elapsed / res.windows * 1e6 : 0;
+    res.gaps = m.gaps;
+    res.rotation_hz = report.rotation_hz;
+    res.phase_err = err > M_PI ? 2 * M_PI - err : err;
+    res.peak_hz = peak * report.freq_step;
+    res.freq_step = report.freq_step;
+    res.parseval = total / (var / n_var);
+    jitter_monitor_free(&m);
+    return res;
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = 600;
+    double overlap = 0.5;
+    int failures = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:o:")) != -1) {
+        switch (opt) {
+        case 's': seconds = atoi(optarg); break;
+        case 'o': overlap = atof(optarg); break;
+        default:
+            printf("Usage: %s [-s seconds] [-o overlap fraction]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("%d s at %.0f Hz, %.0f us jitter at %.0f Hz, %.0f%% overlap\n", seconds, ROTATION_HZ, JITTER_AMPLITUDE * 1e6,
+           JITTER_HZ, overlap * 100);
+    printf("%8s %10s %8s %6s %12s %12s %10s %10s %8s\n", "window", "us/window", "windows", "gaps", "rotation_hz",
+           "phase_urad", "peak_hz", "parseval", "result");
+    for (size_t window = 1024; window <= 16384; window *= 2) {
+        struct result res = run(window, (size_t) (window * overlap), seconds);
+        int ok = res.windows > 0 && res.gaps == 1 && fabs(res.rotation_hz - ROTATION_HZ) < 1e-6 &&
+                 res.phase_err < 1e-4 && fabs(res.peak_hz - JITTER_HZ) <= res.freq_step &&
+                 fabs(res.parseval - 1) < 0.05;
+        printf("%8zu %10.2f %8lu %6lu %12.9f %12.2f %10.3f %10.4f %8s\n", window, res.us_per_window, res.windows, res.gaps,
+               res.rotation_hz, res.phase_err * 1e6, res.peak_hz, res.parseval, ok ? "ok" : "FAIL");
+        failures += !ok;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,590 @@
+//End-to-end benchmark of the receiver implementations
+//Starts each receiver as its own process on loopback, sends it the synthetic stream of loadgen.h at a range of
+//speeds and follows its output files as they grow. For every run it reports the sustained packet rate, the
+//encoder packets that never reached the files, the time from sending a packet to its last row being readable
+//from the file (loopback, so within a few tens of microseconds of receive to disk) and the CPU time of the
+//receiver process. Results are printed as a table and appended to a JSON lines file, one object per run plus a
+//summary per receiver, so successive runs can be compared.
+//
+//Receivers:
+//  encoderDAQ_BB.py  ../encoderDAQ_BB.py under python2, skipped unless numpy, scipy and matplotlib import and
+//                    /home/polarbear/data exists, it binds 192.168.2.54:8080 so the address must be local
+//  csv               ./encoder_receiver -f csv
+//  bin               ./encoder_receiver -f bin, the edges are followed in edge_index.col
+//
+//Speedups run the signal clock faster than real time, 0 sends as fast as possible for the run time. Run from
+//Host/ after make.
+//
+// Usage:
+// $ ./bench_pipeline [-r receiver,...] [-x speedup,...] [-t seconds] [-f hwp_hz] [-n edges_per_rev] [-I irig_hz]
+//                    [-l loss] [-R reorder] [-d work_dir] [-o results.jsonl] [-k]
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "loadgen.h"
+
+#define MAX_SPEEDUPS 16
+#define FULL_SPEED_SIGNAL 4096 //seconds of signal per second of run time at speedup 0, bounds the packet count
+#define START_TIMEOUT_S 10.0
+#define SETTLE_S 1.0 //the receiver is stopped once its files have not grown for this long after the last packet
+#define MAX_SETTLE_S 10.0
+#define POLL_US 500
+
+enum implementation_kind { PYTHON, C_CSV, C_BIN };
+
+struct implementation {
+    const char* name;
+    enum implementation_kind kind;
+};
+
+static const struct implementation implementations[] = {
+    { "encoderDAQ_BB.py", PYTHON },
+    { "csv", C_CSV },
+    { "bin", C_BIN },
+};
+#define N_IMPLEMENTATIONS (sizeof(implementations) / sizeof(implementations[0]))
+
+//Follows a file that the receiver appends to
+struct tail {
+    int fd;
+    int binary; //edge_index.col: a header then one uint32_t per edge, CSV rows otherwise
+    size_t skip; //header bytes still to be skipped
+    char partial[256]; //unfinished row or record
+    size_t len;
+};
+
+//One run of a receiver
+struct run {
+    struct loadgen_config config;
+    double speedup;
+    double run_s;
+    uint32_t capacity; //encoder packets the arrays have room for
+    uint64_t* send_ns; //monotonic time each encoder packet was sent, 0 if it was not
+    double* latency;
+    uint8_t* on_disk;
+    unsigned long int n_latency;
+    unsigned long int n_on_disk;
+    unsigned long int flushed_at_close; //only readable once the receiver was stopped, no latency taken
+    double last_seen;
+    const char* target_ip;
+    int target_port;
+    //written by the sender thread
+    unsigned long int sent;
+    unsigned long int encoder_sent;
+    size_t bytes;
+    double t_start;
+    double t_end;
+    volatile int sender_done;
+};
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_until(double t)
+{
+    double dt = t - now_s();
+    if (dt > 0) {
+        struct timespec ts = { .tv_sec = (time_t) dt, .tv_nsec = (long) ((dt - (time_t) dt) * 1e9) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void* send_stream(void* arg)
+{
+    struct run* run = arg;
+    static struct loadgen g;
+    static struct loadgen_packet p;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(run->target_port) };
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int sndbuf = 4 << 20;
+
+    inet_pton(AF_INET, run->target_ip, &addr.sin_addr);
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    loadgen_init(&g, &run->config);
+    run->t_start = now_s();
+    double t_stop = run->t_start + run->run_s;
+    while (loadgen_next(&g, &p)) {
+        double t = run->speedup > 0 ? run->t_start + p.t / run->speedup : 0;
+        if (run->speedup > 0) {
+            sleep_until(t);
+        } else if ((run->sent & 63) == 0 && now_s() > t_stop) {
+            break;
+        }
+        int encoder = p.header == ENCODER_HEADER && p.index < run->capacity;
+        if (encoder) {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            __atomic_store_n(&run->send_ns[p.index], ts.tv_sec * 1000000000ull + ts.tv_nsec, __ATOMIC_RELEASE);
+        }
+        if (sendto(fd, &p.data, p.size, 0, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+            if (encoder) {
+                __atomic_store_n(&run->send_ns[p.index], 0, __ATOMIC_RELEASE);
+            }
+            continue;
+        }
+        run->sent += 1;
+        run->encoder_sent += encoder;
+        run->bytes += p.size;
+    }
+    run->t_end = now_s();
+    close(fd);
+    __atomic_store_n(&run->sender_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+//An edge count seen in the file, the last edge of a packet means the whole packet is there
+static void seen_edge(struct run* run, uint32_t count, double now, int at_close)
+{
+    if (count == 0 || count % ENCODER_COUNTER_SIZE != 0) {
+        return;
+    }
+    uint32_t k = count / ENCODER_COUNTER_SIZE - 1;
+    if (k >= run->capacity || run->on_disk[k]) {
+        return;
+    }
+    run->on_disk[k] = 1;
+    run->n_on_disk += 1;
+    uint64_t sent = __atomic_load_n(&run->send_ns[k], __ATOMIC_ACQUIRE);
+    if (at_close) {
+        run->flushed_at_close += 1;
+    } else if (sent) {
+        run->latency[run->n_latency++] = now - sent * 1e-9;
+        run->last_seen = now;
+    }
+}
+
+//A CSV row: only the count,clock rows of the encoder file are two numbers
+static void seen_row(struct run* run, const char* row, double now, int at_close)
+{
+    char* end;
+    if (row[0] < '0' || row[0] > '9') {
+        return;
+    }
+    unsigned long int count = strtoul(row, &end, 10);
+    if (*end != ',' || end[1] < '0' || end[1] > '9') {
+        return;
+    }
+    strtoull(end + 1, &end, 10);
+    if (*end == '\r' || *end == '\0') {
+        seen_edge(run, (uint32_t) count, now, at_close);
+    }
+}
+
+static int tail_open(struct tail* t, const char* path, int binary)
+{
+    memset(t, 0, sizeof(*t));
+    t->fd = open(path, O_RDONLY);
+    t->binary = binary;
+    t->skip = binary ? 64 : 0; //ARCHIVE_HEADER_SIZE
+    return t->fd;
+}
+
+//Reads whatever has been appended since the last call, returns the bytes read
+static size_t tail_poll(struct tail* t, struct run* run, int at_close)
+{
+    char buf[1 << 16];
+    size_t total = 0;
+    ssize_t n;
+
+    while ((n = read(t->fd, buf, sizeof(buf))) > 0) {
+        double now = now_s();
+        const char* p = buf;
+        const char* end = buf + n;
+        total += n;
+        if (t->skip) {
+            size_t s = t->skip < (size_t) n ? t->skip : (size_t) n;
+            p += s;
+            t->skip -= s;
+        }
+        while (p < end) {
+            if (t->binary) {
+                t->partial[t->len++] = *p++;
+                if (t->len == sizeof(uint32_t)) {
+                    uint32_t count;
+                    memcpy(&count, t->partial, sizeof(count));
+                    seen_edge(run, count, now, at_close);
+                    t->len = 0;
+                }
+            } else if (*p == '\n') {
+                t->partial[t->len] = '\0';
+                seen_row(run, t->partial, now, at_close);
+                t->len = 0;
+                p++;
+            } else {
+                if (t->len < sizeof(t->partial) - 1) {
+                    t->partial[t->len++] = *p;
+                }
+                p++;
+            }
+        }
+    }
+    return total;
+}
+
+static int compare_double(const void* a, const void* b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double* sorted, unsigned long int n, double q)
+{
+    return n ? sorted[(unsigned long int) (q * (n - 1) + 0.5)] : 0;
+}
+
+//A free UDP port on loopback
+static int free_port(void)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int port = -1;
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0 && getsockname(fd, (struct sockaddr*) &addr, &len) == 0) {
+        port = ntohs(addr.sin_port);
+    }
+    close(fd);
+    return port;
+}
+
+//Why the receiver cannot be run here, NULL if it can
+static const char* unavailable(const struct implementation* impl)
+{
+    struct stat st;
+    if (impl->kind == PYTHON) {
+        if (system("python2 -c 'import numpy, scipy, matplotlib' > /dev/null 2>&1") != 0) {
+            return "python2 with numpy, scipy and matplotlib not found";
+        }
+        if (stat("/home/polarbear/data", &st) < 0 || !S_ISDIR(st.st_mode)) {
+            return "/home/polarbear/data does not exist";
+        }
+        if (access("../encoderDAQ_BB.py", R_OK) < 0) {
+            return "../encoderDAQ_BB.py not found";
+        }
+        return NULL;
+    }
+    return access("./encoder_receiver", X_OK) < 0 ? "./encoder_receiver not built" : NULL;
+}
+
+static pid_t spawn(char* const* argv, const char* log_path)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        int in = open("/dev/null", O_RDONLY);
+        int out = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(in, 0);
+        dup2(out, 1);
+        dup2(out, 2);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void remove_tree(const char* path)
+{
+    char cmd[8192];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", path);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "Could not remove %s\n", path);
+    }
+}
+
+//Output of a command, trailing newline removed, empty if it fails
+static void command_output(const char* cmd, char* out, size_t size)
+{
+    FILE* f = popen(cmd, "r");
+    out[0] = '\0';
+    if (f != NULL) {
+        if (fgets(out, size, f) == NULL) {
+            out[0] = '\0';
+        }
+        out[strcspn(out, "\r\n")] = '\0';
+        pclose(f);
+    }
+}
+
+struct context {
+    FILE* results;
+    const char* work_dir;
+    int keep;
+    char host[256];
+    char revision[64];
+    long int started; //wall clock seconds since the epoch, the same for every record of an invocation
+};
+
+static void record_start(const struct context* ctx, const struct implementation* impl, const char* status)
+{
+    fprintf(ctx->results, "{\"bench\":\"pipeline\",\"time\":%ld,\"host\":\"%s\",\"revision\":\"%s\",\"receiver\":\"%s\",\"status\":\"%s\"",
+            ctx->started, ctx->host, ctx->revision, impl->name, status);
+}
+
+static void record_config(const struct context* ctx, const struct run* run)
+{
+    fprintf(ctx->results, ",\"hwp_hz\":%g,\"edges_per_rev\":%d,\"irig_hz\":%g,\"speedup\":%g,\"loss_injected\":%g,\"reorder\":%g",
+            run->config.hwp_hz, run->config.edges_per_rev, run->config.irig_hz, run->speedup, run->config.loss, run->config.reorder);
+}
+
+//Runs one receiver at one speed, returns the packet rate it sustained without loss, 0 if it lost packets, -1 if
+//it could not be run
+static double run_receiver(const struct context* ctx, const struct implementation* impl, struct run* run)
+{
+    static int n_runs = 0;
+    char run_name[64], data_dir[1024], run_dir[1100], save_dir[1200], follow[1400], log_path[1400], port[16];
+    const char* reason = NULL;
+    struct tail tail = { .fd = -1 };
+    struct rusage ru;
+    int status = 0;
+
+    snprintf(run_name, sizeof(run_name), "bench_pipeline_%d_%d", (int) getpid(), n_runs++);
+    if (impl->kind == PYTHON) {
+        snprintf(data_dir, sizeof(data_dir), "/home/polarbear/data");
+        run->target_ip = "192.168.2.54";
+        run->target_port = 8080;
+    } else {
+        snprintf(data_dir, sizeof(data_dir), "%s", ctx->work_dir);
+        run->target_ip = "127.0.0.1";
+        run->target_port = free_port();
+    }
+    snprintf(run_dir, sizeof(run_dir), "%s/%s", data_dir, run_name);
+    snprintf(save_dir, sizeof(save_dir), "%s/rawData", run_dir);
+    snprintf(log_path, sizeof(log_path), "%s/%s.log", ctx->work_dir, run_name);
+    snprintf(port, sizeof(port), "%d", run->target_port);
+    if (impl->kind == C_BIN) {
+        snprintf(follow, sizeof(follow), "%s/Encoder_Archive_%s/edge_index.col", save_dir, run_name);
+    } else {
+        snprintf(follow, sizeof(follow), "%s/Encoder_Data_%s.csv", save_dir, run_name);
+    }
+
+    char* python_argv[] = { "python2", "../encoderDAQ_BB.py", run_name, "80000", NULL };
+    char* c_argv[] = { "./encoder_receiver", "-q", "-d", data_dir, "-i", "127.0.0.1", "-p", port, "-f",
+                       impl->kind == C_BIN ? "bin" : "csv", "--", run_name, "-1", NULL };
+    double t_spawn = now_s();
+    pid_t pid = spawn(impl->kind == PYTHON ? python_argv : c_argv, log_path);
+    if (pid < 0) {
+        reason = "fork failed";
+    }
+
+    //the output file exists once the socket is bound
+    while (reason == NULL && tail_open(&tail, follow, impl->kind == C_BIN) < 0) {
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            pid = -1;
+            reason = "receiver exited at startup, see its log";
+        } else if (now_s() - t_spawn > START_TIMEOUT_S) {
+            reason = "receiver did not start";
+        } else {
+            usleep(10000);
+        }
+    }
+    if (reason != NULL) {
+        if (pid > 0) {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+        }
+        record_start(ctx, impl, "failed");
+        record_config(ctx, run);
+        fprintf(ctx->results, ",\"reason\":\"%s\",\"log\":\"%s\"}\n", reason, log_path);
+        printf("%-18s %8g  failed: %s (%s)\n", impl->name, run->speedup, reason, log_path);
+        remove_tree(run_dir);
+        return -1;
+    }
+    usleep(100000);
+
+    pthread_t sender;
+    pthread_create(&sender, NULL, send_stream, run);
+    double quiet_since = 0;
+    for (;;) {
+        size_t n = tail_poll(&tail, run, 0);
+        if (__atomic_load_n(&run->sender_done, __ATOMIC_ACQUIRE)) {
+            double now = now_s();
+            if (run->n_on_disk >= run->encoder_sent || now - run->t_end > MAX_SETTLE_S) {
+                break;
+            }
+            if (n > 0 || quiet_since == 0) {
+                quiet_since = now;
+            } else if (now - quiet_since > SETTLE_S) {
+                break;
+            }
+        }
+        usleep(POLL_US);
+    }
+    pthread_join(sender, NULL);
+
+    //whatever the receiver still buffers is written when it stops
+    kill(pid, SIGINT);
+    wait4(pid, &status, 0, &ru);
+    double t_exit = now_s();
+    tail_poll(&tail, run, 1);
+    close(tail.fd);
+
+    qsort(run->latency, run->n_latency, sizeof(double), compare_double);
+    double send_s = run->t_end - run->t_start;
+    double disk_s = (run->last_seen > run->t_start ? run->last_seen : run->t_end) - run->t_start;
+    unsigned long int lost = run->encoder_sent > run->n_on_disk ? run->encoder_sent - run->n_on_disk : 0;
+    double loss = run->encoder_sent ? (double) lost / run->encoder_sent : 0;
+    double cpu_user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6;
+    double cpu_sys = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+    double send_rate = run->sent / send_s;
+    double disk_rate = run->n_on_disk / disk_s;
+    const double* l = run->latency;
+    unsigned long int nl = run->n_latency;
+
+    record_start(ctx, impl, "ok");
+    record_config(ctx, run);
+    fprintf(ctx->results, ",\"seconds\":%.3f,\"packets_sent\":%lu,\"encoder_packets_sent\":%lu,\"encoder_packets_on_disk\":%lu,"
+            "\"encoder_packets_lost\":%lu,\"loss\":%.6f,\"send_packets_per_s\":%.1f,\"disk_encoder_packets_per_s\":%.1f,"
+            "\"disk_edges_per_s\":%.0f,\"wire_mb_per_s\":%.3f,"
+            "\"latency_ms\":{\"n\":%lu,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"p999\":%.3f,\"max\":%.3f},\"flushed_at_close\":%lu,"
+            "\"cpu_user_s\":%.3f,\"cpu_sys_s\":%.3f,\"cpu_percent\":%.1f,\"cpu_us_per_packet\":%.2f,\"max_rss_kb\":%ld,\"exit_status\":%d}\n",
+            send_s, run->sent, run->encoder_sent, run->n_on_disk, lost, loss, send_rate, disk_rate,
+            disk_rate * ENCODER_COUNTER_SIZE, run->bytes / send_s / 1e6,
+            nl, percentile(l, nl, 0.5) * 1e3, percentile(l, nl, 0.9) * 1e3, percentile(l, nl, 0.99) * 1e3,
+            percentile(l, nl, 0.999) * 1e3, nl ? l[nl - 1] * 1e3 : 0, run->flushed_at_close,
+            cpu_user, cpu_sys, 100 * (cpu_user + cpu_sys) / (t_exit - t_spawn),
+            run->sent ? (cpu_user + cpu_sys) / run->sent * 1e6 : 0, ru.ru_maxrss,
+            WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status));
+    fflush(ctx->results);
+    printf("%-18s %8g %10.0f %10.0f %8.1f %9.4f %9.2f %9.2f %9.2f %7.1f %9.2f\n", impl->name, run->speedup, send_rate,
+           disk_rate, run->bytes / send_s / 1e6, loss, percentile(l, nl, 0.5) * 1e3, percentile(l, nl, 0.99) * 1e3,
+           nl ? l[nl - 1] * 1e3 : 0, 100 * (cpu_user + cpu_sys) / (t_exit - t_spawn),
+           run->sent ? (cpu_user + cpu_sys) / run->sent * 1e6 : 0);
+
+    if (!ctx->keep) {
+        remove_tree(run_dir);
+        unlink(log_path);
+    }
+    return lost ? 0 : disk_rate;
+}
+
+int main(int argc, char **argv)
+{
+    struct loadgen_config config = { .hwp_hz = 2, .edges_per_rev = 570 * 2, .irig_hz = 1, .reorder_depth = 3,
+                                     .iep_start = 0xF0000000, .irig_start = 12 * 3600, .seed = 1 };
+    const char* receivers = "encoderDAQ_BB.py,csv,bin";
+    const char* speedup_list = "1,64,1024,0";
+    const char* results_path = "bench_pipeline.jsonl";
+    double speedups[MAX_SPEEDUPS];
+    int n_speedups = 0;
+    double run_s = 3;
+    struct context ctx = { .work_dir = "/tmp" };
+    struct utsname uts;
+    int opt, bad = 0;
+
+    while ((opt = getopt(argc, argv, "r:x:t:f:n:I:l:R:d:o:k")) != -1) {
+        switch (opt) {
+        case 'r': receivers = optarg; break;
+        case 'x': speedup_list = optarg; break;
+        case 't': run_s = atof(optarg); break;
+        case 'f': config.hwp_hz = atof(optarg); break;
+        case 'n': config.edges_per_rev = atoi(optarg); break;
+        case 'I': config.irig_hz = atof(optarg); break;
+        case 'l': config.loss = atof(optarg); break;
+        case 'R': config.reorder = atof(optarg); break;
+        case 'd': ctx.work_dir = optarg; break;
+        case 'o': results_path = optarg; break;
+        case 'k': ctx.keep = 1; break;
+        default: bad = 1; break;
+        }
+    }
+    for (const char* s = speedup_list; *s && n_speedups < MAX_SPEEDUPS; s += strcspn(s, ","), s += (*s == ',')) {
+        speedups[n_speedups] = atof(s);
+        bad |= speedups[n_speedups++] < 0;
+    }
+    config.duration_s = 1;
+    if (bad || optind != argc || run_s <= 0 || n_speedups == 0 || loadgen_init(&(struct loadgen){ 0 }, &config) < 0) {
+        printf("Usage: %s [-r receiver,...] [-x speedup,...] [-t seconds] [-f hwp_hz] [-n edges_per_rev] [-I irig_hz] "
+               "[-l loss] [-R reorder] [-d work_dir] [-o results.jsonl] [-k]\n", argv[0]);
+        return 1;
+    }
+    if (strlen(ctx.work_dir) >= 1024) {
+        fprintf(stderr, "Work directory %s is too long\n", ctx.work_dir);
+        return 1;
+    }
+    ctx.results = fopen(results_path, "a");
+    if (ctx.results == NULL) {
+        perror(results_path);
+        return 1;
+    }
+    uname(&uts);
+    snprintf(ctx.host, sizeof(ctx.host), "%s", uts.nodename);
+    command_output("git describe --always --dirty 2>/dev/null", ctx.revision, sizeof(ctx.revision));
+    ctx.started = (long int) time(NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%.3g Hz, %d edges/rev, %.3g IRIG frames/s, %.3g s per run, loss %g, reorder %g, results appended to %s\n",
+           config.hwp_hz, config.edges_per_rev, config.irig_hz, run_s, config.loss, config.reorder, results_path);
+    printf("%-18s %8s %10s %10s %8s %9s %9s %9s %9s %7s %9s\n", "receiver", "speedup", "sent/s", "disk/s", "MB/s", "loss",
+           "p50_ms", "p99_ms", "max_ms", "cpu%", "cpu_us/pk");
+    for (size_t i = 0; i < N_IMPLEMENTATIONS; i++) {
+        const struct implementation* impl = &implementations[i];
+        size_t len = strlen(impl->name);
+        const char* r = strstr(receivers, impl->name);
+        while (r != NULL && ((r != receivers && r[-1] != ',') || (r[len] != ',' && r[len] != '\0'))) {
+            r = strstr(r + 1, impl->name);
+        }
+        if (r == NULL) {
+            continue;
+        }
+        const char* reason = unavailable(impl);
+        if (reason != NULL) {
+            record_start(&ctx, impl, "skipped");
+            fprintf(ctx.results, ",\"reason\":\"%s\"}\n", reason);
+            printf("%-18s skipped: %s\n", impl->name, reason);
+            continue;
+        }
+
+        double sustained = 0;
+        int ran = 0;
+        for (int s = 0; s < n_speedups; s++) {
+            struct run run = { .config = config, .speedup = speedups[s], .run_s = run_s };
+            run.config.duration_s = run_s * (speedups[s] > 0 ? speedups[s] : FULL_SPEED_SIGNAL);
+            run.capacity = loadgen_encoder_packets(&run.config) + 1;
+            run.send_ns = calloc(run.capacity, sizeof(uint64_t));
+            run.latency = malloc(run.capacity * sizeof(double));
+            run.on_disk = calloc(run.capacity, 1);
+            if (run.send_ns == NULL || run.latency == NULL || run.on_disk == NULL) {
+                fprintf(stderr, "Out of memory for %u packets\n", run.capacity);
+                return 1;
+            }
+            double rate = run_receiver(&ctx, impl, &run);
+            if (rate >= 0) {
+                ran = 1;
+                if (rate > sustained) {
+                    sustained = rate;
+                }
+            }
+            free(run.send_ns);
+            free(run.latency);
+            free(run.on_disk);
+        }
+        if (ran) {
+            record_start(&ctx, impl, "summary");
+            fprintf(ctx.results, ",\"sustained_encoder_packets_per_s\":%.1f,\"sustained_edges_per_s\":%.0f}\n", sustained,
+                    sustained * ENCODER_COUNTER_SIZE);
+            printf("%-18s sustained without loss: %.0f encoder packets/s (%.0f edges/s, %.0f Hz at %d edges/rev)\n",
+                   impl->name, sustained, sustained * ENCODER_COUNTER_SIZE,
+                   sustained * ENCODER_COUNTER_SIZE / config.edges_per_rev, config.edges_per_rev);
+        }
+    }
+    fclose(ctx.results);
+    return 0;
+}
@@ -0,0 +1,173 @@
+//Loopback benchmark of encoder_receiver
+//Sends encoder packets with an IRIG packet every 15 of them through the Beaglebone's udp_batch.c at a paced
+//rate, doubling the rate every step, and checks that every packet was written to the CSV files. Reports the
+//highest rate that was sustained without loss.
+//
+// Usage:
+// $ ./bench_receiver [-r start_packets_per_s] [-s steps] [-t seconds_per_step] [-b single|mmsg|coalesce] [-v 1|2] [-o dir]
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "packet_v2.h"
+#include "receiver.h"
+#include "udp_batch.h"
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_until(double t)
+{
+    double dt = t - now_s();
+    if (dt > 0) {
+        struct timespec ts = { .tv_sec = (time_t) dt, .tv_nsec = (long) ((dt - (time_t) dt) * 1e9) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+struct run_arg {
+    struct receiver* r;
+    volatile int stop;
+};
+
+static void* run_receiver(void* arg)
+{
+    struct run_arg* a = arg;
+    receiver_run(a->r, &a->stop);
+    return NULL;
+}
+
+static unsigned long int written(struct receiver* r)
+{
+    return r->stats.encoder_packets + r->stats.irig_packets;
+}
+
+int main(int argc, char **argv)
+{
+    double rate = 10000;
+    int steps = 8;
+    double step_s = 1.0;
+    int batch_mode = UDP_BATCH_MMSG;
+    int wire_version = 1;
+    const char* dir = "/tmp";
+    char encoder_path[4096], irig_path[4096];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:s:t:b:v:o:")) != -1) {
+        switch (opt) {
+        case 'r': rate = atof(optarg); break;
+        case 's': steps = atoi(optarg); break;
+        case 't': step_s = atof(optarg); break;
+        case 'b': batch_mode = udp_batch_parse_mode(optarg); break;
+        case 'v': wire_version = atoi(optarg); break;
+        case 'o': dir = optarg; break;
+        default:
+            batch_mode = -1;
+            break;
+        }
+    }
+    if (batch_mode < 0 || (wire_version != 1 && wire_version != 2)) {
+        printf("Usage: %s [-r start_packets_per_s] [-s steps] [-t seconds_per_step] [-b single|mmsg|coalesce] [-v 1|2] [-o dir]\n", argv[0]);
+        return 1;
+    }
+
+    snprintf(encoder_path, sizeof(encoder_path), "%s/bench_receiver_Encoder.csv", dir);
+    snprintf(irig_path, sizeof(irig_path), "%s/bench_receiver_IRIG.csv", dir);
+    struct receiver_config config = { .ip = "127.0.0.1", .port = 0, .encoder_path = encoder_path, .irig_path = irig_path,
+                                      .runtime_s = -1, .quiet = 1 };
+    static struct receiver r;
+    if (receiver_open(&r, &config) < 0) {
+        perror("receiver_open");
+        return 1;
+    }
+    struct run_arg arg = { .r = &r, .stop = 0 };
+    pthread_t tr;
+    pthread_create(&tr, NULL, run_receiver, &arg);
+
+    //a 2 Hz like stream, so v2 packets come out at their usual size
+    static struct CompleteDataPackets encoder;
+    static struct IrigInfo irig;
+    static uint8_t encoded[PACKET_V2_MAX_SIZE(ENCODER_COUNTER_SIZE)];
+    const void* encoder_packet = &encoder;
+    size_t encoder_size = sizeof(encoder);
+    encoder.counter_info_header = ENCODER_HEADER;
+    for (int x = 0; x < ENCODER_COUNTER_SIZE; x++) {
+        encoder.Counter_Packets.clock_cnt[x] = 87719 * x + (x * 7919) % 2000;
+        encoder.Counter_Packets.encoder_cnt[x] = x;
+    }
+    irig.random_header = IRIG_HEADER;
+    if (wire_version == 2) {
+        encoder_size = packet_v2_encode(&encoder, 0, encoded);
+        encoder_packet = encoded;
+    }
+
+    static struct udp_batch batch;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(r.port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int sndbuf = 4 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    udp_batch_init(&batch, fd, &addr, batch_mode, 0);
+
+    double sustained = 0, sustained_mb = 0;
+    printf("socket receive buffer: %d bytes, encoder packet: %zu bytes\n", r.rcvbuf, encoder_size);
+    printf("%12s %12s %12s %10s %12s %10s %10s\n", "target/s", "sent/s", "MB/s", "lost", "kernel_drop", "stalls", "result");
+    for (int step = 0; step < steps; step++, rate *= 2) {
+        unsigned long int n = (unsigned long int) (rate * step_s);
+        unsigned long int before = written(&r), drops_before = r.stats.kernel_drops, stalls_before = r.stats.stalls;
+        size_t bytes = 0;
+
+        //bursts the size of the encoder ring, as the forwarder sends them after each wakeup
+        double t0 = now_s();
+        for (unsigned long int i = 0; i < n; i++) {
+            if (i % COUNTER_RING_SLOTS == 0) {
+                udp_batch_flush(&batch);
+                sleep_until(t0 + i / rate);
+            }
+            if (i % 15 == 14) {
+                udp_batch_add(&batch, &irig, sizeof(irig));
+                bytes += sizeof(irig);
+            } else {
+                udp_batch_add(&batch, encoder_packet, encoder_size);
+                bytes += encoder_size;
+            }
+        }
+        udp_batch_flush(&batch);
+        double elapsed = now_s() - t0;
+
+        //waits for the writer to go quiet
+        unsigned long int last = written(&r);
+        for (int k = 0; k < 50 && last - before < n; k++) {
+            usleep(20000);
+            last = written(&r);
+        }
+        unsigned long int lost = n - (last - before);
+        printf("%12.0f %12.0f %12.1f %10lu %12lu %10lu %10s\n", rate, n / elapsed, bytes / elapsed / 1e6, lost,
+               r.stats.kernel_drops - drops_before, r.stats.stalls - stalls_before, lost ? "LOSS" : "ok");
+        if (lost) {
+            break;
+        }
+        sustained = n / elapsed;
+        sustained_mb = bytes / elapsed / 1e6;
+    }
+    printf("sustained without loss: %.0f packets/s (%.1f MB/s), %.1f MB of CSV written\n", sustained, sustained_mb,
+           r.stats.bytes_written / 1e6);
+
+    arg.stop = 1;
+    pthread_join(tr, NULL);
+    receiver_close(&r);
+    close(fd);
+    unlink(encoder_path);
+    unlink(irig_path);
+    return 0;
+}
@@ -0,0 +1,311 @@
+//Recovery of packets lost between the Beaglebone and the host, with the simulated PRUs of ../Beaglebone/pru_sim.c
+//The forwarder runs with replay on (../Beaglebone/replay_buffer.h) and sends over loopback through a proxy that
+//drops datagrams, at random or all of them for a while, in both directions so NACKs and retransmissions get lost
+//too. The receiver asks for what is missing and writes CSV files, which are read back and checked: every edge
+//number and every IRIG second from the first to the last without a gap, a repeat or a step back, and as many
+//packets as the PRUs published, none at odds with the layout packet. The forwarder's longest notice and send times
+//show whether the retransmissions held up the live packets. Exits non-zero if any check fails.
+//
+// Usage:
+// $ ./bench_replay [-r edges_per_second] [-t seconds] [-o dir]
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "csv2archive.h"
+#include "forwarder.h"
+#include "pru_sim.h"
+#include "receiver.h"
+
+#define SIM_NAME "/pb2_chwp_bench_replay"
+#define REPLAY_BYTES (16 << 20)
+#define RETRANSMIT_RATE 4000000 //bytes/s, the simulated PRUs run faster than the real ones
+#define LINGER_S 1.0
+#define CATCH_UP_S 5.0 //longest wait for the receiver to write what the forwarder sent
+#define PROXY_TIMEOUT_US 100000
+
+//How the link between the forwarder and the receiver loses datagrams
+struct scenario {
+    const char* name;
+    double loss; //chance of dropping any datagram, either way
+    double outage_at; //seconds into the run the link goes down for outage_s, 0 for no outage
+    double outage_s;
+};
+
+struct proxy {
+    int fd;
+    struct sockaddr_in receiver; //where data goes
+    struct sockaddr_in forwarder; //where NACKs go, learnt from the first datagram
+    int have_forwarder;
+    struct scenario scenario;
+    unsigned int seed;
+    double t0;
+    volatile int stop;
+    unsigned long int data; //datagrams from the forwarder
+    unsigned long int data_dropped;
+    unsigned long int nacks; //datagrams from the receiver
+    unsigned long int nacks_dropped;
+};
+
+struct bench {
+    struct pru_shm shm;
+    struct pru_sim_config sim;
+    struct pru_sim_stats sim_stats;
+    struct forwarder fwd;
+    struct receiver r;
+    struct proxy proxy;
+    volatile int forwarded; //set once forwarder_run() has returned
+    volatile int stop;
+};
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void* producer(void* arg)
+{
+    struct bench* b = arg;
+    pru_sim_run(&b->shm, &b->sim, &b->sim_stats);
+    return NULL;
+}
+
+static void* forwarder(void* arg)
+{
+    struct bench* b = arg;
+    forwarder_run(&b->fwd);
+    b->forwarded = 1;
+    return NULL;
+}
+
+static void* receiver(void* arg)
+{
+    struct bench* b = arg;
+    receiver_run(&b->r, &b->stop);
+    return NULL;
+}
+
+static int lose(struct proxy* p)
+{
+    return p->scenario.loss > 0 && rand_r(&p->seed) < p->scenario.loss * ((double) RAND_MAX + 1);
+}
+
+//Passes datagrams from the forwarder to the receiver and NACKs from the receiver back, dropping some of both
+static void* proxy(void* arg)
+{
+    struct proxy* p = arg;
+    uint8_t buf[RECEIVER_MAX_DATAGRAM];
+    struct sockaddr_in from;
+
+    while (!p->stop) {
+        socklen_t len = sizeof(from);
+        ssize_t n = recvfrom(p->fd, buf, sizeof(buf), 0, (struct sockaddr *) &from, &len);
+        if (n < 0) {
+            continue;
+        }
+        if (from.sin_port == p->receiver.sin_port) {
+            p->nacks += 1;
+            if (!p->have_forwarder || lose(p)) {
+                p->nacks_dropped += 1;
+                continue;
+            }
+            sendto(p->fd, buf, n, 0, (struct sockaddr *) &p->forwarder, sizeof(p->forwarder));
+            continue;
+        }
+        p->forwarder = from;
+        p->have_forwarder = 1;
+        p->data += 1;
+        double t = now_s() - p->t0;
+        if ((p->scenario.outage_s > 0 && t >= p->scenario.outage_at && t < p->scenario.outage_at + p->scenario.outage_s) ||
+            lose(p)) {
+            p->data_dropped += 1;
+            continue;
+        }
+        sendto(p->fd, buf, n, 0, (struct sockaddr *) &p->receiver, sizeof(p->receiver));
+    }
+    return NULL;
+}
+
+//Reads the CSV files back, counting packets and the edges or seconds out of sequence
+static int read_back(const char* encoder_path, const char* irig_path, unsigned long int* encoder_packets,
+                     unsigned long int* irig_packets, unsigned long int* errors)
+{
+    struct csv_reader reader;
+    static uint64_t clock[ENCODER_COUNTER_SIZE];
+    static uint32_t edge[ENCODER_COUNTER_SIZE];
+    uint64_t sync_clock[10];
+    uint32_t irig_time, next = 1;
+    size_t n;
+    uint8_t quad;
+    int ok;
+
+    if (csv_reader_open(&reader, encoder_path) < 0) {
+        return -1;
+    }
+    while ((ok = csv_next_encoder(&reader, clock, edge, ENCODER_COUNTER_SIZE, &n, &quad)) == 1) {
+        for (size_t x = 0; x < n; x++) {
+            *errors += edge[x] != next;
+            next = edge[x] + 1;
+        }
+        *encoder_packets += 1;
+    }
+    csv_reader_close(&reader);
+    if (ok < 0 || csv_reader_open(&reader, irig_path) < 0) {
+        return -1;
+    }
+    next = 0;
+    while ((ok = csv_next_irig(&reader, &irig_time, clock, sync_clock)) == 1) {
+        *errors += next != 0 && irig_time != next;
+        next = irig_time + 1;
+        *irig_packets += 1;
+    }
+    csv_reader_close(&reader);
+    return ok;
+}
+
+//One run through a lossy link, returns 1 if a check failed
+static int run(const char* dir, double edge_rate, double seconds, const struct scenario* scenario)
+{
+    static struct bench b;
+    char encoder_path[4096], irig_path[4096];
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    struct timeval tv = { .tv_sec = 0, .tv_usec = PROXY_TIMEOUT_US };
+    int rcvbuf = 16 << 20;
+    pthread_t tp, tf, tr, tx;
+
+    memset(&b, 0, sizeof(b));
+    if (snprintf(encoder_path, sizeof(encoder_path), "%s/bench_replay_Encoder.csv", dir) >= (int) sizeof(encoder_path) ||
+        snprintf(irig_path, sizeof(irig_path), "%s/bench_replay_IRIG.csv", dir) >= (int) sizeof(irig_path)) {
+        return 1;
+    }
+    struct receiver_config config = { .ip = "127.0.0.1", .port = 0, .encoder_path = encoder_path, .irig_path = irig_path,
+                                      .runtime_s = -1, .quiet = 1 };
+    if (receiver_open(&b.r, &config) < 0) {
+        perror("receiver_open");
+        return 1;
+    }
+
+    b.proxy.fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(b.proxy.fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(b.proxy.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)); //as much as the receiver asks for
+    if (bind(b.proxy.fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        getsockname(b.proxy.fd, (struct sockaddr *) &addr, &len) < 0) {
+        perror("proxy");
+        receiver_close(&b.r);
+        return 1;
+    }
+    b.proxy.receiver = addr;
+    b.proxy.receiver.sin_port = htons(b.r.port);
+    b.proxy.scenario = *scenario;
+    b.proxy.seed = 12345;
+
+    if (pru_shm_open(&b.shm, SIM_NAME, 1) < 0) {
+        receiver_close(&b.r);
+        return 1;
+    }
+    pru_sim_reset(&b.shm);
+    b.sim.edge_rate = edge_rate;
+    b.sim.duration = 0; //until the forwarder says stop
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    forwarder_init(&b.fwd, &b.shm, FWD_MODE_IRQ, sockfd, "127.0.0.1", ntohs(addr.sin_port));
+    forwarder_set_batching(&b.fwd, UDP_BATCH_MMSG, 0);
+    b.fwd.run_s = seconds;
+    if (forwarder_enable_replay(&b.fwd, REPLAY_BYTES, RETRANSMIT_RATE, LINGER_S) < 0) {
+        perror("forwarder_enable_replay");
+        return 1;
+    }
+
+    double t0 = b.proxy.t0 = now_s();
+    pthread_create(&tr, NULL, receiver, &b);
+    pthread_create(&tx, NULL, proxy, &b.proxy);
+    pthread_create(&tf, NULL, forwarder, &b);
+    pthread_create(&tp, NULL, producer, &b);
+    pthread_join(tp, NULL);
+    pthread_join(tf, NULL);
+    while (now_s() - t0 < seconds + LINGER_S + CATCH_UP_S &&
+           (b.r.stats.encoder_packets < b.fwd.encoder_sent || b.r.stats.irig_packets < b.fwd.irig_sent)) {
+        usleep(10000);
+    }
+    b.stop = 1;
+    pthread_join(tr, NULL);
+    b.proxy.stop = 1;
+    pthread_join(tx, NULL);
+    struct replay_window w = b.r.replay; //counters only, the slots are freed with the receiver
+    unsigned long int kernel_drops = b.r.stats.kernel_drops;
+    receiver_close(&b.r);
+    close(b.proxy.fd);
+    close(sockfd);
+    pru_shm_close(&b.shm, 1);
+
+    unsigned long int encoder_packets = 0, irig_packets = 0, errors = 0;
+    int read_ok = read_back(encoder_path, irig_path, &encoder_packets, &irig_packets, &errors) >= 0;
+    unlink(encoder_path);
+    unlink(irig_path);
+
+    int ok = read_ok && b.sim_stats.overwritten == 0 && errors == 0 && w.lost == 0 && b.fwd.expired == 0 &&
+             b.fwd.encoder_sent == b.sim_stats.encoder_published && b.fwd.irig_sent == b.sim_stats.irig_published &&
+             encoder_packets == b.fwd.encoder_sent && irig_packets == b.fwd.irig_sent &&
+             (b.proxy.data_dropped == 0 || w.recovered > 0) && b.r.stats.layout_mismatches == 0;
+    printf("%-7s %8lu %8lu %8lu %7lu %7lu %7lu %8lu %7lu %9lu %6lu %6lu %9u %9u %7s\n", scenario->name,
+           b.sim_stats.encoder_published, encoder_packets, b.proxy.data, b.proxy.data_dropped, b.proxy.nacks_dropped,
+           kernel_drops,
+           w.nack_packets, w.requested, b.fwd.retransmitted, w.recovered, w.lost + errors, b.fwd.notice_max_us,
+           b.fwd.send_max_us, ok ? "ok" : "FAIL");
+    forwarder_free(&b.fwd);
+    return !ok;
+}
+
+int main(int argc, char **argv)
+{
+    double edge_rate = 2280 * 20, seconds = 6;
+    const char* dir = "/tmp";
+    int opt, usage = 0;
+
+    while ((opt = getopt(argc, argv, "r:t:o:")) != -1) {
+        switch (opt) {
+        case 'r': edge_rate = atof(optarg); break;
+        case 't': seconds = atof(optarg); break;
+        case 'o': dir = optarg; break;
+        default: usage = 1; break;
+        }
+    }
+    if (usage || seconds < 3 || edge_rate <= 0) {
+        printf("Usage: %s [-r edges_per_second] [-t seconds (3 or more)] [-o dir]\n", argv[0]);
+        return 1;
+    }
+
+    //the long outage lasts longer than the receiver's window holds at this rate
+    double window_s = REPLAY_WINDOW_SLOTS / (edge_rate / ENCODER_COUNTER_SIZE + 2);
+    struct scenario scenarios[] = {
+        { "none", 0, 0, 0 },
+        { "1%", 0.01, 0, 0 },
+        { "10%", 0.10, 0, 0 },
+        { "outage", 0, 1, 1 },
+        { "long", 0, 1, window_s * 1.2 },
+    };
+
+    printf("%.0f edges/s for %.1f s, replay ring %d MB, retransmissions up to %.1f MB/s, window %.1f s\n", edge_rate,
+           seconds, REPLAY_BYTES >> 20, RETRANSMIT_RATE / 1e6, window_s);
+    printf("%-7s %8s %8s %8s %7s %7s %7s %8s %7s %9s %6s %6s %9s %9s %7s\n", "link", "enc_pub", "enc_file", "dgrams",
+           "dropped", "nack_dr", "k_drops", "nacks", "asked", "resent", "recov", "lost", "notice_us", "send_us", "result");
+    int failures = 0;
+    for (size_t k = 0; k < sizeof(scenarios) / sizeof(scenarios[0]); k++) {
+        if (scenarios[k].outage_at + scenarios[k].outage_s < seconds) {
+            failures += run(dir, edge_rate, seconds, &scenarios[k]);
+        }
+    }
+    return failures ? 1 : 0;
+}
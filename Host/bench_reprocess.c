@@ -0,0 +1,326 @@
+//Benchmark of encoder_reprocess (reprocess.h) from 1 to N threads
+//Writes a campaign of synthetic runs as CSV: runs of different lengths, one across midnight, one that loses
+//packets, one with IRIG dropouts and one with missed overflows. It is reprocessed with 1, 2, 4, ... up to N
+//threads and the wall time, speedup and rate are reported for each. Every output file must be the same, byte
+//for byte, as with 1 thread, and the angle and time of every edge the same as from one angle_stream fed each
+//whole run in order. The angles are also checked with chunks of an odd number of seconds. Exits non-zero on
+//any difference.
+//
+// Usage:
+// $ ./bench_reprocess [-s seconds] [-k max_threads] [-c chunk_seconds] [-o dir]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "angle_stream.h"
+#include "csv2archive.h"
+#include "reprocess.h"
+
+#define IEP_HZ 200000000ull
+#define EDGES_PER_PACKET 150
+#define EDGES_PER_SECOND 4560 //2 Hz, 1140 slits, both edges
+#define RUNS 6
+
+struct run_spec {
+    const char* name;
+    double length; //of the -s seconds
+    uint32_t start_time; //IRIG seconds since midnight
+    double packet_loss;
+    int irig_gap; //seconds of IRIG missing in the middle
+    int missed_overflows; //edges every so often paired with the old overflow count
+};
+
+static const struct run_spec specs[RUNS] = {
+    { "long", 1.0, 43200, 0, 0, 0 },
+    { "short", 0.25, 50000, 0, 0, 0 },
+    { "midnight", 0.5, 24 * 3600 - 100, 0, 0, 0 },
+    { "lossy", 0.5, 3600, 0.01, 0, 0 },
+    { "irig_gap", 0.5, 7200, 0, 20, 0 },
+    { "overflow", 0.5, 10000, 0, 0, 1 },
+};
+
+static uint64_t rng = 0x9e3779b97f4a7c15ull;
+
+static double uniform(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return ((rng >> 11) + 0.5) / 9007199254740992.0;
+}
+
+//Same rows as encoder_receiver and encoderDAQ_BB.py write, clocks with the overflow count in the upper bits
+static void write_run(const char* dir, const struct run_spec* spec, double seconds)
+{
+    char path[4096 + 64];
+    int n_seconds = (int) (seconds * spec->length);
+    unsigned long int n_edges = (unsigned long int) n_seconds * EDGES_PER_SECOND;
+    uint64_t base = (3ull << 32) - IEP_HZ / 2; //the overflow count goes up half a second in
+    int drop = 0;
+
+    snprintf(path, sizeof(path), "%s/Encoder_Data_%s.csv", dir, spec->name);
+    FILE* enc = fopen(path, "w");
+    snprintf(path, sizeof(path), "%s/IRIG_Data_%s.csv", dir, spec->name);
+    FILE* irig = fopen(path, "w");
+    if (enc == NULL || irig == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fputs("1: Quad readout,2-152: capt_cnt/clk_cnt\r\n\r\n", enc);
+    fputs("1: IRIG_time/clk_cnt,3-13: synch_pulse/clk_cnt\r\n\r\n", irig);
+    for (unsigned long int e = 0; e < n_edges; e++) {
+        if (e % EDGES_PER_PACKET == 0) {
+            drop = uniform() < spec->packet_loss;
+            if (!drop) {
+                fprintf(enc, "%s%lu,0,1\r\n\r\n", e ? "\r\n" : "", (e / EDGES_PER_PACKET) & 1);
+            }
+        }
+        double t = (double) e / EDGES_PER_SECOND;
+        uint64_t clock = base + (uint64_t) ((t + 1e-3 * sin(2 * M_PI * t / 30)) * IEP_HZ) + (uint64_t) (uniform() * 8);
+        if (spec->missed_overflows && e % 10007 == 5000) {
+            clock -= 1ull << 32;
+        }
+        if (!drop) {
+            fprintf(enc, "%lu,%llu\r\n", e + 1000, (unsigned long long) clock);
+        }
+    }
+    fputs("\r\n", enc);
+    for (int s = 0; s < n_seconds; s++) {
+        if (s > n_seconds / 2 && s <= n_seconds / 2 + spec->irig_gap) {
+            continue;
+        }
+        uint64_t clock = base + (uint64_t) s * IEP_HZ + 1000 + (uint64_t) (uniform() * 40);
+        fprintf(irig, "%u,%llu\r\n\r\n", (spec->start_time + s) % (24 * 3600), (unsigned long long) clock);
+        for (int x = 0; x < 10; x++) {
+            fprintf(irig, "%d,%llu\r\n", x, (unsigned long long) (clock + (x + 1) * IEP_HZ / 10 - IEP_HZ / 100));
+        }
+        fputs("\r\n", irig);
+    }
+    fclose(enc);
+    fclose(irig);
+}
+
+static void* read_file(const char* path, size_t* size)
+{
+    FILE* f = fopen(path, "rb");
+    struct stat st;
+    void* data;
+
+    if (f == NULL || fstat(fileno(f), &st) < 0 || (data = malloc(st.st_size + 1)) == NULL ||
+        fread(data, 1, st.st_size, f) != (size_t) st.st_size) {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+    *size = st.st_size;
+    return data;
+}
+
+//The samples of one angle_stream fed the whole run: every encoder packet, then the IRIG packets it has passed
+static struct reprocess_sample* serial_run(const char* dir, const char* name, size_t max_irig, size_t* n_samples)
+{
+    char path[4096 + 64];
+    struct csv_reader enc, irig;
+    struct angle_stream s;
+    uint64_t clock[1024], sync_clock[10];
+    uint32_t edge[1024];
+    uint64_t* irig_clock = malloc(max_irig * sizeof(uint64_t));
+    uint32_t* irig_time = malloc(max_irig * sizeof(uint32_t));
+    size_t n, n_irig = 0, next = 0, cap = 1 << 20;
+    double time[4096], angle[4096];
+    uint8_t quad;
+
+    snprintf(path, sizeof(path), "%s/IRIG_Data_%s.csv", dir, name);
+    csv_reader_open(&irig, path);
+    while (n_irig < max_irig && csv_next_irig(&irig, &irig_time[n_irig], &irig_clock[n_irig], sync_clock) == 1) {
+        n_irig += 1;
+    }
+    csv_reader_close(&irig);
+
+    struct reprocess_sample* out = malloc(cap * sizeof(*out));
+    *n_samples = 0;
+    angle_stream_init(&s, 0, 0);
+    snprintf(path, sizeof(path), "%s/Encoder_Data_%s.csv", dir, name);
+    csv_reader_open(&enc, path);
+    int more = 1;
+    while (more || next < n_irig) {
+        more = more && csv_next_encoder(&enc, clock, edge, 1024, &n, &quad) == 1;
+        if (more) {
+            angle_stream_push_encoder(&s, clock, edge, n);
+        }
+        while (next < n_irig && (!more || (n > 0 && irig_clock[next] <= clock[n - 1]))) {
+            angle_stream_push_irig(&s, irig_time[next], irig_clock[next]);
+            next += 1;
+            size_t got;
+            while ((got = angle_stream_read(&s, time, angle, 4096)) > 0) {
+                if (*n_samples + got > cap) {
+                    cap *= 2;
+                    out = realloc(out, cap * sizeof(*out));
+                }
+                for (size_t k = 0; k < got; k++) {
+                    out[*n_samples + k] = (struct reprocess_sample) { time[k], angle[k] };
+                }
+                *n_samples += got;
+            }
+        }
+    }
+    csv_reader_close(&enc);
+    angle_stream_free(&s);
+    free(irig_clock);
+    free(irig_time);
+    return out;
+}
+
+//1 if the Angle file of a run holds the serial samples
+static int check_serial(const char* out_dir, const char* name, const struct reprocess_sample* serial, size_t n)
+{
+    char path[4096 + 64];
+    size_t size;
+
+    snprintf(path, sizeof(path), "%s/Angle_Data_%s.tab", out_dir, name);
+    char* data = read_file(path, &size);
+    int ok = size == 64 + n * sizeof(*serial) && memcmp(data + 64, serial, n * sizeof(*serial)) == 0;
+    free(data);
+    return ok;
+}
+
+//1 if the three files of a run are the same in both directories
+static int same_files(const char* a, const char* b, const char* name)
+{
+    const char* patterns[3] = { "%s/Angle_Data_%s.tab", "%s/Rotation_Data_%s.csv", "%s/Jitter_PSD_%s.csv" };
+    char path_a[4096 + 64], path_b[4096 + 64];
+    int ok = 1;
+
+    for (int k = 0; k < 3; k++) {
+        size_t size_a, size_b;
+        snprintf(path_a, sizeof(path_a), patterns[k], a, name);
+        snprintf(path_b, sizeof(path_b), patterns[k], b, name);
+        char* data_a = read_file(path_a, &size_a);
+        char* data_b = read_file(path_b, &size_b);
+        ok &= size_a == size_b && memcmp(data_a, data_b, size_a) == 0;
+        free(data_a);
+        free(data_b);
+    }
+    return ok;
+}
+
+static void remove_outputs(const char* dir)
+{
+    const char* patterns[3] = { "%s/Angle_Data_%s.tab", "%s/Rotation_Data_%s.csv", "%s/Jitter_PSD_%s.csv" };
+    char path[4096 + 64];
+
+    for (int r = 0; r < RUNS; r++) {
+        for (int k = 0; k < 3; k++) {
+            snprintf(path, sizeof(path), patterns[k], dir, specs[r].name);
+            unlink(path);
+        }
+    }
+    rmdir(dir);
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 1800;
+    int max_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    long chunk_s = REPROCESS_CHUNK_S;
+    const char* base = "/tmp";
+    char data_dir[4096], out_dir[4096 + 32], first_dir[4096 + 32];
+    struct reprocess_sample* serial[RUNS];
+    size_t n_serial[RUNS];
+    struct reprocess_stats stats;
+    int ok = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:k:c:o:")) != -1) {
+        switch (opt) {
+        case 's': seconds = atof(optarg); break;
+        case 'k': max_threads = atoi(optarg); break;
+        case 'c': chunk_s = atol(optarg); break;
+        case 'o': base = optarg; break;
+        default: seconds = -1; break;
+        }
+    }
+    if (seconds <= 0 || max_threads < 1 || max_threads > REPROCESS_MAX_THREADS || chunk_s < 1) {
+        fprintf(stderr, "Usage: %s [-s seconds] [-k max_threads] [-c chunk_seconds] [-o dir]\n", argv[0]);
+        return 1;
+    }
+
+    snprintf(data_dir, sizeof(data_dir), "%s/bench_reprocess_%d", base, (int) getpid());
+    if (mkdir(data_dir, 0775) < 0) {
+        perror(data_dir);
+        return 1;
+    }
+    long csv_bytes = 0;
+    for (int r = 0; r < RUNS; r++) {
+        char path[4096 + 64];
+        struct stat st;
+        write_run(data_dir, &specs[r], seconds);
+        snprintf(path, sizeof(path), "%s/Encoder_Data_%s.csv", data_dir, specs[r].name);
+        stat(path, &st);
+        csv_bytes += st.st_size;
+        serial[r] = serial_run(data_dir, specs[r].name, (size_t) seconds + 1, &n_serial[r]);
+    }
+    printf("%d runs, longest %.0f s, %.1f MB of encoder CSV, %ld s chunks, %ld CPUs\n", RUNS, seconds, csv_bytes / 1e6,
+           chunk_s, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-8s %8s %8s %8s %10s %8s %8s %8s %10s\n", "threads", "chunks", "stolen", "wall_s", "samples/s", "MB/s",
+           "speedup", "serial", "result");
+
+    char* dirs[1] = { data_dir };
+    double wall_1 = 0;
+    for (int threads = 1;; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+        struct reprocess_config config = { .threads = threads, .chunk_s = chunk_s, .out_dir = out_dir, .quiet = 1 };
+        snprintf(out_dir, sizeof(out_dir), "%s/out_%d", data_dir, threads);
+        mkdir(out_dir, 0775);
+        int run_ok = reprocess_dirs(&config, dirs, 1, &stats) == 0;
+        int same_serial = 1;
+        for (int r = 0; r < RUNS; r++) {
+            same_serial &= check_serial(out_dir, specs[r].name, serial[r], n_serial[r]);
+            if (threads > 1) {
+                run_ok &= same_files(first_dir, out_dir, specs[r].name);
+            }
+        }
+        if (threads == 1) {
+            wall_1 = stats.wall_s;
+            snprintf(first_dir, sizeof(first_dir), "%s", out_dir);
+        } else {
+            remove_outputs(out_dir);
+        }
+        run_ok &= same_serial;
+        ok &= run_ok;
+        printf("%-8d %8lu %8lu %8.2f %10.0f %8.1f %8.2f %8s %10s\n", threads, stats.chunks, stats.steals, stats.wall_s,
+               stats.samples / stats.wall_s, csv_bytes / stats.wall_s / 1e6, wall_1 / stats.wall_s,
+               same_serial ? "same" : "DIFFERS", run_ok ? "ok" : "FAIL");
+        if (threads == max_threads) {
+            break;
+        }
+    }
+
+    //chunk boundaries anywhere must not change the angles
+    struct reprocess_config config = { .threads = max_threads, .chunk_s = 7, .out_dir = out_dir, .quiet = 1 };
+    snprintf(out_dir, sizeof(out_dir), "%s/out_odd", data_dir);
+    mkdir(out_dir, 0775);
+    int odd_ok = reprocess_dirs(&config, dirs, 1, &stats) == 0;
+    for (int r = 0; r < RUNS; r++) {
+        odd_ok &= check_serial(out_dir, specs[r].name, serial[r], n_serial[r]);
+    }
+    printf("7 s chunks: %lu chunks, angles %s\n", stats.chunks, odd_ok ? "same as serial" : "DIFFER");
+    ok &= odd_ok;
+
+    remove_outputs(out_dir);
+    remove_outputs(first_dir);
+    for (int r = 0; r < RUNS; r++) {
+        char path[4096 + 64];
+        snprintf(path, sizeof(path), "%s/Encoder_Data_%s.csv", data_dir, specs[r].name);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/IRIG_Data_%s.csv", data_dir, specs[r].name);
+        unlink(path);
+        free(serial[r]);
+    }
+    rmdir(data_dir);
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,325 @@
+//Continuous acquisition across output chunks, with the simulated PRUs of ../Beaglebone/pru_sim.c
+//The simulated PRUs publish until told to stop, the forwarder sends their packets over loopback and tells them to
+//stop through the control word after the run time, and the receiver rolls its files over every few IRIG seconds.
+//The chunks are then read back in order and every packet is checked off: edge numbers run on without a gap or a
+//repeat from one chunk into the next, IRIG seconds do too, every chunk after the first starts with the IRIG packet
+//that crossed into it, and the totals match what the PRUs published and the forwarder sent. Closed chunks must
+//have given back their preallocated space, and the chunk being written must have had space reserved ahead of it
+//at some point, which it will not on a filesystem without fallocate(). Runs the CSV files and the binary archive in turn, exits non-zero if
+//any check fails.
+//
+// Usage:
+// $ ./bench_rotation [-r edges_per_second] [-t seconds] [-c chunk_seconds] [-f csv|bin|both] [-o dir]
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "csv2archive.h"
+#include "forwarder.h"
+#include "pru_sim.h"
+#include "receiver.h"
+#include "run_archive.h"
+
+#define SIM_NAME "/pb2_chwp_bench_rotation"
+#define CATCH_UP_S 5.0 //longest wait for the receiver to write what the forwarder sent
+
+static const char* archive_columns[] = { "edge_index.col", "edge_clock.col", "edge_quad.col", "irig.tab", "irig_index.tab" };
+
+struct bench {
+    struct pru_shm shm;
+    struct pru_sim_config sim;
+    struct pru_sim_stats sim_stats;
+    struct forwarder fwd;
+    struct receiver r;
+    volatile int forwarded; //set once forwarder_run() has returned
+    volatile int stop;
+};
+
+//What reading the chunks back found
+struct tally {
+    unsigned long int encoder_packets;
+    unsigned long int irig_packets;
+    uint32_t next_edge; //edge number the next entry should have
+    uint32_t next_time; //IRIG second the next packet should have, 0 before the first
+    uint32_t first_time;
+    unsigned long int edge_errors; //gaps or repeats in the edge numbers
+    unsigned long int irig_errors; //gaps or repeats in the IRIG seconds
+    unsigned long int boundary_errors; //chunks that do not start with the IRIG packet of their boundary
+    unsigned long int space_errors; //closed chunk files still holding preallocated blocks
+    unsigned long int bytes;
+    unsigned long int allocated;
+    long ahead; //most bytes the chunk being written had allocated past its end
+};
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void* producer(void* arg)
+{
+    struct bench* b = arg;
+    pru_sim_run(&b->shm, &b->sim, &b->sim_stats);
+    return NULL;
+}
+
+static void* forwarder(void* arg)
+{
+    struct bench* b = arg;
+    forwarder_run(&b->fwd);
+    b->forwarded = 1;
+    return NULL;
+}
+
+static void* receiver(void* arg)
+{
+    struct bench* b = arg;
+    receiver_run(&b->r, &b->stop);
+    return NULL;
+}
+
+static void check_edges(struct tally* t, const uint32_t* edge, size_t n)
+{
+    for (size_t x = 0; x < n; x++) {
+        t->edge_errors += edge[x] != t->next_edge;
+        t->next_edge = edge[x] + 1;
+    }
+    t->encoder_packets += 1;
+}
+
+//first is 1 for the first IRIG packet of a chunk after the first chunk, which has to sit on a chunk boundary
+static void check_irig(struct tally* t, uint32_t irig_time, int first, long chunk_s)
+{
+    if (t->next_time == 0) {
+        t->first_time = irig_time;
+    } else {
+        t->irig_errors += irig_time != t->next_time;
+    }
+    if (first) {
+        t->boundary_errors += (irig_time - t->first_time) % chunk_s != 0;
+    }
+    t->next_time = irig_time + 1;
+    t->irig_packets += 1;
+}
+
+//Watches the chunk being written for space reserved ahead of the data
+static void check_ahead(struct tally* t, const char* path)
+{
+    struct stat st;
+    if (stat(path, &st) == 0 && st.st_blocks * 512 - st.st_size > t->ahead) {
+        t->ahead = st.st_blocks * 512 - st.st_size;
+    }
+}
+
+//A closed file holds no more blocks than its size needs, give or take a filesystem block
+static void check_space(struct tally* t, const char* path)
+{
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        t->space_errors += 1;
+        return;
+    }
+    t->bytes += st.st_size;
+    t->allocated += st.st_blocks * 512;
+    t->space_errors += st.st_blocks * 512 > st.st_size + 2 * st.st_blksize;
+}
+
+static int read_csv_chunk(struct tally* t, const char* encoder_path, const char* irig_path, int first, long chunk_s)
+{
+    struct csv_reader reader;
+    static uint64_t clock[ENCODER_COUNTER_SIZE];
+    static uint32_t edge[ENCODER_COUNTER_SIZE];
+    uint64_t sync_clock[10];
+    uint32_t irig_time;
+    size_t n;
+    uint8_t quad;
+    int ok;
+
+    if (csv_reader_open(&reader, encoder_path) < 0) {
+        return -1;
+    }
+    while ((ok = csv_next_encoder(&reader, clock, edge, ENCODER_COUNTER_SIZE, &n, &quad)) == 1) {
+        check_edges(t, edge, n);
+    }
+    csv_reader_close(&reader);
+    if (ok < 0 || csv_reader_open(&reader, irig_path) < 0) {
+        return -1;
+    }
+    while ((ok = csv_next_irig(&reader, &irig_time, clock, sync_clock)) == 1) {
+        check_irig(t, irig_time, first, chunk_s);
+        first = 0;
+    }
+    csv_reader_close(&reader);
+    check_space(t, encoder_path);
+    check_space(t, irig_path);
+    return ok;
+}
+
+static int read_archive_chunk(struct tally* t, const char* dir, int first, long chunk_s)
+{
+    struct run_archive a;
+    char path[4096];
+
+    if (run_archive_open(&a, dir) < 0) {
+        return -1;
+    }
+    for (size_t x = 0; x < a.n_edges; x += ENCODER_COUNTER_SIZE) {
+        check_edges(t, a.edge_index + x, a.n_edges - x < ENCODER_COUNTER_SIZE ? a.n_edges - x : ENCODER_COUNTER_SIZE);
+    }
+    for (size_t k = 0; k < a.n_irig; k++) {
+        check_irig(t, a.irig[k].irig_time, first && k == 0, chunk_s);
+    }
+    run_archive_close(&a);
+    for (int k = 0; k < 5; k++) {
+        if (snprintf(path, sizeof(path), "%s/%s", dir, archive_columns[k]) >= (int) sizeof(path)) {
+            return -1;
+        }
+        check_space(t, path);
+    }
+    return 0;
+}
+
+//One continuous run into chunks, returns the number of failed checks
+static int run(const char* dir, int binary, double edge_rate, double seconds, long chunk_s)
+{
+    static struct bench b;
+    char encoder_path[4096], irig_path[4096], archive_dir[4096], path[2][4096];
+    struct tally t;
+    pthread_t tp, tf, tr;
+
+    memset(&b, 0, sizeof(b));
+    memset(&t, 0, sizeof(t));
+    t.next_edge = 1;
+    snprintf(encoder_path, sizeof(encoder_path), "%s/bench_rotation_Encoder.csv", dir);
+    snprintf(irig_path, sizeof(irig_path), "%s/bench_rotation_IRIG.csv", dir);
+    snprintf(archive_dir, sizeof(archive_dir), "%s/bench_rotation_Archive", dir);
+    struct receiver_config config = { .ip = "127.0.0.1", .port = 0, .encoder_path = encoder_path, .irig_path = irig_path,
+                                      .archive_dir = binary ? archive_dir : NULL, .runtime_s = -1, .chunk_s = chunk_s,
+                                      .quiet = 1 };
+    if (receiver_open(&b.r, &config) < 0) {
+        perror("receiver_open");
+        return 1;
+    }
+    if (pru_shm_open(&b.shm, SIM_NAME, 1) < 0) {
+        receiver_close(&b.r);
+        return 1;
+    }
+    pru_sim_reset(&b.shm);
+    b.sim.edge_rate = edge_rate;
+    b.sim.duration = 0; //until the forwarder says stop
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    forwarder_init(&b.fwd, &b.shm, FWD_MODE_IRQ, sockfd, "127.0.0.1", b.r.port);
+    forwarder_set_batching(&b.fwd, UDP_BATCH_MMSG, 0);
+    b.fwd.run_s = seconds;
+
+    double t0 = now_s();
+    pthread_create(&tr, NULL, receiver, &b);
+    pthread_create(&tf, NULL, forwarder, &b);
+    pthread_create(&tp, NULL, producer, &b);
+    while (!b.forwarded) {
+        //the chunk index is the writer thread's, a stale one only means a look at the chunk before
+        unsigned int chunk = b.r.chunk;
+        if ((binary ? snprintf(path[0], sizeof(path[0]), "%s_%04u/edge_clock.col", archive_dir, chunk)
+                    : snprintf(path[0], sizeof(path[0]), "%s/bench_rotation_Encoder_%04u.csv", dir, chunk)) < (int) sizeof(path[0])) {
+            check_ahead(&t, path[0]);
+        }
+        usleep(50000);
+    }
+    pthread_join(tp, NULL);
+    pthread_join(tf, NULL);
+    while (now_s() - t0 < seconds + CATCH_UP_S &&
+           (b.r.stats.encoder_packets < b.fwd.encoder_sent || b.r.stats.irig_packets < b.fwd.irig_sent)) {
+        usleep(10000);
+    }
+    b.stop = 1;
+    pthread_join(tr, NULL);
+    unsigned int chunks = b.r.chunk + 1;
+    unsigned long int chunk_errors = b.r.stats.chunk_errors;
+    receiver_close(&b.r);
+    close(sockfd);
+    pru_shm_close(&b.shm, 1);
+
+    int failed_reads = 0;
+    for (unsigned int k = 0; k < chunks; k++) {
+        int ok;
+        if (binary) {
+            ok = snprintf(path[0], sizeof(path[0]), "%s_%04u", archive_dir, k) < (int) sizeof(path[0])
+                 ? read_archive_chunk(&t, path[0], k > 0, chunk_s) : -1;
+            for (int c = 0; c < 5; c++) {
+                if (snprintf(path[1], sizeof(path[1]), "%s/%s", path[0], archive_columns[c]) < (int) sizeof(path[1])) {
+                    unlink(path[1]);
+                }
+            }
+            rmdir(path[0]);
+        } else {
+            ok = snprintf(path[0], sizeof(path[0]), "%s/bench_rotation_Encoder_%04u.csv", dir, k) < (int) sizeof(path[0]) &&
+                 snprintf(path[1], sizeof(path[1]), "%s/bench_rotation_IRIG_%04u.csv", dir, k) < (int) sizeof(path[1])
+                 ? read_csv_chunk(&t, path[0], path[1], k > 0, chunk_s) : -1;
+            unlink(path[0]);
+            unlink(path[1]);
+        }
+        if (ok < 0) {
+            printf("could not read chunk %u: %s\n", k, strerror(errno));
+            failed_reads += 1;
+        }
+    }
+
+    //the forwarder has to have sent everything the PRUs published, and the chunks have to hold all of it
+    int expected_chunks = (int) ((t.next_time - 1 - t.first_time) / chunk_s) + 1;
+    int ok = failed_reads == 0 && chunk_errors == 0 && b.sim_stats.overwritten == 0 &&
+             b.fwd.encoder_sent == b.sim_stats.encoder_published && b.fwd.irig_sent == b.sim_stats.irig_published &&
+             t.encoder_packets == b.fwd.encoder_sent && t.irig_packets == b.fwd.irig_sent &&
+             t.edge_errors == 0 && t.irig_errors == 0 && t.boundary_errors == 0 && t.space_errors == 0 &&
+             (int) chunks == expected_chunks && chunks > 1 && t.ahead > 0;
+    printf("%-4s %7u %9lu %9lu %9lu %7lu %7lu %7lu %7lu %8.3f %9.3f %9.3f %7s\n", binary ? "bin" : "csv", chunks,
+           b.sim_stats.encoder_published, b.fwd.encoder_sent, t.encoder_packets, b.sim_stats.irig_published,
+           t.irig_packets, t.edge_errors + t.irig_errors, t.boundary_errors, t.bytes / 1e6, t.allocated / 1e6,
+           t.ahead / 1e6, ok ? "ok" : "FAIL");
+    return !ok;
+}
+
+int main(int argc, char **argv)
+{
+    double edge_rate = 2280 * 10, seconds = 7;
+    long chunk_s = 2;
+    const char* dir = "/tmp";
+    int formats = 3; //bit 0 CSV, bit 1 archive
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:t:c:f:o:")) != -1) {
+        switch (opt) {
+        case 'r': edge_rate = atof(optarg); break;
+        case 't': seconds = atof(optarg); break;
+        case 'c': chunk_s = atol(optarg); break;
+        case 'f': formats = strcmp(optarg, "csv") == 0 ? 1 : strcmp(optarg, "bin") == 0 ? 2 : strcmp(optarg, "both") == 0 ? 3 : 0; break;
+        case 'o': dir = optarg; break;
+        default: formats = 0; break;
+        }
+    }
+    if (formats == 0 || chunk_s <= 0 || seconds <= 0) {
+        printf("Usage: %s [-r edges_per_second] [-t seconds] [-c chunk_seconds] [-f csv|bin|both] [-o dir]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%.0f edges/s for %.1f s in %ld s chunks, stopped through the PRU control word\n", edge_rate, seconds, chunk_s);
+    printf("%-4s %7s %9s %9s %9s %7s %7s %7s %7s %8s %9s %9s %7s\n", "fmt", "chunks", "enc_pub", "enc_sent", "enc_file",
+           "irig_pub", "irig_fl", "gaps", "bounds", "MB", "alloc_MB", "ahead_MB", "result");
+    int failures = 0;
+    if (formats & 1) {
+        failures += run(dir, 0, edge_rate, seconds, chunk_s);
+    }
+    if (formats & 2) {
+        failures += run(dir, 1, edge_rate, seconds, chunk_s);
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,247 @@
+//Benchmark of the shared memory ring of encoder_receiver -s (shm_ring.h)
+//For 0, 1, 2, 4 and 8 reader processes, publishes synthetic encoder packets and IRIG frames at a paced rate
+//while every reader follows the ring, then once more as fast as the writer can go. Reports the writer's CPU
+//time per record, which should not change with the number of readers, and for each reader the records it got,
+//the records it lost by falling behind and its CPU time per record. Every record read is checked edge by edge,
+//so a copy the writer tore would show up as bad.
+//
+// Usage:
+// $ ./bench_shm_ring [-r records_per_s] [-t seconds] [-k max_readers] [-o path]
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm_ring.h"
+
+#define READER_IDLE_US 100 //a reader that has caught up sleeps this long, as a real consumer would
+
+struct reader_result {
+    unsigned long int records;
+    unsigned long int lost;
+    unsigned long int bad;
+    double cpu_s;
+};
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double cpu_s(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_until(double t)
+{
+    double dt = t - now_s();
+    if (dt > 0) {
+        struct timespec ts = { .tv_sec = (time_t) dt, .tv_nsec = (long) ((dt - (time_t) dt) * 1e9) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+//Record n is an IRIG frame every 16 records and an encoder packet otherwise, with edges that follow from n
+static void fill(struct shm_record* record, uint64_t n)
+{
+    if (n % 16 == 15) {
+        record->type = SHM_RECORD_IRIG;
+        record->irig.rising_edge_clock = n << 20;
+        for (int x = 0; x < ARCHIVE_SYNC_PULSES; x++) {
+            record->irig.sync_clock[x] = (n << 20) + x;
+            record->irig.info[x] = n + x;
+        }
+        record->irig.irig_time = n;
+        return;
+    }
+    record->type = SHM_RECORD_ENCODER;
+    record->encoder.n_edges = ENCODER_COUNTER_SIZE - n % 8;
+    record->encoder.quad = n & 7;
+    for (uint32_t x = 0; x < record->encoder.n_edges; x++) {
+        record->encoder.edge_index[x] = n * ENCODER_COUNTER_SIZE + x;
+        record->encoder.edge_clock[x] = (n << 20) + x;
+    }
+}
+
+static int check(const struct shm_record* record)
+{
+    uint64_t n = record->seq;
+    if (n % 16 == 15) {
+        if (record->type != SHM_RECORD_IRIG || record->irig.rising_edge_clock != n << 20 || record->irig.irig_time != (uint32_t) n) {
+            return 0;
+        }
+        for (int x = 0; x < ARCHIVE_SYNC_PULSES; x++) {
+            if (record->irig.sync_clock[x] != (n << 20) + x || record->irig.info[x] != n + x) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    if (record->type != SHM_RECORD_ENCODER || record->encoder.n_edges != ENCODER_COUNTER_SIZE - n % 8 ||
+        record->encoder.quad != (n & 7)) {
+        return 0;
+    }
+    for (uint32_t x = 0; x < record->encoder.n_edges; x++) {
+        if (record->encoder.edge_index[x] != n * ENCODER_COUNTER_SIZE + x || record->encoder.edge_clock[x] != (n << 20) + x) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//Runs in a reader process: attaches, says so on ready, follows the ring until the writer closes it and sends the
+//result back on done
+static void reader(const char* path, int ready, int done)
+{
+    struct shm_ring_reader r;
+    struct shm_record record;
+    struct reader_result result = { 0 };
+
+    if (shm_ring_attach(&r, path, 1) < 0) {
+        perror("shm_ring_attach");
+        _exit(1);
+    }
+    if (write(ready, "r", 1) != 1) {
+        _exit(1);
+    }
+    double start = cpu_s(CLOCK_PROCESS_CPUTIME_ID);
+    while (!shm_ring_finished(&r)) {
+        if (!shm_ring_read(&r, &record)) {
+            usleep(READER_IDLE_US);
+            continue;
+        }
+        result.bad += !check(&record);
+    }
+    result.cpu_s = cpu_s(CLOCK_PROCESS_CPUTIME_ID) - start;
+    result.records = r.records;
+    result.lost = r.lost;
+    shm_ring_detach(&r);
+    if (write(done, &result, sizeof(result)) != sizeof(result)) {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+//Publishes n records at rate records/s (0 for as fast as it can) with k readers following, returns 1 if every
+//reader checks out
+static int run(const char* path, int k, double rate, uint64_t n)
+{
+    struct shm_ring ring;
+    struct shm_record record;
+    struct reader_result results[64];
+    int ready[2], done[2];
+    pid_t pids[64];
+    char c;
+
+    if (shm_ring_create(&ring, path) < 0) {
+        perror("shm_ring_create");
+        exit(1);
+    }
+    if (pipe(ready) < 0 || pipe(done) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    for (int x = 0; x < k; x++) {
+        if ((pids[x] = fork()) == 0) {
+            reader(path, ready[1], done[1]);
+        }
+    }
+    for (int x = 0; x < k; x++) {
+        if (read(ready[0], &c, 1) != 1) {
+            perror("read");
+            exit(1);
+        }
+    }
+
+    double start = now_s(), start_cpu = cpu_s(CLOCK_THREAD_CPUTIME_ID);
+    for (uint64_t seq = 0; seq < n; seq++) {
+        if (rate > 0 && seq % 64 == 0) {
+            sleep_until(start + seq / rate);
+        }
+        fill(&record, seq);
+        shm_ring_publish(&ring, &record);
+    }
+    double writer_cpu = cpu_s(CLOCK_THREAD_CPUTIME_ID) - start_cpu, wall = now_s() - start;
+    shm_ring_close(&ring);
+
+    int ok = 1;
+    unsigned long int records_min = n, lost = 0, bad = 0;
+    double reader_cpu = 0;
+    for (int x = 0; x < k; x++) {
+        if (read(done[0], &results[x], sizeof(results[x])) != sizeof(results[x])) {
+            perror("read");
+            exit(1);
+        }
+        waitpid(pids[x], NULL, 0);
+        records_min = results[x].records < records_min ? results[x].records : records_min;
+        lost += results[x].lost;
+        bad += results[x].bad;
+        reader_cpu += results[x].cpu_s;
+        ok &= results[x].bad == 0 && results[x].records + results[x].lost == n && (rate == 0 || results[x].lost == 0);
+    }
+    close(ready[0]);
+    close(ready[1]);
+    close(done[0]);
+    close(done[1]);
+    unlink(path);
+
+    char rate_s[32];
+    snprintf(rate_s, sizeof(rate_s), rate > 0 ? "%.0f" : "max", rate);
+    double total = 0;
+    for (int x = 0; x < k; x++) {
+        total += results[x].records;
+    }
+    printf("%-8d %8s %10llu %10.0f %10.1f %12lu %10lu %8lu %12.1f %10s\n", k, rate_s, (unsigned long long) n,
+           n / wall, writer_cpu * 1e9 / n, k > 0 ? records_min : 0, lost, bad,
+           total > 0 ? reader_cpu * 1e9 / total : 0, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    double rate = 20000;
+    double seconds = 2.0;
+    int max_readers = 8;
+    char path[4096];
+    int opt;
+
+    snprintf(path, sizeof(path), "/dev/shm/bench_shm_ring.%d", (int) getpid());
+    while ((opt = getopt(argc, argv, "r:t:k:o:")) != -1) {
+        switch (opt) {
+        case 'r': rate = atof(optarg); break;
+        case 't': seconds = atof(optarg); break;
+        case 'k': max_readers = atoi(optarg); break;
+        case 'o': snprintf(path, sizeof(path), "%s", optarg); break;
+        default:
+            rate = -1;
+            break;
+        }
+    }
+    if (rate <= 0 || seconds <= 0 || max_readers < 0 || max_readers > 64) {
+        fprintf(stderr, "Usage: %s [-r records_per_s] [-t seconds] [-k max_readers] [-o path]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%lu byte records, %d slots, %.0f records/s for %.1f s\n", sizeof(struct shm_record), SHM_RING_SLOTS,
+           rate, seconds);
+    printf("%-8s %8s %10s %10s %10s %12s %10s %8s %12s %10s\n", "readers", "rate", "records", "rec/s",
+           "write_ns", "min_read", "lost", "bad", "read_ns", "result");
+    int ok = 1;
+    for (int k = 0; k <= max_readers; k = k ? k * 2 : 1) {
+        ok &= run(path, k, rate, (uint64_t) (rate * seconds));
+    }
+    //as fast as the writer can go, readers on a busy machine lose records but must never see a torn one
+    ok &= run(path, max_readers, 0, (uint64_t) (rate * seconds) * 4);
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock_model.h"
+
+#define PRIOR 1e8 //starting covariance, large against the weight of one pulse
+
+void clock_model_init(struct clock_model* m, double hz, double window_s, double outlier_sigma)
+{
+    memset(m, 0, sizeof(*m));
+    m->hz = hz > 0 ? hz : CLOCK_MODEL_HZ;
+    m->forget = 1 - 1 / ((window_s > 0 ? window_s : CLOCK_MODEL_WINDOW_S) * CLOCK_MODEL_PULSES);
+    m->outlier_sigma = outlier_sigma > 0 ? outlier_sigma : CLOCK_MODEL_OUTLIER_SIGMA;
+}
+
+//Starts the fit over from one pulse, with the nominal rate and nothing known about either
+static void start(struct clock_model* m, int64_t second, double fraction, uint64_t clock)
+{
+    m->n = 1;
+    m->c_ref = clock;
+    m->t_ref = second;
+    m->offset = fraction;
+    m->rate = 1;
+    m->p00 = PRIOR;
+    m->p01 = 0;
+    m->p11 = PRIOR;
+    m->var = 0;
+    m->rejected_run = 0;
+    m->accepted += 1;
+}
+
+int clock_model_push(struct clock_model* m, int64_t second, double fraction, uint64_t clock)
+{
+    if (m->n == 0) {
+        start(m, second, fraction, clock);
+        return 1;
+    }
+
+    //moves the reference to the new pulse: offset and covariance as seen from there, on its own whole second
+    double d = (double) (int64_t) (clock - m->c_ref) / m->hz;
+    double offset = m->offset + m->rate * d - (double) (second - m->t_ref);
+    double p00 = m->p00 + d * (2 * m->p01 + d * m->p11);
+    double p01 = m->p01 + d * m->p11;
+    double e = fraction - offset; //a priori residual
+    double s = 1 + p00; //its variance in units of the pulse variance
+
+    if (m->n >= CLOCK_MODEL_LOCK_PULSES) {
+        double var = m->var > CLOCK_MODEL_MIN_SIGMA * CLOCK_MODEL_MIN_SIGMA ? m->var : CLOCK_MODEL_MIN_SIGMA * CLOCK_MODEL_MIN_SIGMA;
+        if (e * e > m->outlier_sigma * m->outlier_sigma * var * s) {
+            m->rejected += 1;
+            m->rejected_run += 1;
+            if (m->rejected_run >= CLOCK_MODEL_RELOCK_PULSES) {
+                m->relocks += 1;
+                start(m, second, fraction, clock);
+                return 1;
+            }
+            return 0;
+        }
+    }
+
+    //the first two pulses fit any line exactly, from the third on the residuals measure the noise: averaged
+    //until the model locks, then with the same forgetting as the fit
+    if (m->n >= 2) {
+        double r = e * e / s;
+        if (m->n < CLOCK_MODEL_LOCK_PULSES) {
+            m->var += (r - m->var) / (double) (m->n - 1);
+        } else {
+            m->var = m->forget * m->var + (1 - m->forget) * r;
+        }
+    }
+
+    //RLS update with h = (1, 0), written so that nothing large is subtracted from itself but p11
+    double g = 1 / (m->forget + p00);
+    m->offset = offset + p00 * g * e;
+    m->rate += p01 * g * e;
+    m->p11 = (m->p11 - p01 * p01 * g) / m->forget;
+    m->p01 = p01 * g;
+    m->p00 = p00 * g;
+    m->c_ref = clock;
+    m->t_ref = second;
+    m->n += 1;
+    m->accepted += 1;
+    m->rejected_run = 0;
+    return 1;
+}
+
+int clock_model_push_frame(struct clock_model* m, int64_t second, uint64_t rising_edge_clock, const uint64_t* sync_clock)
+{
+    int used = clock_model_push(m, second, 0, rising_edge_clock);
+    for (int k = 0; k < CLOCK_MODEL_PULSES - 1; k++) {
+        used += clock_model_push(m, second, (10 * k + 9) * 0.01, sync_clock[k]); //IRIG-B bits are 10 ms
+    }
+    m->frames += 1;
+    return used;
+}
+
+int clock_model_locked(const struct clock_model* m)
+{
+    return m->n >= CLOCK_MODEL_LOCK_PULSES;
+}
+
+double clock_model_time(const struct clock_model* m, uint64_t clock, double* err)
+{
+    double d = (double) (int64_t) (clock - m->c_ref) / m->hz;
+    if (err != NULL) {
+        double p = m->p00 + d * (2 * m->p01 + d * m->p11);
+        *err = p > 0 ? sqrt(m->var * p) : 0;
+    }
+    return (double) m->t_ref + (m->offset + m->rate * d);
+}
+
+void clock_model_affine(const struct clock_model* m, uint64_t* c0, double* t0, double* slope)
+{
+    *c0 = m->c_ref;
+    *t0 = (double) m->t_ref + m->offset;
+    *slope = m->rate / m->hz;
+}
+
+double clock_model_sigma(const struct clock_model* m)
+{
+    return sqrt(m->var);
+}
+
+struct clock_model* clock_model_new(double hz, double window_s, double outlier_sigma)
+{
+    struct clock_model* m = malloc(sizeof(*m));
+    if (m != NULL) {
+        clock_model_init(m, hz, window_s, outlier_sigma);
+    }
+    return m;
+}
+
+void clock_model_delete(struct clock_model* m)
+{
+    free(m);
+}
@@ -0,0 +1,82 @@
+//Incremental model of UTC as a function of the 200 MHz IEP clock of the Beaglebone, fit to the IRIG pulses
+//
+//Every IRIG frame gives 11 points of (clock, UTC): the rising edge of its reference bit, on the second the
+//frame carries, and the rising edges of its ten position identifiers 90 ms, 190 ms, ..., 990 ms later (the
+//re_count[] of the packet). A recursive least-squares fit with exponential forgetting follows
+//    time = t_ref + offset + rate * (clock - c_ref) / hz
+//through them. The reference is moved to every new point before it is used, so the fit never extrapolates
+//far in double precision. The latest pulses count the most, older ones fade out over window_s seconds, which
+//tracks the slow drift of the crystal with temperature.
+//
+//A pulse whose residual is beyond outlier_sigma times what the fit expects is not used: a glitch on the IRIG
+//line, a pulse paired with the old overflow count, or a frame whose seconds were decoded wrong. When
+//CLOCK_MODEL_RELOCK_PULSES pulses in a row are rejected the time really has moved (the IRIG source stepped,
+//or the model was wrong to begin with) and the fit starts over from there.
+//
+//Once locked, time and its 1 sigma error at any clock are an affine function of the clock, so encoder edges
+//are timestamped with one multiply-add each. Between pulses, and for a while when IRIG drops out, that is an
+//interpolation or extrapolation of the fit. The error covers the noise of the pulses as seen through the fit,
+//not a change of the crystal rate that nothing has measured yet, which matters for dropouts of minutes.
+
+#ifndef CLOCK_MODEL_H
+#define CLOCK_MODEL_H
+
+#include <stdint.h>
+
+#define CLOCK_MODEL_HZ 200000000.0 //IEP counter frequency
+#define CLOCK_MODEL_WINDOW_S 5.0 //default memory of the fit, long enough to average the pulse noise down and short
+                                //enough to follow the crystal drifting with temperature
+#define CLOCK_MODEL_OUTLIER_SIGMA 6.0 //default rejection threshold
+#define CLOCK_MODEL_MIN_SIGMA 100e-9 //floor of the pulse noise in the outlier test, a few IRIG PRU loop passes
+#define CLOCK_MODEL_PULSES 11 //per frame
+#define CLOCK_MODEL_LOCK_PULSES (2 * CLOCK_MODEL_PULSES) //pulses fit before the model is used
+#define CLOCK_MODEL_RELOCK_PULSES (3 * CLOCK_MODEL_PULSES) //rejected in a row before the fit starts over
+
+struct clock_model {
+    double hz;
+    double forget; //weight left to a pulse after each new one
+    double outlier_sigma;
+
+    unsigned long int n; //pulses in the fit since it last started
+    uint64_t c_ref; //clock of the latest pulse used
+    int64_t t_ref; //whole seconds at c_ref
+    double offset; //seconds past t_ref at c_ref
+    double rate; //UTC seconds per nominal second of the clock
+    double p00, p01, p11; //covariance of (offset, rate) in units of the pulse variance
+    double var; //pulse variance in s^2
+    unsigned long int rejected_run; //pulses rejected since the last one used
+
+    unsigned long int frames;
+    unsigned long int accepted; //pulses used
+    unsigned long int rejected; //pulses rejected as outliers
+    unsigned long int relocks; //times the fit started over
+};
+
+//hz <= 0 picks CLOCK_MODEL_HZ, window_s <= 0 CLOCK_MODEL_WINDOW_S and outlier_sigma <= 0 CLOCK_MODEL_OUTLIER_SIGMA
+void clock_model_init(struct clock_model* m, double hz, double window_s, double outlier_sigma);
+
+//Adds one pulse at fraction seconds past the whole second, returns 1 if it was used and 0 if rejected
+int clock_model_push(struct clock_model* m, int64_t second, double fraction, uint64_t clock);
+
+//Adds the rising edge and the ten position identifier edges of an IRIG frame on second, returns the pulses used
+//Clocks are counter_ovflow << 32 | clock count, unwrapped across the 64-bit range by the caller if need be
+int clock_model_push_frame(struct clock_model* m, int64_t second, uint64_t rising_edge_clock, const uint64_t* sync_clock);
+
+//1 once enough pulses have been fit for the model to be used
+int clock_model_locked(const struct clock_model* m);
+
+//Time at clock in seconds, on the same scale as the seconds pushed in, err (may be NULL) gets its 1 sigma error
+double clock_model_time(const struct clock_model* m, uint64_t clock, double* err);
+
+//time = *t0 + (int64_t) (clock - *c0) * *slope, for timestamping many clocks at once
+void clock_model_affine(const struct clock_model* m, uint64_t* c0, double* t0, double* slope);
+
+//Pulse noise in seconds, as estimated from the residuals
+double clock_model_sigma(const struct clock_model* m);
+
+//Heap allocated model for the Python bindings (angle_stream.py)
+struct clock_model* clock_model_new(double hz, double window_s, double outlier_sigma);
+
+void clock_model_delete(struct clock_model* m);
+
+#endif
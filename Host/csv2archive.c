@@ -0,0 +1,229 @@
+//Converts a run recorded as CSV to the binary archive, -z packs the edges (edge_codec.h)
+//
+// Usage:
+// $ ./csv2archive [-z] Encoder_Data_<run>.csv IRIG_Data_<run>.csv <archive dir>
+
+#include <errno.h>
+#include <string.h>
+
+#include "csv2archive.h"
+
+//Parses a row of unsigned integers
+//Returns the number of fields, 0 for a blank row and -1 if the row holds anything else (the header rows)
+static int parse_row(const char* p, uint64_t* values, int max_fields)
+{
+    int n = 0;
+
+    if (*p == '\r' || *p == '\n' || *p == '\0') {
+        return 0;
+    }
+    while (1) {
+        uint64_t v = 0;
+        if (*p < '0' || *p > '9' || n == max_fields) {
+            return -1;
+        }
+        while (*p >= '0' && *p <= '9') {
+            v = v * 10 + (*p++ - '0');
+        }
+        values[n++] = v;
+        if (*p == ',') {
+            p++;
+        } else if (*p == '\r' || *p == '\n' || *p == '\0') {
+            return n;
+        } else {
+            return -1;
+        }
+    }
+}
+
+//Next non-blank row with numbers in it, the header rows at the top of the file are skipped
+static int next_row(struct csv_reader* r, uint64_t* values, int max_fields)
+{
+    while (1) {
+        if (!r->have_line) {
+            if (fgets(r->line, sizeof(r->line), r->f) == NULL) {
+                return 0;
+            }
+            r->line_no += 1;
+        }
+        r->have_line = 0;
+        int n = parse_row(r->line, values, max_fields);
+        if (n > 0) {
+            return n;
+        }
+        if (n < 0 && r->line_no > 1) {
+            return -1;
+        }
+    }
+}
+
+int csv_reader_open(struct csv_reader* r, const char* path)
+{
+    memset(r, 0, sizeof(*r));
+    if ((r->f = fopen(path, "r")) == NULL) {
+        return -1;
+    }
+    setvbuf(r->f, NULL, _IOFBF, 1 << 20);
+    return 0;
+}
+
+void csv_reader_close(struct csv_reader* r)
+{
+    if (r->f != NULL) {
+        fclose(r->f);
+        r->f = NULL;
+    }
+}
+
+int csv_next_encoder(struct csv_reader* r, uint64_t* clock, uint32_t* edge, size_t max_edges, size_t* n, uint8_t* quad)
+{
+    uint64_t v[3];
+    int fields = next_row(r, v, 3);
+
+    if (fields <= 0) {
+        return fields;
+    }
+    if (fields != 3) {
+        return -1;
+    }
+    *quad = (uint8_t) ((v[0] & 1) | (v[1] & 1) << 1 | (v[2] & 1) << 2);
+    *n = 0;
+    //edges run up to the next quadrature row
+    while ((fields = next_row(r, v, 3)) == 2) {
+        if (*n == max_edges) {
+            return -1;
+        }
+        edge[*n] = (uint32_t) v[0];
+        clock[*n] = v[1];
+        *n += 1;
+    }
+    if (fields == 3) {
+        r->have_line = 1;
+    } else if (fields < 0) {
+        return -1;
+    }
+    return 1;
+}
+
+int csv_seek_encoder(struct csv_reader* r, long offset)
+{
+    uint64_t v[3];
+    int fields;
+
+    if (fseek(r->f, offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    r->have_line = 0;
+    r->line_no = 0;
+    //the line offset falls in is cut, and the header rows are only skipped at the top of the file
+    if (offset > 0) {
+        if (fgets(r->line, sizeof(r->line), r->f) == NULL) {
+            return 0;
+        }
+        r->line_no = 1;
+    }
+    while ((fields = next_row(r, v, 3)) == 2) {
+    }
+    if (fields == 3) {
+        r->have_line = 1;
+        return 1;
+    }
+    return fields;
+}
+
+int csv_next_irig(struct csv_reader* r, uint32_t* irig_time, uint64_t* clock, uint64_t* sync_clock)
+{
+    uint64_t v[2];
+    int fields = next_row(r, v, 2);
+
+    if (fields <= 0) {
+        return fields;
+    }
+    if (fields != 2) {
+        return -1;
+    }
+    *irig_time = (uint32_t) v[0];
+    *clock = v[1];
+    for (int x = 0; x < ARCHIVE_SYNC_PULSES; x++) {
+        if (next_row(r, v, 2) != 2 || v[0] != (uint64_t) x) {
+            return -1;
+        }
+        sync_clock[x] = v[1];
+    }
+    return 1;
+}
+
+int csv_convert_run(const char* encoder_csv, const char* irig_csv, const char* dir, int packed, struct run_archive_writer* w)
+{
+    struct csv_reader enc, irig;
+    uint64_t clock[1024], irig_clock, sync_clock[ARCHIVE_SYNC_PULSES];
+    uint32_t edge[1024], irig_time;
+    size_t n;
+    uint8_t quad;
+    int rc = 0, enc_rc, irig_rc;
+
+    if (csv_reader_open(&enc, encoder_csv) < 0) {
+        fprintf(stderr, "%s: %s\n", encoder_csv, strerror(errno));
+        return -1;
+    }
+    if (csv_reader_open(&irig, irig_csv) < 0) {
+        fprintf(stderr, "%s: %s\n", irig_csv, strerror(errno));
+        csv_reader_close(&enc);
+        return -1;
+    }
+    if (run_archive_create(w, dir, packed) < 0) {
+        fprintf(stderr, "%s: %s\n", dir, strerror(errno));
+        csv_reader_close(&enc);
+        csv_reader_close(&irig);
+        return -1;
+    }
+
+    //An IRIG packet is appended once the encoder packets reach its rising edge, as it would arrive live
+    irig_rc = csv_next_irig(&irig, &irig_time, &irig_clock, sync_clock);
+    while ((enc_rc = csv_next_encoder(&enc, clock, edge, 1024, &n, &quad)) == 1) {
+        while (irig_rc == 1 && n > 0 && irig_clock <= clock[n - 1]) {
+            run_archive_append_irig(w, irig_time, irig_clock, sync_clock, NULL);
+            irig_rc = csv_next_irig(&irig, &irig_time, &irig_clock, sync_clock);
+        }
+        if (run_archive_append_edges(w, clock, edge, n, quad) < 0) {
+            fprintf(stderr, "%s: %s\n", dir, strerror(errno));
+            rc = -1;
+            break;
+        }
+    }
+    while (irig_rc == 1) {
+        run_archive_append_irig(w, irig_time, irig_clock, sync_clock, NULL);
+        irig_rc = csv_next_irig(&irig, &irig_time, &irig_clock, sync_clock);
+    }
+    if (enc_rc < 0) {
+        fprintf(stderr, "%s:%lu: malformed row\n", encoder_csv, enc.line_no);
+        rc = -1;
+    }
+    if (irig_rc < 0) {
+        fprintf(stderr, "%s:%lu: malformed row\n", irig_csv, irig.line_no);
+        rc = -1;
+    }
+
+    csv_reader_close(&enc);
+    csv_reader_close(&irig);
+    return rc;
+}
+
+#ifdef CSV2ARCHIVE_MAIN
+int main(int argc, char **argv)
+{
+    struct run_archive_writer w;
+    int packed = argc == 5 && strcmp(argv[1], "-z") == 0;
+
+    if (argc != 4 + packed) {
+        printf("Usage: %s [-z] Encoder_Data_<run>.csv IRIG_Data_<run>.csv <archive dir>\n", argv[0]);
+        return 1;
+    }
+    argv += packed;
+    int rc = csv_convert_run(argv[1], argv[2], argv[3], packed, &w);
+    printf("Wrote %llu edges and %llu IRIG packets to %s, %llu clocks repaired\n", (unsigned long long) w.n_edges,
+           (unsigned long long) w.n_irig, argv[3], (unsigned long long) w.repaired);
+    run_archive_close_writer(&w);
+    return rc < 0 ? 1 : 0;
+}
+#endif
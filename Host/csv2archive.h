@@ -0,0 +1,40 @@
+//Reads the Encoder_Data and IRIG_Data CSV files written by encoderDAQ_BB.py and encoder_receiver, and
+//converts old runs to the binary archive in run_archive.h
+
+#ifndef CSV2ARCHIVE_H
+#define CSV2ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "run_archive.h"
+
+struct csv_reader {
+    FILE* f;
+    char line[256];
+    int have_line; //line holds a row that has been read but not used yet
+    unsigned long int line_no;
+};
+
+int csv_reader_open(struct csv_reader* r, const char* path);
+
+void csv_reader_close(struct csv_reader* r);
+
+//Reads the next encoder packet: its quadrature row and the [absolute number, clock count] rows after it
+//Returns 1 with the packet in clock/edge/n/quad, 0 at the end of the file and -1 on a malformed row
+int csv_next_encoder(struct csv_reader* r, uint64_t* clock, uint32_t* edge, size_t max_edges, size_t* n, uint8_t* quad);
+
+//Moves to the first encoder packet that starts after byte offset, or at the top of the file for 0, so a file can
+//be read from part way through. Returns 1, 0 if there is no packet after offset and -1 on a malformed row
+int csv_seek_encoder(struct csv_reader* r, long offset);
+
+//Reads the next IRIG packet: its [UTC time in sec, clock count] row and the 10 synch pulse rows after it
+//Returns 1, 0 at the end of the file and -1 on a malformed row
+int csv_next_irig(struct csv_reader* r, uint32_t* irig_time, uint64_t* clock, uint64_t* sync_clock);
+
+//Converts one run, packed or not, IRIG packets are merged in clock order with the encoder packets so the index
+//comes out the same as when the archive is written live. Returns 0 on success, -1 with a message printed otherwise
+int csv_convert_run(const char* encoder_csv, const char* irig_csv, const char* dir, int packed, struct run_archive_writer* w);
+
+#endif
@@ -0,0 +1,297 @@
+#include <string.h>
+
+#include "edge_codec.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define EDGE_HAVE_SSE2 1
+#endif
+
+#define RUNS (EDGE_CODEC_BLOCK / EDGE_CODEC_MINI)
+
+#ifdef EDGE_HAVE_SSE2
+static int use_simd = 1;
+#else
+static int use_simd = 0;
+#endif
+
+int edge_codec_set_simd(int simd)
+{
+#ifdef EDGE_HAVE_SSE2
+    use_simd = simd != 0;
+#else
+    (void) simd;
+#endif
+    return use_simd;
+}
+
+static int bits(uint64_t v)
+{
+    return v ? 64 - __builtin_clzll(v) : 0;
+}
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+//Bytes of a run of width bits per value
+static size_t packed_bytes(int width)
+{
+    return width == EDGE_CODEC_RAW ? EDGE_CODEC_MINI * sizeof(uint64_t) : (size_t) EDGE_CODEC_MINI / 8 * width;
+}
+
+//Frame of reference of a run: its smallest value and the bits above it, EDGE_CODEC_RAW if a value needs 64 bits
+static int run_width(const uint64_t* v, uint32_t* base)
+{
+    uint64_t lo = v[0], hi = v[0];
+    for (int i = 1; i < EDGE_CODEC_MINI; i++) {
+        lo = v[i] < lo ? v[i] : lo;
+        hi = v[i] > hi ? v[i] : hi;
+    }
+    if (hi > UINT32_MAX) {
+        *base = 0;
+        return EDGE_CODEC_RAW;
+    }
+    *base = (uint32_t) lo;
+    return bits(hi - lo);
+}
+
+//Value i goes to lane i % 4 at bit (i / 4) * width of that lane, lane j holding words j, j + 4, j + 8, ...
+static void pack(const uint64_t* v, int width, uint32_t base, uint8_t* out)
+{
+    uint32_t words[4 * 32];
+
+    memset(words, 0, 16 * width);
+    for (int i = 0; i < 32; i++) {
+        int bit = i * width, k = bit >> 5, s = bit & 31;
+        for (int j = 0; j < 4; j++) {
+            uint32_t x = (uint32_t) (v[4 * i + j] - base);
+            words[4 * k + j] |= x << s;
+            if (s + width > 32) {
+                words[4 * (k + 1) + j] |= x >> (32 - s);
+            }
+        }
+    }
+    memcpy(out, words, 16 * width);
+}
+
+static void unpack_scalar(const uint8_t* in, int width, uint32_t base, uint32_t* out)
+{
+    uint32_t words[4 * 32];
+    uint32_t mask = width == 32 ? UINT32_MAX : (1u << width) - 1;
+
+    memcpy(words, in, 16 * width);
+    for (int i = 0; i < 32; i++) {
+        int bit = i * width, k = bit >> 5, s = bit & 31;
+        for (int j = 0; j < 4; j++) {
+            uint32_t x = words[4 * k + j] >> s;
+            if (s + width > 32) {
+                x |= words[4 * (k + 1) + j] << (32 - s);
+            }
+            out[4 * i + j] = (x & mask) + base;
+        }
+    }
+}
+
+#ifdef EDGE_HAVE_SSE2
+//The 4 lanes shift alike, so a row of 4 values is one or two loads, two shifts, a mask and an add. Inlined for
+//every width, the shifts and branches are constants.
+static inline __attribute__((always_inline)) void unpack_sse2_width(const uint8_t* in, const int width, uint32_t base,
+                                                                    uint32_t* out)
+{
+    const __m128i* words = (const __m128i *) in;
+    const __m128i mask = _mm_set1_epi32(width == 32 ? -1 : (int) ((1u << width) - 1));
+    const __m128i vbase = _mm_set1_epi32((int) base);
+
+#pragma GCC unroll 32
+    for (int i = 0; i < 32; i++) {
+        int bit = i * width, k = bit >> 5, s = bit & 31;
+        __m128i x = _mm_srl_epi32(_mm_loadu_si128(words + k), _mm_cvtsi32_si128(s));
+        if (s + width > 32) {
+            x = _mm_or_si128(x, _mm_sll_epi32(_mm_loadu_si128(words + k + 1), _mm_cvtsi32_si128(32 - s)));
+        }
+        _mm_storeu_si128((__m128i *) (out + 4 * i), _mm_add_epi32(_mm_and_si128(x, mask), vbase));
+    }
+}
+
+#define UNPACK_WIDTH(w) case w: unpack_sse2_width(in, w, base, out); break;
+
+static void unpack_sse2(const uint8_t* in, int width, uint32_t base, uint32_t* out)
+{
+    switch (width) {
+    UNPACK_WIDTH(1) UNPACK_WIDTH(2) UNPACK_WIDTH(3) UNPACK_WIDTH(4) UNPACK_WIDTH(5) UNPACK_WIDTH(6) UNPACK_WIDTH(7)
+    UNPACK_WIDTH(8) UNPACK_WIDTH(9) UNPACK_WIDTH(10) UNPACK_WIDTH(11) UNPACK_WIDTH(12) UNPACK_WIDTH(13)
+    UNPACK_WIDTH(14) UNPACK_WIDTH(15) UNPACK_WIDTH(16) UNPACK_WIDTH(17) UNPACK_WIDTH(18) UNPACK_WIDTH(19)
+    UNPACK_WIDTH(20) UNPACK_WIDTH(21) UNPACK_WIDTH(22) UNPACK_WIDTH(23) UNPACK_WIDTH(24) UNPACK_WIDTH(25)
+    UNPACK_WIDTH(26) UNPACK_WIDTH(27) UNPACK_WIDTH(28) UNPACK_WIDTH(29) UNPACK_WIDTH(30) UNPACK_WIDTH(31)
+    UNPACK_WIDTH(32)
+    }
+}
+#endif
+
+static void unpack(const uint8_t* in, int width, uint32_t base, uint32_t* out)
+{
+    if (width == 0) {
+        for (int i = 0; i < EDGE_CODEC_MINI; i++) {
+            out[i] = base;
+        }
+        return;
+    }
+#ifdef EDGE_HAVE_SSE2
+    if (use_simd) {
+        unpack_sse2(in, width, base, out);
+        return;
+    }
+#endif
+    unpack_scalar(in, width, base, out);
+}
+
+//The first three values of a block are in its header and the runs are padded out to EDGE_CODEC_MINI. Both are
+//filled with a neighbour, so they never widen a run.
+static void fill_unused(uint64_t* v, size_t n)
+{
+    size_t padded = (n + EDGE_CODEC_MINI - 1) / EDGE_CODEC_MINI * EDGE_CODEC_MINI;
+    for (size_t i = 0; i < 3 && i < n; i++) {
+        v[i] = n > 3 ? v[3] : 0;
+    }
+    for (size_t i = n; i < padded; i++) {
+        v[i] = v[n - 1];
+    }
+}
+
+size_t edge_codec_encode(const uint64_t* clock, const uint32_t* edge_index, const uint8_t* quad, size_t n, uint8_t* out)
+{
+    uint64_t clock_res[2][EDGE_CODEC_BLOCK], index_res[EDGE_CODEC_BLOCK], quads[EDGE_CODEC_BLOCK];
+    uint32_t base[2][RUNS];
+    int width[2][RUNS];
+    size_t size[2] = { 0, 0 };
+    size_t runs = (n + EDGE_CODEC_MINI - 1) / EDGE_CODEC_MINI;
+    struct edge_block_header h;
+
+    for (size_t i = 0; i < n; i++) {
+        quads[i] = quad[i];
+    }
+    for (size_t i = 3; i < n; i++) {
+        for (int lag = 1; lag <= 2; lag++) {
+            clock_res[lag - 1][i] = zigzag((int64_t) (clock[i] - clock[i - 1] - (clock[i - lag] - clock[i - lag - 1])));
+        }
+        index_res[i] = zigzag((int32_t) (edge_index[i] - 2 * edge_index[i - 1] + edge_index[i - 2]));
+    }
+    fill_unused(clock_res[0], n);
+    fill_unused(clock_res[1], n);
+    fill_unused(index_res, n);
+    for (size_t i = n; i < runs * EDGE_CODEC_MINI; i++) {
+        quads[i] = quads[n - 1];
+    }
+    for (int l = 0; l < 2; l++) {
+        for (size_t m = 0; m < runs; m++) {
+            width[l][m] = run_width(clock_res[l] + m * EDGE_CODEC_MINI, &base[l][m]);
+            size[l] += packed_bytes(width[l][m]);
+        }
+    }
+    int l = size[1] < size[0];
+
+    memset(&h, 0, sizeof(h));
+    h.n_edges = n;
+    h.lag = l + 1;
+    for (size_t i = 0; i < 3 && i < n; i++) {
+        h.clock[i] = clock[i];
+        h.edge_index[i] = edge_index[i];
+    }
+    uint8_t* p = out + sizeof(h);
+    for (size_t m = 0; m < runs; m++) {
+        struct edge_mini_header mh = { .width = { width[l][m] }, .base = { base[l][m] } };
+        const uint64_t* c = clock_res[l] + m * EDGE_CODEC_MINI;
+        uint8_t* data = p + sizeof(mh);
+
+        if (mh.width[0] == EDGE_CODEC_RAW) {
+            memcpy(data, c, EDGE_CODEC_MINI * sizeof(uint64_t));
+        } else {
+            pack(c, mh.width[0], mh.base[0], data);
+        }
+        data += packed_bytes(mh.width[0]);
+        mh.width[1] = run_width(index_res + m * EDGE_CODEC_MINI, &mh.base[1]);
+        pack(index_res + m * EDGE_CODEC_MINI, mh.width[1], mh.base[1], data);
+        data += packed_bytes(mh.width[1]);
+        mh.width[2] = run_width(quads + m * EDGE_CODEC_MINI, &mh.base[2]);
+        pack(quads + m * EDGE_CODEC_MINI, mh.width[2], mh.base[2], data);
+        data += packed_bytes(mh.width[2]);
+        memcpy(p, &mh, sizeof(mh));
+        p = data;
+    }
+    h.bytes = p - out;
+    memcpy(out, &h, sizeof(h));
+    return h.bytes;
+}
+
+int edge_codec_decode(const uint8_t* block, size_t size, uint64_t* clock, uint32_t* edge_index, uint8_t* quad)
+{
+    struct edge_block_header h;
+    uint64_t clock_res[EDGE_CODEC_BLOCK];
+    uint32_t index_res[EDGE_CODEC_BLOCK], run[EDGE_CODEC_MINI];
+
+    if (size < sizeof(h)) {
+        return -1;
+    }
+    memcpy(&h, block, sizeof(h));
+    if (h.bytes > size || h.n_edges == 0 || h.n_edges > EDGE_CODEC_BLOCK || (h.lag != 1 && h.lag != 2)) {
+        return -1;
+    }
+    size_t n = h.n_edges;
+    size_t runs = (n + EDGE_CODEC_MINI - 1) / EDGE_CODEC_MINI;
+    const uint8_t* p = block + sizeof(h);
+    const uint8_t* end = block + h.bytes;
+
+    for (size_t m = 0; m < runs; m++) {
+        struct edge_mini_header mh;
+        size_t first = m * EDGE_CODEC_MINI, count = n - first < EDGE_CODEC_MINI ? n - first : EDGE_CODEC_MINI;
+
+        if (end - p < (ptrdiff_t) sizeof(mh)) {
+            return -1;
+        }
+        memcpy(&mh, p, sizeof(mh));
+        p += sizeof(mh);
+        if ((mh.width[0] > 32 && mh.width[0] != EDGE_CODEC_RAW) || mh.width[1] > 32 || mh.width[2] > 8 ||
+            end - p < (ptrdiff_t) (packed_bytes(mh.width[0]) + packed_bytes(mh.width[1]) + packed_bytes(mh.width[2]))) {
+            return -1;
+        }
+        if (mh.width[0] == EDGE_CODEC_RAW) {
+            memcpy(clock_res + first, p, EDGE_CODEC_MINI * sizeof(uint64_t));
+        } else {
+            unpack(p, mh.width[0], mh.base[0], run);
+            for (size_t i = 0; i < count; i++) {
+                clock_res[first + i] = run[i];
+            }
+        }
+        p += packed_bytes(mh.width[0]);
+        unpack(p, mh.width[1], mh.base[1], index_res + first);
+        p += packed_bytes(mh.width[1]);
+        unpack(p, mh.width[2], mh.base[2], run);
+        for (size_t i = 0; i < count; i++) {
+            quad[first + i] = run[i];
+        }
+        p += packed_bytes(mh.width[2]);
+    }
+    if (p != end) {
+        return -1;
+    }
+
+    //the residuals go back through the predictors, one edge after the other
+    size_t head = n < 3 ? n : 3;
+    for (size_t i = 0; i < head; i++) {
+        clock[i] = h.clock[i];
+        edge_index[i] = h.edge_index[i];
+    }
+    int lag = h.lag;
+    for (size_t i = 3; i < n; i++) {
+        clock[i] = clock[i - 1] + (clock[i - lag] - clock[i - lag - 1]) + (uint64_t) unzigzag(clock_res[i]);
+        edge_index[i] = 2 * edge_index[i - 1] - edge_index[i - 2] + (uint32_t) unzigzag(index_res[i]);
+    }
+    return (int) n;
+}
@@ -0,0 +1,59 @@
+//Lossless block codec for the edges of a run archive (run_archive.h): clock, edge index and quadrature byte
+//
+//Edges are coded in blocks of up to EDGE_CODEC_BLOCK that decode on their own, so a reader can start at any
+//block. A block starts with a struct edge_block_header holding its first three edges as they are. After those
+//  - the clock is predicted as clock[i-1] + (clock[i-lag] - clock[i-lag-1]), the spacing lag edges back. With
+//    both edges of every slit counted the spacing alternates with the duty cycle of the slits, so lag 2 usually
+//    wins; the encoder works out the size of the block for lag 1 and 2 and keeps the smaller.
+//  - the edge index as 2 * index[i-1] - index[i-2], exact for consecutive edges and for quadrature positions
+//    turning at a steady rate
+//  - the quadrature byte as it is
+//The residuals are zigzag coded and cut into runs of EDGE_CODEC_MINI that are bit packed, frame of reference,
+//with a width of their own behind a struct edge_mini_header. A run is packed in 4 interleaved lanes of 32-bit
+//words, value i in lane i % 4, so 4 values unpack at once with the same shifts; the SSE2 path does just that.
+//Clock residuals of 32 bits or more (a gap in the data, a missed overflow) send their run as raw 64-bit values.
+//Every part of a block is a multiple of 16 bytes, so a block at a 16 byte boundary has its words aligned too.
+//
+//Steady rotation costs about 2.3 bytes per edge against the 13 of the plain archive columns, nearly all of it
+//the clock spread by jitter and slit to slit differences; quadrature transitions about 1.5.
+
+#ifndef EDGE_CODEC_H
+#define EDGE_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EDGE_CODEC_BLOCK 1024 //edges per block, every block but the last of a run is full
+#define EDGE_CODEC_MINI 128 //values per packed run
+#define EDGE_CODEC_RAW 64 //width of a clock run sent as raw 64-bit residuals
+//Largest block: header, then per run its header, raw clocks, 32-bit indices and 8-bit quad bytes
+#define EDGE_CODEC_MAX_BYTES (sizeof(struct edge_block_header) + \
+                              EDGE_CODEC_BLOCK / EDGE_CODEC_MINI * (sizeof(struct edge_mini_header) + EDGE_CODEC_MINI * (8 + 4 + 1)))
+
+struct edge_block_header {
+    uint32_t bytes; //size of the block, this header included
+    uint16_t n_edges;
+    uint8_t lag; //1 or 2, spacing the clock predictor looks back to
+    uint8_t reserved;
+    uint64_t clock[3]; //the first three edges, their quad bytes are packed with the rest
+    uint32_t edge_index[3];
+    uint32_t reserved2;
+};
+
+struct edge_mini_header {
+    uint8_t width[3]; //bits per clock, index and quad value, EDGE_CODEC_RAW for a raw clock run
+    uint8_t reserved;
+    uint32_t base[3]; //subtracted from every value of the run before it is packed
+};
+
+//Codes n edges (1 to EDGE_CODEC_BLOCK) into out, which holds EDGE_CODEC_MAX_BYTES, returns the block size
+size_t edge_codec_encode(const uint64_t* clock, const uint32_t* edge_index, const uint8_t* quad, size_t n, uint8_t* out);
+
+//Decodes a block of at most size bytes into arrays of EDGE_CODEC_BLOCK, returns the number of edges or -1 if
+//the block is damaged or cut short
+int edge_codec_decode(const uint8_t* block, size_t size, uint64_t* clock, uint32_t* edge_index, uint8_t* quad);
+
+//Turns the SSE2 unpacking on or off, for benchmarks. Returns 1 if it is on, it is on by default where there is one.
+int edge_codec_set_simd(int simd);
+
+#endif
@@ -0,0 +1,103 @@
+//Sends a synthetic Beaglebone packet stream (loadgen.h) over UDP, one packet per datagram as the forwarder does
+//By default the packets are paced in real time, -x runs the clock faster and -x 0 sends as fast as possible.
+//
+// Usage:
+// $ ./encoder_loadgen [-i ip] [-p port] [-f hwp_hz] [-n edges_per_rev] [-I irig_hz] [-t seconds] [-l loss]
+//                     [-R reorder] [-D reorder_depth] [-x speedup] [-s seed]
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "loadgen.h"
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_until(double t)
+{
+    double dt = t - now_s();
+    if (dt > 0) {
+        struct timespec ts = { .tv_sec = (time_t) dt, .tv_nsec = (long) ((dt - (time_t) dt) * 1e9) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct loadgen_config config = { .hwp_hz = 2, .edges_per_rev = 570 * 2, .irig_hz = 1, .duration_s = 10,
+                                     .reorder_depth = 1, .iep_start = 0xF0000000, .irig_start = 12 * 3600 };
+    const char* ip = "192.168.2.54";
+    int port = 8080;
+    double speedup = 1;
+    static struct loadgen g;
+    static struct loadgen_packet p;
+    unsigned long int sent = 0, errors = 0;
+    size_t bytes = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:p:f:n:I:t:l:R:D:x:s:")) != -1) {
+        switch (opt) {
+        case 'i': ip = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'f': config.hwp_hz = atof(optarg); break;
+        case 'n': config.edges_per_rev = atoi(optarg); break;
+        case 'I': config.irig_hz = atof(optarg); break;
+        case 't': config.duration_s = atof(optarg); break;
+        case 'l': config.loss = atof(optarg); break;
+        case 'R': config.reorder = atof(optarg); break;
+        case 'D': config.reorder_depth = atoi(optarg); break;
+        case 'x': speedup = atof(optarg); break;
+        case 's': config.seed = strtoull(optarg, NULL, 0); break;
+        default:
+            config.duration_s = -1;
+            break;
+        }
+    }
+    if (optind != argc || speedup < 0 || loadgen_init(&g, &config) < 0) {
+        fprintf(stderr, "Usage: %s [-i ip] [-p port] [-f hwp_hz] [-n edges_per_rev] [-I irig_hz] [-t seconds] [-l loss] "
+                "[-R reorder] [-D reorder_depth] [-x speedup] [-s seed]\n", argv[0]);
+        return 1;
+    }
+
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1) {
+        fprintf(stderr, "Bad address %s\n", ip);
+        return 1;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int sndbuf = 4 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    printf("%.3g Hz, %d edges/rev, %.3g IRIG frames/s, %.0f s of signal to %s:%d at %s\n", config.hwp_hz,
+           config.edges_per_rev, config.irig_hz, config.duration_s, ip, port, speedup > 0 ? "a paced rate" : "full speed");
+    double t0 = now_s();
+    while (loadgen_next(&g, &p)) {
+        if (speedup > 0) {
+            sleep_until(t0 + p.t / speedup);
+        }
+        //nothing listening on loopback comes back as ECONNREFUSED on the next send, the stream carries on
+        if (sendto(fd, &p.data, p.size, 0, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+            if (errno != ECONNREFUSED) {
+                errors += 1;
+            }
+            continue;
+        }
+        sent += 1;
+        bytes += p.size;
+    }
+    double elapsed = now_s() - t0;
+    printf("sent %lu packets (%.0f/s, %.1f MB/s) in %.2f s, %lu dropped and %lu held back on purpose, %lu send errors\n",
+           sent, sent / elapsed, bytes / elapsed / 1e6, elapsed, g.dropped, g.reordered, errors);
+    close(fd);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+//Records the encoder and IRIG packets from the Beaglebone, drop in replacement for encoderDAQ_BB.py
+//Takes the same arguments and writes the same Encoder_Data_<run>.csv and IRIG_Data_<run>.csv files under
+//<data dir>/<run>/rawData/, but receives with recvmmsg() and writes from a separate thread so it keeps up at
+//full HWP speed. With -f bin the run is written as a binary archive (run_archive.h) in
+//<data dir>/<run>/rawData/Encoder_Archive_<run>/ instead of the CSV files, -f packed writes the same archive with
+//the edges packed to about a sixth of the size (edge_codec.h). With -j the rotation frequency and the
+//angle jitter PSD are worked out as the data comes in and <data dir>/<run>/rawData/Jitter_PSD_<run>.csv is
+//rewritten every given number of seconds. The Beaglebone's telemetry goes to Stats_<run>.csv and the state of
+//the IRIG clock model, a row per IRIG frame, to Clock_<run>.csv.
+//
+//A number of seconds of 0 or less records until SIGINT or SIGTERM, for a Beaglebone_Encoder_DAQ that runs
+//continuously. With -c the Encoder and IRIG files (or the archive) are rolled over every given number of IRIG
+//seconds into Encoder_Data_<run>_0000.csv, Encoder_Data_<run>_0001.csv, ..., see receiver.h.
+//
+//Packets from a Beaglebone_Encoder_DAQ run with -r are numbered, missing ones are asked for again and the files
+//are written in the order the packets were sent, see receiver.h.
+//
+//With -s the decoded encoder and IRIG packets are also published into a ring at the given path, normally
+//under /dev/shm. The archiver, live monitors and the HWP controller can all follow it at once, through
+//shm_ring.h or shm_ring.py, without binding the UDP port.
+//
+// Usage:
+// $ ./encoder_receiver [-d data_dir] [-i ip] [-p port] [-f csv|bin|packed] [-j seconds] [-c chunk_seconds] [-s shm_path] [-q] [Run Name] [Number of seconds to collect data]
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "receiver.h"
+
+static volatile int stop = 0;
+
+static void on_signal(int sig)
+{
+    (void) sig;
+    stop = 1;
+}
+
+static int make_dir(const char* path)
+{
+    if (mkdir(path, 0775) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct receiver_config config = { .ip = "192.168.2.54", .port = 8080, .runtime_s = -1, .quiet = 0 };
+    const char* master_dir = "/home/polarbear/data/";
+    static struct receiver r;
+    struct stat st;
+    char input_dir[4096], save_dir[4096], encoder_path[4096], irig_path[4096], archive_dir[4096], jitter_path[4096],
+         stats_path[4096], clock_path[4096];
+    int binary = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:i:p:f:j:c:s:q")) != -1) {
+        switch (opt) {
+        case 'd': master_dir = optarg; break;
+        case 'i': config.ip = optarg; break;
+        case 'p': config.port = atoi(optarg); break;
+        case 'q': config.quiet = 1; break;
+        case 'j': config.jitter_period_s = atof(optarg); break;
+        case 'c': config.chunk_s = atol(optarg); break;
+        case 's': config.shm_path = optarg; break;
+        case 'f':
+            if (strcmp(optarg, "bin") == 0 || strcmp(optarg, "packed") == 0) {
+                binary = 1;
+                config.archive_packed = optarg[0] == 'p';
+                break;
+            } else if (strcmp(optarg, "csv") == 0) {
+                binary = 0;
+                break;
+            }
+            //fall through
+        default:
+            fprintf(stderr, "Usage: %s [-d data_dir] [-i ip] [-p port] [-f csv|bin|packed] [-j seconds] [-c chunk_seconds] [-s shm_path] [-q] [Run Name] [Number of seconds to collect data]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "Usage: %s [-d data_dir] [-i ip] [-p port] [-f csv|bin|packed] [-j seconds] [-c chunk_seconds] [-s shm_path] [-q] [Run Name] [Number of seconds to collect data]\n", argv[0]);
+        return 1;
+    }
+    const char* run_name = argv[optind];
+    config.runtime_s = atol(argv[optind + 1]);
+    if (config.runtime_s <= 0) {
+        config.runtime_s = -1;
+    }
+
+    //Same directory layout as encoderDAQ_BB.py
+    printf("All encoder data collected on the CHWP NUC PC is stored in %s\n", master_dir);
+    if (stat(master_dir, &st) < 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Master path %s does not exist\n", master_dir);
+        return 1;
+    }
+    snprintf(input_dir, sizeof(input_dir), "%s/%s/", master_dir, run_name);
+    if (stat(input_dir, &st) == 0) {
+        printf("CAUTION: Run name %s already exists at location %s, overwriting existing data\n", run_name, master_dir);
+    } else if (make_dir(input_dir) < 0) {
+        return 1;
+    }
+    if (snprintf(save_dir, sizeof(save_dir), "%s/rawData/", input_dir) >= (int) sizeof(save_dir)) {
+        fprintf(stderr, "Run name %s is too long\n", run_name);
+        return 1;
+    }
+    if (stat(save_dir, &st) < 0) {
+        printf("Creating directory %s...\n", save_dir);
+        if (make_dir(save_dir) < 0) {
+            return 1;
+        }
+    }
+    if (snprintf(encoder_path, sizeof(encoder_path), "%s/Encoder_Data_%s.csv", save_dir, run_name) >= (int) sizeof(encoder_path) ||
+        snprintf(irig_path, sizeof(irig_path), "%s/IRIG_Data_%s.csv", save_dir, run_name) >= (int) sizeof(irig_path) ||
+        snprintf(archive_dir, sizeof(archive_dir), "%s/Encoder_Archive_%s", save_dir, run_name) >= (int) sizeof(archive_dir) ||
+        snprintf(jitter_path, sizeof(jitter_path), "%s/Jitter_PSD_%s.csv", save_dir, run_name) >= (int) sizeof(jitter_path) ||
+        snprintf(stats_path, sizeof(stats_path), "%s/Stats_%s.csv", save_dir, run_name) >= (int) sizeof(stats_path) ||
+        snprintf(clock_path, sizeof(clock_path), "%s/Clock_%s.csv", save_dir, run_name) >= (int) sizeof(clock_path)) {
+        fprintf(stderr, "Run name %s is too long\n", run_name);
+        return 1;
+    }
+    config.encoder_path = encoder_path;
+    config.irig_path = irig_path;
+    config.archive_dir = binary ? archive_dir : NULL;
+    config.jitter_path = jitter_path;
+    config.stats_path = stats_path;
+    config.clock_path = clock_path;
+
+    if (receiver_open(&r, &config) < 0) {
+        fprintf(stderr, "Could not start receiving on %s:%d: %s\n", config.ip, config.port, strerror(errno));
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    printf("Starting\n");
+    int failed = receiver_run(&r, &stop) < 0;
+    printf("Done\n");
+    printf("Encoder packets: %lu, IRIG packets: %lu, error packets: %lu, stats packets: %lu, datagrams: %lu\n",
+           r.stats.encoder_packets, r.stats.irig_packets, r.stats.error_packets, r.stats.stats_packets, r.stats.datagrams);
+    printf("Dropped by the kernel: %lu, bad datagrams: %lu, truncated: %lu, writer stalls: %lu, bad IRIG frames: %lu\n",
+           r.stats.kernel_drops, r.stats.bad, r.stats.truncated, r.stats.stalls, r.stats.irig_bad_frames);
+    if (r.stats.layout_packets > 0) {
+        printf("Layout packets: %lu, encoder packets that did not match the layout: %lu\n", r.stats.layout_packets,
+               r.stats.layout_mismatches);
+    }
+    if (r.layout.layout.n_channels > 1) {
+        printf("Packets of the other encoder channels: %lu written, %lu skipped\n", r.stats.channel_packets,
+               r.stats.channel_skipped);
+    }
+    if (config.chunk_s > 0) {
+        printf("Chunks: %u, chunks that could not be created: %lu\n", r.chunk + 1, r.stats.chunk_errors);
+    }
+    if (r.ring_open) {
+        printf("Records published to %s: %llu\n", config.shm_path, (unsigned long long) r.ring.header->head);
+    }
+    if (r.replay.packets > 0) {
+        printf("Replay packets: %lu, recovered: %lu, duplicates: %lu, lost: %lu, NACKs sent: %lu for %lu packets\n",
+               r.replay.packets, r.replay.recovered, r.replay.duplicates, r.replay.lost, r.replay.nack_packets,
+               r.replay.requested);
+    }
+    receiver_close(&r);
+    return failed;
+}
@@ -0,0 +1,45 @@
+//Reprocesses recorded runs on every core: the angle and time of every edge, the rotation frequency and time
+//jitter of every IRIG second and the angle jitter PSD of each run, from the Encoder_Data_<run>.csv and
+//IRIG_Data_<run>.csv files in the given directories. Every run is cut into chunks of whole IRIG seconds that
+//are shared out over the threads, and what is written is the same, bit for bit, whatever the number of threads.
+//Writes Angle_Data_<run>.tab, Rotation_Data_<run>.csv and Jitter_PSD_<run>.csv next to the CSV files, or in
+//the directory given with -o, see reprocess.h.
+//
+// Usage:
+// $ ./encoder_reprocess [-j threads] [-c chunk_seconds] [-w jitter_window] [-o out_dir] [-q] run_dir ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "reprocess.h"
+
+int main(int argc, char **argv)
+{
+    struct reprocess_config config = { 0 };
+    struct reprocess_stats stats;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:c:w:o:q")) != -1) {
+        switch (opt) {
+        case 'j': config.threads = atoi(optarg); break;
+        case 'c': config.chunk_s = atol(optarg); break;
+        case 'w': config.jitter_window = (size_t) atol(optarg); break;
+        case 'o': config.out_dir = optarg; break;
+        case 'q': config.quiet = 1; break;
+        default:
+            optind = argc + 1;
+            break;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: %s [-j threads] [-c chunk_seconds] [-w jitter_window] [-o out_dir] [-q] run_dir ...\n", argv[0]);
+        return 1;
+    }
+
+    int rc = reprocess_dirs(&config, argv + optind, argc - optind, &stats);
+    printf("Runs: %lu, failed: %lu, chunks: %lu, stolen: %lu, edges read: %lu, samples: %lu, IRIG seconds: %lu\n",
+           stats.runs, stats.failed, stats.chunks, stats.steals, stats.edges, stats.samples, stats.seconds);
+    printf("Done in %.2f s, %.2f million samples/s\n", stats.wall_s, stats.samples / stats.wall_s / 1e6);
+    return rc < 0 ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fft.h"
+
+int fft_plan_init(struct fft_plan* p, size_t n)
+{
+    size_t m = n / 2, bits = 0;
+
+    memset(p, 0, sizeof(*p));
+    if (n < 4 || (n & (n - 1)) != 0) {
+        return -1;
+    }
+    p->n = n;
+    p->bitrev = malloc(m * sizeof(size_t));
+    p->cos_half = malloc(m / 2 * sizeof(double));
+    p->sin_half = malloc(m / 2 * sizeof(double));
+    p->cos_full = malloc(m * sizeof(double));
+    p->sin_full = malloc(m * sizeof(double));
+    p->work = malloc(n * sizeof(double));
+    if (!p->bitrev || !p->cos_half || !p->sin_half || !p->cos_full || !p->sin_full || !p->work) {
+        fft_plan_free(p);
+        return -1;
+    }
+
+    while (((size_t) 1 << bits) < m) {
+        bits++;
+    }
+    for (size_t k = 0; k < m; k++) {
+        size_t r = 0;
+        for (size_t b = 0; b < bits; b++) {
+            r |= ((k >> b) & 1) << (bits - 1 - b);
+        }
+        p->bitrev[k] = r;
+    }
+    for (size_t k = 0; k < m / 2; k++) {
+        p->cos_half[k] = cos(2 * M_PI * k / m);
+        p->sin_half[k] = sin(2 * M_PI * k / m);
+    }
+    for (size_t k = 0; k < m; k++) {
+        p->cos_full[k] = cos(2 * M_PI * k / n);
+        p->sin_full[k] = sin(2 * M_PI * k / n);
+    }
+    return 0;
+}
+
+void fft_plan_free(struct fft_plan* p)
+{
+    free(p->bitrev);
+    free(p->cos_half);
+    free(p->sin_half);
+    free(p->cos_full);
+    free(p->sin_full);
+    free(p->work);
+    memset(p, 0, sizeof(*p));
+}
+
+void fft_real(struct fft_plan* p, const double* in, double* re, double* im)
+{
+    size_t m = p->n / 2;
+    double* a = p->work; //m complex points, interleaved
+
+    //even samples as the real part and odd ones as the imaginary part, in bit reversed order
+    for (size_t k = 0; k < m; k++) {
+        size_t j = p->bitrev[k];
+        a[2 * j] = in[2 * k];
+        a[2 * j + 1] = in[2 * k + 1];
+    }
+
+    //iterative decimation in time
+    for (size_t len = 2; len <= m; len <<= 1) {
+        size_t half = len / 2, step = m / len;
+        for (size_t i = 0; i < m; i += len) {
+            for (size_t j = 0; j < half; j++) {
+                double wr = p->cos_half[j * step], wi = -p->sin_half[j * step];
+                double* u = a + 2 * (i + j);
+                double* v = a + 2 * (i + j + half);
+                double vr = v[0] * wr - v[1] * wi;
+                double vi = v[0] * wi + v[1] * wr;
+                v[0] = u[0] - vr;
+                v[1] = u[1] - vi;
+                u[0] += vr;
+                u[1] += vi;
+            }
+        }
+    }
+
+    //splits the half size transform Z into the transform X of the real input:
+    //X[k] = (Z[k] + conj(Z[m-k])) / 2 - i/2 exp(-2 pi i k / n) (Z[k] - conj(Z[m-k]))
+    re[0] = a[0] + a[1];
+    im[0] = 0;
+    re[m] = a[0] - a[1];
+    im[m] = 0;
+    for (size_t k = 1; k < m; k++) {
+        double zr = a[2 * k], zi = a[2 * k + 1];
+        double cr = a[2 * (m - k)], ci = -a[2 * (m - k) + 1];
+        double er = (zr + cr) / 2, ei = (zi + ci) / 2;
+        double or_ = (zi - ci) / 2, oi = -(zr - cr) / 2;
+        double c = p->cos_full[k], s = p->sin_full[k];
+        re[k] = er + c * or_ + s * oi;
+        im[k] = ei + c * oi - s * or_;
+    }
+}
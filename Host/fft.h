@@ -0,0 +1,27 @@
+//Radix-2 FFT of real data with everything that depends only on the size worked out once in a plan
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <stddef.h>
+
+//A real FFT of n points runs as a complex FFT of n/2 points and a split step
+struct fft_plan {
+    size_t n; //points, a power of 2 of at least 4
+    size_t* bitrev; //bit reversed order of the n/2 complex points
+    double* cos_half; //exp(-2 pi i k / (n/2)) for the complex FFT, k < n/4
+    double* sin_half;
+    double* cos_full; //exp(-2 pi i k / n) for the split step, k < n/2
+    double* sin_full;
+    double* work; //n doubles
+};
+
+//Returns -1 if n is not a power of 2 of at least 4 or out of memory
+int fft_plan_init(struct fft_plan* p, size_t n);
+
+void fft_plan_free(struct fft_plan* p);
+
+//Bins 0 to n/2 of the DFT of in (n points) into re and im (n/2 + 1 each)
+void fft_real(struct fft_plan* p, const double* in, double* re, double* im);
+
+#endif
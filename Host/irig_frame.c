@@ -0,0 +1,150 @@
+#include <string.h>
+
+#include "irig_frame.h"
+
+#define SECONDS_PER_DAY 86400
+
+//Digits the frame bits add up into
+enum {
+    DIGIT_NONE, //index bits, position identifiers and the reference bit
+    SECONDS_UNITS,
+    SECONDS_TENS,
+    MINUTES_UNITS,
+    MINUTES_TENS,
+    HOURS_UNITS,
+    HOURS_TENS,
+    DAY_UNITS,
+    DAY_TENS,
+    DAY_HUNDREDS,
+    YEAR_UNITS,
+    YEAR_TENS,
+    CONTROL_LOW, //frame bits 60-68
+    CONTROL_HIGH, //frame bits 70-78
+    SBS_LOW, //frame bits 80-88
+    SBS_HIGH, //frame bits 90-97
+    N_DIGITS
+};
+
+struct irig_bit {
+    uint8_t digit;
+    uint16_t weight;
+};
+
+#define BCD4(bit, digit) [bit] = { digit, 1 }, [bit + 1] = { digit, 2 }, [bit + 2] = { digit, 4 }, [bit + 3] = { digit, 8 }
+#define BCD3(bit, digit) [bit] = { digit, 1 }, [bit + 1] = { digit, 2 }, [bit + 2] = { digit, 4 }
+#define BCD2(bit, digit) [bit] = { digit, 1 }, [bit + 1] = { digit, 2 }
+#define BINARY8(bit, digit) BCD4(bit, digit), [bit + 4] = { digit, 16 }, [bit + 5] = { digit, 32 }, \
+                            [bit + 6] = { digit, 64 }, [bit + 7] = { digit, 128 }
+#define BINARY9(bit, digit) BINARY8(bit, digit), [bit + 8] = { digit, 256 }
+
+//Digit and weight of every frame bit, bits left out are DIGIT_NONE
+static const struct irig_bit irig_bits[IRIG_FRAME_WORDS * 10] = {
+    BCD4(1, SECONDS_UNITS), BCD3(6, SECONDS_TENS),
+    BCD4(10, MINUTES_UNITS), BCD3(15, MINUTES_TENS),
+    BCD4(20, HOURS_UNITS), BCD2(25, HOURS_TENS),
+    BCD4(30, DAY_UNITS), BCD4(35, DAY_TENS), BCD2(40, DAY_HUNDREDS),
+    BCD4(50, YEAR_UNITS), BCD4(55, YEAR_TENS),
+    BINARY9(60, CONTROL_LOW), BINARY9(70, CONTROL_HIGH),
+    BINARY9(80, SBS_LOW), BINARY8(90, SBS_HIGH),
+};
+
+//BCD digits, checked for values above 9
+static const uint8_t bcd_digits[] = { SECONDS_UNITS, SECONDS_TENS, MINUTES_UNITS, MINUTES_TENS, HOURS_UNITS, HOURS_TENS,
+                                      DAY_UNITS, DAY_TENS, DAY_HUNDREDS, YEAR_UNITS, YEAR_TENS };
+
+int irig_frame_decode(const uint32_t* info, struct irig_frame* f)
+{
+    uint32_t digit[N_DIGITS] = { 0 };
+    int bad = 0;
+
+    for (int k = 0; k < IRIG_FRAME_WORDS; k++) {
+        uint32_t word = info[k] & 0x3ff;
+        while (word) {
+            const struct irig_bit* b = &irig_bits[k * 10 + __builtin_ctz(word)];
+            digit[b->digit] += b->weight;
+            word &= word - 1;
+        }
+    }
+    for (size_t d = 0; d < sizeof(bcd_digits); d++) {
+        if (digit[bcd_digits[d]] > 9) {
+            bad |= IRIG_FRAME_BAD_DIGIT;
+        }
+    }
+    f->seconds = digit[SECONDS_UNITS] + 10 * digit[SECONDS_TENS];
+    f->minutes = digit[MINUTES_UNITS] + 10 * digit[MINUTES_TENS];
+    f->hours = digit[HOURS_UNITS] + 10 * digit[HOURS_TENS];
+    f->day_of_year = digit[DAY_UNITS] + 10 * digit[DAY_TENS] + 100 * digit[DAY_HUNDREDS];
+    f->year = digit[YEAR_UNITS] + 10 * digit[YEAR_TENS];
+    f->control = digit[CONTROL_LOW] | digit[CONTROL_HIGH] << 9;
+    f->sbs = digit[SBS_LOW] | digit[SBS_HIGH] << 9;
+
+    if (f->seconds > 60 || f->minutes > 59 || f->hours > 23) {
+        bad |= IRIG_FRAME_BAD_TIME;
+    }
+    if (f->day_of_year > 366) {
+        bad |= IRIG_FRAME_BAD_DAY;
+    }
+    if (f->sbs != 0 && (long) f->sbs != irig_frame_time_of_day(f)) {
+        bad |= IRIG_FRAME_BAD_SBS;
+    }
+    return bad;
+}
+
+void irig_frame_encode(const struct irig_frame* f, uint32_t* info)
+{
+    uint32_t digit[N_DIGITS] = {
+        [SECONDS_UNITS] = f->seconds % 10, [SECONDS_TENS] = f->seconds / 10,
+        [MINUTES_UNITS] = f->minutes % 10, [MINUTES_TENS] = f->minutes / 10,
+        [HOURS_UNITS] = f->hours % 10, [HOURS_TENS] = f->hours / 10,
+        [DAY_UNITS] = f->day_of_year % 10, [DAY_TENS] = f->day_of_year / 10 % 10, [DAY_HUNDREDS] = f->day_of_year / 100,
+        [YEAR_UNITS] = f->year % 10, [YEAR_TENS] = f->year / 10 % 10,
+        [CONTROL_LOW] = f->control & 0x1ff, [CONTROL_HIGH] = f->control >> 9 & 0x1ff,
+        [SBS_LOW] = f->sbs & 0x1ff, [SBS_HIGH] = f->sbs >> 9 & 0xff,
+    };
+
+    memset(info, 0, IRIG_FRAME_WORDS * sizeof(uint32_t));
+    for (int bit = 0; bit < IRIG_FRAME_WORDS * 10; bit++) {
+        const struct irig_bit* b = &irig_bits[bit];
+        if (digit[b->digit] & b->weight) {
+            info[bit / 10] |= 1u << (bit % 10);
+        }
+    }
+}
+
+long irig_frame_time_of_day(const struct irig_frame* f)
+{
+    return f->seconds + f->minutes * 60 + f->hours * 3600;
+}
+
+//Days from 1970-01-01 to the first of January of a year of the Gregorian calendar
+static int64_t days_to_year(int64_t year)
+{
+    int64_t y = year - 1;
+    return 365 * (year - 1970) + (y / 4 - y / 100 + y / 400) - (1969 / 4 - 1969 / 100 + 1969 / 400);
+}
+
+int64_t irig_frame_unix_time(const struct irig_frame* f)
+{
+    if (f->day_of_year == 0) {
+        return -1;
+    }
+    return (days_to_year(2000 + f->year) + f->day_of_year - 1) * SECONDS_PER_DAY + irig_frame_time_of_day(f);
+}
+
+void irig_frame_from_unix_time(int64_t t, struct irig_frame* f)
+{
+    int64_t days = t / SECONDS_PER_DAY;
+    long time_of_day = (long) (t % SECONDS_PER_DAY);
+    int64_t year = 1970 + days / 366;
+
+    while (days_to_year(year + 1) <= days) {
+        year++;
+    }
+    memset(f, 0, sizeof(*f));
+    f->seconds = time_of_day % 60;
+    f->minutes = time_of_day / 60 % 60;
+    f->hours = time_of_day / 3600;
+    f->day_of_year = (int) (days - days_to_year(year)) + 1;
+    f->year = (int) (year % 100);
+    f->sbs = (uint32_t) time_of_day;
+}
@@ -0,0 +1,63 @@
+//Full IRIG-B frame decoding from the info[10] words of an IRIG packet
+//
+//The IRIG PRU stores bit 10 * k + j of the frame as bit j of info[k]. The position identifiers (bits 9, 19,
+//..., 99) never get there, their rising edges are the re_count[] of the packet instead. Where each field sits
+//is one table of frame bits with the BCD or binary digit they belong to and their weight in it (IRIG Standard
+//200, format B):
+//  1-8    seconds      BCD, 5 is an index bit
+//  10-17  minutes      BCD, 14 is an index bit
+//  20-26  hours        BCD, 24 is an index bit
+//  30-41  day of year  BCD, 34 is an index bit, 1-366
+//  50-58  year         BCD, two digits, 54 is an index bit
+//  60-78  control functions, 18 bits, the IEEE 1344 assignments are below
+//  80-97  straight binary seconds of the day, 17 bits
+//Decoding walks the set bits of each word through the table and adds up the digits, then checks every BCD
+//digit and field against its range. Generators that leave out the date, the control functions or the binary
+//seconds send zeros there, which decode as "not sent".
+
+#ifndef IRIG_FRAME_H
+#define IRIG_FRAME_H
+
+#include <stdint.h>
+
+#define IRIG_FRAME_WORDS 10
+
+//IEEE 1344 use of the control functions, bit n of control is frame bit 60 + n, or 61 + n past bit 68
+#define IRIG_CONTROL_LEAP_PENDING (1 << 0) //a leap second is inserted or deleted at the end of this minute
+#define IRIG_CONTROL_LEAP_DELETE (1 << 1) //the pending leap second is a deletion
+#define IRIG_CONTROL_DST_PENDING (1 << 2)
+#define IRIG_CONTROL_DST (1 << 3)
+
+//What irig_frame_decode() found wrong, 0 for a good frame
+#define IRIG_FRAME_BAD_DIGIT 0x01 //a BCD digit above 9
+#define IRIG_FRAME_BAD_TIME 0x02 //seconds, minutes or hours out of range
+#define IRIG_FRAME_BAD_DAY 0x04 //day of year above 366
+#define IRIG_FRAME_BAD_SBS 0x08 //binary seconds sent and not matching the BCD time of day
+
+struct irig_frame {
+    int seconds; //0-59, 60 during a leap second
+    int minutes;
+    int hours;
+    int day_of_year; //1-366, 0 if not sent
+    int year; //0-99, only meaningful with day_of_year
+    uint32_t control; //control function bits, IRIG_CONTROL_*
+    uint32_t sbs; //straight binary seconds of the day, 0 if not sent
+};
+
+//Decodes a frame, returns 0 or the IRIG_FRAME_BAD_* bits of what is wrong with it. The fields are filled in
+//either way.
+int irig_frame_decode(const uint32_t* info, struct irig_frame* f);
+
+//Builds the info words of a frame, the inverse of irig_frame_decode() for the simulators and benchmarks
+void irig_frame_encode(const struct irig_frame* f, uint32_t* info);
+
+//Seconds since midnight, as written to the IRIG_Data CSV files
+long irig_frame_time_of_day(const struct irig_frame* f);
+
+//Seconds since 1970 taking the year as 20xx, or -1 if the frame has no date
+int64_t irig_frame_unix_time(const struct irig_frame* f);
+
+//Fills in f for a Unix time, with the date, the binary seconds and no control bits
+void irig_frame_from_unix_time(int64_t t, struct irig_frame* f);
+
+#endif
@@ -0,0 +1,160 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "angle_stream.h"
+#include "jitter_monitor.h"
+
+int jitter_monitor_init(struct jitter_monitor* m, size_t window, size_t overlap, unsigned long int average,
+                        double slits_per_rev, double publish_period_s, jitter_publish_fn publish, void* arg)
+{
+    memset(m, 0, sizeof(*m));
+    if (window == 0) {
+        window = JITTER_WINDOW;
+    }
+    if (window < 16 || (window & (window - 1)) != 0 || overlap >= window) {
+        return -1;
+    }
+    m->window = window;
+    m->hop = window - overlap;
+    m->average = average;
+    m->rad_per_edge = 2 * M_PI / (slits_per_rev > 0 ? slits_per_rev : ANGLE_SLITS_PER_REV);
+    m->publish_period_s = publish_period_s;
+    m->publish = publish;
+    m->arg = arg;
+
+    size_t n_bins = window / 2 + 1;
+    m->hann = malloc(window * sizeof(double));
+    m->time = malloc(window * sizeof(double));
+    m->angle = malloc(window * sizeof(double));
+    m->jitter = malloc(window * sizeof(double));
+    m->re = malloc(n_bins * sizeof(double));
+    m->im = malloc(n_bins * sizeof(double));
+    m->psd = calloc(n_bins, sizeof(double));
+    if (!m->hann || !m->time || !m->angle || !m->jitter || !m->re || !m->im || !m->psd || fft_plan_init(&m->plan, window) < 0) {
+        jitter_monitor_free(m);
+        return -1;
+    }
+
+    //periodic Hann window, as Welch's method uses
+    for (size_t k = 0; k < window; k++) {
+        m->hann[k] = 0.5 - 0.5 * cos(2 * M_PI * k / window);
+        m->hann_sq_sum += m->hann[k] * m->hann[k];
+    }
+    return 0;
+}
+
+void jitter_monitor_free(struct jitter_monitor* m)
+{
+    fft_plan_free(&m->plan);
+    free(m->hann);
+    free(m->time);
+    free(m->angle);
+    free(m->jitter);
+    free(m->re);
+    free(m->im);
+    free(m->psd);
+    memset(m, 0, sizeof(*m));
+}
+
+void jitter_monitor_report(const struct jitter_monitor* m, struct jitter_report* report)
+{
+    report->time = m->phase_time;
+    report->rotation_hz = m->rotation_hz;
+    report->phase = m->phase;
+    report->rms_jitter = m->rms_jitter;
+    report->freq_step = m->freq_step;
+    report->n_bins = m->window / 2 + 1;
+    report->psd = m->psd;
+    report->windows = m->windows;
+    report->gaps = m->gaps;
+}
+
+//One full window in m->time and m->angle
+static void process_window(struct jitter_monitor* m)
+{
+    size_t n = m->window;
+    double t0 = m->time[0];
+    double xm = (n - 1) / 2.0;
+    double sy = 0, sxy = 0, sq = 0;
+
+    //least squares line through time against edge number, with the edge number centred so the sums stay small
+    for (size_t k = 0; k < n; k++) {
+        double y = m->time[k] - t0;
+        sy += y;
+        sxy += (k - xm) * y;
+    }
+    double b = sxy / (n * ((double) n * n - 1) / 12); //seconds per edge
+    double a = sy / n - b * xm;
+    if (!(b > 0)) {
+        return;
+    }
+
+    for (size_t k = 0; k < n; k++) {
+        double r = m->time[k] - t0 - a - b * k;
+        sq += r * r;
+        m->jitter[k] = r * m->hann[k];
+    }
+    fft_real(&m->plan, m->jitter, m->re, m->im);
+
+    //one-sided PSD, 2 |X|^2 / (fs sum(w^2)) except at DC and Nyquist. Starts out as the mean of every window
+    //so far and turns into an exponential average over the last `average` windows once there are that many
+    double fs = 1 / b;
+    double scale = 1 / (fs * m->hann_sq_sum);
+    m->windows += 1;
+    double alpha = (m->average > 0 && m->windows > m->average) ? 1.0 / m->average : 1.0 / m->windows;
+    for (size_t k = 0; k <= n / 2; k++) {
+        double p = (m->re[k] * m->re[k] + m->im[k] * m->im[k]) * scale * (k == 0 || k == n / 2 ? 1 : 2);
+        m->psd[k] += alpha * (p - m->psd[k]);
+    }
+
+    m->rotation_hz = m->rad_per_edge / (2 * M_PI * b);
+    m->rms_jitter = sqrt(sq / n);
+    m->freq_step = fs / n;
+    m->phase_time = t0 + a + b * (n - 1); //fitted time of the last edge, free of its jitter
+    m->phase = fmod(m->angle[n - 1], 2 * M_PI);
+
+    if (m->publish != NULL && (!m->have_publish || m->phase_time >= m->next_publish)) {
+        struct jitter_report report;
+        jitter_monitor_report(m, &report);
+        m->publish(&report, m->arg);
+        m->have_publish = 1;
+        m->next_publish = m->phase_time + m->publish_period_s;
+    }
+}
+
+size_t jitter_monitor_push(struct jitter_monitor* m, const double* time, const double* angle, size_t n)
+{
+    size_t windows = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (m->fill > 0) {
+            double step = (angle[i] - m->angle[m->fill - 1]) / m->rad_per_edge;
+            if (fabs(step - 1) > 0.5 || !(time[i] > m->time[m->fill - 1])) {
+                m->gaps += 1;
+                m->fill = 0;
+            }
+        }
+        m->time[m->fill] = time[i];
+        m->angle[m->fill] = angle[i];
+        m->fill += 1;
+        if (m->fill == m->window) {
+            process_window(m);
+            windows += 1;
+            //the overlap is the start of the next window
+            m->fill = m->window - m->hop;
+            memmove(m->time, m->time + m->hop, m->fill * sizeof(double));
+            memmove(m->angle, m->angle + m->hop, m->fill * sizeof(double));
+        }
+    }
+    return windows;
+}
+
+double jitter_monitor_phase_at(const struct jitter_monitor* m, double t)
+{
+    if (m->windows == 0) {
+        return 0;
+    }
+    double phase = fmod(m->phase + 2 * M_PI * m->rotation_hz * (t - m->phase_time), 2 * M_PI);
+    return phase < 0 ? phase + 2 * M_PI : phase;
+}
@@ -0,0 +1,89 @@
+//Online rotation frequency, phase and angle jitter PSD of the HWP
+//
+//The streaming version of the jitter analysis left commented out at the end of encoderDAQ_BB.py. It takes
+//the (time, angle) samples coming out of angle_stream one chunk at a time and cuts them into windows of
+//a fixed number of consecutive edges that overlap by a fixed number of edges. For every window:
+//  - time is fit to a line in the edge number, time_jitter = time - polyval(polyfit(...)) as in
+//    encoderDAQ_BB.py, and the slope gives the rotation frequency and the sample rate of the jitter
+//  - the jitter is Hann windowed and transformed with an FFT planned once, and its one-sided PSD is
+//    averaged into the running spectrum (Welch's method)
+//Memory is allocated once in jitter_monitor_init() and does not grow with the length of the run. A window
+//never spans a missing edge, a gap starts the next one over. Every publish_period_s seconds of data the
+//running estimates are handed to a callback.
+
+#ifndef JITTER_MONITOR_H
+#define JITTER_MONITOR_H
+
+#include <stddef.h>
+
+#include "fft.h"
+
+#define JITTER_WINDOW 4096 //default edges per window, about 1.8 s at 2 Hz
+
+//What is published, valid only during the callback
+struct jitter_report {
+    double time; //time of the last edge in the latest window, as given by angle_stream
+    double rotation_hz; //from the latest window
+    double phase; //HWP angle in [0, 2 pi) at time
+    double rms_jitter; //s, of the latest window
+    double freq_step; //Hz between PSD bins, bin k is at k * freq_step
+    size_t n_bins; //window / 2 + 1
+    const double* psd; //s^2/Hz, one-sided
+    unsigned long int windows; //windows that went into psd
+    unsigned long int gaps; //windows restarted by a missing edge
+};
+
+typedef void (*jitter_publish_fn)(const struct jitter_report* report, void* arg);
+
+struct jitter_monitor {
+    size_t window; //edges per window, a power of 2
+    size_t hop; //new edges between windows, window - overlap
+    unsigned long int average; //windows in the exponential average of the PSD, 0 averages every window equally
+    double rad_per_edge;
+    double publish_period_s; //<= 0 publishes after every window
+    jitter_publish_fn publish;
+    void* arg;
+
+    struct fft_plan plan;
+    double* hann;
+    double hann_sq_sum;
+    double* time; //edges of the window being filled
+    double* angle;
+    size_t fill;
+    double* jitter; //scratch, window doubles
+    double* re; //scratch, n_bins doubles
+    double* im;
+    double* psd; //running average, n_bins doubles
+
+    //running estimates from the latest window
+    double rotation_hz;
+    double phase; //at phase_time
+    double phase_time;
+    double rms_jitter;
+    double freq_step;
+    int have_publish;
+    double next_publish;
+
+    unsigned long int windows; //windows averaged into psd
+    unsigned long int gaps; //missing edges or time going backwards that restarted a window
+};
+
+//window: edges per window, a power of 2 of at least 16, 0 picks JITTER_WINDOW
+//overlap: edges shared by consecutive windows, less than window (window / 2 is the usual Welch choice)
+//slits_per_rev: as in angle_stream_init(), <= 0 picks ANGLE_SLITS_PER_REV
+//Returns -1 if the arguments are out of range or out of memory
+int jitter_monitor_init(struct jitter_monitor* m, size_t window, size_t overlap, unsigned long int average,
+                        double slits_per_rev, double publish_period_s, jitter_publish_fn publish, void* arg);
+
+void jitter_monitor_free(struct jitter_monitor* m);
+
+//Adds samples as read from angle_stream_read(), returns the number of windows finished
+size_t jitter_monitor_push(struct jitter_monitor* m, const double* time, const double* angle, size_t n);
+
+//HWP angle in [0, 2 pi) at time t extrapolated from the latest window, 0 before the first window
+double jitter_monitor_phase_at(const struct jitter_monitor* m, double t);
+
+//Fills in a report of the running estimates, as handed to the callback
+void jitter_monitor_report(const struct jitter_monitor* m, struct jitter_report* report);
+
+#endif
@@ -0,0 +1,164 @@
+#include <math.h>
+#include <string.h>
+
+#include "loadgen.h"
+#include "pru_sigsim.h"
+
+#define IRIG_PHASE 0.5 //frames from the start to the first IRIG rising edge
+
+//xorshift64, as in pru_sigsim.c
+static double uniform(struct loadgen* g)
+{
+    g->rng ^= g->rng << 13;
+    g->rng ^= g->rng >> 7;
+    g->rng ^= g->rng << 17;
+    return ((g->rng >> 11) + 0.5) / 9007199254740992.0;
+}
+
+//IEP count at t seconds, overflows in the upper word
+static uint64_t clock_at(const struct loadgen* g, double t)
+{
+    return g->config.iep_start + (uint64_t) llround(t * LOADGEN_HZ);
+}
+
+static double encoder_time(const struct loadgen* g, uint32_t k)
+{
+    return (double) (k + 1) * ENCODER_COUNTER_SIZE * g->edge_period;
+}
+
+static double irig_time(const struct loadgen* g, uint32_t j)
+{
+    return (j + IRIG_PHASE + 1) / g->config.irig_hz;
+}
+
+static void build_encoder(struct loadgen* g, struct loadgen_packet* p)
+{
+    struct CompleteDataPackets* e = &p->data.encoder;
+    uint32_t first = g->encoder_packets * ENCODER_COUNTER_SIZE + 1;
+
+    p->t = encoder_time(g, g->encoder_packets);
+    p->header = ENCODER_HEADER;
+    p->index = g->encoder_packets;
+    p->size = sizeof(*e);
+    e->counter_info_header = ENCODER_HEADER;
+    for (int x = 0; x < ENCODER_COUNTER_SIZE; x++) {
+        uint64_t clock = clock_at(g, (first + x) * g->edge_period);
+        e->Counter_Packets.clock_cnt[x] = (uint32_t) clock;
+        e->Counter_Packets.counter_ovflow[x] = (uint32_t) (clock >> 32);
+        e->Counter_Packets.encoder_cnt[x] = first + x;
+    }
+    //the quadrature pins of a forward turning HWP, as pru_sigsim.h has them
+    e->Quad.encoder_value_2 = 0;
+    e->Quad.encoder_value_3 = 1;
+    e->Quad.encoder_value_4 = 0;
+    g->encoder_packets += 1;
+}
+
+static void build_irig(struct loadgen* g, struct loadgen_packet* p)
+{
+    struct IrigInfo* i = &p->data.irig;
+    double rise = (g->irig_frames + IRIG_PHASE) / g->config.irig_hz;
+    double bit = 0.01 / g->config.irig_hz;
+    uint64_t clock = clock_at(g, rise);
+
+    p->t = irig_time(g, g->irig_frames);
+    p->header = IRIG_HEADER;
+    p->index = g->irig_frames;
+    p->size = sizeof(*i);
+    i->random_header = IRIG_HEADER;
+    i->rising_edge_time = (uint32_t) clock;
+    i->init_overflow = (uint32_t) (clock >> 32);
+    pru_sigsim_irig_info((g->config.irig_start + (uint32_t) floor(rise)) % (24 * 3600), i->info);
+    for (int x = 0; x < 10; x++) {
+        clock = clock_at(g, rise + (10 * x + 9) * bit); //the position identifiers at bits 9, 19, ..., 99
+        i->re_count[x] = (uint32_t) clock;
+        i->re_count_overflow[x] = (uint32_t) (clock >> 32);
+    }
+    g->irig_frames += 1;
+}
+
+//Builds the next packet of the stream in g->next, returns 0 at the end of the signal
+static int build(struct loadgen* g)
+{
+    double te = encoder_time(g, g->encoder_packets);
+    double ti = irig_time(g, g->irig_frames);
+
+    if (te > g->config.duration_s && ti > g->config.duration_s) {
+        return 0;
+    }
+    if (te <= ti) {
+        build_encoder(g, &g->next);
+    } else {
+        build_irig(g, &g->next);
+    }
+    g->built += 1;
+    return 1;
+}
+
+static void emit(struct loadgen* g, const struct loadgen_packet* from, struct loadgen_packet* p)
+{
+    memcpy(p, from, offsetof(struct loadgen_packet, data) + from->size);
+    if (p->t < g->last_t) {
+        p->t = g->last_t; //a held back packet goes out with the one it was held behind
+    }
+    g->last_t = p->t;
+}
+
+static void release(struct loadgen* g, int h, struct loadgen_packet* p)
+{
+    emit(g, &g->held[h].packet, p);
+    g->n_held -= 1;
+    memmove(&g->held[h], &g->held[h + 1], (g->n_held - h) * sizeof(g->held[0]));
+}
+
+int loadgen_init(struct loadgen* g, const struct loadgen_config* config)
+{
+    if (config->hwp_hz <= 0 || config->edges_per_rev <= 0 || config->irig_hz <= 0 || config->duration_s <= 0 ||
+        config->loss < 0 || config->loss >= 1 || config->reorder < 0 || config->reorder > 1 ||
+        (config->reorder > 0 && config->reorder_depth < 1)) {
+        return -1;
+    }
+    memset(g, 0, sizeof(*g));
+    g->config = *config;
+    g->edge_period = 1 / (config->hwp_hz * config->edges_per_rev);
+    g->rng = config->seed ? config->seed : 88172645463325252ull;
+    return 0;
+}
+
+int loadgen_next(struct loadgen* g, struct loadgen_packet* p)
+{
+    for (;;) {
+        if (g->n_held > 0 && g->held[0].after <= 0) {
+            release(g, 0, p);
+            return 1;
+        }
+        if (!build(g)) {
+            if (g->n_held > 0) {
+                release(g, 0, p);
+                return 1;
+            }
+            return 0;
+        }
+        if (g->config.loss > 0 && uniform(g) < g->config.loss) {
+            g->dropped += 1;
+            continue;
+        }
+        for (int h = 0; h < g->n_held; h++) {
+            g->held[h].after -= 1;
+        }
+        if (g->config.reorder > 0 && g->n_held < LOADGEN_MAX_HELD && uniform(g) < g->config.reorder) {
+            memcpy(&g->held[g->n_held].packet, &g->next, sizeof(g->next));
+            g->held[g->n_held].after = g->config.reorder_depth;
+            g->n_held += 1;
+            g->reordered += 1;
+            continue;
+        }
+        emit(g, &g->next, p);
+        return 1;
+    }
+}
+
+uint32_t loadgen_encoder_packets(const struct loadgen_config* config)
+{
+    return (uint32_t) floor(config->duration_s * config->hwp_hz * config->edges_per_rev / ENCODER_COUNTER_SIZE);
+}
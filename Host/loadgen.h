@@ -0,0 +1,78 @@
+//Synthetic Beaglebone packet stream, for loading the receivers without the DAQ hardware
+//
+//Builds the same byte-exact 0x1EAF encoder packets and 0xCAFE IRIG packets as Beaglebone_Encoder_DAQ.c sends,
+//from a HWP turning at a constant rate: edge n of the encoder comes at n / (hwp_hz * edges_per_rev) seconds and
+//is stamped with the 200 MHz IEP count, overflows included, as the encoder PRU does. IRIG frames start every
+//1 / irig_hz seconds and carry the time of day of their rising edge in the same BCD words as the IRIG PRU. A
+//packet is handed out at the time it would leave the Beaglebone: an encoder packet at its last edge, an IRIG
+//packet when its frame has ended, 1 / irig_hz after its rising edge.
+//
+//On top of the stream, packets can be dropped at random and held back behind later packets, as a lossy or
+//reordering network would. Both use a fixed seed, so a run replays exactly.
+
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pru_layout.h"
+
+#define LOADGEN_HZ 200000000.0 //IEP counter frequency
+#define LOADGEN_MAX_HELD 16 //packets that can be held back at once
+
+struct loadgen_config {
+    double hwp_hz; //rotation frequency
+    int edges_per_rev; //encoder edges per revolution, 570 slits with both edges counted is 1140
+    double irig_hz; //IRIG frames per second, 1 for real IRIG-B
+    double duration_s; //seconds of signal
+    double loss; //fraction of packets dropped
+    double reorder; //fraction of packets held back
+    int reorder_depth; //later packets sent before a held back one
+    uint32_t iep_start; //IEP count at the start, close to 2^32 to get a wrap early on
+    uint32_t irig_start; //time of day of the first IRIG frame, seconds since midnight
+    uint64_t seed;
+};
+
+struct loadgen_packet {
+    double t; //seconds of signal at which the packet leaves, never less than the packet before
+    uint32_t header; //ENCODER_HEADER or IRIG_HEADER
+    uint32_t index; //number of the packet among those of its type, dropped ones included
+    size_t size;
+    union {
+        struct CompleteDataPackets encoder;
+        struct IrigInfo irig;
+    } data;
+};
+
+struct loadgen_held {
+    struct loadgen_packet packet;
+    int after; //packets still to be sent before this one
+};
+
+struct loadgen {
+    struct loadgen_config config;
+    double edge_period; //seconds
+    uint32_t encoder_packets; //built so far
+    uint32_t irig_frames;
+    uint64_t rng;
+    double last_t;
+    struct loadgen_held held[LOADGEN_MAX_HELD];
+    int n_held;
+    struct loadgen_packet next; //scratch space for the packet being built
+    //counts over both packet types
+    unsigned long int built;
+    unsigned long int dropped;
+    unsigned long int reordered;
+};
+
+//Returns 0, or -1 if the configuration makes no sense
+int loadgen_init(struct loadgen* g, const struct loadgen_config* config);
+
+//Fills *p with the next packet to send and returns 1, returns 0 once duration_s of signal has been sent
+int loadgen_next(struct loadgen* g, struct loadgen_packet* p);
+
+//Encoder packets in duration_s of signal, dropped ones included
+uint32_t loadgen_encoder_packets(const struct loadgen_config* config);
+
+#endif
@@ -0,0 +1,1117 @@
+#define _GNU_SOURCE //recvmmsg
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "packet_v2.h"
+#include "pru_layout.h"
+#include "receiver.h"
+
+#define RECEIVER_RCVBUF (16 << 20) //asked for, the kernel caps it at net.core.rmem_max
+#define RECEIVER_TIMEOUT_US 200000 //how often the receive thread checks the stop flags
+#define RECEIVER_IDLE_US 100 //sleep while a queue is empty or full
+#define LOOKING_FOR_DATA_US 2000000 //same period as the select() in encoderDAQ_BB.py
+#define JITTER_CHUNK 4096 //samples moved from the angle stream to the jitter monitor at a time
+#define NOMINAL_EDGES_PER_S 2280.0 //570 slits, both edges, at 2 Hz, sizes the first chunk
+#define NOMINAL_CSV_EDGE_BYTES 24 //an encoder CSV row
+#define NOMINAL_CSV_IRIG_BYTES 330 //an IRIG packet in CSV
+#define ENCODER_CSV_HEADER "1: Quad readout,2-152: capt_cnt/clk_cnt\r\n\r\n" //same headers as EncoderParser.__init__()
+#define IRIG_CSV_HEADER "1: IRIG_time/clk_cnt,3-13: synch_pulse/clk_cnt\r\n\r\n"
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void idle(void)
+{
+    struct timespec ts = { .tv_sec = 0, .tv_nsec = RECEIVER_IDLE_US * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+//Formats v in decimal at p and returns the end, much cheaper than fprintf() for the 300 numbers of an encoder packet
+static char* put_u64(char* p, uint64_t v)
+{
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = (char) ('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n) {
+        *p++ = tmp[--n];
+    }
+    return p;
+}
+
+//Rows are terminated with \r\n like the csv module does, so the files match the ones encoderDAQ_BB.py writes
+static char* put_row2(char* p, uint64_t a, uint64_t b)
+{
+    p = put_u64(p, a);
+    *p++ = ',';
+    p = put_u64(p, b);
+    *p++ = '\r';
+    *p++ = '\n';
+    return p;
+}
+
+//put_row2() with a signed first column, for quadrature positions
+static char* put_row2_signed(char* p, int64_t a, uint64_t b)
+{
+    if (a < 0) {
+        *p++ = '-';
+    }
+    p = put_u64(p, a < 0 ? -(uint64_t) a : (uint64_t) a);
+    *p++ = ',';
+    p = put_u64(p, b);
+    *p++ = '\r';
+    *p++ = '\n';
+    return p;
+}
+
+static char* put_blank_row(char* p)
+{
+    *p++ = '\r';
+    *p++ = '\n';
+    return p;
+}
+
+static void write_out(struct receiver* r, FILE* f, const char* buf, size_t len)
+{
+    fwrite(buf, 1, len, f);
+    r->stats.bytes_written += len;
+}
+
+//Rewrites the jitter PSD file, through a temporary file and rename() so a reader never sees half of it
+//[time, rotation frequency in Hz, phase in rad, rms jitter in s, windows averaged]
+//[]
+//[frequency in Hz, PSD in s^2/Hz]*(window/2 + 1)
+static void publish_jitter(const struct jitter_report* report, void* arg)
+{
+    struct receiver* r = arg;
+    char tmp_path[4096 + 8];
+
+    if (!r->config.quiet) {
+        printf("Jitter: rotation %.6f Hz, phase %.4f rad, rms jitter %.3f us over %lu windows, %lu gaps\n",
+               report->rotation_hz, report->phase, report->rms_jitter * 1e6, report->windows, report->gaps);
+    }
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", r->config.jitter_path) >= (int) sizeof(tmp_path)) {
+        return;
+    }
+    FILE* f = fopen(tmp_path, "w");
+    if (f == NULL) {
+        return;
+    }
+    fprintf(f, "1: time/rotation_hz/phase/rms_jitter/windows,3-: freq/psd\r\n\r\n");
+    fprintf(f, "%.6f,%.9f,%.9f,%.6e,%lu\r\n\r\n", report->time, report->rotation_hz, report->phase, report->rms_jitter,
+            report->windows);
+    for (size_t k = 0; k < report->n_bins; k++) {
+        fprintf(f, "%.6f,%.6e\r\n", k * report->freq_step, report->psd[k]);
+    }
+    if (fclose(f) == 0) {
+        rename(tmp_path, r->config.jitter_path);
+    }
+}
+
+//Hands the samples finished by the last IRIG packet to the jitter monitor
+static void feed_jitter(struct receiver* r)
+{
+    double time[JITTER_CHUNK], angle[JITTER_CHUNK];
+    size_t n;
+
+    while ((n = angle_stream_read(&r->angle, time, angle, JITTER_CHUNK)) > 0) {
+        jitter_monitor_push(&r->jitter, time, angle, n);
+    }
+}
+
+static FILE* create_csv(const char* path, const char* header)
+{
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        return NULL;
+    }
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+    fputs(header, f);
+    return f;
+}
+
+//Path of the file of an encoder channel: _chN goes in front of a .csv extension and after anything else
+static int channel_path(char* out, size_t size, const char* path, uint32_t channel)
+{
+    size_t len = strlen(path);
+    size_t stem = len >= 4 && strcmp(path + len - 4, ".csv") == 0 ? len - 4 : len;
+
+    if (snprintf(out, size, "%.*s_ch%u%s", (int) stem, path, channel, path + stem) >= (int) size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+//Whether a channel after the first has its file or archive in the current chunk
+static int channel_open(const struct receiver* r, uint32_t channel)
+{
+    return r->channel_files[channel] != NULL || r->channel_archive_open[channel];
+}
+
+//What's written to the Encoder file:
+//[quad input 2, quad input 3, quad input 4]
+//[]
+//[absolute number, clock count]* edges per packet, 150 by default
+//[]
+//Quadrature packets have the signed position in place of the absolute number. In an archive their edge_index
+//holds the QUAD_WORD as sent, see run_archive.h. The jitter monitor only follows encoder edges.
+//Returns the length of the rows
+static size_t format_encoder(char* buf, const uint64_t* clock, const uint32_t* encoder_cnt, int n_edges,
+                             const uint32_t* quad, int quadrature)
+{
+    char* p = buf;
+
+    p = put_u64(p, quad[0]);
+    *p++ = ',';
+    p = put_u64(p, quad[1]);
+    *p++ = ',';
+    p = put_u64(p, quad[2]);
+    p = put_blank_row(p);
+    p = put_blank_row(p);
+    for (int x = 0; x < n_edges; x++) {
+        p = quadrature ? put_row2_signed(p, QUAD_POSITION(encoder_cnt[x]), clock[x]) : put_row2(p, encoder_cnt[x], clock[x]);
+    }
+    p = put_blank_row(p);
+    return p - buf;
+}
+
+//Quadrature pins of a packet and ARCHIVE_QUAD_ENTRY, as edge_quad in run_archive.h
+static uint8_t edge_quad_bits(const uint32_t* quad, int quadrature)
+{
+    return (quad[0] & 1) | (quad[1] & 1) << 1 | (quad[2] & 1) << 2 | (quadrature ? ARCHIVE_QUAD_ENTRY : 0);
+}
+
+static void publish_encoder(struct receiver* r, uint32_t channel, const uint64_t* clock, const uint32_t* encoder_cnt,
+                            int n_edges, uint8_t edge_quad)
+{
+    struct shm_record record = { .type = SHM_RECORD_ENCODER, .channel = channel };
+    record.encoder.n_edges = n_edges;
+    record.encoder.quad = edge_quad;
+    memcpy(record.encoder.edge_index, encoder_cnt, n_edges * sizeof(uint32_t));
+    memcpy(record.encoder.edge_clock, clock, n_edges * sizeof(uint64_t));
+    shm_ring_publish(&r->ring, &record);
+}
+
+static void write_encoder(struct receiver* r, const uint32_t* clock_cnt, const uint32_t* counter_ovflow,
+                          const uint32_t* encoder_cnt, int n_edges, const uint32_t* quad, int quadrature)
+{
+    char buf[64 + ENCODER_COUNTER_SIZE * 36];
+    uint64_t clock[ENCODER_COUNTER_SIZE];
+    uint8_t edge_quad = edge_quad_bits(quad, quadrature);
+
+    for (int x = 0; x < n_edges; x++) {
+        clock[x] = clock_cnt[x] + ((uint64_t) counter_ovflow[x] << 32);
+    }
+    r->stats.encoder_packets += 1;
+    if (r->jitter_open && !quadrature) {
+        angle_stream_push_encoder(&r->angle, clock, encoder_cnt, n_edges);
+    }
+    if (r->ring_open) {
+        publish_encoder(r, 0, clock, encoder_cnt, n_edges, edge_quad);
+    }
+    if (r->archive_open) {
+        run_archive_append_edges(&r->archive, clock, encoder_cnt, n_edges, edge_quad);
+        r->stats.bytes_written += n_edges * (sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint8_t));
+        return;
+    }
+    write_out(r, r->encoder_file, buf, format_encoder(buf, clock, encoder_cnt, n_edges, quad, quadrature));
+}
+
+static int create_channel(struct receiver* r, uint32_t channel, unsigned int chunk, double scale, FILE** file,
+                          struct run_archive_writer* archive);
+
+//Packets of the channels after the first, in files or archives of their own in the format of the Encoder file or
+//the archive, opened at their first packet and then rolled over with the chunks
+static void write_channel(struct receiver* r, uint32_t channel, const uint32_t* clock_cnt, const uint32_t* counter_ovflow,
+                          const uint32_t* encoder_cnt, int n_edges, const uint32_t* quad, int quadrature)
+{
+    char buf[64 + ENCODER_COUNTER_SIZE * 36];
+    uint64_t clock[ENCODER_COUNTER_SIZE];
+    uint8_t edge_quad = edge_quad_bits(quad, quadrature);
+
+    for (int x = 0; x < n_edges; x++) {
+        clock[x] = clock_cnt[x] + ((uint64_t) counter_ovflow[x] << 32);
+    }
+    if (r->ring_open) {
+        publish_encoder(r, channel, clock, encoder_cnt, n_edges, edge_quad);
+    }
+    if (!channel_open(r, channel)) {
+        if (create_channel(r, channel, r->chunk, 0, &r->channel_files[channel], &r->channel_archives[channel]) < 0) {
+            r->stats.channel_skipped += 1;
+            return;
+        }
+        r->channel_archive_open[channel] = r->config.archive_dir != NULL;
+    }
+    r->stats.channel_packets += 1;
+    if (r->channel_archive_open[channel]) {
+        run_archive_append_edges(&r->channel_archives[channel], clock, encoder_cnt, n_edges, edge_quad);
+        r->stats.bytes_written += n_edges * (sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint8_t));
+        return;
+    }
+    write_out(r, r->channel_files[channel], buf, format_encoder(buf, clock, encoder_cnt, n_edges, quad, quadrature));
+}
+
+//Once a layout packet has come, every encoder packet is held against it. One of a channel it does not list, of
+//another size or in the other mode is counted, and written all the same so no edges are lost.
+static void check_layout(struct receiver* r, uint32_t channel, int n_edges, int quadrature)
+{
+    const struct LayoutPacket* l = &r->layout;
+
+    if (l->header == LAYOUT_HEADER && (channel >= l->layout.n_channels || (uint32_t) n_edges != l->layout.packet_edges ||
+                                       !quadrature != !l->config.quadrature)) {
+        r->stats.layout_mismatches += 1;
+    }
+}
+
+static void write_encoder_v1(struct receiver* r, const uint8_t* data)
+{
+    struct CompleteDataPackets packet;
+    memcpy(&packet, data, sizeof(packet));
+    const struct CounterInfo* c = &packet.Counter_Packets;
+    uint32_t quad[3] = { packet.Quad.encoder_value_2, packet.Quad.encoder_value_3, packet.Quad.encoder_value_4 };
+    check_layout(r, 0, ENCODER_COUNTER_SIZE, 0);
+    write_encoder(r, c->clock_cnt, c->counter_ovflow, c->encoder_cnt, ENCODER_COUNTER_SIZE, quad, 0);
+}
+
+static void write_encoder_v2(struct receiver* r, const uint8_t* data, size_t size)
+{
+    struct packet_v2_header hdr;
+    uint32_t clock_cnt[ENCODER_COUNTER_SIZE], counter_ovflow[ENCODER_COUNTER_SIZE], encoder_cnt[ENCODER_COUNTER_SIZE];
+    int n = packet_v2_decode(data, size, &hdr, clock_cnt, counter_ovflow, encoder_cnt, ENCODER_COUNTER_SIZE);
+    if (n < 0) {
+        r->stats.other_packets += 1;
+        return;
+    }
+    uint32_t quad[3] = { hdr.quad & 1, (hdr.quad >> 1) & 1, (hdr.quad >> 2) & 1 };
+    uint32_t channel = PACKET_V2_CHANNEL(hdr.flags);
+    check_layout(r, channel, n, hdr.flags & PACKET_V2_FLAG_QUAD);
+    if (channel >= PRU_MAX_CHANNELS) {
+        r->stats.other_packets += 1;
+    } else if (channel > 0) {
+        write_channel(r, channel, clock_cnt, counter_ovflow, encoder_cnt, n, quad, hdr.flags & PACKET_V2_FLAG_QUAD);
+    } else {
+        write_encoder(r, clock_cnt, counter_ovflow, encoder_cnt, n, quad, hdr.flags & PACKET_V2_FLAG_QUAD);
+    }
+}
+
+//Path of a chunk: _kkkk goes in front of a .csv extension and after anything else, path as is without chunks
+static int chunk_path(char* out, size_t size, const char* path, long chunk_s, unsigned int chunk)
+{
+    size_t len = strlen(path);
+    size_t stem = len >= 4 && strcmp(path + len - 4, ".csv") == 0 ? len - 4 : len;
+    int n = chunk_s > 0 ? snprintf(out, size, "%.*s_%04u%s", (int) stem, path, chunk, path + stem)
+                        : snprintf(out, size, "%s", path);
+
+    if (n >= (int) size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+//Reserves disk for bytes of data ahead, leaving the file size as it is so readers only ever see rows. Best
+//effort: on a filesystem without fallocate() the file just grows as it is written.
+static void preallocate(FILE* f, double bytes)
+{
+    if (bytes > 0) {
+        fallocate(fileno(f), FALLOC_FL_KEEP_SIZE, 0, (off_t) bytes);
+    }
+}
+
+//Closes a file of a chunk, giving back the space preallocated past what was written
+static void close_chunk_file(FILE** f)
+{
+    if (*f != NULL) {
+        fflush(*f);
+        if (ftruncate(fileno(*f), ftello(*f)) < 0) {
+            //the file is complete either way, only the spare blocks stay allocated
+        }
+        fclose(*f);
+        *f = NULL;
+    }
+}
+
+//Creates the file or archive of a channel after the first in a chunk, named after the Encoder file or archive of
+//the chunk with _chN. scale is as for open_chunk(), sizing it after the channel's current one, 0 for the nominal
+//rate.
+static int create_channel(struct receiver* r, uint32_t channel, unsigned int chunk, double scale, FILE** file,
+                          struct run_archive_writer* archive)
+{
+    char name[4096], path[4096];
+    double margin = r->config.chunk_s * 1.25;
+    const char* base = r->config.archive_dir != NULL ? r->config.archive_dir : r->config.encoder_path;
+
+    if (chunk_path(name, sizeof(name), base, r->config.chunk_s, chunk) < 0 ||
+        channel_path(path, sizeof(path), name, channel) < 0) {
+        return -1;
+    }
+    if (r->config.archive_dir != NULL) {
+        const struct run_archive_writer* current = &r->channel_archives[channel];
+        uint64_t edges = r->channel_archive_open[channel] ? current->n_edges : 0;
+        uint64_t frames = r->channel_archive_open[channel] ? current->n_irig : 0;
+        if (run_archive_create(archive, path, r->config.archive_packed) < 0) {
+            return -1;
+        }
+        if (r->config.chunk_s > 0) {
+            run_archive_preallocate(archive, scale > 0 ? edges * scale : margin * NOMINAL_EDGES_PER_S,
+                                    scale > 0 ? frames * scale : margin);
+        }
+        return 0;
+    }
+    double bytes = r->channel_files[channel] != NULL ? ftello(r->channel_files[channel]) * scale : 0;
+    if ((*file = create_csv(path, ENCODER_CSV_HEADER)) == NULL) {
+        return -1;
+    }
+    if (r->config.chunk_s > 0) {
+        preallocate(*file, scale > 0 ? bytes : margin * NOMINAL_EDGES_PER_S * NOMINAL_CSV_EDGE_BYTES);
+    }
+    return 0;
+}
+
+//Closes the file or archive of a channel after the first
+static void close_channel(struct receiver* r, uint32_t channel)
+{
+    close_chunk_file(&r->channel_files[channel]);
+    if (r->channel_archive_open[channel]) {
+        run_archive_close_writer(&r->channel_archives[channel]);
+        r->channel_archive_open[channel] = 0;
+    }
+}
+
+//Moves every channel after the first that has a file or archive on to the chunk, all or none of them
+static int open_chunk_channels(struct receiver* r, unsigned int chunk, double scale)
+{
+    FILE* files[PRU_MAX_CHANNELS] = { NULL };
+    struct run_archive_writer archives[PRU_MAX_CHANNELS];
+    uint32_t c;
+
+    for (c = 1; c < PRU_MAX_CHANNELS; c++) {
+        if (channel_open(r, c) && create_channel(r, c, chunk, scale, &files[c], &archives[c]) < 0) {
+            int err = errno;
+            while (--c > 0) {
+                if (channel_open(r, c) && r->config.archive_dir != NULL) {
+                    run_archive_close_writer(&archives[c]);
+                }
+                close_chunk_file(&files[c]);
+            }
+            errno = err;
+            return -1;
+        }
+    }
+    for (c = 1; c < PRU_MAX_CHANNELS; c++) {
+        if (channel_open(r, c)) {
+            int archived = r->channel_archive_open[c];
+            close_channel(r, c);
+            r->channel_files[c] = files[c];
+            r->channel_archives[c] = archives[c];
+            r->channel_archive_open[c] = archived;
+        }
+    }
+    return 0;
+}
+
+//Creates the files of a chunk, those of the channels after the first included. scale is the size of a chunk over
+//what the current one holds, 0 sizes the first chunk for the nominal rate.
+static int open_chunk(struct receiver* r, unsigned int chunk, double scale)
+{
+    char path[4096];
+    double margin = r->config.chunk_s * 1.25;
+
+    if (r->config.archive_dir != NULL) {
+        uint64_t edges = r->archive_open ? r->archive.n_edges : 0, frames = r->archive_open ? r->archive.n_irig : 0;
+        if (chunk_path(path, sizeof(path), r->config.archive_dir, r->config.chunk_s, chunk) < 0 ||
+            run_archive_create(&r->archive, path, r->config.archive_packed) < 0) {
+            return -1;
+        }
+        if (open_chunk_channels(r, chunk, scale) < 0) {
+            int err = errno;
+            run_archive_close_writer(&r->archive);
+            errno = err;
+            return -1;
+        }
+        if (r->config.chunk_s > 0) {
+            run_archive_preallocate(&r->archive, scale > 0 ? edges * scale : margin * NOMINAL_EDGES_PER_S,
+                                    scale > 0 ? frames * scale : margin);
+        }
+        r->archive_open = 1;
+        return 0;
+    }
+    double encoder_bytes = r->encoder_file != NULL ? ftello(r->encoder_file) * scale : 0;
+    double irig_bytes = r->irig_file != NULL ? ftello(r->irig_file) * scale : 0;
+    FILE* encoder_file = NULL;
+    FILE* irig_file = NULL;
+    if (chunk_path(path, sizeof(path), r->config.encoder_path, r->config.chunk_s, chunk) < 0 ||
+        (encoder_file = create_csv(path, ENCODER_CSV_HEADER)) == NULL ||
+        chunk_path(path, sizeof(path), r->config.irig_path, r->config.chunk_s, chunk) < 0 ||
+        (irig_file = create_csv(path, IRIG_CSV_HEADER)) == NULL || open_chunk_channels(r, chunk, scale) < 0) {
+        int err = errno;
+        if (encoder_file != NULL) {
+            fclose(encoder_file);
+        }
+        if (irig_file != NULL) {
+            fclose(irig_file);
+        }
+        errno = err;
+        return -1;
+    }
+    if (r->config.chunk_s > 0) {
+        preallocate(encoder_file, scale > 0 ? encoder_bytes : margin * NOMINAL_EDGES_PER_S * NOMINAL_CSV_EDGE_BYTES);
+        preallocate(irig_file, scale > 0 ? irig_bytes : margin * NOMINAL_CSV_IRIG_BYTES);
+    }
+    close_chunk_file(&r->encoder_file);
+    close_chunk_file(&r->irig_file);
+    r->encoder_file = encoder_file;
+    r->irig_file = irig_file;
+    return 0;
+}
+
+//Moves on to the next chunk at the IRIG packet that crossed into it, so the packet is the first of the new chunk
+//A chunk that cannot be created is reported once and its data goes on into the current one until one can
+static void next_chunk(struct receiver* r, int64_t run_time)
+{
+    int64_t elapsed = run_time - r->chunk_start;
+    double scale = elapsed > 0 ? 1.25 * r->config.chunk_s / elapsed : 1.25;
+    struct run_archive_writer archive = r->archive;
+
+    if (open_chunk(r, r->chunk + 1, scale) < 0) {
+        if (r->stats.chunk_errors++ == 0) {
+            fprintf(stderr, "Could not create chunk %u: %s, writing on to chunk %u\n", r->chunk + 1, strerror(errno),
+                    r->chunk);
+        }
+        r->archive = archive;
+        return;
+    }
+    if (r->archive_open) {
+        run_archive_close_writer(&archive);
+    }
+    r->chunk += 1;
+    r->chunk_start = run_time - run_time % r->config.chunk_s;
+    if (!r->config.quiet) {
+        printf("Chunk %u starts at run time %lld s\n", r->chunk, (long long) run_time);
+    }
+}
+
+//Seconds since the midnight before the run, on which the clock model runs. From the date when the frame has
+//one, otherwise by counting the times the time of day goes backwards as account_for_next_day() does.
+static int64_t run_seconds(struct receiver* r, const struct irig_frame* f)
+{
+    long time_of_day = irig_frame_time_of_day(f);
+    int64_t t = irig_frame_unix_time(f);
+
+    if (t >= 0) {
+        if (r->midnight < 0) {
+            r->midnight = t - time_of_day - r->day_offset;
+        }
+        r->day_offset = t - time_of_day - r->midnight;
+    } else if (r->last_time_of_day >= 0 && time_of_day < r->last_time_of_day) {
+        r->day_offset += 24 * 3600;
+    }
+    r->last_time_of_day = time_of_day;
+    return r->day_offset + time_of_day;
+}
+
+//What's written to the Clock file, one row per IRIG packet:
+//[time of day, IRIG_FRAME_BAD_* bits, rising edge clock count, pulses used by the model, model time at the
+// rising edge - frame time in s, rate - 1 in ppm, pulse rms in s, 1 sigma error of the model at the rising edge
+// in s, times the model started over]
+//The model columns are empty until it has locked.
+static void write_clock(struct receiver* r, const struct irig_frame* f, int bad, uint64_t rising_edge_time, int used)
+{
+    if (r->clock_file == NULL) {
+        return;
+    }
+    fprintf(r->clock_file, "%ld,%d,%llu,%d", irig_frame_time_of_day(f), bad, (unsigned long long) rising_edge_time, used);
+    if (clock_model_locked(&r->clock)) {
+        double err;
+        double t = clock_model_time(&r->clock, rising_edge_time, &err);
+        fprintf(r->clock_file, ",%.3e,%.6f,%.3e,%.3e,%lu\r\n", t - (double) (r->day_offset + irig_frame_time_of_day(f)),
+                (r->clock.rate - 1) * 1e6, clock_model_sigma(&r->clock), err, r->clock.relocks);
+    } else {
+        fprintf(r->clock_file, ",,,,,%lu\r\n", r->clock.relocks);
+    }
+    fflush(r->clock_file);
+}
+
+//What's written to the IRIG file:
+//[UTC time in sec, clock count]
+//[]
+//[0, synch pulse clock count 1]
+//[...]
+//[9, synch pulse clock count 10]
+//[]
+static void write_irig(struct receiver* r, const uint8_t* data)
+{
+    struct IrigInfo irig;
+    struct irig_frame frame;
+    char buf[64 + 10 * 36];
+    char* p = buf;
+    uint64_t sync_clock[10];
+
+    memcpy(&irig, data, sizeof(irig));
+    int bad = irig_frame_decode(irig.info, &frame);
+    long current_time = irig_frame_time_of_day(&frame);
+    uint64_t rising_edge_time = irig.rising_edge_time + ((uint64_t) irig.init_overflow << 32);
+    for (int x = 0; x < 10; x++) {
+        sync_clock[x] = irig.re_count[x] + ((uint64_t) irig.re_count_overflow[x] << 32);
+    }
+
+    r->stats.irig_packets += 1;
+    int64_t run = 0, run_time = 0;
+    if (!bad) {
+        run = run_seconds(r, &frame);
+        if (r->is_start) {
+            r->start_time = run;
+            r->is_start = 0;
+        }
+        run_time = run - r->start_time;
+        if (r->config.chunk_s > 0 && run_time - r->chunk_start >= r->config.chunk_s) {
+            next_chunk(r, run_time);
+        }
+    }
+
+    if (r->ring_open) {
+        struct shm_record record = { .type = SHM_RECORD_IRIG };
+        record.irig.rising_edge_clock = rising_edge_time;
+        memcpy(record.irig.sync_clock, sync_clock, sizeof(sync_clock));
+        record.irig.irig_time = current_time;
+        memcpy(record.irig.info, irig.info, sizeof(record.irig.info));
+        shm_ring_publish(&r->ring, &record);
+    }
+    if (r->archive_open) {
+        //every channel's archive gets the IRIG packets too, so each one has its own IRIG-second index
+        run_archive_append_irig(&r->archive, current_time, rising_edge_time, sync_clock, irig.info);
+        r->stats.bytes_written += sizeof(struct archive_irig) + sizeof(struct archive_index_entry);
+        run_archive_flush(&r->archive);
+        for (int c = 1; c < PRU_MAX_CHANNELS; c++) {
+            if (r->channel_archive_open[c]) {
+                run_archive_append_irig(&r->channel_archives[c], current_time, rising_edge_time, sync_clock, irig.info);
+                r->stats.bytes_written += sizeof(struct archive_irig) + sizeof(struct archive_index_entry);
+                run_archive_flush(&r->channel_archives[c]);
+            }
+        }
+    } else {
+        p = put_row2(p, current_time, rising_edge_time);
+        p = put_blank_row(p);
+        for (int x = 0; x < 10; x++) {
+            p = put_row2(p, x, sync_clock[x]);
+        }
+        p = put_blank_row(p);
+        write_out(r, r->irig_file, buf, p - buf);
+
+        //IRIG packets come once a second, a good moment to push the files out to the kernel
+        fflush(r->encoder_file);
+        fflush(r->irig_file);
+        for (int c = 0; c < PRU_MAX_CHANNELS; c++) {
+            if (r->channel_files[c] != NULL) {
+                fflush(r->channel_files[c]);
+            }
+        }
+    }
+
+    if (bad) {
+        r->stats.irig_bad_frames += 1;
+        if (!r->config.quiet) {
+            printf("Bad IRIG frame (0x%x) at clock count %llu\n", bad, (unsigned long long) rising_edge_time);
+        }
+        write_clock(r, &frame, bad, rising_edge_time, 0);
+        return;
+    }
+    int used = clock_model_push_frame(&r->clock, run, rising_edge_time, sync_clock);
+    write_clock(r, &frame, bad, rising_edge_time, used);
+
+    if (!r->config.quiet) {
+        printf("Current Time: %d:%d:%d Run Time %lld:%lld:%lld Clock Count %llu", frame.hours, frame.minutes, frame.seconds,
+               (long long) run_time / 3600, (long long) run_time / 60 % 60, (long long) run_time % 60,
+               (unsigned long long) rising_edge_time);
+        if (frame.day_of_year) {
+            printf(" Day %d of 20%02d", frame.day_of_year, frame.year);
+        }
+        if (clock_model_locked(&r->clock)) {
+            printf(" Clock %+.3f ppm, %.0f ns rms", (r->clock.rate - 1) * 1e6, clock_model_sigma(&r->clock) * 1e9);
+        }
+        printf("\n");
+    }
+
+    if (r->jitter_open) {
+        angle_stream_push_irig(&r->angle, current_time, rising_edge_time);
+        feed_jitter(r);
+    }
+
+    if (r->config.runtime_s >= 0 && run_time >= r->config.runtime_s) {
+        r->done = 1;
+    }
+}
+
+//What's written to the Stats file, one row per packet:
+//[seq, uptime_ms, encoder_overruns, irig_overruns, the struct pru_telemetry fields in order]
+static void write_stats(struct receiver* r, const uint8_t* data, uint32_t size)
+{
+    const struct pru_telemetry* t = &r->last_stats.telemetry;
+    char buf[(6 + sizeof(struct pru_telemetry) / 4) * 12];
+    const uint32_t* word = (const uint32_t *) &r->last_stats.seq;
+    char* p = buf;
+
+    //newer forwarders may append fields, the ones known here always come first
+    if (size < sizeof(struct StatsPacket)) {
+        r->stats.other_packets += 1;
+        return;
+    }
+    memcpy(&r->last_stats, data, sizeof(r->last_stats));
+    r->stats.stats_packets += 1;
+    if (!r->config.quiet) {
+        printf("Stats %u: %u encoder packets (%u overruns, %u lost), %u IRIG frames (%u desyncs), %u send errors, "
+               "notice max %u us, send max %u us\n", r->last_stats.seq, t->encoder_packets, r->last_stats.encoder_overruns,
+               t->arm_encoder_lost, t->irig_frames, t->irig_desyncs, t->arm_send_errors, t->arm_notice_max_us,
+               t->arm_send_max_us);
+    }
+    if (r->stats_file == NULL) {
+        return;
+    }
+    for (size_t k = 0; k < 4 + sizeof(struct pru_telemetry) / 4; k++) {
+        if (k > 0) {
+            *p++ = ',';
+        }
+        p = put_u64(p, word[k]);
+    }
+    *p++ = '\r';
+    *p++ = '\n';
+    write_out(r, r->stats_file, buf, p - buf);
+    fflush(r->stats_file);
+}
+
+//Keeps the layout the Beaglebone was started with, printed whenever it changes
+static void write_layout(struct receiver* r, const uint8_t* data, uint32_t size)
+{
+    struct LayoutPacket layout;
+
+    //newer forwarders may append fields, the ones known here always come first
+    if (size < sizeof(layout)) {
+        r->stats.other_packets += 1;
+        return;
+    }
+    memcpy(&layout, data, sizeof(layout));
+    r->stats.layout_packets += 1;
+    if (!r->config.quiet && memcmp(&layout, &r->layout, sizeof(layout)) != 0) {
+        printf("Layout: %u encoder channels, %u edges per packet in %s mode, v%u packets, %u ring slots each\n",
+               layout.layout.n_channels, layout.layout.packet_edges, layout.config.quadrature ? "quadrature" : "edge",
+               layout.wire_version, layout.layout.slots);
+    }
+    r->layout = layout;
+}
+
+static void write_packet(struct receiver* r, const uint8_t* data, uint32_t size)
+{
+    uint32_t header;
+
+    memcpy(&header, data, sizeof(header));
+    switch (header) {
+    case ENCODER_HEADER:
+        write_encoder_v1(r, data);
+        break;
+    case ENCODER_V2_HEADER:
+        write_encoder_v2(r, data, size);
+        break;
+    case IRIG_HEADER:
+        write_irig(r, data);
+        break;
+    case ERROR_HEADER:
+        //Sent if there is a timing error in the synchronization pulses of the IRIG packet
+        printf("Packet Error\n");
+        r->stats.error_packets += 1;
+        break;
+    case STATS_HEADER:
+        write_stats(r, data, size);
+        break;
+    case LAYOUT_HEADER:
+        write_layout(r, data, size);
+        break;
+    default:
+        r->stats.other_packets += 1;
+        break;
+    }
+}
+
+//replay_window callback, packets come in the order the forwarder sent them
+static void deliver_replayed(void* ctx, const uint8_t* packet, uint32_t size)
+{
+    struct receiver* r = ctx;
+
+    //once runtime_s is reached the rest is only handed back, like encoderDAQ_BB.py stopping
+    if (!r->done) {
+        write_packet(r, packet, size);
+    }
+}
+
+//replay_window callback, asks the forwarder for missing packets
+static void send_nack(void* ctx, const struct nack_range* ranges, int n_ranges)
+{
+    struct receiver* r = ctx;
+    struct nack_packet nack;
+
+    nack.header = NACK_HEADER;
+    nack.size = 12 + n_ranges * sizeof(struct nack_range);
+    nack.n_ranges = n_ranges;
+    memcpy(nack.ranges, ranges, n_ranges * sizeof(struct nack_range));
+    sendto(r->fd, &nack, nack.size, 0, (const struct sockaddr *) &r->replay_source, sizeof(r->replay_source));
+}
+
+static void write_block(struct receiver* r, struct receiver_block* block)
+{
+    for (int k = 0; k < block->n_packets && !r->done; k++) {
+        const uint8_t* data = (const uint8_t *) block->data + block->packets[k].offset;
+        uint32_t header;
+        memcpy(&header, data, sizeof(header));
+        if (header == REPLAY_HEADER) {
+            r->replay_source = block->source;
+            replay_window_push(&r->replay, data, block->packets[k].size, now_ns());
+        } else {
+            write_packet(r, data, block->packets[k].size);
+        }
+    }
+}
+
+static void* writer_thread(void* arg)
+{
+    struct receiver* r = arg;
+    uint32_t index;
+
+    while (1) {
+        replay_window_poll(&r->replay, now_ns()); //NACKs are sent from here, as soon as a gap is seen
+        if (spsc_queue_pop(&r->filled, &index)) {
+            //once runtime_s is reached the rest is only handed back, like encoderDAQ_BB.py stopping
+            write_block(r, &r->pool[index]);
+            spsc_queue_push(&r->free, index);
+            continue;
+        }
+        if (r->rx_done) {
+            __sync_synchronize(); //the last block was pushed before rx_done was set
+            if (r->filled.head == r->filled.tail) {
+                break;
+            }
+            continue;
+        }
+        idle();
+    }
+    replay_window_flush(&r->replay); //whatever is still held goes out, the gaps stay gaps
+    if (r->archive_open) {
+        run_archive_flush(&r->archive);
+        for (int c = 1; c < PRU_MAX_CHANNELS; c++) {
+            if (r->channel_archive_open[c]) {
+                run_archive_flush(&r->channel_archives[c]);
+            }
+        }
+    } else {
+        fflush(r->encoder_file);
+        fflush(r->irig_file);
+        for (int c = 0; c < PRU_MAX_CHANNELS; c++) {
+            if (r->channel_files[c] != NULL) {
+                fflush(r->channel_files[c]);
+            }
+        }
+    }
+    return NULL;
+}
+
+//Splits a datagram into packets with the framing rules in udp_batch.h
+//Returns 0 if the datagram is malformed, the packets before the bad one are kept
+static int split(struct receiver_block* block, uint32_t offset, size_t len)
+{
+    const uint8_t* data = (const uint8_t *) block->data + offset;
+    size_t pos = 0;
+
+    while (pos < len) {
+        uint32_t header, size;
+        if (pos + 4 > len) {
+            return 0;
+        }
+        memcpy(&header, data + pos, 4);
+        if (header == ENCODER_HEADER) {
+            size = sizeof(struct CompleteDataPackets);
+        } else if (header == IRIG_HEADER) {
+            size = sizeof(struct IrigInfo);
+        } else if (header == ERROR_HEADER) {
+            size = sizeof(struct ErrorInfo);
+        } else if (pos + 8 <= len) {
+            memcpy(&size, data + pos + 4, 4);
+        } else {
+            size = 0;
+        }
+        if (size < 4 || pos + size > len || block->n_packets == RECEIVER_MAX_PACKETS) {
+            return 0;
+        }
+        block->packets[block->n_packets].offset = offset + pos;
+        block->packets[block->n_packets].size = size;
+        block->n_packets += 1;
+        pos += size;
+    }
+    return 1;
+}
+
+//Column names of the Stats file, in the order of struct StatsPacket after the header and size
+static const char* stats_columns(void)
+{
+    static char header[2048];
+    char* p = header;
+
+    p += sprintf(p, "seq,uptime_ms,encoder_overruns,irig_overruns,encoder_edges,encoder_packets,encoder_max_gap,"
+                 "irig_frames,irig_desyncs,irig_bad_pulses,irig_max_gap,pru_reserved,arm_encoder_sent,arm_irig_sent,"
+                 "arm_error_sent,arm_encoder_lost,arm_irig_lost,arm_datagrams,arm_send_errors,arm_wakeups,"
+                 "arm_notice_max_us,arm_send_max_us");
+    for (int k = 0; k < TELEMETRY_HIST_BINS; k++) {
+        p += sprintf(p, ",notice_hist_%d", k);
+    }
+    for (int k = 0; k < TELEMETRY_HIST_BINS; k++) {
+        p += sprintf(p, ",send_hist_%d", k);
+    }
+    sprintf(p, ",arm_nacks,arm_retransmitted,arm_replay_expired\r\n");
+    return header;
+}
+
+int receiver_open(struct receiver* r, const struct receiver_config* config)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    struct timeval tv = { .tv_sec = 0, .tv_usec = RECEIVER_TIMEOUT_US };
+    int one = 1;
+
+    memset(r, 0, sizeof(*r));
+    r->config = *config;
+    r->is_start = 1;
+    r->midnight = -1;
+    r->last_time_of_day = -1;
+    clock_model_init(&r->clock, 0, 0, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config->port);
+    if (inet_pton(AF_INET, config->ip, &addr.sin_addr) != 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((r->fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        return -1;
+    }
+    r->rcvbuf = RECEIVER_RCVBUF;
+    setsockopt(r->fd, SOL_SOCKET, SO_RCVBUF, &r->rcvbuf, sizeof(r->rcvbuf));
+    len = sizeof(r->rcvbuf);
+    getsockopt(r->fd, SOL_SOCKET, SO_RCVBUF, &r->rcvbuf, &len);
+    setsockopt(r->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(r->fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)); //reports kernel drops with every datagram
+    len = sizeof(addr);
+    if (bind(r->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || getsockname(r->fd, (struct sockaddr *) &addr, &len) < 0) {
+        close(r->fd);
+        return -1;
+    }
+    r->port = ntohs(addr.sin_port);
+
+    if ((r->pool = malloc(RECEIVER_BLOCKS * sizeof(struct receiver_block))) == NULL ||
+        replay_window_init(&r->replay, 0, 0, deliver_replayed, send_nack, r) < 0) {
+        free(r->pool);
+        close(r->fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    spsc_queue_init(&r->filled);
+    spsc_queue_init(&r->free);
+    for (uint32_t k = 0; k < RECEIVER_BLOCKS; k++) {
+        spsc_queue_push(&r->free, k);
+    }
+
+    if (open_chunk(r, 0, 0) < 0) {
+        int err = errno;
+        receiver_close(r);
+        errno = err;
+        return -1;
+    }
+    if (config->stats_path != NULL && (r->stats_file = create_csv(config->stats_path, stats_columns())) == NULL) {
+        int err = errno;
+        receiver_close(r);
+        errno = err;
+        return -1;
+    }
+    if (config->clock_path != NULL &&
+        (r->clock_file = create_csv(config->clock_path, "time_of_day,bad,rising_edge_clock,pulses_used,residual_s,rate_ppm,"
+                                    "sigma_s,error_s,relocks\r\n")) == NULL) {
+        int err = errno;
+        receiver_close(r);
+        errno = err;
+        return -1;
+    }
+    if (config->shm_path != NULL) {
+        if (shm_ring_create(&r->ring, config->shm_path) < 0) {
+            int err = errno;
+            receiver_close(r);
+            errno = err;
+            return -1;
+        }
+        r->ring_open = 1;
+    }
+    if (config->jitter_period_s > 0) {
+        if (angle_stream_init(&r->angle, 0, 0) < 0) {
+            receiver_close(r);
+            errno = ENOMEM;
+            return -1;
+        }
+        if (jitter_monitor_init(&r->jitter, JITTER_WINDOW, JITTER_WINDOW / 2, 0, 0, config->jitter_period_s,
+                                publish_jitter, r) < 0) {
+            angle_stream_free(&r->angle);
+            receiver_close(r);
+            errno = ENOMEM;
+            return -1;
+        }
+        angle_stream_set_clock_model(&r->angle, &r->clock);
+        r->jitter_open = 1;
+    }
+
+    if ((errno = pthread_create(&r->writer, NULL, writer_thread, r)) != 0) {
+        int err = errno;
+        receiver_close(r);
+        errno = err;
+        return -1;
+    }
+    r->writer_running = 1;
+    return 0;
+}
+
+int receiver_run(struct receiver* r, volatile int* stop)
+{
+    struct mmsghdr msgs[RECEIVER_BATCH];
+    struct iovec iov[RECEIVER_BATCH];
+    struct sockaddr_in source[RECEIVER_BATCH];
+    char control[RECEIVER_BATCH][CMSG_SPACE(sizeof(uint32_t))];
+    struct receiver_block* block = NULL;
+    uint32_t index = 0;
+    long idle_us = 0;
+    int error = 0;
+
+    while (!*stop && !r->done) {
+        //a fresh block from the pool, waiting for the writer if it has all of them
+        if (block == NULL) {
+            if (!spsc_queue_pop(&r->free, &index)) {
+                r->stats.stalls += 1;
+                idle();
+                continue;
+            }
+            block = &r->pool[index];
+            block->n_packets = 0;
+        }
+        for (int k = 0; k < RECEIVER_BATCH; k++) {
+            iov[k].iov_base = block->data[k];
+            iov[k].iov_len = RECEIVER_MAX_DATAGRAM;
+            memset(&msgs[k], 0, sizeof(msgs[k]));
+            msgs[k].msg_hdr.msg_iov = &iov[k];
+            msgs[k].msg_hdr.msg_iovlen = 1;
+            msgs[k].msg_hdr.msg_name = &source[k];
+            msgs[k].msg_hdr.msg_namelen = sizeof(source[k]);
+            msgs[k].msg_hdr.msg_control = control[k];
+            msgs[k].msg_hdr.msg_controllen = sizeof(control[k]);
+        }
+
+        //blocks for the first datagram and then takes whatever else is already queued
+        int n = recvmmsg(r->fd, msgs, RECEIVER_BATCH, MSG_WAITFORONE, NULL);
+        r->stats.syscalls += 1;
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            //anything but the SO_RCVTIMEO timeout or a signal will not go away by calling again
+            error = errno;
+            perror("recvmmsg");
+            break;
+        }
+        if (n <= 0) {
+            //If you see 'Looking for data ...' make sure that the Beaglebone has been set up properly
+            if ((idle_us += RECEIVER_TIMEOUT_US) >= LOOKING_FOR_DATA_US) {
+                printf("Looking for data ...\n");
+                idle_us = 0;
+            }
+            continue;
+        }
+        idle_us = 0;
+        block->source = source[n - 1];
+
+        for (int k = 0; k < n; k++) {
+            struct msghdr* h = &msgs[k].msg_hdr;
+            r->stats.datagrams += 1;
+            for (struct cmsghdr* c = CMSG_FIRSTHDR(h); c != NULL; c = CMSG_NXTHDR(h, c)) {
+                if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+                    uint32_t drops;
+                    memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+                    r->stats.kernel_drops = drops; //running total for the socket
+                }
+            }
+            if (h->msg_flags & MSG_TRUNC) {
+                r->stats.truncated += 1;
+                continue;
+            }
+            if (!split(block, (uint32_t) k * RECEIVER_MAX_DATAGRAM, msgs[k].msg_len)) {
+                r->stats.bad += 1;
+            }
+        }
+        spsc_queue_push(&r->filled, index); //cannot fail, the queue is larger than the pool
+        block = NULL;
+    }
+
+    if (block != NULL) {
+        spsc_queue_push(&r->free, index);
+    }
+    __sync_synchronize(); //every filled block is visible before rx_done
+    r->rx_done = 1;
+    if (r->writer_running) {
+        pthread_join(r->writer, NULL);
+        r->writer_running = 0;
+    }
+    errno = error;
+    return error != 0 ? -1 : 0;
+}
+
+void receiver_close(struct receiver* r)
+{
+    if (r->writer_running) {
+        r->rx_done = 1;
+        pthread_join(r->writer, NULL);
+        r->writer_running = 0;
+    }
+    close_chunk_file(&r->encoder_file);
+    close_chunk_file(&r->irig_file);
+    for (int c = 1; c < PRU_MAX_CHANNELS; c++) {
+        close_channel(r, c);
+    }
+    if (r->stats_file != NULL) {
+        fclose(r->stats_file);
+        r->stats_file = NULL;
+    }
+    if (r->clock_file != NULL) {
+        fclose(r->clock_file);
+        r->clock_file = NULL;
+    }
+    if (r->archive_open) {
+        run_archive_close_writer(&r->archive);
+        r->archive_open = 0;
+    }
+    if (r->jitter_open) {
+        jitter_monitor_free(&r->jitter);
+        angle_stream_free(&r->angle);
+        r->jitter_open = 0;
+    }
+    if (r->ring_open) {
+        shm_ring_close(&r->ring);
+        r->ring_open = 0;
+    }
+    free(r->pool);
+    r->pool = NULL;
+    replay_window_free(&r->replay);
+    if (r->fd >= 0) {
+        close(r->fd);
+        r->fd = -1;
+    }
+}
@@ -0,0 +1,172 @@
+//Receives the packets sent by Beaglebone_Encoder_DAQ and records them in the same CSV files as encoderDAQ_BB.py,
+//or in a binary run archive (run_archive.h)
+//
+//The calling thread receives: recvmmsg() fills a block from a preallocated pool with up to RECEIVER_BATCH
+//datagrams, the datagrams are split into packets with the framing rules in ../Beaglebone/udp_batch.h and the
+//block is handed to the writer thread through a lock-free queue. The writer thread formats the packets as CSV
+//rows, writes them out and hands the block back through a second queue. Neither thread ever blocks on the
+//other unless the whole pool is waiting to be written.
+//
+//Stats packets (0x57A7) with the Beaglebone's PRU and ARM telemetry are written one row each to a CSV file of
+//their own, whether the data goes to CSV files or to an archive.
+//
+//Every IRIG frame is decoded in full (irig_frame.h) and its pulses go into a model of UTC against the IEP clock
+//(clock_model.h). A row per frame with the state of the model, error bars included, goes to the Clock CSV file.
+//Frames that do not decode are still recorded as they came, but are not used for the run time or the model.
+//
+//With chunk_s set the Encoder and IRIG files (or the archive) are rolled over every chunk_s seconds of IRIG time,
+//so a run can go on for as long as the Beaglebone sends. Chunk k is written to the configured path with _kkkk
+//in front of the .csv, and starts with the IRIG packet that crossed into it, so every packet is in exactly one
+//chunk and every chunk can be timed on its own. New files are preallocated with fallocate() for the data the
+//last chunk held, a quarter more to spare, so appending never waits for the filesystem to find blocks, and
+//what was not used is given back when a chunk is closed. The Stats and Clock files are small and cover the run.
+//
+//Packets from a forwarder with replay on (../Beaglebone/replay_buffer.h) come numbered. The writer thread puts them
+//back in order in a replay window (replay_window.h) and sends NACKs for the missing ones back to the address they
+//came from, from the same socket, so the files hold every packet in the order it was sent whatever the network
+//lost. Packets without numbers are written as they come.
+//
+//With shm_path set the writer thread also publishes every encoder and IRIG packet, decoded, into a memory mapped
+//ring (shm_ring.h) that any number of other processes can follow while the files are written.
+//
+//Layout packets (0x1A70) tell the packet size and encoder channels the Beaglebone was started with. Channel 0 goes
+//to the Encoder file (or the archive) as before. Every other channel has a CSV file of its own in the same
+//format, named after the Encoder file of the chunk with _chN in front of the .csv, or with archive_dir set an
+//archive named after the chunk's with _chN, which gets the IRIG packets as well. They are opened at the channel's
+//first packet and then rolled over and preallocated along with the chunks. Every channel goes into the ring, each
+//record marked with its channel. Once a layout packet has come, encoder packets of a channel it does not list,
+//of another size or mode are counted as mismatches, but still written.
+//
+//With jitter_period_s set the writer thread also reconstructs the angle (angle_stream.h) and runs the jitter
+//monitor (jitter_monitor.h) on it, rewriting the jitter PSD file every jitter_period_s seconds of data.
+
+#ifndef RECEIVER_H
+#define RECEIVER_H
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/socket.h>
+
+#include "angle_stream.h"
+#include "clock_model.h"
+#include "irig_frame.h"
+#include "jitter_monitor.h"
+#include "pru_layout.h"
+#include "replay_window.h"
+#include "run_archive.h"
+#include "shm_ring.h"
+#include "spsc_queue.h"
+
+#define RECEIVER_BATCH 64 //datagrams per recvmmsg() call and per block
+#define RECEIVER_MAX_DATAGRAM 9216 //larger than UDP_BATCH_MAX_DATAGRAM_SIZE, bigger datagrams are counted as truncated
+#define RECEIVER_MAX_PACKETS 4096 //packets per block, the rest of a datagram is dropped if a block runs out
+#define RECEIVER_BLOCKS 16 //blocks in the pool, must be less than SPSC_QUEUE_SIZE
+
+//Where a packet sits inside its block
+struct receiver_packet {
+    uint32_t offset; //bytes from the start of the block data
+    uint32_t size;
+};
+
+struct receiver_block {
+    int n_packets;
+    struct sockaddr_in source; //where the last datagram came from, NACKs go back there
+    struct receiver_packet packets[RECEIVER_MAX_PACKETS];
+    uint8_t data[RECEIVER_BATCH][RECEIVER_MAX_DATAGRAM];
+};
+
+struct receiver_config {
+    const char* ip; //address to bind to
+    int port; //0 picks a free port, see receiver.port
+    const char* encoder_path; //Encoder_Data CSV file
+    const char* irig_path; //IRIG_Data CSV file
+    const char* archive_dir; //when set a binary archive is written to this directory instead of the CSV files
+    int archive_packed; //packs the edges of the archive (edge_codec.h)
+    long runtime_s; //stop once the IRIG time is this many seconds past the first IRIG packet, -1 runs until stopped
+    long chunk_s; //IRIG seconds per output chunk, 0 writes one set of files for the whole run
+    int quiet; //do not print the time of every IRIG packet
+    double jitter_period_s; //seconds of data between jitter PSD updates, 0 turns the jitter monitor off
+    const char* jitter_path; //jitter PSD CSV file, replaced as a whole at every update
+    const char* stats_path; //Stats CSV file, NULL skips the stats packets
+    const char* clock_path; //Clock CSV file, NULL does not write it
+    const char* shm_path; //ring the decoded packets are published into, normally under /dev/shm, NULL for none
+};
+
+//Counters, written by the thread named in the comment and safe to read from any thread
+struct receiver_stats {
+    unsigned long int datagrams; //receive thread
+    unsigned long int syscalls; //receive thread, recvmmsg() calls
+    unsigned long int truncated; //receive thread, datagrams larger than RECEIVER_MAX_DATAGRAM
+    unsigned long int bad; //receive thread, datagrams with a bad header or a packet running past the end
+    unsigned long int stalls; //receive thread, times the pool was empty because the writer fell behind
+    unsigned long int kernel_drops; //receive thread, datagrams the kernel dropped because the socket buffer was full
+    unsigned long int encoder_packets; //writer thread, encoder packets written (v1 and v2) of channel 0
+    unsigned long int channel_packets; //writer thread, encoder packets of the other channels written to their files
+    unsigned long int channel_skipped; //writer thread, encoder packets of the other channels with nowhere to go
+    unsigned long int layout_packets; //writer thread
+    unsigned long int layout_mismatches; //writer thread, encoder packets of a channel, size or mode the layout does not have
+    unsigned long int irig_packets; //writer thread
+    unsigned long int irig_bad_frames; //writer thread, IRIG packets that did not decode
+    unsigned long int chunk_errors; //writer thread, chunks that could not be opened, their data went to the one before
+    unsigned long int error_packets; //writer thread
+    unsigned long int stats_packets; //writer thread
+    unsigned long int other_packets; //writer thread, unknown types that were skipped
+    unsigned long int bytes_written; //writer thread
+};
+
+struct receiver {
+    struct receiver_config config;
+    int fd;
+    int port; //port the socket is bound to
+    int rcvbuf; //socket receive buffer the kernel granted
+    FILE* encoder_file;
+    FILE* irig_file;
+    FILE* stats_file;
+    FILE* clock_file;
+    FILE* channel_files[PRU_MAX_CHANNELS]; //writer thread, channels after the first in the current chunk
+    struct run_archive_writer channel_archives[PRU_MAX_CHANNELS]; //writer thread, the same with archive_dir set
+    int channel_archive_open[PRU_MAX_CHANNELS];
+    struct StatsPacket last_stats; //writer thread, the latest stats packet received, header 0 until there is one
+    struct LayoutPacket layout; //writer thread, the latest layout packet received, header 0 until there is one
+    struct run_archive_writer archive;
+    int archive_open;
+    struct angle_stream angle;
+    struct jitter_monitor jitter;
+    int jitter_open;
+    struct shm_ring ring; //writer thread
+    int ring_open;
+    struct replay_window replay; //writer thread
+    struct sockaddr_in replay_source; //writer thread, the forwarder's address
+    struct receiver_block* pool;
+    struct spsc_queue filled; //blocks waiting to be written, receive thread -> writer thread
+    struct spsc_queue free; //blocks ready to be reused, writer thread -> receive thread
+    pthread_t writer;
+    int writer_running;
+    volatile int rx_done; //set by the receive thread once it has queued its last block
+    volatile int done; //set by the writer thread once runtime_s is reached
+    //IRIG time bookkeeping, as in EncoderParser.pretty_print_irig_info(), run times are seconds since start_time
+    int is_start;
+    int64_t start_time; //run_seconds() of the first frame that decoded
+    unsigned int chunk; //writer thread, index of the chunk being written
+    int64_t chunk_start; //writer thread, run time the chunk began at
+    struct clock_model clock; //writer thread, fed every IRIG frame that decodes
+    int64_t midnight; //Unix time of the midnight before the run, -1 until a frame with a date comes
+    int64_t day_offset; //seconds from that midnight to the one before the latest frame
+    long last_time_of_day; //-1 before the first frame
+    struct receiver_stats stats;
+};
+
+//Binds the socket, allocates the pool, creates the CSV files with their headers and starts the writer thread
+//Returns 0 on success, -1 with errno set otherwise
+int receiver_open(struct receiver* r, const struct receiver_config* config);
+
+//Receives until runtime_s is reached or *stop becomes non-zero, then waits for the writer to catch up
+//Returns 0, or -1 with errno set if the socket failed and receiving stopped early. What came before is written.
+int receiver_run(struct receiver* r, volatile int* stop);
+
+//Stops the writer thread, closes the files and the socket
+void receiver_close(struct receiver* r);
+
+#endif
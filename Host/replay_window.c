@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay_window.h"
+
+int replay_window_init(struct replay_window* w, long retry_us, uint32_t max_nacks, replay_deliver_fn deliver,
+                       replay_nack_fn nack, void* ctx)
+{
+    memset(w, 0, sizeof(*w));
+    w->slots = calloc(REPLAY_WINDOW_SLOTS, sizeof(struct replay_slot));
+    w->data = malloc((size_t) REPLAY_WINDOW_SLOTS * REPLAY_WINDOW_SLOT_SIZE);
+    if (w->slots == NULL || w->data == NULL) {
+        replay_window_free(w);
+        return -1;
+    }
+    w->retry_us = retry_us > 0 ? retry_us : REPLAY_WINDOW_RETRY_US;
+    w->max_nacks = max_nacks > 0 ? max_nacks : REPLAY_WINDOW_MAX_NACKS;
+    w->deliver = deliver;
+    w->nack = nack;
+    w->ctx = ctx;
+    return 0;
+}
+
+void replay_window_free(struct replay_window* w)
+{
+    free(w->slots);
+    free(w->data);
+    w->slots = NULL;
+    w->data = NULL;
+}
+
+static struct replay_slot* slot(struct replay_window* w, uint32_t seq)
+{
+    return &w->slots[seq % REPLAY_WINDOW_SLOTS];
+}
+
+//One past the last number of the window that has been seen or skipped over
+static uint32_t limit(const struct replay_window* w)
+{
+    return w->end - w->next < REPLAY_WINDOW_SLOTS ? w->end : w->next + REPLAY_WINDOW_SLOTS;
+}
+
+//Numbers that come into the window start out missing
+static void enter(struct replay_window* w, uint32_t from, uint32_t to)
+{
+    for (uint32_t seq = from; seq != to; seq++) {
+        *slot(w, seq) = (struct replay_slot) { 0 };
+        w->missing += 1;
+    }
+}
+
+//Moves past the next packet, delivered or given up on, which lets one more number into the window
+static void advance(struct replay_window* w)
+{
+    uint32_t old_limit = limit(w);
+    w->next += 1;
+    enter(w, old_limit, limit(w));
+}
+
+//Delivers the held packets from next on, up to the first missing one
+static void deliver_held(struct replay_window* w)
+{
+    while (w->next != w->end && slot(w, w->next)->size != 0) {
+        struct replay_slot* s = slot(w, w->next);
+        w->deliver(w->ctx, w->data + (size_t) (w->next % REPLAY_WINDOW_SLOTS) * REPLAY_WINDOW_SLOT_SIZE, s->size);
+        advance(w);
+    }
+}
+
+void replay_window_flush(struct replay_window* w)
+{
+    while (w->next != w->end) {
+        struct replay_slot* s = slot(w, w->next);
+        if (s->size != 0) {
+            w->deliver(w->ctx, w->data + (size_t) (w->next % REPLAY_WINDOW_SLOTS) * REPLAY_WINDOW_SLOT_SIZE, s->size);
+        } else {
+            w->missing -= 1;
+            w->lost += 1;
+        }
+        advance(w);
+    }
+}
+
+void replay_window_push(struct replay_window* w, const uint8_t* wrapped, uint32_t size, uint64_t now_ns)
+{
+    struct replay_header h;
+    const uint8_t* packet = wrapped + sizeof(h);
+    uint32_t packet_size = size - sizeof(h);
+
+    w->packets += 1;
+    if (size < sizeof(h) + 4 || packet_size > REPLAY_WINDOW_SLOT_SIZE) {
+        w->bad += 1;
+        return;
+    }
+    memcpy(&h, wrapped, sizeof(h));
+    if (!w->started) {
+        w->started = 1;
+        w->next = w->end = h.seq;
+        w->poll_ns = now_ns;
+    }
+    int32_t behind = (int32_t) (w->next - h.seq);
+    if (behind > 0) {
+        if (behind <= REPLAY_WINDOW_SLOTS) {
+            w->duplicates += 1;
+            return;
+        }
+        replay_window_flush(w);
+        w->restarts += 1;
+        w->next = w->end = h.seq;
+    }
+
+    //numbers up to this one that had not been seen are missing, this one is taken out again below
+    int gap = h.seq - w->next < w->end - w->next;
+    if (!gap) {
+        uint32_t old_limit = limit(w);
+        w->end = h.seq + 1;
+        enter(w, old_limit, limit(w));
+    }
+    if (h.seq - w->next >= REPLAY_WINDOW_SLOTS) {
+        w->deferred += 1;
+        return;
+    }
+    struct replay_slot* s = slot(w, h.seq);
+    if (s->size != 0) {
+        w->duplicates += 1;
+        return;
+    }
+    w->missing -= 1;
+    w->recovered += gap;
+    if (h.seq == w->next) {
+        w->deliver(w->ctx, packet, packet_size);
+        advance(w);
+        deliver_held(w);
+        return;
+    }
+    memcpy(w->data + (size_t) (h.seq % REPLAY_WINDOW_SLOTS) * REPLAY_WINDOW_SLOT_SIZE, packet, packet_size);
+    s->size = packet_size;
+}
+
+void replay_window_poll(struct replay_window* w, uint64_t now_ns)
+{
+    struct nack_range ranges[NACK_MAX_RANGES];
+    int n = 0;
+    uint64_t retry_ns = (uint64_t) w->retry_us * 1000;
+
+    if (w->missing == 0 || now_ns < w->poll_ns) {
+        return;
+    }
+    w->poll_ns = now_ns + REPLAY_WINDOW_POLL_US * 1000ull;
+
+    //the oldest packets have been asked for often enough
+    while (w->next != w->end) {
+        struct replay_slot* s = slot(w, w->next);
+        if (s->size != 0 || s->nacks < w->max_nacks || now_ns - s->nacked_ns < retry_ns) {
+            break;
+        }
+        w->missing -= 1;
+        w->lost += 1;
+        advance(w);
+        deliver_held(w);
+    }
+
+    for (uint32_t seq = w->next, end = limit(w); seq != end; seq++) {
+        struct replay_slot* s = slot(w, seq);
+        if (s->size != 0 || s->nacks >= w->max_nacks || (s->nacks > 0 && now_ns - s->nacked_ns < retry_ns)) {
+            continue;
+        }
+        s->nacks += 1;
+        s->nacked_ns = now_ns;
+        w->requested += 1;
+        if (n > 0 && ranges[n - 1].first + ranges[n - 1].count == seq) {
+            ranges[n - 1].count += 1;
+            continue;
+        }
+        if (n == NACK_MAX_RANGES) {
+            w->nack(w->ctx, ranges, n);
+            w->nack_packets += 1;
+            n = 0;
+        }
+        ranges[n++] = (struct nack_range) { .first = seq, .count = 1 };
+    }
+    if (n > 0) {
+        w->nack(w->ctx, ranges, n);
+        w->nack_packets += 1;
+    }
+}
@@ -0,0 +1,82 @@
+//Puts the numbered packets of a forwarder with replay on (../Beaglebone/replay_buffer.h) back in order and asks
+//for the ones the network lost
+//
+//The window spans REPLAY_WINDOW_SLOTS numbers from the next packet to deliver. A packet that is next is
+//delivered at once, along with the held packets that follow it. One further ahead is copied into its slot and
+//held, one behind is a duplicate and is dropped. One past the end of the window is dropped too and asked for again
+//once the window gets there, so however long an outage lasts the packets after it come back in order.
+//
+//Numbers skipped over are missing. replay_window_poll() asks for them through the nack callback as soon as it sees
+//them, and again every retry_us while they stay missing. A packet still missing after max_nacks requests has
+//left the forwarder's ring or will not get through, and is given up on so the packets held behind it can go.
+//A packet lost for good therefore holds the stream up for max_nacks * retry_us at most.
+//
+//Numbers far behind the window mean the forwarder started over. Everything held is delivered and the window
+//starts again from there.
+
+#ifndef REPLAY_WINDOW_H
+#define REPLAY_WINDOW_H
+
+#include <stdint.h>
+
+#include "replay_buffer.h"
+
+#define REPLAY_WINDOW_SLOTS 1024 //about a minute of packets at 2 Hz
+#define REPLAY_WINDOW_SLOT_SIZE 4096 //larger than any packet the forwarder sends
+#define REPLAY_WINDOW_RETRY_US 200000 //default time between requests for a packet
+#define REPLAY_WINDOW_MAX_NACKS 10 //default requests before a packet is given up on
+#define REPLAY_WINDOW_POLL_US 1000 //shortest time between two scans of the window for missing packets
+
+struct replay_slot {
+    uint32_t size; //size of the packet held, 0 while it is missing
+    uint32_t nacks; //times it was asked for
+    uint64_t nacked_ns; //time it was last asked for
+};
+
+//Called with each packet in order, without its replay header
+typedef void (*replay_deliver_fn)(void* ctx, const uint8_t* packet, uint32_t size);
+
+//Called with ranges of missing packets to ask the forwarder for
+typedef void (*replay_nack_fn)(void* ctx, const struct nack_range* ranges, int n_ranges);
+
+struct replay_window {
+    int started; //0 until the first packet
+    uint32_t next; //next packet to deliver
+    uint32_t end; //one past the furthest packet seen, may be past the window
+    uint32_t missing; //numbers in the window that are not held
+    struct replay_slot* slots; //packet seq at seq % REPLAY_WINDOW_SLOTS
+    uint8_t* data; //REPLAY_WINDOW_SLOT_SIZE bytes per slot
+    long retry_us;
+    uint32_t max_nacks;
+    uint64_t poll_ns; //time of the next scan
+    replay_deliver_fn deliver;
+    replay_nack_fn nack;
+    void* ctx;
+    unsigned long int packets; //replay packets pushed, duplicates included
+    unsigned long int duplicates;
+    unsigned long int recovered; //packets that filled a gap
+    unsigned long int deferred; //packets past the end of the window, dropped to be asked for later
+    unsigned long int lost; //packets given up on
+    unsigned long int nack_packets; //NACK packets sent
+    unsigned long int requested; //packet numbers asked for, repeats included
+    unsigned long int restarts; //times the forwarder started over
+    unsigned long int bad; //replay packets too short or too long to hold
+};
+
+//Allocates the slots, retry_us <= 0 and max_nacks == 0 pick the defaults
+//Returns 0 on success, -1 if there is not enough memory
+int replay_window_init(struct replay_window* w, long retry_us, uint32_t max_nacks, replay_deliver_fn deliver,
+                       replay_nack_fn nack, void* ctx);
+
+void replay_window_free(struct replay_window* w);
+
+//Takes a packet as it came, replay header included, size is the size from the header
+void replay_window_push(struct replay_window* w, const uint8_t* wrapped, uint32_t size, uint64_t now_ns);
+
+//Asks for missing packets that are due and gives up on the ones that have been asked for too often
+void replay_window_poll(struct replay_window* w, uint64_t now_ns);
+
+//Delivers every packet held and gives up on the missing ones, at the end of a run
+void replay_window_flush(struct replay_window* w);
+
+#endif
@@ -0,0 +1,708 @@
+#define _GNU_SOURCE //asprintf, strndup
+#include <dirent.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "angle_stream.h"
+#include "csv2archive.h"
+#include "jitter_monitor.h"
+#include "reprocess.h"
+#include "run_archive.h"
+
+#define SECONDS_PER_DAY (24 * 3600)
+#define PACKET_EDGES 1024 //largest encoder packet read from a CSV file
+#define SEEK_SLACK (64 << 10) //bytes the binary search on the encoder file stops within, about a second at 2 Hz
+#define READ_SAMPLES 4096 //samples taken from the angle_stream at a time
+
+//A row of the Rotation file
+struct second_row {
+    uint32_t irig_time;
+    uint32_t edges;
+    double rotation_hz;
+    double rms_jitter;
+};
+
+struct run {
+    char encoder_csv[4096];
+    char irig_csv[4096];
+    char angle_path[4096];
+    char rotation_path[4096];
+    char jitter_path[4096];
+    const char* name;
+    long encoder_size;
+    size_t n_irig;
+    uint32_t* irig_time;
+    uint64_t* irig_clock;
+    int64_t* day_offset; //whole days an angle_stream fed from the start has added by each IRIG packet
+    size_t n_chunks;
+    int failed;
+
+    //written by the calling thread as the chunks come in
+    FILE* angle;
+    FILE* rotation;
+    double* psd; //sum of the chunk PSDs weighted by their windows
+    size_t n_bins;
+    unsigned long int windows;
+    unsigned long int gaps;
+    unsigned long int samples;
+    struct jitter_report last; //of the last chunk with a window, psd not used
+};
+
+struct chunk {
+    struct run* run;
+    size_t index; //in its run
+    size_t first_knot; //IRIG packets that time the edges of the chunk
+    size_t last_knot;
+
+    struct reprocess_sample* samples;
+    size_t n_samples;
+    size_t cap_samples;
+    struct second_row* rows;
+    size_t n_rows;
+    double* psd; //mean over the windows of the chunk
+    size_t n_bins;
+    struct jitter_report report;
+    unsigned long int edges;
+    int failed;
+    char error[4096 + 128];
+    int done; //under pool.done_lock
+};
+
+//Chunks a thread has yet to take, items[head] to items[tail - 1]
+struct queue {
+    pthread_mutex_t lock;
+    size_t* items;
+    size_t head;
+    size_t tail;
+};
+
+struct pool {
+    const struct reprocess_config* config;
+    struct chunk* chunks;
+    size_t n_chunks;
+    int threads;
+    struct queue queues[REPROCESS_MAX_THREADS];
+    pthread_mutex_t done_lock;
+    pthread_cond_t done_cond;
+};
+
+struct worker {
+    struct pool* pool;
+    int id;
+    unsigned long int steals;
+};
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//Reads the IRIG packets of a run and works out the chunks, returns -1 with a message printed if it cannot
+static int load_irig(struct run* run, long chunk_s)
+{
+    struct csv_reader r;
+    struct stat st;
+    uint64_t clock, sync_clock[ARCHIVE_SYNC_PULSES];
+    uint32_t irig_time;
+    size_t cap = 0;
+    int rc;
+
+    if (stat(run->encoder_csv, &st) < 0) {
+        fprintf(stderr, "%s: %s\n", run->encoder_csv, strerror(errno));
+        return -1;
+    }
+    run->encoder_size = (long) st.st_size;
+    if (csv_reader_open(&r, run->irig_csv) < 0) {
+        fprintf(stderr, "%s: %s\n", run->irig_csv, strerror(errno));
+        return -1;
+    }
+    while ((rc = csv_next_irig(&r, &irig_time, &clock, sync_clock)) == 1) {
+        if (run->n_irig == cap) {
+            cap = cap ? cap * 2 : 4096;
+            uint32_t* t = realloc(run->irig_time, cap * sizeof(uint32_t));
+            uint64_t* c = t ? realloc(run->irig_clock, cap * sizeof(uint64_t)) : NULL;
+            int64_t* d = c ? realloc(run->day_offset, cap * sizeof(int64_t)) : NULL;
+            run->irig_time = t ? t : run->irig_time;
+            run->irig_clock = c ? c : run->irig_clock;
+            run->day_offset = d ? d : run->day_offset;
+            if (d == NULL) {
+                fprintf(stderr, "%s: out of memory\n", run->irig_csv);
+                csv_reader_close(&r);
+                return -1;
+            }
+        }
+        //account_for_next_day(), as angle_stream_push_irig() does it
+        int64_t days = run->n_irig ? run->day_offset[run->n_irig - 1] : 0;
+        if (run->n_irig && irig_time < run->irig_time[run->n_irig - 1]) {
+            days += SECONDS_PER_DAY;
+        }
+        run->irig_time[run->n_irig] = irig_time;
+        run->irig_clock[run->n_irig] = clock;
+        run->day_offset[run->n_irig] = days;
+        run->n_irig += 1;
+    }
+    if (rc < 0) {
+        fprintf(stderr, "%s:%lu: malformed row\n", run->irig_csv, r.line_no);
+    }
+    csv_reader_close(&r);
+    if (rc < 0) {
+        return -1;
+    }
+    //knots 1 to n_irig - 1 time edges, and a run with none still gets its (empty) files
+    run->n_chunks = run->n_irig > 1 ? (run->n_irig - 2) / chunk_s + 1 : 1;
+    return 0;
+}
+
+static void free_run(struct run* run)
+{
+    free(run->irig_time);
+    free(run->irig_clock);
+    free(run->day_offset);
+    free(run->psd);
+}
+
+//Byte offset in the encoder file from which every packet ends before clock, or 0. The file is bisected on the
+//largest clock of the packet after each probe, a missed overflow only ever makes a single clock look early.
+static long find_offset(struct csv_reader* r, long size, uint64_t clock)
+{
+    uint64_t packet_clock[PACKET_EDGES];
+    uint32_t edge[PACKET_EDGES];
+    size_t n;
+    uint8_t quad;
+    long lo = 0, hi = size;
+
+    while (hi - lo > SEEK_SLACK) {
+        long mid = lo + (hi - lo) / 2;
+        uint64_t max = UINT64_MAX;
+        if (csv_seek_encoder(r, mid) == 1 && csv_next_encoder(r, packet_clock, edge, PACKET_EDGES, &n, &quad) == 1) {
+            max = 0;
+            for (size_t x = 0; x < n; x++) {
+                max = packet_clock[x] > max ? packet_clock[x] : max;
+            }
+        }
+        if (max < clock) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+//Line through time against edge number for the samples of one IRIG second
+static void fit_second(struct second_row* row, const struct reprocess_sample* samples, size_t n, double rad_per_edge)
+{
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, sq = 0;
+
+    row->edges = (uint32_t) n;
+    row->rotation_hz = NAN;
+    row->rms_jitter = NAN;
+    if (n < 3) {
+        return;
+    }
+    //relative to the first edge so the sums stay small
+    for (size_t k = 0; k < n; k++) {
+        double x = (samples[k].angle - samples[0].angle) / rad_per_edge;
+        double y = samples[k].time - samples[0].time;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    double d = n * sxx - sx * sx;
+    double b = (n * sxy - sx * sy) / d; //seconds per edge
+    double a = (sy - b * sx) / n;
+    if (!(d > 0) || !(b > 0)) {
+        return;
+    }
+    for (size_t k = 0; k < n; k++) {
+        double r = samples[k].time - samples[0].time - a - b * (samples[k].angle - samples[0].angle) / rad_per_edge;
+        sq += r * r;
+    }
+    row->rotation_hz = rad_per_edge / (2 * M_PI * b);
+    row->rms_jitter = sqrt(sq / n);
+}
+
+static void chunk_error(struct chunk* c, const char* path, const char* what)
+{
+    c->failed = 1;
+    snprintf(c->error, sizeof(c->error), "%s: %s", path, what);
+}
+
+//Collects the samples finished by IRIG packet knot, kept if the chunk owns the knot
+static int collect(struct chunk* c, struct angle_stream* s, struct jitter_monitor* m, size_t knot, double rad_per_edge)
+{
+    double time[READ_SAMPLES], angle[READ_SAMPLES];
+    size_t n = angle_stream_available(s), first = c->n_samples, got;
+
+    if (knot >= c->first_knot && c->n_samples + n > c->cap_samples) {
+        size_t cap = c->cap_samples ? c->cap_samples : 16384;
+        while (cap < c->n_samples + n) {
+            cap *= 2;
+        }
+        struct reprocess_sample* samples = realloc(c->samples, cap * sizeof(*samples));
+        if (samples == NULL) {
+            return -1;
+        }
+        c->samples = samples;
+        c->cap_samples = cap;
+    }
+    while ((got = angle_stream_read(s, time, angle, READ_SAMPLES)) > 0) {
+        if (knot < c->first_knot) {
+            continue;
+        }
+        for (size_t k = 0; k < got; k++) {
+            c->samples[c->n_samples + k].time = time[k];
+            c->samples[c->n_samples + k].angle = angle[k];
+        }
+        c->n_samples += got;
+        jitter_monitor_push(m, time, angle, got);
+    }
+    if (knot >= c->first_knot) {
+        struct second_row* row = &c->rows[c->n_rows++];
+        row->irig_time = c->run->irig_time[knot - 1];
+        fit_second(row, c->samples + first, c->n_samples - first, rad_per_edge);
+    }
+    return 0;
+}
+
+//Feeds an angle_stream from the IRIG packet before the chunk to its last one, see reprocess.h
+static void process_chunk(const struct reprocess_config* config, struct chunk* c)
+{
+    struct run* run = c->run;
+    struct csv_reader r;
+    struct angle_stream s;
+    struct jitter_monitor m;
+    uint64_t clock[PACKET_EDGES];
+    uint32_t edge[PACKET_EDGES];
+    size_t n;
+    uint8_t quad;
+    int rc;
+
+    memset(&r, 0, sizeof(r));
+    if (run->n_irig < 2) {
+        return;
+    }
+    size_t start = c->first_knot >= 2 ? c->first_knot - 2 : 0;
+    size_t next = start;
+    double rad_per_edge = 2 * M_PI / (config->slits_per_rev > 0 ? config->slits_per_rev : ANGLE_SLITS_PER_REV);
+
+    c->rows = malloc((c->last_knot - c->first_knot + 1) * sizeof(struct second_row));
+    if (c->rows == NULL || angle_stream_init(&s, config->slits_per_rev, 0) < 0) {
+        chunk_error(c, run->encoder_csv, "out of memory");
+        return;
+    }
+    size_t window = config->jitter_window ? config->jitter_window : JITTER_WINDOW;
+    if (jitter_monitor_init(&m, window, window / 2, 0, config->slits_per_rev, 0, NULL, NULL) < 0) {
+        chunk_error(c, run->encoder_csv, "bad jitter window or out of memory");
+        angle_stream_free(&s);
+        return;
+    }
+    //the stream starts part way into the run, on the days a stream fed from the start would have added by then
+    s.day_offset = run->day_offset[start];
+
+    if (csv_reader_open(&r, run->encoder_csv) < 0) {
+        chunk_error(c, run->encoder_csv, strerror(errno));
+        goto out;
+    }
+    rc = start > 0 ? csv_seek_encoder(&r, find_offset(&r, run->encoder_size, run->irig_clock[start])) : 1;
+    while (rc == 1 && next <= c->last_knot && (rc = csv_next_encoder(&r, clock, edge, PACKET_EDGES, &n, &quad)) == 1) {
+        c->edges += n;
+        if (angle_stream_push_encoder(&s, clock, edge, n) < 0) {
+            chunk_error(c, run->encoder_csv, "out of memory");
+            goto out;
+        }
+        while (next <= c->last_knot && n > 0 && run->irig_clock[next] <= clock[n - 1]) {
+            if (angle_stream_push_irig(&s, run->irig_time[next], run->irig_clock[next]) < 0 ||
+                collect(c, &s, &m, next, rad_per_edge) < 0) {
+                chunk_error(c, run->encoder_csv, "out of memory");
+                goto out;
+            }
+            next += 1;
+        }
+    }
+    if (rc < 0) {
+        char what[64];
+        snprintf(what, sizeof(what), "malformed row before byte %ld", ftell(r.f));
+        chunk_error(c, run->encoder_csv, what);
+        goto out;
+    }
+    //the end of the file, the IRIG packets left are pushed as they come
+    for (; next <= c->last_knot; next++) {
+        if (angle_stream_push_irig(&s, run->irig_time[next], run->irig_clock[next]) < 0 ||
+            collect(c, &s, &m, next, rad_per_edge) < 0) {
+            chunk_error(c, run->encoder_csv, "out of memory");
+            goto out;
+        }
+    }
+    jitter_monitor_report(&m, &c->report);
+    c->n_bins = c->report.n_bins;
+    c->psd = malloc(c->n_bins * sizeof(double));
+    if (c->psd == NULL) {
+        chunk_error(c, run->encoder_csv, "out of memory");
+        goto out;
+    }
+    memcpy(c->psd, m.psd, c->n_bins * sizeof(double));
+    c->report.psd = NULL;
+out:
+    csv_reader_close(&r);
+    jitter_monitor_free(&m);
+    angle_stream_free(&s);
+}
+
+//Next chunk for thread id: the front of its own queue, else the back of another's
+static int take(struct pool* pool, struct worker* w, size_t* item)
+{
+    for (int k = 0; k < pool->threads; k++) {
+        struct queue* q = &pool->queues[(w->id + k) % pool->threads];
+        int found = 0;
+        pthread_mutex_lock(&q->lock);
+        if (q->head < q->tail) {
+            *item = k == 0 ? q->items[q->head++] : q->items[--q->tail];
+            found = 1;
+        }
+        pthread_mutex_unlock(&q->lock);
+        if (found) {
+            w->steals += k > 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void* work(void* arg)
+{
+    struct worker* w = arg;
+    struct pool* pool = w->pool;
+    size_t item;
+
+    //nothing is ever added to a queue, so once every queue is empty the work is done
+    while (take(pool, w, &item)) {
+        process_chunk(pool->config, &pool->chunks[item]);
+        pthread_mutex_lock(&pool->done_lock);
+        pool->chunks[item].done = 1;
+        pthread_cond_broadcast(&pool->done_cond);
+        pthread_mutex_unlock(&pool->done_lock);
+    }
+    return NULL;
+}
+
+static FILE* open_output(struct run* run, const char* path)
+{
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        run->failed = 1;
+        return NULL;
+    }
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+    return f;
+}
+
+static void write_jitter(struct run* run)
+{
+    FILE* f = open_output(run, run->jitter_path);
+    if (f == NULL) {
+        return;
+    }
+    fprintf(f, "1: time/rotation_hz/phase/rms_jitter/windows,3-: freq/psd\r\n\r\n");
+    fprintf(f, "%.6f,%.9f,%.9f,%.6e,%lu\r\n\r\n", run->last.time, run->last.rotation_hz, run->last.phase,
+            run->last.rms_jitter, run->windows);
+    for (size_t k = 0; k < run->n_bins && run->windows > 0; k++) {
+        fprintf(f, "%.6f,%.6e\r\n", k * run->last.freq_step, run->psd[k] / run->windows);
+    }
+    if (fclose(f) != 0) {
+        fprintf(stderr, "%s: %s\n", run->jitter_path, strerror(errno));
+        run->failed = 1;
+    }
+}
+
+static void close_output(struct run* run, FILE** f, const char* path)
+{
+    if (*f != NULL && fclose(*f) != 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        run->failed = 1;
+    }
+    *f = NULL;
+}
+
+//Writes a finished chunk after the ones before it in its run, then frees what it held
+static void write_chunk(const struct reprocess_config* config, struct chunk* c, struct reprocess_stats* stats)
+{
+    struct run* run = c->run;
+
+    if (c->index == 0 && !run->failed) {
+        struct archive_file_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+        header.version = ARCHIVE_VERSION;
+        header.record_size = sizeof(struct reprocess_sample);
+        strcpy(header.name, "angle");
+        if ((run->angle = open_output(run, run->angle_path)) != NULL) {
+            fwrite(&header, sizeof(header), 1, run->angle);
+        }
+        if ((run->rotation = open_output(run, run->rotation_path)) != NULL) {
+            fprintf(run->rotation, "1: IRIG_time/edges/rotation_hz/rms_jitter\r\n\r\n");
+        }
+    }
+    if (c->failed && !run->failed) {
+        fprintf(stderr, "%s\n", c->error);
+        run->failed = 1;
+    }
+    if (!run->failed) {
+        fwrite(c->samples, sizeof(struct reprocess_sample), c->n_samples, run->angle);
+        for (size_t k = 0; k < c->n_rows; k++) {
+            fprintf(run->rotation, "%u,%u,%.9f,%.6e\r\n", c->rows[k].irig_time, c->rows[k].edges, c->rows[k].rotation_hz,
+                    c->rows[k].rms_jitter);
+        }
+        if (c->report.windows > 0) {
+            if (run->psd == NULL) {
+                run->n_bins = c->n_bins;
+                run->psd = calloc(run->n_bins, sizeof(double));
+            }
+            for (size_t k = 0; k < run->n_bins && run->psd != NULL; k++) {
+                run->psd[k] += c->psd[k] * c->report.windows;
+            }
+            run->windows += c->report.windows;
+            run->last = c->report;
+        }
+        run->gaps += c->report.gaps;
+        run->samples += c->n_samples;
+        stats->samples += c->n_samples;
+        stats->seconds += c->n_rows;
+    }
+    stats->edges += c->edges;
+
+    if (c->index == run->n_chunks - 1) {
+        close_output(run, &run->angle, run->angle_path);
+        close_output(run, &run->rotation, run->rotation_path);
+        if (!run->failed) {
+            write_jitter(run);
+        }
+        stats->failed += run->failed;
+        if (!config->quiet && !run->failed) {
+            printf("%s: %lu samples over %zu IRIG packets, %lu jitter windows, rotation %.6f Hz, rms jitter %.3f us\n",
+                   run->encoder_csv, run->samples, run->n_irig, run->windows, run->last.rotation_hz,
+                   run->last.rms_jitter * 1e6);
+        }
+    }
+    free(c->samples);
+    free(c->rows);
+    free(c->psd);
+    c->samples = NULL;
+    c->rows = NULL;
+    c->psd = NULL;
+}
+
+int reprocess_runs(const struct reprocess_config* config, char* const* encoder_csv, char* const* irig_csv,
+                   char* const* names, int n_runs, struct reprocess_stats* stats)
+{
+    static struct pool pool;
+    struct worker workers[REPROCESS_MAX_THREADS];
+    pthread_t threads[REPROCESS_MAX_THREADS];
+    long chunk_s = config->chunk_s > 0 ? config->chunk_s : REPROCESS_CHUNK_S;
+    int rc = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    double start = now_s();
+    struct run* runs = calloc(n_runs > 0 ? n_runs : 1, sizeof(struct run));
+    if (runs == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    //the IRIG files fix the chunks, every chunk of every run is a task
+    size_t n_chunks = 0;
+    for (int k = 0; k < n_runs; k++) {
+        struct run* run = &runs[k];
+        const char* dir = config->out_dir;
+        char csv_dir[4096];
+        snprintf(csv_dir, sizeof(csv_dir), "%s", encoder_csv[k]);
+        char* slash = strrchr(csv_dir, '/');
+        if (dir == NULL) {
+            if (slash != NULL) {
+                *slash = '\0';
+            }
+            dir = slash != NULL ? csv_dir : ".";
+        }
+        run->name = names[k];
+        if (snprintf(run->encoder_csv, sizeof(run->encoder_csv), "%s", encoder_csv[k]) >= (int) sizeof(run->encoder_csv) ||
+            snprintf(run->irig_csv, sizeof(run->irig_csv), "%s", irig_csv[k]) >= (int) sizeof(run->irig_csv) ||
+            snprintf(run->angle_path, sizeof(run->angle_path), "%s/Angle_Data_%s.tab", dir, names[k]) >= (int) sizeof(run->angle_path) ||
+            snprintf(run->rotation_path, sizeof(run->rotation_path), "%s/Rotation_Data_%s.csv", dir, names[k]) >= (int) sizeof(run->rotation_path) ||
+            snprintf(run->jitter_path, sizeof(run->jitter_path), "%s/Jitter_PSD_%s.csv", dir, names[k]) >= (int) sizeof(run->jitter_path)) {
+            fprintf(stderr, "%s: path too long\n", encoder_csv[k]);
+            run->failed = 1;
+        } else if (load_irig(run, chunk_s) < 0) {
+            run->failed = 1;
+        }
+        if (run->failed) {
+            run->n_chunks = 0;
+            stats->failed += 1;
+        }
+        n_chunks += run->n_chunks;
+    }
+    stats->runs = n_runs;
+    stats->chunks = n_chunks;
+
+    memset(&pool, 0, sizeof(pool));
+    pool.config = config;
+    pool.threads = config->threads > 0 ? config->threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    pool.threads = pool.threads < 1 ? 1 : pool.threads > REPROCESS_MAX_THREADS ? REPROCESS_MAX_THREADS : pool.threads;
+    pool.n_chunks = n_chunks;
+    pool.chunks = calloc(n_chunks > 0 ? n_chunks : 1, sizeof(struct chunk));
+    if (pool.chunks == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        rc = -1;
+        goto out;
+    }
+    //dealt out in turn, so the threads go through the runs in about the order they are written in
+    for (int t = 0; t < pool.threads; t++) {
+        pthread_mutex_init(&pool.queues[t].lock, NULL);
+        pool.queues[t].items = malloc((n_chunks / pool.threads + 1) * sizeof(size_t));
+        if (pool.queues[t].items == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            rc = -1;
+            goto out;
+        }
+    }
+    size_t g = 0;
+    for (int k = 0; k < n_runs; k++) {
+        for (size_t x = 0; x < runs[k].n_chunks; x++, g++) {
+            struct chunk* c = &pool.chunks[g];
+            c->run = &runs[k];
+            c->index = x;
+            c->first_knot = 1 + x * chunk_s;
+            c->last_knot = runs[k].n_irig > 1 ? (x + 1) * chunk_s : 0;
+            c->last_knot = c->last_knot < runs[k].n_irig - 1 ? c->last_knot : runs[k].n_irig - 1;
+            struct queue* q = &pool.queues[g % pool.threads];
+            q->items[q->tail++] = g;
+        }
+    }
+    pthread_mutex_init(&pool.done_lock, NULL);
+    pthread_cond_init(&pool.done_cond, NULL);
+
+    int started = 0;
+    for (int t = 0; t < pool.threads; t++) {
+        workers[t] = (struct worker) { .pool = &pool, .id = t };
+        if (pthread_create(&threads[t], NULL, work, &workers[t]) != 0) {
+            break;
+        }
+        started += 1;
+    }
+    if (started == 0) {
+        //no thread to be had, the calling thread does it all, stealing every queue in turn
+        workers[0] = (struct worker) { .pool = &pool, .id = 0 };
+        work(&workers[0]);
+    }
+
+    //written in order as the chunks finish
+    for (g = 0; g < n_chunks; g++) {
+        pthread_mutex_lock(&pool.done_lock);
+        while (!pool.chunks[g].done) {
+            pthread_cond_wait(&pool.done_cond, &pool.done_lock);
+        }
+        pthread_mutex_unlock(&pool.done_lock);
+        write_chunk(config, &pool.chunks[g], stats);
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+        stats->steals += workers[t].steals;
+    }
+    stats->steals += started == 0 ? workers[0].steals : 0;
+    pthread_mutex_destroy(&pool.done_lock);
+    pthread_cond_destroy(&pool.done_cond);
+    rc = stats->failed > 0 ? -1 : 0;
+
+out:
+    for (int t = 0; t < REPROCESS_MAX_THREADS; t++) {
+        if (pool.queues[t].items != NULL) {
+            pthread_mutex_destroy(&pool.queues[t].lock);
+            free(pool.queues[t].items);
+        }
+    }
+    free(pool.chunks);
+    for (int k = 0; k < n_runs; k++) {
+        free_run(&runs[k]);
+    }
+    free(runs);
+    stats->wall_s = now_s() - start;
+    return rc;
+}
+
+static int compare_names(const void* a, const void* b)
+{
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+int reprocess_dirs(const struct reprocess_config* config, char* const* dirs, int n_dirs, struct reprocess_stats* stats)
+{
+    char** encoder_csv = NULL;
+    char** irig_csv = NULL;
+    char** names = NULL;
+    int n = 0, cap = 0, rc = 0;
+
+    for (int k = 0; k < n_dirs; k++) {
+        DIR* d = opendir(dirs[k]);
+        struct dirent* e;
+        int first = n;
+        if (d == NULL) {
+            fprintf(stderr, "%s: %s\n", dirs[k], strerror(errno));
+            rc = -1;
+            continue;
+        }
+        while ((e = readdir(d)) != NULL) {
+            size_t len = strlen(e->d_name);
+            if (strncmp(e->d_name, "Encoder_Data_", 13) != 0 || len <= 17 || strcmp(e->d_name + len - 4, ".csv") != 0) {
+                continue;
+            }
+            if (n == cap) {
+                cap = cap ? cap * 2 : 64;
+                encoder_csv = realloc(encoder_csv, cap * sizeof(char*));
+                irig_csv = realloc(irig_csv, cap * sizeof(char*));
+                names = realloc(names, cap * sizeof(char*));
+                if (encoder_csv == NULL || irig_csv == NULL || names == NULL) {
+                    fprintf(stderr, "Out of memory\n");
+                    exit(1);
+                }
+            }
+            names[n] = strndup(e->d_name + 13, len - 17);
+            n += 1;
+        }
+        closedir(d);
+        //the same order whatever order the directory lists them in
+        qsort(names + first, n - first, sizeof(char*), compare_names);
+        for (int x = first; x < n; x++) {
+            if (asprintf(&encoder_csv[x], "%s/Encoder_Data_%s.csv", dirs[k], names[x]) < 0 ||
+                asprintf(&irig_csv[x], "%s/IRIG_Data_%s.csv", dirs[k], names[x]) < 0) {
+                fprintf(stderr, "Out of memory\n");
+                exit(1);
+            }
+        }
+        if (n == first) {
+            fprintf(stderr, "%s: no Encoder_Data_<run>.csv files\n", dirs[k]);
+            rc = -1;
+        }
+    }
+    if (reprocess_runs(config, encoder_csv, irig_csv, names, n, stats) < 0) {
+        rc = -1;
+    }
+    for (int x = 0; x < n; x++) {
+        free(encoder_csv[x]);
+        free(irig_csv[x]);
+        free(names[x]);
+    }
+    free(encoder_csv);
+    free(irig_csv);
+    free(names);
+    return rc;
+}
@@ -0,0 +1,71 @@
+//Parallel reprocessing of recorded runs: angle and time of every edge, rotation and jitter per IRIG second, and
+//the angle jitter PSD of the run, from the Encoder_Data_<run>.csv and IRIG_Data_<run>.csv files
+//
+//Every run is cut into chunks of chunk_s IRIG seconds. The IRIG file of a run is read up front (one packet a
+//second), which fixes the chunks and the days to add to each IRIG second after midnight. Chunk c holds the
+//edges timed by IRIG packets c * chunk_s + 1 to (c + 1) * chunk_s. Its worker finds where to start in the
+//encoder file with a binary search on the clock, then feeds an angle_stream from the IRIG packet one before the
+//chunk: that second of overlap unwraps the clocks and counts and places the first knot exactly as a single pass
+//over the whole run would have, and its samples are thrown away. The samples of a chunk are therefore the same,
+//bit for bit, as those of one angle_stream fed the whole file, encoder packet by encoder packet with every IRIG
+//packet pushed once the edges have passed its rising edge. Edges are timed by the IRIG knots, never the clock
+//model, whose fit depends on the whole history of the run.
+//
+//The chunks of every run go to a pool of threads, dealt out in turn to a queue per thread. A thread works its own
+//queue from the front and, once it is empty, steals from the back of another thread's, so a campaign of runs of
+//very different lengths keeps every thread busy to the end. The calling thread writes the chunks of each run in
+//order as they finish, so what is written depends on chunk_s but never on the number of threads or on which
+//thread did what. For each run, in out_dir or next to its CSV files:
+//
+//  Angle_Data_<run>.tab     struct archive_file_header (run_archive.h), then struct reprocess_sample per edge
+//  Rotation_Data_<run>.csv  per IRIG second: IRIG time, edges, rotation frequency and rms time jitter of a line
+//                           fit through the edges of the second
+//  Jitter_PSD_<run>.csv     as encoder_receiver -j writes it, the PSD averaged over every jitter window of the
+//                           run. Windows do not span chunks.
+//
+//Each Encoder_Data file is a run of its own, so the files of a run recorded with -c are processed one by one and
+//the second before the first IRIG packet of each is lost, as it would be at the start of any run.
+
+#ifndef REPROCESS_H
+#define REPROCESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define REPROCESS_CHUNK_S 60 //default IRIG seconds per chunk
+#define REPROCESS_MAX_THREADS 256
+
+struct reprocess_sample {
+    double time; //UTC seconds since the midnight before the run
+    double angle; //rad, absolute edge number times 2 pi / slits per revolution
+};
+
+struct reprocess_config {
+    int threads; //<= 0 picks the number of CPUs
+    long chunk_s; //<= 0 picks REPROCESS_CHUNK_S
+    const char* out_dir; //NULL writes next to each run's CSV files
+    double slits_per_rev; //<= 0 picks ANGLE_SLITS_PER_REV
+    size_t jitter_window; //edges, 0 picks JITTER_WINDOW, overlapping by half
+    int quiet; //1 prints nothing but errors
+};
+
+struct reprocess_stats {
+    unsigned long int runs;
+    unsigned long int failed; //runs with a file that could not be read or written
+    unsigned long int chunks;
+    unsigned long int steals; //chunks a thread took from another thread's queue
+    unsigned long int edges; //edges read, the second of overlap of every chunk included
+    unsigned long int samples; //samples written
+    unsigned long int seconds; //rows of the Rotation files
+    double wall_s;
+};
+
+//Processes every run found in the given directories, returns 0 or -1 if any run failed, with a message printed
+//for each
+int reprocess_dirs(const struct reprocess_config* config, char* const* dirs, int n_dirs, struct reprocess_stats* stats);
+
+//Same for runs given by their two CSV files, encoder_csv[k] and irig_csv[k], named names[k]
+int reprocess_runs(const struct reprocess_config* config, char* const* encoder_csv, char* const* irig_csv,
+                   char* const* names, int n_runs, struct reprocess_stats* stats);
+
+#endif
@@ -0,0 +1,482 @@
+#define _GNU_SOURCE //fallocate
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "run_archive.h"
+
+#define SECONDS_PER_DAY (24 * 3600)
+
+//The last two replace the first three in a packed run, edges.pack holds blocks of any size
+static const char* file_names[7] = { "edge_index.col", "edge_clock.col", "edge_quad.col", "irig.tab", "irig_index.tab",
+                                     "edges.pack", "edge_blocks.tab" };
+static const uint32_t record_sizes[7] = { sizeof(uint32_t), sizeof(uint64_t), sizeof(uint8_t),
+                                          sizeof(struct archive_irig), sizeof(struct archive_index_entry),
+                                          sizeof(uint8_t), sizeof(struct archive_block_entry) };
+
+struct archive_packing {
+    uint64_t clock[EDGE_CODEC_BLOCK];
+    uint32_t edge_index[EDGE_CODEC_BLOCK];
+    uint8_t quad[EDGE_CODEC_BLOCK];
+    size_t n;
+    uint8_t out[EDGE_CODEC_MAX_BYTES];
+};
+
+static FILE* create_column(const char* dir, int k)
+{
+    char path[4096];
+    struct archive_file_header header;
+    FILE* f;
+
+    if (snprintf(path, sizeof(path), "%s/%s", dir, file_names[k]) >= (int) sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    if ((f = fopen(path, "w")) == NULL) {
+        return NULL;
+    }
+    setvbuf(f, NULL, _IOFBF, 256 << 10);
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    header.version = ARCHIVE_VERSION;
+    header.record_size = record_sizes[k];
+    memcpy(header.name, file_names[k], strchr(file_names[k], '.') - file_names[k]);
+    fwrite(&header, sizeof(header), 1, f);
+    return f;
+}
+
+int run_archive_create(struct run_archive_writer* w, const char* dir, int packed)
+{
+    memset(w, 0, sizeof(*w));
+    if (mkdir(dir, 0775) < 0 && errno != EEXIST) {
+        return -1;
+    }
+    if ((w->recent = malloc(ARCHIVE_RECENT_EDGES * sizeof(uint64_t))) == NULL ||
+        (packed && (w->packing = calloc(1, sizeof(*w->packing))) == NULL)) {
+        free(w->recent);
+        w->recent = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+    if ((packed ? (w->blocks = create_column(dir, 5)) == NULL || (w->block_index = create_column(dir, 6)) == NULL :
+                  (w->edge_index = create_column(dir, 0)) == NULL || (w->edge_clock = create_column(dir, 1)) == NULL ||
+                  (w->edge_quad = create_column(dir, 2)) == NULL) ||
+        (w->irig = create_column(dir, 3)) == NULL ||
+        (w->index = create_column(dir, 4)) == NULL) {
+        int err = errno;
+        run_archive_close_writer(w);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+//The overflow count is read separately from the 32-bit clock, so once in a while a clock that has just
+//wrapped is paired with the old overflow count and comes out 2^32 counts (21 s) too early.
+//Nothing real moves backwards by more than half of that.
+static uint64_t repair_overflow(struct run_archive_writer* w, uint64_t clock, uint64_t last)
+{
+    if (clock + (1ull << 31) < last) {
+        w->repaired += 1;
+        return clock + (1ull << 32);
+    }
+    return clock;
+}
+
+static void write_index(struct run_archive_writer* w, const struct archive_index_entry* entry)
+{
+    fwrite(entry, sizeof(*entry), 1, w->index);
+}
+
+//Codes the edges waiting in the packing buffer as one block
+static int write_block(struct run_archive_writer* w)
+{
+    struct archive_packing* p = w->packing;
+    struct archive_block_entry entry = { .offset = w->block_offset, .first_clock = p->clock[0] };
+
+    if (p->n == 0) {
+        return 0;
+    }
+    size_t bytes = edge_codec_encode(p->clock, p->edge_index, p->quad, p->n, p->out);
+    p->n = 0;
+    w->block_offset += bytes;
+    if (fwrite(p->out, 1, bytes, w->blocks) != bytes || fwrite(&entry, sizeof(entry), 1, w->block_index) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+static int pack_edges(struct run_archive_writer* w, const uint64_t* clock, const uint32_t* edge, size_t n, uint8_t quad)
+{
+    struct archive_packing* p = w->packing;
+
+    while (n > 0) {
+        size_t take = EDGE_CODEC_BLOCK - p->n < n ? EDGE_CODEC_BLOCK - p->n : n;
+        memcpy(p->clock + p->n, clock, take * sizeof(uint64_t));
+        memcpy(p->edge_index + p->n, edge, take * sizeof(uint32_t));
+        memset(p->quad + p->n, quad, take);
+        p->n += take;
+        clock += take;
+        edge += take;
+        n -= take;
+        if (p->n == EDGE_CODEC_BLOCK && write_block(w) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int run_archive_append_edges(struct run_archive_writer* w, const uint64_t* clock, const uint32_t* edge, size_t n, uint8_t quad)
+{
+    uint64_t clocks[256];
+    uint8_t quads[256];
+
+    //packets hold 150 edges, bigger batches are split
+    while (n > 256) {
+        if (run_archive_append_edges(w, clock, edge, 256, quad) < 0) {
+            return -1;
+        }
+        clock += 256;
+        edge += 256;
+        n -= 256;
+    }
+    for (size_t x = 0; x < n; x++) {
+        clocks[x] = w->last_edge_clock = repair_overflow(w, clock[x], w->last_edge_clock);
+        w->recent[(w->n_edges + x) % ARCHIVE_RECENT_EDGES] = clocks[x];
+        quads[x] = quad;
+    }
+
+    //IRIG packets that came in ahead of their rising edge get the first edge at or after it
+    size_t x = 0;
+    while (w->n_pending > 0) {
+        struct archive_index_entry* entry = &w->pending[0];
+        while (x < n && clocks[x] < entry->clock) {
+            x++;
+        }
+        if (x == n) {
+            break;
+        }
+        entry->edge_row = w->n_edges + x;
+        write_index(w, entry);
+        memmove(&w->pending[0], &w->pending[1], --w->n_pending * sizeof(w->pending[0]));
+    }
+
+    w->n_edges += n;
+    if (w->packing != NULL) {
+        return pack_edges(w, clocks, edge, n, quad);
+    }
+    if (fwrite(edge, sizeof(uint32_t), n, w->edge_index) != n ||
+        fwrite(clocks, sizeof(uint64_t), n, w->edge_clock) != n ||
+        fwrite(quads, sizeof(uint8_t), n, w->edge_quad) != n) {
+        return -1;
+    }
+    return 0;
+}
+
+int run_archive_append_irig(struct run_archive_writer* w, uint32_t irig_time, uint64_t rising_edge_clock,
+                            const uint64_t* sync_clock, const uint32_t* info)
+{
+    struct archive_irig irig;
+    struct archive_index_entry entry;
+
+    memset(&irig, 0, sizeof(irig));
+    irig.rising_edge_clock = w->last_irig_clock = repair_overflow(w, rising_edge_clock, w->last_irig_clock);
+    uint64_t last_sync = irig.rising_edge_clock;
+    for (int x = 0; x < ARCHIVE_SYNC_PULSES; x++) {
+        irig.sync_clock[x] = last_sync = repair_overflow(w, sync_clock[x], last_sync);
+    }
+    irig.irig_time = irig_time;
+    if (info != NULL) {
+        memcpy(irig.info, info, sizeof(irig.info));
+    }
+
+    entry.clock = irig.rising_edge_clock;
+    entry.irig_time = irig_time;
+    entry.irig_row = (uint32_t) w->n_irig++;
+    if (w->n_pending > 0 || w->n_edges == 0 || entry.clock > w->last_edge_clock) {
+        //the edges at the rising edge have not arrived yet
+        if (w->n_pending == (int) (sizeof(w->pending) / sizeof(w->pending[0]))) {
+            w->pending[0].edge_row = w->n_edges;
+            write_index(w, &w->pending[0]);
+            memmove(&w->pending[0], &w->pending[1], --w->n_pending * sizeof(w->pending[0]));
+        }
+        w->pending[w->n_pending++] = entry;
+    } else {
+        //the IRIG packet is only complete a second after its rising edge, so usually the edge is in the recent window
+        uint64_t lo = w->n_edges > ARCHIVE_RECENT_EDGES ? w->n_edges - ARCHIVE_RECENT_EDGES : 0;
+        uint64_t hi = w->n_edges;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (w->recent[mid % ARCHIVE_RECENT_EDGES] < entry.clock) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        entry.edge_row = lo;
+        write_index(w, &entry);
+    }
+
+    if (fwrite(&irig, sizeof(irig), 1, w->irig) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+//The edges of a packed run still in the packing buffer are not flushed, a block is only written once it is full
+void run_archive_flush(struct run_archive_writer* w)
+{
+    FILE* files[7] = { w->edge_index, w->edge_clock, w->edge_quad, w->irig, w->index, w->blocks, w->block_index };
+
+    for (int k = 0; k < 7; k++) {
+        if (files[k] != NULL) {
+            fflush(files[k]);
+        }
+    }
+}
+
+void run_archive_preallocate(struct run_archive_writer* w, uint64_t edges, uint64_t irig)
+{
+    FILE* files[7] = { w->edge_index, w->edge_clock, w->edge_quad, w->irig, w->index, w->blocks, w->block_index };
+    uint64_t blocks = (w->n_edges + edges) / EDGE_CODEC_BLOCK + 1;
+    uint64_t records[7] = { w->n_edges + edges, w->n_edges + edges, w->n_edges + edges, w->n_irig + irig, w->n_irig + irig,
+                            0, blocks };
+
+    //packed blocks are as big as the ones written so far, or 2 bytes an edge to begin with
+    if (w->blocks != NULL) {
+        uint64_t packed = w->n_edges - w->packing->n;
+        records[5] = packed > 0 ? (double) w->block_offset / packed * (w->n_edges + edges) : 2 * (w->n_edges + edges);
+    }
+    for (int k = 0; k < 7; k++) {
+        if (files[k] != NULL) {
+            fallocate(fileno(files[k]), FALLOC_FL_KEEP_SIZE, 0, ARCHIVE_HEADER_SIZE + (off_t) (records[k] * record_sizes[k]));
+        }
+    }
+}
+
+void run_archive_close_writer(struct run_archive_writer* w)
+{
+    FILE** files[7] = { &w->edge_index, &w->edge_clock, &w->edge_quad, &w->irig, &w->index, &w->blocks, &w->block_index };
+
+    //rising edges after the last edge of the run point one past it
+    if (w->index != NULL) {
+        for (int k = 0; k < w->n_pending; k++) {
+            w->pending[k].edge_row = w->n_edges;
+            write_index(w, &w->pending[k]);
+        }
+    }
+    w->n_pending = 0;
+    if (w->blocks != NULL) {
+        write_block(w);
+    }
+    for (int k = 0; k < 7; k++) {
+        if (*files[k] != NULL) {
+            fflush(*files[k]);
+            if (ftruncate(fileno(*files[k]), ftello(*files[k])) < 0) {
+                //only matters to the disk space run_archive_preallocate() took
+            }
+            fclose(*files[k]);
+            *files[k] = NULL;
+        }
+    }
+    free(w->recent);
+    w->recent = NULL;
+    free(w->packing);
+    w->packing = NULL;
+}
+
+//Maps file k of a run, its records start at *array and there are *count of them
+static int map_file(struct run_archive* a, const char* dir, int k, const void** array, size_t* count)
+{
+    char path[4096];
+    struct stat st;
+    const struct archive_file_header* header;
+    int fd;
+
+    if (snprintf(path, sizeof(path), "%s/%s", dir, file_names[k]) >= (int) sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < ARCHIVE_HEADER_SIZE) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    a->maps[k] = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (a->maps[k] == MAP_FAILED) {
+        a->maps[k] = NULL;
+        return -1;
+    }
+    a->map_sizes[k] = st.st_size;
+    header = a->maps[k];
+    if (memcmp(header->magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 || header->version != ARCHIVE_VERSION ||
+        header->record_size != record_sizes[k]) {
+        errno = EINVAL;
+        return -1;
+    }
+    *array = (const uint8_t *) a->maps[k] + ARCHIVE_HEADER_SIZE;
+    *count = (st.st_size - ARCHIVE_HEADER_SIZE) / record_sizes[k];
+    return 0;
+}
+
+int run_archive_open(struct run_archive* a, const char* dir)
+{
+    const void* arrays[7];
+    size_t counts[7];
+    char path[4096];
+
+    memset(a, 0, sizeof(*a));
+    if (snprintf(path, sizeof(path), "%s/%s", dir, file_names[5]) >= (int) sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    a->packed = access(path, F_OK) == 0;
+    for (int k = a->packed ? 3 : 0; k < (a->packed ? 7 : 5); k++) {
+        if (map_file(a, dir, k, &arrays[k], &counts[k]) < 0) {
+            goto fail;
+        }
+    }
+
+    if (a->packed) {
+        a->blocks = arrays[5];
+        a->blocks_size = counts[5];
+        a->block_index = arrays[6];
+        a->n_blocks = counts[6];
+        //a run cut short may end in a block that was only partly written, or with its entry missing
+        while (a->n_blocks > 0) {
+            const struct archive_block_entry* last = &a->block_index[a->n_blocks - 1];
+            struct edge_block_header h;
+            if (last->offset + sizeof(h) <= a->blocks_size) {
+                memcpy(&h, a->blocks + last->offset, sizeof(h));
+                if (last->offset + h.bytes <= a->blocks_size) {
+                    a->n_edges = (a->n_blocks - 1) * EDGE_CODEC_BLOCK + h.n_edges;
+                    break;
+                }
+            }
+            a->n_blocks -= 1;
+        }
+    } else {
+        //the three edge columns are written together, a run cut short may have one of them a record ahead
+        a->n_edges = counts[0] < counts[1] ? counts[0] : counts[1];
+        a->n_edges = a->n_edges < counts[2] ? a->n_edges : counts[2];
+        a->edge_index = arrays[0];
+        a->edge_clock = arrays[1];
+        a->edge_quad = arrays[2];
+    }
+    a->n_irig = counts[3];
+    a->irig = arrays[3];
+    a->n_index = counts[4];
+    a->index = arrays[4];
+    return 0;
+
+fail:
+    {
+        int err = errno;
+        run_archive_close(a);
+        errno = err;
+    }
+    return -1;
+}
+
+void run_archive_close(struct run_archive* a)
+{
+    for (int k = 0; k < 7; k++) {
+        if (a->maps[k] != NULL) {
+            munmap(a->maps[k], a->map_sizes[k]);
+            a->maps[k] = NULL;
+        }
+    }
+}
+
+int run_archive_read_edges(const struct run_archive* a, size_t begin, size_t end, uint32_t* edge_index,
+                           uint64_t* edge_clock, uint8_t* edge_quad)
+{
+    if (begin > end || end > a->n_edges) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!a->packed) {
+        if (edge_index != NULL) {
+            memcpy(edge_index, a->edge_index + begin, (end - begin) * sizeof(uint32_t));
+        }
+        if (edge_clock != NULL) {
+            memcpy(edge_clock, a->edge_clock + begin, (end - begin) * sizeof(uint64_t));
+        }
+        if (edge_quad != NULL) {
+            memcpy(edge_quad, a->edge_quad + begin, end - begin);
+        }
+        return 0;
+    }
+
+    uint64_t clock[EDGE_CODEC_BLOCK];
+    uint32_t index[EDGE_CODEC_BLOCK];
+    uint8_t quad[EDGE_CODEC_BLOCK];
+    for (size_t row = begin; row < end;) {
+        size_t b = row / EDGE_CODEC_BLOCK, first = b * EDGE_CODEC_BLOCK;
+        uint64_t offset = a->block_index[b].offset;
+        int n = offset <= a->blocks_size ? edge_codec_decode(a->blocks + offset, a->blocks_size - offset, clock, index, quad) : -1;
+        if (n < 0 || first + n < (end < first + EDGE_CODEC_BLOCK ? end : first + EDGE_CODEC_BLOCK)) {
+            errno = EIO;
+            return -1;
+        }
+        size_t from = row - first, to = (end - first < (size_t) n ? end - first : (size_t) n);
+        if (edge_index != NULL) {
+            memcpy(edge_index + (row - begin), index + from, (to - from) * sizeof(uint32_t));
+        }
+        if (edge_clock != NULL) {
+            memcpy(edge_clock + (row - begin), clock + from, (to - from) * sizeof(uint64_t));
+        }
+        if (edge_quad != NULL) {
+            memcpy(edge_quad + (row - begin), quad + from, to - from);
+        }
+        row = first + to;
+    }
+    return 0;
+}
+
+const struct archive_index_entry* run_archive_find_second(const struct run_archive* a, uint32_t irig_time)
+{
+    if (a->n_index == 0) {
+        return NULL;
+    }
+    //one entry per second, so unless seconds were missed the entry sits at its distance from the first one
+    size_t guess = (irig_time + SECONDS_PER_DAY - a->index[0].irig_time) % SECONDS_PER_DAY;
+    if (guess < a->n_index && a->index[guess].irig_time == irig_time) {
+        return &a->index[guess];
+    }
+    for (size_t k = 0; k < a->n_index; k++) {
+        if (a->index[k].irig_time == irig_time) {
+            return &a->index[k];
+        }
+    }
+    return NULL;
+}
+
+int run_archive_seconds(const struct run_archive* a, uint32_t first, uint32_t last, size_t* begin, size_t* end)
+{
+    const struct archive_index_entry* entry = run_archive_find_second(a, first);
+    if (entry == NULL) {
+        return -1;
+    }
+    uint32_t span = (last + SECONDS_PER_DAY - first) % SECONDS_PER_DAY;
+    const struct archive_index_entry* stop = a->index + a->n_index;
+
+    *begin = entry->edge_row;
+    //walks to the first second past last, skipping over any seconds the run is missing
+    while (entry < stop && (entry->irig_time + SECONDS_PER_DAY - first) % SECONDS_PER_DAY <= span) {
+        entry++;
+    }
+    *end = entry < stop ? entry->edge_row : a->n_edges;
+    if (*end > a->n_edges) {
+        *end = a->n_edges;
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+//Columnar binary archive of a run, the compact alternative to the Encoder_Data and IRIG_Data CSV files
+//
+//A run is a directory holding one append-only file per column. Every file starts with a 64 byte
+//struct archive_file_header followed by fixed size records, so the number of records is implied by the file
+//size and a reader can mmap a file and use it as an array:
+//
+//  edge_index.col   uint32_t per edge, absolute edge number (encoder_cnt)
+//  edge_clock.col   uint64_t per edge, counter_ovflow << 32 | clock_cnt with missed overflows repaired
+//  edge_quad.col    uint8_t per edge, quadrature pins of the packet (bit 0 = input 2, bit 1 = 3, bit 2 = 4),
+//                   bit 3 (ARCHIVE_QUAD_ENTRY) set if the edge is a quadrature transition, whose edge_index is then
+//                   the QUAD_WORD of ../Beaglebone/pru_layout.h: signed position << 2 | state of the two channels
+//  irig.tab         struct archive_irig per IRIG packet
+//  irig_index.tab   struct archive_index_entry per IRIG packet, the first edge at or after its rising edge
+//
+//The index lets analysis code jump to any IRIG second without reading the edges before it. A record that
+//was only partly written when a run was cut short is ignored by the reader.
+//
+//A packed run holds the edges in two files in place of the three edge columns, about a sixth of their size:
+//
+//  edges.pack       the edges coded in blocks of EDGE_CODEC_BLOCK (edge_codec.h), one after the other
+//  edge_blocks.tab  struct archive_block_entry per block
+//
+//Every block but the last holds EDGE_CODEC_BLOCK edges, so the block of any row is known without a search and
+//run_archive_read_edges() decodes no more than the blocks a range touches. The writer keeps the edges of the
+//block being filled in memory, up to a quarter of a second at 2 Hz.
+
+#ifndef RUN_ARCHIVE_H
+#define RUN_ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "edge_codec.h"
+
+#define ARCHIVE_MAGIC "PB2ARCH"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_HEADER_SIZE 64
+#define ARCHIVE_RECENT_EDGES 65536 //edges kept in memory to place IRIG rising edges, about 14 s at 2 Hz
+#define ARCHIVE_SYNC_PULSES 10
+#define ARCHIVE_QUAD_ENTRY 0x08 //edge_quad bit of quadrature transitions
+
+struct archive_file_header {
+    char magic[8]; //ARCHIVE_MAGIC
+    uint32_t version; //ARCHIVE_VERSION
+    uint32_t record_size; //bytes per record
+    char name[48]; //column name, same as the file name without extension
+};
+
+struct archive_irig {
+    uint64_t rising_edge_clock; //clock count of the start of the IRIG frame
+    uint64_t sync_clock[ARCHIVE_SYNC_PULSES]; //clock counts of the synchronization pulses
+    uint32_t irig_time; //UTC seconds since midnight
+    uint32_t info[ARCHIVE_SYNC_PULSES]; //raw IRIG words, 0 when converted from CSV
+    uint32_t reserved;
+};
+
+struct archive_index_entry {
+    uint64_t clock; //rising_edge_clock of the IRIG packet
+    uint64_t edge_row; //first edge with a clock at or after it
+    uint32_t irig_time;
+    uint32_t irig_row; //row of the IRIG packet in irig.tab
+};
+
+struct archive_block_entry {
+    uint64_t offset; //bytes from the start of edges.pack to the block
+    uint64_t first_clock; //clock of its first edge
+};
+
+struct run_archive_writer {
+    FILE* edge_index;
+    FILE* edge_clock;
+    FILE* edge_quad;
+    FILE* irig;
+    FILE* index;
+    uint64_t n_edges;
+    uint64_t n_irig;
+    uint64_t last_edge_clock; //for the missed overflow repair
+    uint64_t last_irig_clock;
+    uint64_t repaired; //clocks moved up by 2^32
+    //IRIG packets whose rising edge is later than every edge written so far, at most a few
+    struct archive_index_entry pending[8];
+    int n_pending;
+    uint64_t* recent; //clocks of the last ARCHIVE_RECENT_EDGES edges, by row % ARCHIVE_RECENT_EDGES
+    //packed runs only, the edge columns above are then NULL
+    FILE* blocks;
+    FILE* block_index;
+    uint64_t block_offset; //bytes written to edges.pack
+    struct archive_packing* packing; //edges of the block being filled
+};
+
+//A run mapped for reading, the arrays point straight into the files
+//The edge arrays are NULL for a packed run, whose edges are read with run_archive_read_edges().
+struct run_archive {
+    size_t n_edges;
+    const uint32_t* edge_index;
+    const uint64_t* edge_clock;
+    const uint8_t* edge_quad;
+    int packed;
+    const uint8_t* blocks;
+    size_t blocks_size;
+    size_t n_blocks;
+    const struct archive_block_entry* block_index;
+    size_t n_irig;
+    const struct archive_irig* irig;
+    size_t n_index;
+    const struct archive_index_entry* index;
+    void* maps[7];
+    size_t map_sizes[7];
+};
+
+//Creates the run directory and its column files, packed with the edges in blocks of edge_codec.h
+//Returns -1 with errno set on failure
+int run_archive_create(struct run_archive_writer* w, const char* dir, int packed);
+
+//Appends the edges of one encoder packet, clock holds the 64-bit clock counts as the PRU reported them
+int run_archive_append_edges(struct run_archive_writer* w, const uint64_t* clock, const uint32_t* edge, size_t n, uint8_t quad);
+
+//Appends one IRIG packet, info may be NULL
+int run_archive_append_irig(struct run_archive_writer* w, uint32_t irig_time, uint64_t rising_edge_clock,
+                            const uint64_t* sync_clock, const uint32_t* info);
+
+//Pushes buffered records out to the kernel
+void run_archive_flush(struct run_archive_writer* w);
+
+//Reserves disk for the given number of edges and IRIG packets on top of what has been written, without changing
+//the file sizes the reader goes by. Best effort, nothing happens on a filesystem without fallocate().
+void run_archive_preallocate(struct run_archive_writer* w, uint64_t edges, uint64_t irig);
+
+//Writes the index entries still waiting for an edge and closes the files, giving back preallocated space
+void run_archive_close_writer(struct run_archive_writer* w);
+
+//Maps a run for reading, plain or packed, returns -1 with errno set on failure
+int run_archive_open(struct run_archive* a, const char* dir);
+
+//Copies the edges of rows [begin, end) to whichever of edge_index, edge_clock and edge_quad are not NULL,
+//decoding the blocks of a packed run. Returns -1 with errno set if the range is past the end of the run (EINVAL)
+//or a block is damaged (EIO).
+int run_archive_read_edges(const struct run_archive* a, size_t begin, size_t end, uint32_t* edge_index,
+                           uint64_t* edge_clock, uint8_t* edge_quad);
+
+void run_archive_close(struct run_archive* a);
+
+//Finds the index entry of an IRIG second (seconds since midnight), NULL if the run has none
+const struct archive_index_entry* run_archive_find_second(const struct run_archive* a, uint32_t irig_time);
+
+//Rows [begin, end) of the edges from the start of IRIG second first up to the start of the second after last
+//Returns -1 if first is not in the run, a last past the end of the run extends the range to the last edge
+int run_archive_seconds(const struct run_archive* a, uint32_t first, uint32_t last, size_t* begin, size_t* end);
+
+#endif
@@ -0,0 +1,75 @@
+# Reads the binary run archives written by encoder_receiver -f bin and csv2archive (see run_archive.h)
+# Packed runs (encoder_receiver -f packed, csv2archive -z) are read with run_archive_read_edges() in C
+# The columns are memory mapped, so opening a run costs nothing and slicing a time range only touches the
+# pages holding it
+#
+# Example:
+#     run = RunArchive('/home/polarbear/data/run1/rawData/Encoder_Archive_run1')
+#     begin, end = run.seconds(3600, 3660)
+#     clock, edge = run.edge_clock[begin:end], run.edge_index[begin:end]
+import os
+import numpy
+
+HEADER_SIZE = 64
+MAGIC = b'PB2ARCH\0'
+VERSION = 1
+SECONDS_PER_DAY = 24 * 3600
+
+IRIG_DTYPE = numpy.dtype([('rising_edge_clock', '<u8'), ('sync_clock', '<u8', (10,)), ('irig_time', '<u4'),
+                          ('info', '<u4', (10,)), ('reserved', '<u4')])
+INDEX_DTYPE = numpy.dtype([('clock', '<u8'), ('edge_row', '<u8'), ('irig_time', '<u4'), ('irig_row', '<u4')])
+ANGLE_DTYPE = numpy.dtype([('time', '<f8'), ('angle', '<f8')])
+
+
+def _map_column(path, dtype):
+    dtype = numpy.dtype(dtype)
+    with open(path, 'rb') as f:
+        header = f.read(HEADER_SIZE)
+    if len(header) < HEADER_SIZE or header[0:8] != MAGIC:
+        raise ValueError('%s is not a run archive column' % path)
+    version, record_size = numpy.frombuffer(header[8:16], dtype='<u4')
+    if version != VERSION or record_size != dtype.itemsize:
+        raise ValueError('%s has version %d and %d byte records' % (path, version, record_size))
+    # A record only partly written when the run was cut short is left out
+    n = (os.path.getsize(path) - HEADER_SIZE) // dtype.itemsize
+    if n == 0:
+        return numpy.zeros(0, dtype=dtype)
+    return numpy.memmap(path, dtype=dtype, mode='r', offset=HEADER_SIZE, shape=(n,))
+
+
+class RunArchive(object):
+    def __init__(self, path):
+        if os.path.exists(os.path.join(path, 'edges.pack')):
+            raise ValueError('%s is a packed run, its edges are not plain columns' % path)
+        self.edge_index = _map_column(os.path.join(path, 'edge_index.col'), '<u4')
+        self.edge_clock = _map_column(os.path.join(path, 'edge_clock.col'), '<u8')
+        self.edge_quad = _map_column(os.path.join(path, 'edge_quad.col'), 'u1')
+        self.irig = _map_column(os.path.join(path, 'irig.tab'), IRIG_DTYPE)
+        self.index = _map_column(os.path.join(path, 'irig_index.tab'), INDEX_DTYPE)
+        n = min(len(self.edge_index), len(self.edge_clock), len(self.edge_quad))
+        self.edge_index = self.edge_index[:n]
+        self.edge_clock = self.edge_clock[:n]
+        self.edge_quad = self.edge_quad[:n]
+
+    # Rows [begin, end) of the edges from the start of IRIG second first up to the start of the second after
+    # last, in UTC seconds since midnight like the IRIG_Data CSV files
+    def seconds(self, first, last):
+        times = self.index['irig_time'].astype(numpy.int64)
+        rel = (times - first) % SECONDS_PER_DAY
+        start = numpy.nonzero(times == first)[0]
+        if len(start) == 0:
+            raise KeyError('IRIG second %d is not in the run' % first)
+        k = start[0]
+        span = (last - first) % SECONDS_PER_DAY
+        stop = k
+        while stop < len(times) and rel[stop] <= span:
+            stop += 1
+        begin = int(self.index['edge_row'][k])
+        end = int(self.index['edge_row'][stop]) if stop < len(times) else len(self.edge_clock)
+        return begin, min(end, len(self.edge_clock))
+
+
+# The Angle_Data_<run>.tab written by encoder_reprocess (see reprocess.h), memory mapped: time in UTC seconds since
+# the midnight before the run and angle in rad, one record per edge
+def angle_data(path):
+    return _map_column(path, ANGLE_DTYPE)
@@ -0,0 +1,199 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm_ring.h"
+
+static size_t ring_size(void)
+{
+    return sizeof(struct shm_ring_header) + (size_t) SHM_RING_SLOTS * sizeof(struct shm_record);
+}
+
+int shm_ring_create(struct shm_ring* ring, const char* path)
+{
+    size_t tmp_size = strlen(path) + 32;
+    char* tmp = malloc(tmp_size);
+    int err;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->path = strdup(path);
+    if (tmp == NULL || ring->path == NULL) {
+        free(tmp);
+        free(ring->path);
+        ring->path = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+    snprintf(tmp, tmp_size, "%s.%d.tmp", path, (int) getpid());
+
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        goto fail;
+    }
+    ring->map_size = ring_size();
+    if (ftruncate(fd, ring->map_size) < 0) {
+        goto fail_file;
+    }
+    //faulted in now, so publishing never waits for the kernel to find a page
+    void* map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (map == MAP_FAILED) {
+        goto fail_file;
+    }
+    close(fd);
+    ring->header = map;
+    ring->records = (struct shm_record*) (ring->header + 1);
+
+    ring->header->version = SHM_RING_VERSION;
+    ring->header->record_size = sizeof(struct shm_record);
+    ring->header->slots = SHM_RING_SLOTS;
+    ring->header->writer_pid = getpid();
+    __sync_synchronize(); //the rest of the header is visible before the magic
+    memcpy(ring->header->magic, SHM_RING_MAGIC, sizeof(ring->header->magic));
+    if (rename(tmp, path) < 0) {
+        err = errno;
+        munmap(map, ring->map_size);
+        unlink(tmp);
+        errno = err;
+        goto fail;
+    }
+    free(tmp);
+    return 0;
+
+fail_file:
+    err = errno;
+    close(fd);
+    unlink(tmp);
+    errno = err;
+fail:
+    err = errno;
+    free(tmp);
+    free(ring->path);
+    memset(ring, 0, sizeof(*ring));
+    errno = err;
+    return -1;
+}
+
+void shm_ring_publish(struct shm_ring* ring, struct shm_record* record)
+{
+    uint64_t n = ring->header->head;
+    struct shm_record* slot = &ring->records[n % SHM_RING_SLOTS];
+
+    slot->seq = SHM_RING_WRITING;
+    __sync_synchronize(); //readers see the slot taken before any of it changes
+    memcpy((uint8_t*) slot + sizeof(slot->seq), (const uint8_t*) record + sizeof(record->seq),
+           sizeof(*record) - sizeof(record->seq));
+    __sync_synchronize(); //the record is complete before it gets its number
+    slot->seq = n;
+    __sync_synchronize(); //and before head covers it
+    ring->header->head = n + 1;
+    record->seq = n;
+}
+
+void shm_ring_close(struct shm_ring* ring)
+{
+    if (ring->header != NULL) {
+        __sync_synchronize();
+        ring->header->closed = 1;
+        munmap(ring->header, ring->map_size);
+    }
+    free(ring->path);
+    memset(ring, 0, sizeof(*ring));
+}
+
+int shm_ring_attach(struct shm_ring_reader* r, const char* path, int from_oldest)
+{
+    struct stat st;
+    int err;
+
+    memset(r, 0, sizeof(*r));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) < 0) {
+        err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    if ((size_t) st.st_size != ring_size()) {
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    err = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        errno = err;
+        return -1;
+    }
+    r->ring.header = map;
+    r->ring.records = (struct shm_record*) (r->ring.header + 1);
+    r->ring.map_size = st.st_size;
+
+    const struct shm_ring_header* h = r->ring.header;
+    if (memcmp(h->magic, SHM_RING_MAGIC, sizeof(h->magic)) != 0 || h->version != SHM_RING_VERSION ||
+        h->record_size != sizeof(struct shm_record) || h->slots != SHM_RING_SLOTS) {
+        shm_ring_detach(r);
+        errno = EPROTO;
+        return -1;
+    }
+    uint64_t head = h->head;
+    r->next = !from_oldest ? head : head > SHM_RING_SLOTS ? head - SHM_RING_SLOTS : 0;
+    return 0;
+}
+
+int shm_ring_read(struct shm_ring_reader* r, struct shm_record* out)
+{
+    for (;;) {
+        uint64_t head = r->ring.header->head;
+        if (r->next == head) {
+            return 0;
+        }
+        __sync_synchronize(); //the slot is read only after head
+        if (head - r->next > SHM_RING_SLOTS) {
+            r->lost += head - SHM_RING_SLOTS - r->next;
+            r->next = head - SHM_RING_SLOTS;
+        }
+
+        const struct shm_record* slot = &r->ring.records[r->next % SHM_RING_SLOTS];
+        uint64_t before = slot->seq;
+        __sync_synchronize();
+        memcpy(out, (const void*) slot, sizeof(*out));
+        __sync_synchronize(); //the copy is done before the number is checked again
+        uint64_t after = slot->seq;
+        if (before == r->next && after == r->next) {
+            out->seq = r->next;
+            r->next += 1;
+            r->records += 1;
+            return 1;
+        }
+        //the writer came round to this slot while it was being read
+        r->lost += 1;
+        r->next += 1;
+    }
+}
+
+int shm_ring_finished(const struct shm_ring_reader* r)
+{
+    const struct shm_ring_header* h = r->ring.header;
+    if (!h->closed) {
+        return 0;
+    }
+    __sync_synchronize(); //head is read after closed, so it holds the last record
+    return r->next == h->head;
+}
+
+void shm_ring_detach(struct shm_ring_reader* r)
+{
+    if (r->ring.header != NULL) {
+        munmap(r->ring.header, r->ring.map_size);
+    }
+    memset(r, 0, sizeof(*r));
+}
@@ -0,0 +1,104 @@
+//Memory mapped ring the receiver publishes its decoded encoder and IRIG records into, so any number of other
+//processes (archiver, live monitor, HWP controller) can follow the stream without binding the UDP port
+//
+//The ring is a file, normally in /dev/shm: a struct shm_ring_header followed by SHM_RING_SLOTS slots of one
+//struct shm_record each. There is one writer and any number of readers, and the writer never looks at the
+//readers, so publishing a record costs the same however many there are and a reader that stops or dies holds
+//nobody up. Readers map the file read-only.
+//
+//Records are numbered from 0 and record n goes in slot n % SHM_RING_SLOTS. head is the number of records
+//published. Every slot carries the number of the record in it, set to SHM_RING_WRITING while the writer fills
+//it and to the record number once it is done, a seqlock per slot: a reader copies the slot and checks the number
+//before and after, so a record the writer overwrote while it was being read is never taken for a good one. A
+//reader that falls more than SHM_RING_SLOTS records behind has lost the oldest ones; it counts them and carries
+//on from the oldest record still in the ring.
+//
+//The writer builds a new ring under a temporary name and renames it over the path, so a reader that attaches
+//always finds a complete header, and readers of a previous run keep the old ring, marked closed, until they
+//attach again.
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pru_layout.h"
+#include "run_archive.h"
+
+#define SHM_RING_MAGIC "PB2RING"
+#define SHM_RING_VERSION 2 //1 had no channel, every record was of channel 0
+#define SHM_RING_SLOTS 8192 //about 4 minutes of packets at 2 Hz, a power of 2
+#define SHM_RING_WRITING UINT64_MAX //slot number while the writer fills the slot
+
+#define SHM_RECORD_ENCODER 1
+#define SHM_RECORD_IRIG 2
+
+//The edges of one encoder packet, as the Encoder_Data file or an archive holds them
+struct shm_encoder {
+    uint32_t n_edges;
+    uint32_t quad; //quadrature pins and ARCHIVE_QUAD_ENTRY, as edge_quad in run_archive.h
+    uint32_t edge_index[ENCODER_COUNTER_SIZE]; //absolute edge number, or QUAD_WORD for quadrature transitions
+    uint64_t edge_clock[ENCODER_COUNTER_SIZE]; //counter_ovflow << 32 | clock_cnt
+};
+
+struct shm_record {
+    volatile uint64_t seq; //record number, SHM_RING_WRITING while it is written
+    uint32_t type; //SHM_RECORD_ENCODER or SHM_RECORD_IRIG
+    uint32_t channel; //encoder channel of an encoder record (pru_layout.h), 0 for IRIG records
+    union {
+        struct shm_encoder encoder;
+        struct archive_irig irig; //info holds the raw IRIG words
+    };
+};
+
+struct shm_ring_header {
+    char magic[8]; //SHM_RING_MAGIC, written last
+    uint32_t version; //SHM_RING_VERSION
+    uint32_t record_size; //sizeof(struct shm_record)
+    uint32_t slots; //SHM_RING_SLOTS
+    uint32_t writer_pid;
+    volatile uint32_t closed; //set once the writer is done with the ring
+    uint8_t pad0[36]; //head on a cache line of its own
+    volatile uint64_t head; //records published, written only by the writer
+    uint8_t pad1[56];
+};
+
+struct shm_ring {
+    struct shm_ring_header* header;
+    struct shm_record* records;
+    size_t map_size;
+    char* path; //writer only, NULL for a reader
+};
+
+//A reader's place in the ring and what it has seen, records numbers are 64-bit so they never wrap
+struct shm_ring_reader {
+    struct shm_ring ring;
+    uint64_t next; //next record to read
+    unsigned long int records; //records read
+    unsigned long int lost; //records overwritten before they were read
+};
+
+//Creates the ring at path, replacing any ring there, returns -1 with errno set on failure
+int shm_ring_create(struct shm_ring* ring, const char* path);
+
+//Publishes a record: fills in its number and copies it into its slot
+void shm_ring_publish(struct shm_ring* ring, struct shm_record* record);
+
+//Marks the ring closed and unmaps it, the file stays for readers still attached
+void shm_ring_close(struct shm_ring* ring);
+
+//Attaches to the ring at path, from the oldest record it holds if from_oldest is set, otherwise from the next
+//record published. Returns -1 with errno set on failure, EPROTO if the file is not a ring of this version.
+int shm_ring_attach(struct shm_ring_reader* r, const char* path, int from_oldest);
+
+//Copies the next record to out, returns 1 if there was one and 0 if the reader has caught up with the writer
+//Records lost in between are added to r->lost.
+int shm_ring_read(struct shm_ring_reader* r, struct shm_record* out);
+
+//1 once the writer has closed the ring and every record has been read
+int shm_ring_finished(const struct shm_ring_reader* r);
+
+void shm_ring_detach(struct shm_ring_reader* r);
+
+#endif
@@ -0,0 +1,88 @@
+# Follows the ring encoder_receiver -s publishes its decoded encoder and IRIG packets into (see shm_ring.h)
+# Any number of processes can read the same ring at once, each at its own pace; a reader that falls more than
+# a ring's worth of records behind loses the oldest ones and counts them in lost. Encoder records carry their
+# encoder channel, 0 unless the Beaglebone was started with several (-c)
+#
+# Example:
+#     ring = ShmRing('/dev/shm/pb2_encoder')
+#     while not ring.finished():
+#         record = ring.read()
+#         if record is None:
+#             time.sleep(0.01)
+#         elif record[0] == 'encoder':
+#             kind, seq, channel, quad, edge_index, edge_clock = record
+#         else:
+#             kind, seq, irig_time, rising_edge_clock, sync_clock, info = record
+import mmap
+import os
+import struct
+
+MAGIC = b'PB2RING\0'
+VERSION = 2
+HEADER_SIZE = 128
+HEAD_OFFSET = 64
+CLOSED_OFFSET = 24
+WRITING = 0xFFFFFFFFFFFFFFFF
+RECORD_ENCODER = 1
+RECORD_IRIG = 2
+EDGES = 150
+
+
+class ShmRing(object):
+    # Starts at the next record published, or at the oldest one the ring holds with from_oldest
+    def __init__(self, path, from_oldest=False):
+        f = open(path, 'rb')
+        try:
+            self.map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        finally:
+            f.close()
+        magic = self.map[0:8]
+        version, self.record_size, self.slots = struct.unpack_from('<III', self.map, 8)
+        if magic != MAGIC or version != VERSION or len(self.map) != HEADER_SIZE + self.slots * self.record_size:
+            raise ValueError('%s is not a ring of version %d' % (path, VERSION))
+        head = self._head()
+        self.next = max(head - self.slots, 0) if from_oldest else head
+        self.records = 0
+        self.lost = 0
+
+    def _head(self):
+        return struct.unpack_from('<Q', self.map, HEAD_OFFSET)[0]
+
+    # The next record as a tuple, see the example above, or None once the reader has caught up with the writer
+    def read(self):
+        while True:
+            head = self._head()
+            if self.next == head:
+                return None
+            if head - self.next > self.slots:
+                self.lost += head - self.slots - self.next
+                self.next = head - self.slots
+            offset = HEADER_SIZE + (self.next % self.slots) * self.record_size
+            before = struct.unpack_from('<Q', self.map, offset)[0]
+            data = self.map[offset : offset + self.record_size]
+            after = struct.unpack_from('<Q', self.map, offset)[0]
+            seq = self.next
+            self.next += 1
+            # The writer came round to this slot while it was being read
+            if before != seq or after != seq:
+                self.lost += 1
+                continue
+            self.records += 1
+            kind, channel = struct.unpack_from('<II', data, 8)
+            if kind == RECORD_ENCODER:
+                n, quad = struct.unpack_from('<II', data, 16)
+                edge_index = struct.unpack_from('<%dI' % n, data, 24)
+                edge_clock = struct.unpack_from('<%dQ' % n, data, 24 + 4 * EDGES)
+                return ('encoder', seq, channel, quad, edge_index, edge_clock)
+            rising_edge_clock = struct.unpack_from('<Q', data, 16)[0]
+            sync_clock = struct.unpack_from('<10Q', data, 24)
+            irig_time = struct.unpack_from('<I', data, 104)[0]
+            info = struct.unpack_from('<10I', data, 108)
+            return ('irig', seq, irig_time, rising_edge_clock, sync_clock, info)
+
+    # True once the writer has closed the ring and every record has been read
+    def finished(self):
+        return struct.unpack_from('<I', self.map, CLOSED_OFFSET)[0] != 0 and self.next == self._head()
+
+    def close(self):
+        self.map.close()
@@ -0,0 +1,54 @@
+//Lock-free single-producer/single-consumer queue of buffer indices, used to pass receive blocks between
+//the receive thread and the writer thread of encoder_receiver
+//Works like the PRU packet rings in ../Beaglebone/pru_layout.h: head and tail are free running counts, the
+//producer only writes head and the consumer only writes tail, so neither side ever takes a lock
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdint.h>
+
+#define SPSC_QUEUE_SIZE 64 //must be a power of 2
+
+struct spsc_queue {
+    volatile uint32_t head; //items pushed, written only by the producer
+    uint8_t pad0[60]; //keeps head and tail on separate cache lines
+    volatile uint32_t tail; //items popped, written only by the consumer
+    uint8_t pad1[60];
+    uint32_t items[SPSC_QUEUE_SIZE];
+};
+
+static inline void spsc_queue_init(struct spsc_queue* q)
+{
+    q->head = 0;
+    q->tail = 0;
+}
+
+//Returns 0 if the queue is full
+static inline int spsc_queue_push(struct spsc_queue* q, uint32_t item)
+{
+    uint32_t head = q->head;
+    if (head - q->tail >= SPSC_QUEUE_SIZE) {
+        return 0;
+    }
+    q->items[head & (SPSC_QUEUE_SIZE - 1)] = item;
+    __sync_synchronize(); //item is visible before head moves
+    q->head = head + 1;
+    return 1;
+}
+
+//Returns 0 if the queue is empty
+static inline int spsc_queue_pop(struct spsc_queue* q, uint32_t* item)
+{
+    uint32_t tail = q->tail;
+    if (q->head == tail) {
+        return 0;
+    }
+    __sync_synchronize(); //item is read only after head
+    *item = q->items[tail & (SPSC_QUEUE_SIZE - 1)];
+    __sync_synchronize(); //item is read before the slot may be reused
+    q->tail = tail + 1;
+    return 1;
+}
+
+#endif
@@ -20,6 +20,54 @@ COUNTER_INFO_LENGTH = 150
 COUNTER_PACKET_SIZE = 4 + 4 * COUNTER_INFO_LENGTH+8 * COUNTER_INFO_LENGTH + 12
 # The size of the IRIG packet from the Arduino
 IRIG_PACKET_SIZE = 132
+# The size of the error packet (header + error code)
+ERROR_PACKET_SIZE = 8
+# The size of the fixed part of a v2 (delta encoded) encoder packet, see Beaglebone/packet_v2.h
+COUNTER_V2_HEADER_SIZE = 28
+# Flag of a v2 packet holding quadrature transitions instead of encoder edges, see Beaglebone/packet_v2.h
+COUNTER_V2_FLAG_QUAD = 0x01
+# The encoder channel of a v2 packet is in the upper bits of its flags
+COUNTER_V2_CHANNEL_SHIFT = 4
+# Encoder channels the Beaglebone can read at once, see PRU_MAX_CHANNELS in Beaglebone/pru_layout.h
+PRU_MAX_CHANNELS = 4
+# The words of a layout packet after its header and size, in the order of struct LayoutPacket: the wire format,
+# the config block the PRUs were started with and where it put the rings in shared memory
+LAYOUT_COLUMNS = (['wire_version', 'reserved', 'magic', 'version', 'packet_edges', 'n_channels', 'quadrature'] +
+                  ['pin_mask_%d' % k for k in range(PRU_MAX_CHANNELS)] +
+                  ['quad_mask_%d' % k for k in range(PRU_MAX_CHANNELS)] +
+                  ['layout_packet_edges', 'layout_n_channels', 'slot_size', 'slots', 'irig_ring_offset', 'irig_slots'] +
+                  ['ring_ctrl_offset_%d' % k for k in range(PRU_MAX_CHANNELS)] +
+                  ['ring_offset_%d' % k for k in range(PRU_MAX_CHANNELS)])
+# The size of the layout packet (header + size + the words above)
+LAYOUT_PACKET_SIZE = 8 + 4 * len(LAYOUT_COLUMNS)
+# Next state of the two quadrature channels turning forward and backward
+QUAD_FORWARD = [1, 3, 0, 2]
+QUAD_BACKWARD = [2, 0, 3, 1]
+# Telemetry histograms have this many bins, see struct pru_telemetry in Beaglebone/pru_layout.h
+TELEMETRY_HIST_BINS = 16
+# The words of a stats packet after its header and size, in the order of struct StatsPacket
+STATS_COLUMNS = (['seq', 'uptime_ms', 'encoder_overruns', 'irig_overruns', 'encoder_edges', 'encoder_packets',
+                  'encoder_max_gap', 'irig_frames', 'irig_desyncs', 'irig_bad_pulses', 'irig_max_gap', 'pru_reserved',
+                  'arm_encoder_sent', 'arm_irig_sent', 'arm_error_sent', 'arm_encoder_lost', 'arm_irig_lost',
+                  'arm_datagrams', 'arm_send_errors', 'arm_wakeups', 'arm_notice_max_us', 'arm_send_max_us'] +
+                 ['notice_hist_%d' % k for k in range(TELEMETRY_HIST_BINS)] +
+                 ['send_hist_%d' % k for k in range(TELEMETRY_HIST_BINS)] +
+                 ['arm_nacks', 'arm_retransmitted', 'arm_replay_expired'])
+# The size of the stats packet (header + size + the words above)
+STATS_PACKET_SIZE = 8 + 4 * len(STATS_COLUMNS)
+# The digits of an IRIG-B frame as (field, digit weight, first frame bit, bits), least significant bit first.
+# Bit 10*k+j of the frame is bit j of info[k], see Host/irig_frame.h
+IRIG_DIGITS = [('seconds', 1, 1, 4), ('seconds', 10, 6, 3), ('minutes', 1, 10, 4), ('minutes', 10, 15, 3),
+               ('hours', 1, 20, 4), ('hours', 10, 25, 2), ('day_of_year', 1, 30, 4), ('day_of_year', 10, 35, 4),
+               ('day_of_year', 100, 40, 2), ('year', 1, 50, 4), ('year', 10, 55, 4),
+               ('control', 1, 60, 9), ('control', 1 << 9, 70, 9), ('sbs', 1, 80, 9), ('sbs', 1 << 9, 90, 8)]
+# Fields sent as BCD, each of their digits must be 9 or less
+IRIG_BCD_FIELDS = ('seconds', 'minutes', 'hours', 'day_of_year', 'year')
+# What decode_irig() found wrong, as the IRIG_FRAME_BAD_* bits in Host/irig_frame.h
+IRIG_BAD_DIGIT = 0x01
+IRIG_BAD_TIME = 0x02
+IRIG_BAD_DAY = 0x04
+IRIG_BAD_SBS = 0x08
 
 #overflow = []
 # Class which will parse the incoming packets from the Arduino and store the data in CSV files
@@ -27,8 +75,9 @@ class EncoderParser(object):
     # port: This must be the same as the localPort in the Arduino code
     # date, run: Used for naming the CSV file (will be changed later on in the code by a user input)
     # read_chunk_size: This value shouldn't need to change
+    # chunk_s: IRIG seconds per Encoder/IRIG file, 0 writes one of each for the whole run
     
-    def __init__(self, saveDir, date = "test", run = "test", beaglebone_port = 8080, read_chunk_size = 8196):
+    def __init__(self, saveDir, date = "test", run = "test", beaglebone_port = 8080, read_chunk_size = 65536, chunk_s = 0):
         #Directory to save files
         self.saveDir = saveDir
         
@@ -43,6 +92,13 @@ class EncoderParser(object):
         self.start_time = [0,0,0]
         # Will be continually updated with the UTC time in seconds
         self.current_time = 0
+        # Seconds since the first good IRIG frame, counting across midnight, -1 before it
+        self.run_time = -1
+        self.start_seconds = 0
+        self.day_offset = 0
+        self.last_time_of_day = -1
+        # Date of the first frame that carries one, less the days counted before it
+        self.day_origin = None
 
         # Creates a UDP socket to connect to the Arduino
         self.s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
@@ -52,25 +108,43 @@ class EncoderParser(object):
         self.s.setblocking(0)
 
         # String which will hold the raw data from the Arduino before it is parsed
-        self.data = ''
+        self.data = b''
         self.read_chunk_size = read_chunk_size
 
         # Keeps track of how many packets have been parsed
         self.counter = 0
 
+        # Next replay sequence number expected when the Beaglebone runs with -r, see Beaglebone/replay_buffer.h
+        self.replay_seq = None
+
+        # Packet size and encoder channels from the latest layout packet, None until one comes
+        self.layout = None
+        # Encoder packets of a channel, size or mode that the layout does not have, written all the same
+        self.layout_mismatches = 0
+
         # Date and run number used to name the CSV file
         self.date = date
         self.run = run
 
-        # Creates two CSV files to hold the Encoder and IRIG data
-        self.fname1 = self.saveDir+"/Encoder_Data_"+self.run+".csv"
-        self.fname2 = self.saveDir+"/IRIG_Data_"+self.run+".csv"
-        self.file1 = open(self.fname1, "w")
-        self.file2 = open(self.fname2, "w")
-        self.file1.close()
-        self.file2.close()
-
-        # Opens the files again and writes the headers
+        # Creates two CSV files to hold the Encoder and IRIG data, rolled over every chunk_s seconds
+        # into Encoder_Data_<run>_0000.csv, Encoder_Data_<run>_0001.csv, ... as encoder_receiver -c does
+        self.chunk_s = chunk_s
+        self.chunk = 0
+        self.chunk_start = 0
+        self.start_chunk(0)
+        self.fname3 = self.saveDir+"/Stats_"+self.run+".csv"
+
+        # The stats file has one row per stats packet under a row of column names
+        with open(self.fname3, "w") as Stats_Data_CSV:
+            csv.writer(Stats_Data_CSV).writerow(STATS_COLUMNS)
+
+    # Creates the Encoder and IRIG files of a chunk with their headers
+    def start_chunk(self, chunk):
+        self.suffix = "_%04d" % chunk if self.chunk_s > 0 else ""
+        # Encoder files of the channels after the first in this chunk, created at their first packet in it
+        self.channel_fnames = {}
+        self.fname1 = self.saveDir+"/Encoder_Data_"+self.run+self.suffix+".csv"
+        self.fname2 = self.saveDir+"/IRIG_Data_"+self.run+self.suffix+".csv"
         with open(self.fname1, "w") as self.Encoder_Data_CSV, open(self.fname2, "w") as self.IRIG_Data_CSV:
             self.Encoder_CSV = csv.writer(self.Encoder_Data_CSV)
             # Header for the Encoder file
@@ -79,50 +153,51 @@ class EncoderParser(object):
             self.IRIG_CSV = csv.writer(self.IRIG_Data_CSV)
             # Header for the IRIG file
             self.IRIG_CSV.writerows([['1: IRIG_time/clk_cnt','3-13: synch_pulse/clk_cnt'],[]])
+        self.chunk = chunk
 
-    # Converts the IRIG signal into sec/min/hours depending on the parameters
-    def de_irig(self, val, base_shift=0):
-        return (((val >> (0+base_shift)) & 1) + 
-                ((val >> (1+base_shift)) & 1) * 2 + 
-                ((val >> (2+base_shift)) & 1) * 4 + 
-                ((val >> (3+base_shift)) & 1) * 8 + 
-                ((val >> (5+base_shift)) & 1) * 10 + 
-                ((val >> (6+base_shift)) & 1) * 20 + 
-                ((val >> (7+base_shift)) & 1) * 40 )
-
-    # Takes the IRIG information, prints it to the screen, sets the current time,
+    # Takes the IRIG information, prints it to the screen, sets the current time and the run time,
     # and returns the current time
     def pretty_print_irig_info(self, v, edge):
-        # Calls self.de_irig() to get the sec/min/hour of the IRIG packet
-        secs = self.de_irig(v[0], 1)
-        mins = self.de_irig(v[1], 0)
-        hours = self.de_irig(v[2], 0)
+        # Decodes the whole frame, a frame that does not decode is reported and left out of the run time
+        frame = decode_irig(v)
+        secs = frame['seconds']
+        mins = frame['minutes']
+        hours = frame['hours']
+        if frame['bad']:
+            print ("Bad IRIG frame (0x%x) at clock count %d" % (frame['bad'], edge))
+            return secs + mins*60 + hours*3600
+
+        # Counts the days from the date when the frame has one, otherwise from the time of day going backwards,
+        # so runs longer than a day keep counting
+        time_of_day = secs + mins*60 + hours*3600
+        if frame['day_of_year']:
+            day = (datetime.date(2000 + frame['year'], 1, 1).toordinal() + frame['day_of_year'] - 1)*24*3600
+            if self.day_origin is None:
+                self.day_origin = day - self.day_offset
+            self.day_offset = day - self.day_origin
+        elif self.last_time_of_day >= 0 and time_of_day < self.last_time_of_day:
+            self.day_offset += 24*3600
+        self.last_time_of_day = time_of_day
 
         # If it is the first time that the function is called then set self.start_time
         # to the current time
         if self.is_start == 1:
             self.start_time = [hours, mins, secs]
+            self.start_seconds = self.day_offset + time_of_day
             self.is_start = 0
 
-        # Find the sec/min/hour digit difference from the start time
-        dsecs = secs - self.start_time[2]
-        dmins = mins - self.start_time[1]
-        dhours = hours - self.start_time[0]
-
-        # Corrections to make sure that dsecs/dmins/dhours are all positive
-        if dhours < 0:
-            dhours = dhours + 24
-
-        if (dmins < 0)or((dmins == 0)and(dsecs < 0)):
-            dmins = dmins + 60
-            dhours = dhours - 1
-
-        if dsecs < 0:
-            dsecs = dsecs + 60
-            dmins = dmins - 1
+        # Run time since the start time
+        self.run_time = self.day_offset + time_of_day - self.start_seconds
+        dhours = self.run_time // 3600
+        dmins = self.run_time // 60 % 60
+        dsecs = self.run_time % 60
         
-        # Print UTC time, run time, and current clock count of the Arduino
-        print ("Current Time:",("%d:%d:%d"%(hours, mins, secs)),"Run Time",("%d:%d:%d"%(dhours, dmins, dsecs)), "Clock Count",edge)
+        # Print UTC time, run time, and current clock count of the Arduino, and the date when the frame has one
+        if frame['day_of_year']:
+            print ("Current Time:",("%d:%d:%d"%(hours, mins, secs)),"Run Time",("%d:%d:%d"%(dhours, dmins, dsecs)), "Clock Count",edge,
+                   "Day",("%d of 20%02d"%(frame['day_of_year'], frame['year'])))
+        else:
+            print ("Current Time:",("%d:%d:%d"%(hours, mins, secs)),"Run Time",("%d:%d:%d"%(dhours, dmins, dsecs)), "Clock Count",edge)
 
         # Set the current time in seconds
         self.current_time = secs + mins*60 + hours*3600
@@ -141,6 +216,9 @@ class EncoderParser(object):
 
     # Grabs self.data, determine what packet it corresponds to, parses the data, and
     # records it to CSV file
+    # The Beaglebone may coalesce several packets into one datagram. Every packet starts
+    # with its header; the three types below have fixed sizes and any newer type carries
+    # its total size in the int after its header, so a datagram is split packet by packet
     def grab_and_parse_data(self):
         while True:
             # If there is data from the socket attached to the Arduino then ready[0] = true
@@ -149,7 +227,7 @@ class EncoderParser(object):
             if ready[0]:
                 # Add the data from the socket attached to the Arduino to the string self.data
                 self.data += self.s.recv(self.read_chunk_size)
-                while True:
+                while len(self.data) > 0:
                     # Check to make sure that there is at least 1 int in the packet
                     # The first int in every packet should be the header
                     if not self.check_data_length(0, 4):
@@ -161,8 +239,12 @@ class EncoderParser(object):
                     header = struct.unpack('<I', header)[0]
 
                     # 0x1EAF = Encoder Packet
+                    # 0x2EAF = Delta Encoded Encoder Packet (v2)
                     # 0xCAFE = IRIG Packet
                     # 0xE12A = Error Packet
+                    # 0x57A7 = Stats Packet
+                    # 0x1A70 = Layout Packet, the packet size and channels the Beaglebone was started with
+                    # 0x5E90 = Replay wrapper, numbers the packet behind it
 
                     # Encoder
                     if header == 0x1EAF:
@@ -174,6 +256,20 @@ class EncoderParser(object):
                         self.parse_counter_info(self.data[4 : COUNTER_PACKET_SIZE])
                         # Increment self.counter to signify that an Encoder Packet has been parsed
                         self.counter += 1
+                        size = COUNTER_PACKET_SIZE
+
+                    # Encoder v2
+                    elif header == 0x2EAF:
+                        # v2 packets vary in length and carry their size after the header
+                        if not self.check_data_length(0, COUNTER_V2_HEADER_SIZE):
+                            print ('Error 3')
+                            break
+                        size = struct.unpack('<I', self.data[4 : 8])[0]
+                        if not self.check_data_length(0, size):
+                            print ('Error 3')
+                            break
+                        self.parse_counter_info_v2(self.data[0 : size])
+                        self.counter += 1
 
                     # IRIG
                     elif header == 0xCAFE:
@@ -183,6 +279,7 @@ class EncoderParser(object):
                             break
                         # Call the meathod self.parse_irig_info() to parse the IRIG Packet
                         self.parse_irig_info(self.data[4 : IRIG_PACKET_SIZE])
+                        size = IRIG_PACKET_SIZE
 
                     # Error
                     # An Error Packet will be sent if there is a timing error in the 
@@ -191,13 +288,69 @@ class EncoderParser(object):
                     # intended and that all the connections are made correctly 
                     elif header == 0xE12A:
                         print ('Packet Error')
+                        size = ERROR_PACKET_SIZE
 
-                    else:
-                        print ('Bad header')
+                    # Stats
+                    # Sent by the Beaglebone every second with the PRU and forwarder counters
+                    elif header == 0x57A7:
+                        if not self.check_data_length(0, 8):
+                            print ('Error 4')
+                            break
+                        # Newer forwarders may append fields, the size word says how far to skip
+                        size = struct.unpack('<I', self.data[4 : 8])[0]
+                        if size < STATS_PACKET_SIZE or not self.check_data_length(0, size):
+                            print ('Error 4')
+                            break
+                        self.parse_stats_info(self.data[8 : STATS_PACKET_SIZE])
+
+                    # Layout
+                    # Sent by the Beaglebone when it starts and ahead of every stats packet
+                    elif header == 0x1A70:
+                        if not self.check_data_length(0, 8):
+                            print ('Error 6')
+                            break
+                        size = struct.unpack('<I', self.data[4 : 8])[0]
+                        if size < LAYOUT_PACKET_SIZE or not self.check_data_length(0, size):
+                            print ('Error 6')
+                            break
+                        self.parse_layout_info(self.data[8 : LAYOUT_PACKET_SIZE])
+
+                    # Replay
+                    # With -r every packet comes behind a header with its sequence number. This script does
+                    # not send NACKs or reorder, so it reports gaps and drops packets older than one already parsed;
+                    # use encoder_receiver to have lost packets sent again
+                    elif header == 0x5E90:
+                        if not self.check_data_length(0, 12):
+                            print ('Error 5')
+                            break
+                        size, seq = struct.unpack('<II', self.data[4 : 12])
+                        if size < 12 or not self.check_data_length(0, size):
+                            print ('Error 5')
+                            break
+                        behind = (self.replay_seq - seq) & 0xFFFFFFFF if self.replay_seq is not None else 0
+                        if 0 < behind < 0x80000000:
+                            # Already parsed, skip the packet behind the header too
+                            pass
+                        else:
+                            if self.replay_seq is not None and seq != self.replay_seq:
+                                print ('Missed %d packets' % ((seq - self.replay_seq) & 0xFFFFFFFF))
+                            self.replay_seq = (seq + 1) & 0xFFFFFFFF
+                            # Parse the packet behind the header next
+                            size = 12
 
-                    # Clear self.data
-                    self.data = ''
-                    break
+                    else:
+                        # Packet types this script does not know about say how long they are
+                        if len(self.data) >= 8:
+                            size = struct.unpack('<I', self.data[4 : 8])[0]
+                        else:
+                            size = 0
+                        if size < 4:
+                            # Nothing left in this datagram can be trusted
+                            print ('Bad header')
+                            size = len(self.data)
+
+                    # Move on to the next packet in the datagram
+                    self.data = self.data[size:]
                 break
             
             # If there is no data from the Arduino 'Looking for data ...' will print
@@ -217,24 +370,122 @@ class EncoderParser(object):
         # or (150, 151, 152, etc ...) or (301, 302, 303, etc ...) etc ...)
         # [450-452] Readout from the quadrature
 
+        self.check_layout(0, COUNTER_INFO_LENGTH, 0)
+        self.record_counter_info(derter[0:150], derter[150:300], derter[300:450], derter[450:453])
+
+    # Meathod to parse the delta encoded (v2) Encoder Packet
+    def parse_counter_info_v2(self, data):
+        # Fixed part: header, size, sequence number, first edge number, clock count and
+        # overflow count of the first edge, number of edges, quadrature bits, flags
+        seq, first_edge, base_clock, base_overflow, n_edges, quad, flags = struct.unpack('<IIIIHBB', data[8:COUNTER_V2_HEADER_SIZE])
+        buf = bytearray(data[COUNTER_V2_HEADER_SIZE:])
+        channel = flags >> COUNTER_V2_CHANNEL_SHIFT
+        self.check_layout(channel, n_edges, flags & COUNTER_V2_FLAG_QUAD)
+
+        # Every later edge is a varint of the zigzag encoded clock difference from the edge
+        # before it. A 0 escapes an edge whose number did not go up by exactly 1, it is
+        # followed by the zigzag encoded edge number difference and then the clock difference
+        def read_varint(pos):
+            value = 0
+            shift = 0
+            while True:
+                b = buf[pos]
+                value |= (b & 0x7f) << shift
+                pos += 1
+                if b < 0x80:
+                    return value, pos
+                shift += 7
+
+        def unzigzag(value):
+            return (value >> 1) ^ -(value & 1)
+
+        clock = numpy.zeros(n_edges, dtype=numpy.int64)
+        count = numpy.zeros(n_edges, dtype=numpy.int64)
+        clk = (base_overflow << 32) + base_clock
+        edge = first_edge
+        clock[0] = clk
+        count[0] = edge
+        pos = 0
+
+        # Quadrature packets hold every transition of both channels. The first one is sent as its
+        # position << 2 | state, every later one as a varint of the zigzag encoded clock difference
+        # shifted up by 2 above a step code: 0 forward, 1 backward, 2 both channels changed and 3
+        # followed by the full position << 2 | state. The signed position goes in the count column
+        if flags & COUNTER_V2_FLAG_QUAD:
+            position = (first_edge ^ 0x80000000) - 0x80000000 >> 2
+            state = first_edge & 3
+            count[0] = position
+            for x in range(1, n_edges):
+                value, pos = read_varint(pos)
+                step = value & 3
+                if step == 0:
+                    position += 1
+                    state = QUAD_FORWARD[state]
+                elif step == 1:
+                    position -= 1
+                    state = QUAD_BACKWARD[state]
+                elif step == 2:
+                    state ^= 3
+                else:
+                    word, pos = read_varint(pos)
+                    position = (word ^ 0x80000000) - 0x80000000 >> 2
+                    state = word & 3
+                clk += unzigzag(value >> 2)
+                clock[x] = clk
+                count[x] = position
+            self.record_counter_info(clock & 0xFFFFFFFF, clock >> 32, count, [quad & 1, (quad >> 1) & 1, (quad >> 2) & 1], channel)
+            return
+
+        for x in range(1, n_edges):
+            value, pos = read_varint(pos)
+            if value == 0:
+                value, pos = read_varint(pos)
+                edge += unzigzag(value)
+                value, pos = read_varint(pos)
+            else:
+                edge += 1
+            clk += unzigzag(value)
+            clock[x] = clk
+            count[x] = edge
+
+        self.record_counter_info(clock & 0xFFFFFFFF, clock >> 32, count & 0xFFFFFFFF, [quad & 1, (quad >> 1) & 1, (quad >> 2) & 1], channel)
+
+    # Queues one packet worth of encoder data and writes it to the Encoder CSV file
+    # clock, ovflow and count are the clock counts, overflow counts and absolute numbers of
+    # the edges and quad is the readout of the 3 quadrature inputs
+    # Channels after the first go to Encoder_Data_<run>_ch<channel>.csv in the same format, as encoder_receiver does,
+    # rolled over with the chunks into Encoder_Data_<run>_<chunk>_ch<channel>.csv
+    def record_counter_info(self, clock, ovflow, count, quad, channel = 0):
+        if channel > 0:
+            if channel not in self.channel_fnames:
+                self.channel_fnames[channel] = self.saveDir+"/Encoder_Data_"+self.run+self.suffix+"_ch%d.csv" % channel
+                with open(self.channel_fnames[channel], "w") as Channel_CSV:
+                    csv.writer(Channel_CSV).writerows([['1: Quad readout','2-152: capt_cnt/clk_cnt'],[]])
+            with open(self.channel_fnames[channel], "a") as Channel_CSV:
+                writer = csv.writer(Channel_CSV)
+                writer.writerows([[quad[0], quad[1], quad[2]], []])
+                writer.writerows(numpy.transpose([count, clock+(ovflow<<32)]))
+                writer.writerows([[]])
+            return
+
         # NOTE: These next two lines are only required if the data is going to be manipulated
         # within this code and not just recorded
     
         # self.counter_queue = [[clock count array],[absolute number array]]
-        self.counter_queue.append(( derter[0:150] + (derter[150:300] << 32), derter[300:450]))
+        self.counter_queue.append(( clock + (ovflow << 32), count))
         # self.quad_queue = [[quad input 2 array],[quad input 3 array],[quad input 4 array]]
-        self.quad_queue.append((derter[450], derter[451], derter[452]))
+        self.quad_queue.append((quad[0], quad[1], quad[2]))
 
         # Write the Encoder Data to a CSV file
         with open(self.fname1, "a") as self.Encoder_Data_CSV:
             # What's writen to the Encoder file:
             # [quad input 2, quad input 3, quad input 4]
             # []
-            # [absolute number, clock count]*150
+            # [absolute number, clock count]*edges per packet (150 by default)
             # []
             self.Encoder_CSV = csv.writer(self.Encoder_Data_CSV)
-            self.Encoder_CSV.writerows([[derter[450], derter[451], derter[452]], []])
-            self.Encoder_CSV.writerows(numpy.transpose([derter[300:450], derter[0:150]+(derter[150:300]<<32)]))
+            self.Encoder_CSV.writerows([[quad[0], quad[1], quad[2]], []])
+            self.Encoder_CSV.writerows(numpy.transpose([count, clock+(ovflow<<32)]))
             self.Encoder_CSV.writerows([[]])
 
     # Meathod to parse the IRIG Packet
@@ -260,6 +511,11 @@ class EncoderParser(object):
 
         # Prints the time information and returns the current time in seconds
         irig_time = self.pretty_print_irig_info(irig_info, rising_edge_time)
+        # The IRIG packet that crosses into the next chunk is the first one written to it
+        if self.chunk_s > 0 and self.run_time - self.chunk_start >= self.chunk_s:
+            self.start_chunk(self.chunk + 1)
+            self.chunk_start = self.run_time - self.run_time % self.chunk_s
+            print ("Chunk %d starts at run time %d s" % (self.chunk, self.run_time))
         # Stores synch pulse clock counts accounting for overflow of 32 bit counter
         synch_pulse_clock_times = (numpy.asarray(unpacked_data[12:22]) + (numpy.asarray(unpacked_data[22:]) << 32)).tolist()
 
@@ -283,6 +539,32 @@ class EncoderParser(object):
             self.IRIG_CSV.writerows(numpy.transpose([range(10), synch_pulse_clock_times]))
             self.IRIG_CSV.writerows([[]])
 
+    # Meathod to parse the Stats Packet
+    def parse_stats_info(self, data):
+        stats = dict(zip(STATS_COLUMNS, struct.unpack('<' + 'I'*len(STATS_COLUMNS), data)))
+        print ('Stats %d: %d encoder packets (%d overruns, %d lost), %d IRIG frames (%d desyncs), %d send errors, '
+               'notice max %d us, send max %d us' % (stats['seq'], stats['encoder_packets'], stats['encoder_overruns'],
+               stats['arm_encoder_lost'], stats['irig_frames'], stats['irig_desyncs'], stats['arm_send_errors'],
+               stats['arm_notice_max_us'], stats['arm_send_max_us']))
+        with open(self.fname3, "a") as Stats_Data_CSV:
+            csv.writer(Stats_Data_CSV).writerow([stats[c] for c in STATS_COLUMNS])
+
+    # Meathod to parse the Layout Packet, printed whenever it changes
+    def parse_layout_info(self, data):
+        layout = dict(zip(LAYOUT_COLUMNS, struct.unpack('<' + 'I'*len(LAYOUT_COLUMNS), data)))
+        if layout != self.layout:
+            print ('Layout: %d encoder channels, %d edges per packet in %s mode, v%d packets, %d ring slots each' %
+                   (layout['n_channels'], layout['packet_edges'], 'quadrature' if layout['quadrature'] else 'edge',
+                    layout['wire_version'], layout['slots']))
+        self.layout = layout
+
+    # Holds an encoder packet against the latest layout packet, once there is one
+    def check_layout(self, channel, n_edges, quad):
+        if self.layout is not None and (channel >= self.layout['layout_n_channels'] or
+                                        n_edges != self.layout['layout_packet_edges'] or
+                                        bool(quad) != bool(self.layout['quadrature'])):
+            self.layout_mismatches += 1
+
     def __del__(self):
         self.s.close()
 
@@ -292,6 +574,28 @@ class EncoderParser(object):
 
 # Returns two arrays; diff = array of the difference between adjacent points in the array
 # clk_cnts, time = corresponding index for values in the diff array (1, 2, 3, etc ...)
+# Decodes a whole IRIG-B frame from the info words of an IRIG packet by walking IRIG_DIGITS
+# Returns a dict of the fields, 0 for the ones the generator does not send, with 'bad' holding the IRIG_BAD_* bits
+def decode_irig(info):
+    frame = dict((field, 0) for field, weight, first, bits in IRIG_DIGITS)
+    bad = 0
+    for field, weight, first, bits in IRIG_DIGITS:
+        digit = 0
+        for n in range(bits):
+            bit = first + n
+            digit |= ((info[bit // 10] >> (bit % 10)) & 1) << n
+        if field in IRIG_BCD_FIELDS and digit > 9:
+            bad |= IRIG_BAD_DIGIT
+        frame[field] += digit * weight
+    if frame['seconds'] > 60 or frame['minutes'] > 59 or frame['hours'] > 23:
+        bad |= IRIG_BAD_TIME
+    if frame['day_of_year'] > 366:
+        bad |= IRIG_BAD_DAY
+    if frame['sbs'] != 0 and frame['sbs'] != frame['seconds'] + frame['minutes']*60 + frame['hours']*3600:
+        bad |= IRIG_BAD_SBS
+    frame['bad'] = bad
+    return frame
+
 def find_difference(clk_cnts):
     diff = []
     for i in range(len(clk_cnts)-1):
@@ -374,11 +678,13 @@ if __name__ == '__main__':
     '''
     #Use command-line arguments to obtain save directory
     args = sys.argv[1:]
-    if not len(args) == 2:
-        sys.exit("Usage: python encoderDAQ.py [Run Name] [Number of seconds to collect data]\n")
+    # A number of seconds of 0 or less records until Ctrl-C, for a Beaglebone_Encoder_DAQ that runs continuously
+    if not len(args) in (2, 3):
+        sys.exit("Usage: python encoderDAQ.py [Run Name] [Number of seconds to collect data] [Seconds per file chunk]\n")
     else:
         runName = str(args[0])
         runtime = int(args[1])
+        chunk_s = int(args[2]) if len(args) == 3 else 0
         mode = 0 #Keep this fixed for now
 
         masterDir = "/home/polarbear/data/"
@@ -410,22 +716,25 @@ if __name__ == '__main__':
     # Creates an instance of the EncoderParser class with the current date and asks the user
     # for the run number
     #ep = EncoderParser(date = str(datetime.date.today()), run = raw_input("Enter the Run Number: "))
-    ep = EncoderParser(saveDir = saveDir, date = str(datetime.date.today()), run = runName)
+    ep = EncoderParser(saveDir = saveDir, date = str(datetime.date.today()), run = runName, chunk_s = chunk_s)
     if True:
             print ('Starting')
             
             if (mode == 0):
-                # Run until current_time == strat_time + runtime
-                start_time = 123456789
-                while (start_time+runtime != ep.current_time) and (start_time+runtime != ep.current_time + 24*3600):
-                    ep.grab_and_parse_data()
-                    start_time = ep.start_time[0]*3600 + ep.start_time[1]*60 + ep.start_time[2]
+                # Run until the run time reaches runtime, or until Ctrl-C if runtime is 0 or less
+                try:
+                    while runtime <= 0 or ep.run_time < runtime:
+                        ep.grab_and_parse_data()
+                except KeyboardInterrupt:
+                    pass
             elif (mode == 1):
                 # Run until the specified number of packets have been collected
                 while data_points > ep.counter:
                     ep.grab_and_parse_data()
 
             print 'Done'
+            if ep.layout is not None:
+                print ('Encoder packets that did not match the layout: %d' % (ep.layout_mismatches))
             
             # Additional graphing
 #            """encoder_clock_cnts, encoder_capture_cnt = zip(*ep.counter_queue)